@@ -0,0 +1,157 @@
+// Times every noise path (3D, 2D, with derivatives and volume) for both noise
+// bases on each instruction set the CPU supports, on one thread. Then writes
+// the same terrain in each basis to <directory>/noise_<basis>.png, with the
+// spread of its heights, so the bases can be compared side by side.
+//
+//   noise_bench [directory] [grid size] [octaves]
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "terrain/heightfield.hpp"
+#include "terrain/heightmap_io.hpp"
+#include "utils/perlin_noise.hpp"
+
+namespace {
+// The defaults of terrain_model
+constexpr unsigned int seed = 0;
+constexpr float lacunarity = 2.0f;
+constexpr float persistence = 0.5f;
+constexpr float spacing = 5.0f;
+constexpr float height = 200.0f;
+
+// Best of this many passes over the grid, the first one warms the caches
+constexpr int passes = 3;
+
+auto make_grid(const int grid_size) -> heightfield {
+  heightfield field;
+  const float total_width = spacing * static_cast<float>(grid_size);
+  field.resize(grid_size, spacing,
+               glm::vec2(-total_width / 2.0f, -total_width / 2.0f));
+  return field;
+}
+}  // namespace
+
+auto main(int argc, char** argv) -> int {
+  const std::string directory = argc > 1 ? argv[1] : "noise_benchmark";
+  const int grid_size = argc > 2 ? std::atoi(argv[2]) : 512;
+  const unsigned int octaves =
+      argc > 3 ? static_cast<unsigned int>(std::atoi(argv[3])) : 5;
+  if (grid_size <= 0 || octaves == 0) {
+    std::fprintf(stderr, "usage: %s [directory] [grid size] [octaves]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  heightfield field = make_grid(grid_size);
+  const int resolution = field.resolution();
+  const double samples = static_cast<double>(field.sample_count());
+
+  // Every path evaluates the grid a row at a time, so the numbers compare
+  // the kernels rather than the thread count
+  std::vector<float> xs(resolution);
+  std::vector<float> zs(resolution);
+  std::vector<float> out(resolution);
+  std::vector<float> dxs(resolution);
+  std::vector<float> dzs(resolution);
+  for (auto j = 0; j < resolution; ++j) zs[j] = field.z(j);
+
+  const auto time_rows = [&](const auto& evaluate) {
+    double best = 0.0;
+    for (auto pass = 0; pass < passes; ++pass) {
+      const auto start = std::chrono::steady_clock::now();
+      for (auto i = 0; i < resolution; ++i) {
+        std::ranges::fill(xs, field.x(i));
+        evaluate();
+      }
+      const double ns = std::chrono::duration<double, std::nano>(
+                            std::chrono::steady_clock::now() - start)
+                            .count();
+      if (pass == 0 || ns < best) best = ns;
+    }
+    return best / samples;
+  };
+
+  const perlin_simd fastest = perlin_kernels::detect();
+
+  std::printf("Noise benchmark, ns per sample over %zu samples with %u "
+              "octaves on one thread\n"
+              "  basis    simd       3D      2D   3D+d/dx   2D+d/dx  volume\n",
+              field.sample_count(), octaves);
+  for (const noise_basis basis : {noise_basis::perlin, noise_basis::simplex}) {
+    const perlin noise(seed, octaves, lacunarity, persistence, 0, basis);
+    for (auto l = 0; l <= static_cast<int>(fastest); ++l) {
+      perlin::set_simd_level(static_cast<perlin_simd>(l));
+      const double noise_3d = time_rows([&] {
+        noise.generate_perlin_batch(xs.data(), zs.data(), out.data(),
+                                    out.size());
+      });
+      const double noise_2d = time_rows([&] {
+        noise.generate_perlin_2d_batch(xs.data(), zs.data(), out.data(),
+                                       out.size());
+      });
+      const double gradient_3d = time_rows([&] {
+        noise.generate_perlin_gradient_batch(xs.data(), zs.data(), out.data(),
+                                             dxs.data(), dzs.data(),
+                                             out.size());
+      });
+      const double gradient_2d = time_rows([&] {
+        noise.generate_perlin_2d_gradient_batch(xs.data(), zs.data(),
+                                                out.data(), dxs.data(),
+                                                dzs.data(), out.size());
+      });
+      // A vertical slice through the volume, y runs along x
+      const double volume = time_rows([&] {
+        noise.generate_perlin_volume_batch(xs.data(), xs.data(), zs.data(),
+                                           out.data(), out.size());
+      });
+
+      std::printf("  %-8s %-7s %7.1f %7.1f %9.1f %9.1f %7.1f\n",
+                  perlin::basis_name(basis),
+                  perlin::simd_name(perlin::simd_level()), noise_3d, noise_2d,
+                  gradient_3d, gradient_2d, volume);
+    }
+  }
+
+  // The same terrain in both bases, with the spread of its heights so the
+  // images can be compared for contrast as well as by eye
+  std::error_code error;
+  std::filesystem::create_directories(directory, error);
+  for (const noise_basis basis : {noise_basis::perlin, noise_basis::simplex}) {
+    const perlin noise(seed, octaves, lacunarity, persistence, 0, basis);
+    double sum = 0.0;
+    double sum_squares = 0.0;
+    for (auto i = 0; i < resolution; ++i) {
+      std::ranges::fill(xs, field.x(i));
+      float* row = field.heights().data() + field.index(i, 0);
+      noise.generate_perlin_batch(xs.data(), zs.data(), row, xs.size());
+      for (auto j = 0; j < resolution; ++j) {
+        sum += row[j];
+        sum_squares += static_cast<double>(row[j]) * row[j];
+        row[j] = (row[j] * height) - (height / 2.0f);
+      }
+    }
+
+    const auto [low, high] = std::ranges::minmax(field.heights());
+    const double mean = sum / samples;
+    const double deviation =
+        std::sqrt(std::max(sum_squares / samples - mean * mean, 0.0));
+    const std::string path =
+        directory + "/noise_" +
+        (basis == noise_basis::simplex ? "simplex" : "perlin") + ".png";
+    if (!export_heightmap(path, field, -height / 2.0f, height / 2.0f)) {
+      return 1;
+    }
+    std::printf("  %s noise in [0, 1]: mean %.3f, std dev %.3f, heights %.1f "
+                "to %.1f, written to %s\n",
+                perlin::basis_name(basis), mean, deviation, low, high,
+                path.c_str());
+  }
+  return 0;
+}
@@ -10,6 +10,7 @@
 #include "mesh/simplified_mesh.hpp"
 #include "mesh/simplified_mesh_debugging.hpp"
 #include "terrain/terrain_model.hpp"
+#include "terrain/terrain_tile_manager.hpp"
 #include "trees/trees.hpp"
 #include "utils/camera.hpp"
 #include "utils/opengl.hpp"
@@ -63,6 +64,22 @@ class application {
   terrain_model m_terrain_;
   mesh_deformation m_mesh_deform_;
   bool m_use_perlin_ = true;
+  // Regenerate the terrain progressively while the noise sliders move
+  bool m_auto_regenerate_ = false;
+  // The picking tree lags behind a progressive regeneration
+  bool m_terrain_aabb_stale_ = false;
+  // .png, .r16/.raw or .r32/.f32, see heightmap_io.hpp
+  char m_heightmap_path_[256] = "heightmap.png";
+
+  // Heightfield, noise parameters and edits, restored on startup. Only saved
+  // on exit when asked to and the terrain has been sculpted
+  char m_snapshot_path_[256] = "terrain.tsnap";
+  bool m_save_on_exit_ = false;
+
+  // Unbounded terrain streamed around the camera, drawn instead of the
+  // editable terrain while enabled
+  terrain_tile_manager m_tiles_;
+  bool m_stream_terrain_ = false;
 
   // Tree Values
   int m_num_trees_ = 35;
@@ -73,9 +90,14 @@ class application {
 
   skybox m_skybox_{};
 
+  // Draws a top face sample of the current heightfield for every tree. Tree
+  // positions are flat sample indices, so this runs again whenever a
+  // snapshot replaces the grid
+  auto place_trees() -> void;
+
  public:
   explicit application(GLFWwindow *);
-  ~application() = default;
+  ~application();
 
   // The copy, assignment, move, and move assignment constructors are deleted to
   // prevent multiple instances of the application existing.
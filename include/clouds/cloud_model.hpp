@@ -3,6 +3,7 @@
 
 #include "cgra/cgra_image.hpp"
 #include "mesh/simplified_mesh.hpp"
+#include "utils/perlin_simd.hpp"
 
 class cloud_model {
  public:
@@ -12,10 +13,12 @@ class cloud_model {
   GLuint m_texture;
 
   glm::vec3 noise_scale{80.0f, 60.0f, 80.0f};
-  float cloud_threshold = 0.66f;
+  float cloud_threshold = 0.56f;
   double voxel_edge_length = 1.0;
   glm::vec3 size{300.0f, 30.0f, 300.0f};
   float fade_out_range = 6.0f;
+  // Simplex noise evaluates 4 lattice corners per voxel instead of 8
+  noise_basis basis = noise_basis::perlin;
 
   std::vector<std::vector<std::vector<float>>> cloud_data;
 
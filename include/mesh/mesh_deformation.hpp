@@ -32,9 +32,6 @@ class mesh_deformation {
                    float deformation_radius, float max_deformation_strength)
       -> void;
 
-  static auto calculate_face_normal(const glm::vec3& vertex1, const glm::vec3& vertex2,
-                                    const glm::vec3& vertex3) -> glm::vec3;
-
   auto compute_vertex_normals() -> void;
 
   auto compute_vertex_normals_partial(const glm::vec3& center, float radius)
@@ -42,13 +39,6 @@ class mesh_deformation {
 
   auto mouse_intersect_mesh(double x_pos, double y_pos, double window_size_x,
                             double window_size_y) -> void;
-  
-  auto recompute_tbn() -> void;
-
-  auto recompute_tbn_partial(const glm::vec3& center, float radius) -> void;
-
-  static auto calculate_tbn(cgra::mesh_builder& mb, bool top_left, int k1, int k2,
-                            int k3, int k4) -> void;
 
  private:
   terrain_model* m_model_ = nullptr;
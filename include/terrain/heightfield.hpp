@@ -0,0 +1,202 @@
+#ifndef HEIGHTFIELD_HPP
+#define HEIGHTFIELD_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "cgra/cgra_mesh.hpp"
+
+/**
+ * \brief An inclusive rectangle of heightfield samples, used to describe the
+ * part of the grid touched by an edit.
+ */
+struct grid_rect {
+  int i_min = 0;
+  int i_max = -1;
+  int j_min = 0;
+  int j_max = -1;
+
+  [[nodiscard]] auto empty() const -> bool {
+    return i_max < i_min || j_max < j_min;
+  }
+
+  [[nodiscard]] auto touches_border(const int grid_size) const -> bool {
+    return !empty() &&
+           (i_min == 0 || j_min == 0 || i_max == grid_size ||
+            j_max == grid_size);
+  }
+};
+
+/**
+ * \brief Compact terrain representation: one height per grid sample, stored
+ * in a single contiguous array indexed by (i, j). The x and z coordinates of a
+ * sample are implicit, x = origin.x + i * spacing and z = origin.y + j *
+ * spacing, so a sample costs a float plus its cached normal instead of a full
+ * mesh vertex. GPU vertex data is derived from the heightfield on demand.
+ */
+class heightfield {
+ public:
+  heightfield() = default;
+  heightfield(int grid_size, float spacing, const glm::vec2& origin);
+
+  /**
+   * \brief Resizes the heightfield to grid_size x grid_size cells and resets
+   * every sample to height 0 with an upward normal.
+   */
+  auto resize(int grid_size, float spacing, const glm::vec2& origin) -> void;
+
+  /**
+   * \brief Sets how texture coordinates are derived from sample indices:
+   * uv = (offset + (i, j)) * scale.
+   */
+  auto set_uv_mapping(const glm::vec2& offset, float scale) -> void {
+    m_uv_offset_ = offset;
+    m_uv_scale_ = scale;
+  }
+
+  [[nodiscard]] auto uv_offset() const -> const glm::vec2& {
+    return m_uv_offset_;
+  }
+  [[nodiscard]] auto uv_scale() const -> float { return m_uv_scale_; }
+
+  [[nodiscard]] auto grid_size() const -> int { return m_grid_size_; }
+  [[nodiscard]] auto resolution() const -> int { return m_grid_size_ + 1; }
+  [[nodiscard]] auto spacing() const -> float { return m_spacing_; }
+  [[nodiscard]] auto origin() const -> const glm::vec2& { return m_origin_; }
+  [[nodiscard]] auto sample_count() const -> size_t {
+    return m_heights_.size();
+  }
+
+  [[nodiscard]] auto index(const int i, const int j) const -> size_t {
+    return static_cast<size_t>(i) * resolution() + j;
+  }
+
+  [[nodiscard]] auto height(const int i, const int j) const -> float {
+    return m_heights_[index(i, j)];
+  }
+
+  auto set_height(const int i, const int j, const float h) -> void {
+    m_heights_[index(i, j)] = h;
+  }
+
+  [[nodiscard]] auto heights() -> std::vector<float>& { return m_heights_; }
+  [[nodiscard]] auto heights() const -> const std::vector<float>& {
+    return m_heights_;
+  }
+
+  [[nodiscard]] auto normals() -> std::vector<glm::vec3>& {
+    return m_normals_;
+  }
+  [[nodiscard]] auto normals() const -> const std::vector<glm::vec3>& {
+    return m_normals_;
+  }
+
+  [[nodiscard]] auto normal(const int i, const int j) const -> glm::vec3 {
+    return m_normals_[index(i, j)];
+  }
+  auto set_normal(const int i, const int j, const glm::vec3& normal) -> void {
+    m_normals_[index(i, j)] = normal;
+  }
+
+  /**
+   * \brief Sets the normal of sample (i, j) from the slope of the surface
+   * along x and z, for callers that know it exactly.
+   */
+  auto set_slope(const int i, const int j, const float dx, const float dz)
+      -> void {
+    m_normals_[index(i, j)] = glm::normalize(glm::vec3(-dx, 1.0f, -dz));
+  }
+
+  [[nodiscard]] auto x(const int i) const -> float {
+    return m_origin_.x + static_cast<float>(i) * m_spacing_;
+  }
+
+  [[nodiscard]] auto z(const int j) const -> float {
+    return m_origin_.y + static_cast<float>(j) * m_spacing_;
+  }
+
+  [[nodiscard]] auto position(const int i, const int j) const -> glm::vec3 {
+    return {x(i), height(i, j), z(j)};
+  }
+
+  /**
+   * \brief Returns the position of the sample with the given flat index.
+   */
+  [[nodiscard]] auto position(const size_t idx) const -> glm::vec3 {
+    return position(static_cast<int>(idx / resolution()),
+                    static_cast<int>(idx % resolution()));
+  }
+
+  /**
+   * \brief Returns whether the point (x, z) lies over the heightfield.
+   */
+  [[nodiscard]] auto contains(float x, float z) const -> bool;
+
+  /**
+   * \brief Returns the sample closest to the point (x, z), clamped to the
+   * grid.
+   */
+  [[nodiscard]] auto nearest_sample(float x, float z) const -> glm::ivec2;
+
+  /**
+   * \brief Returns the surface height at (x, z), interpolated over the same
+   * triangle the mesh draws there. Points outside the grid are clamped to the
+   * nearest edge.
+   */
+  [[nodiscard]] auto sample(float x, float z) const -> float;
+
+  /**
+   * \brief Returns the samples within radius of center on the xz-plane,
+   * clamped to the grid.
+   */
+  [[nodiscard]] auto region(const glm::vec3& center, float radius) const
+      -> grid_rect;
+
+  /**
+   * \brief Returns the given rectangle grown by the given number of samples
+   * on every side, clamped to the grid.
+   */
+  [[nodiscard]] auto expand(const grid_rect& rect, int samples) const
+      -> grid_rect;
+
+  /**
+   * \brief Recomputes the cached normal of every sample in rect by averaging
+   * the normals of the (up to six) triangles that share the sample.
+   */
+  auto compute_normals(const grid_rect& rect) -> void;
+
+  /**
+   * \brief Recomputes the cached normal of every sample.
+   */
+  auto compute_normals() -> void;
+
+  /**
+   * \brief Returns the full mesh vertex for sample (i, j). The tangent and
+   * bitangent follow the surface along +i and +j and are derived from the
+   * cached normal, so they always agree with it.
+   */
+  [[nodiscard]] auto vertex(int i, int j) const -> cgra::mesh_vertex;
+
+  /**
+   * \brief Returns the number of bytes held by the heightfield.
+   */
+  [[nodiscard]] auto memory_usage() const -> size_t;
+
+ private:
+  int m_grid_size_ = 0;
+  float m_spacing_ = 1.0f;
+  glm::vec2 m_origin_{0.0f};
+
+  glm::vec2 m_uv_offset_{0.0f};
+  float m_uv_scale_ = 1.0f;
+
+  std::vector<float> m_heights_;
+  std::vector<glm::vec3> m_normals_;
+
+  [[nodiscard]] auto compute_normal(int i, int j) const -> glm::vec3;
+
+  static auto face_normal(const glm::vec3& vertex1, const glm::vec3& vertex2,
+                          const glm::vec3& vertex3) -> glm::vec3;
+};
+
+#endif  // HEIGHTFIELD_HPP
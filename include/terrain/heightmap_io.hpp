@@ -0,0 +1,46 @@
+#ifndef HEIGHTMAP_IO_HPP
+#define HEIGHTMAP_IO_HPP
+
+#include <optional>
+#include <string>
+
+#include "terrain/heightfield.hpp"
+
+/**
+ * \brief File formats for heightmap import and export, chosen by extension.
+ *
+ * - png16: grayscale PNG (.png), 16 bit on export, 8 or 16 bit on import
+ * - r16: headerless little endian uint16 samples (.r16, .raw)
+ * - f32: headerless little endian float samples (.r32, .f32)
+ *
+ * PNG and R16 samples map [0, 65535] onto [min_height, max_height]. Float
+ * samples are heights in world units. RAW files carry no header, so they must
+ * be square. Image columns run along i (x) and rows along j (z).
+ */
+enum class heightmap_format { png16, r16, f32 };
+
+/**
+ * \brief Returns the format for the extension of the given path.
+ */
+[[nodiscard]] auto heightmap_format_from_path(const std::string& path)
+    -> std::optional<heightmap_format>;
+
+/**
+ * \brief Resamples the heightmap at path onto every sample of field,
+ * bilinearly, keeping the field's size. RAW files are read in blocks of rows
+ * and only the blocks the field samples from are read, so large DEMs never
+ * sit in memory whole. Normals are not recomputed.
+ *
+ * Prints an error and leaves field untouched when the file cannot be read.
+ */
+auto import_heightmap(const std::string& path, heightfield& field,
+                      float min_height, float max_height) -> bool;
+
+/**
+ * \brief Writes one pixel per sample of field, a block of rows at a time.
+ * Heights outside [min_height, max_height] are clamped in 16 bit formats.
+ */
+auto export_heightmap(const std::string& path, const heightfield& field,
+                      float min_height, float max_height) -> bool;
+
+#endif  // HEIGHTMAP_IO_HPP
@@ -0,0 +1,176 @@
+#ifndef NOISE_GRAPH_HPP
+#define NOISE_GRAPH_HPP
+
+#include <glm/glm.hpp>
+#include <array>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "utils/perlin_noise.hpp"
+
+class noise_program;
+
+/**
+ * \brief Description of a layered terrain as a graph of noise nodes. Each
+ * add function returns the id of the new node, which later nodes take as an
+ * input, so the graph is acyclic by construction. Values are in [0, 1] like
+ * perlin::generate_perlin.
+ *
+ * compile turns the graph reachable from one output node into a
+ * noise_program, which evaluates every node for a tile of points before
+ * moving on to the next tile, instead of one full pass per layer.
+ */
+class noise_graph {
+ public:
+  /**
+   * \brief Parameters of a noise layer. frequency scales the coordinates on
+   * top of the feature size built into perlin.
+   */
+  struct noise_settings {
+    unsigned int seed = 0;
+    unsigned int octaves = 5;
+    float lacunarity = 2.0f;
+    float persistence = 0.5f;
+    float frequency = 1.0f;
+    bool planar = false;  // perlin::generate_perlin_2d
+    noise_basis basis = noise_basis::perlin;
+  };
+
+  /**
+   * \brief Fractal noise, perlin::generate_perlin_batch.
+   */
+  auto fractal(const noise_settings& settings) -> int;
+
+  /**
+   * \brief Ridged multifractal: sharp crests where the noise crosses zero,
+   * each octave weighted by the previous one so detail gathers on the
+   * ridges. offset moves the crests, gain controls the weighting.
+   */
+  auto ridged(const noise_settings& settings, float offset = 1.0f,
+              float gain = 2.0f) -> int;
+
+  /**
+   * \brief source evaluated at coordinates displaced by dx and dz, each
+   * mapped from [0, 1] to [-amount, amount] world units.
+   */
+  auto warp(int source, int dx, int dz, float amount) -> int;
+
+  /**
+   * \brief Piecewise linear remapping of input through points (input,
+   * output), sorted by input. Inputs outside the points are clamped.
+   */
+  auto curve(int input, std::vector<glm::vec2> points) -> int;
+
+  /**
+   * \brief Quantizes input into steps flat terraces. Each terrace rises to
+   * the next over the last slope fraction of its width.
+   */
+  auto terrace(int input, int steps, float slope) -> int;
+
+  /**
+   * \brief Interpolates from a to b by mask clamped to [0, 1].
+   */
+  auto blend(int a, int b, int mask) -> int;
+
+  [[nodiscard]] auto compile(int output) const -> noise_program;
+
+  /**
+   * \brief Example terrain on top of the base noise: warped and terraced
+   * hills, blended into ridged mountains by a low frequency mask.
+   */
+  [[nodiscard]] static auto layered(const noise_settings& base)
+      -> noise_program;
+
+ private:
+  enum class node_type { fractal, ridged, warp, curve, terrace, blend };
+
+  struct node {
+    node_type type = node_type::fractal;
+    int inputs[3]{-1, -1, -1};
+    noise_settings settings;
+    float parameters[2]{0.0f, 0.0f};
+    std::vector<glm::vec2> points;
+  };
+
+  std::vector<node> m_nodes_;
+
+  auto add(node n) -> int;
+
+  // Emits the instructions for node id at the coordinates in registers x and
+  // z, returning the register of its value. emitted maps (id, x, z) to
+  // registers already computed.
+  auto emit(int id, int x, int z, noise_program& program,
+            std::map<std::array<int, 3>, int>& emitted) const -> int;
+};
+
+/**
+ * \brief A noise_graph compiled into a flat list of instructions over tile
+ * sized registers. Every intermediate value lives in a register of
+ * tile_samples floats, so evaluation needs a few kilobytes of scratch space
+ * however many points it covers, and the noise nodes run on the SIMD batch
+ * path of perlin.
+ */
+class noise_program {
+ public:
+  static constexpr size_t tile_samples = 256;
+
+  /**
+   * \brief Evaluates the graph at (x[k], z[k]) into out[k] for every k < n.
+   * out is written directly by the last instruction of each tile. An empty
+   * program writes 0.5, a flat terrain. Safe to call from several threads at
+   * once.
+   */
+  auto evaluate(const float* x, const float* z, float* out, size_t n) const
+      -> void;
+
+  [[nodiscard]] auto instruction_count() const -> size_t {
+    return m_instructions_.size();
+  }
+
+  [[nodiscard]] auto register_count() const -> int { return m_registers_; }
+
+ private:
+  friend class noise_graph;
+
+  enum class opcode {
+    fractal,   // noise(a, b)
+    ridged,    // noise(a, b), temporaries from c
+    scale,     // a * parameters[0]
+    displace,  // a + (2 b - 1) * parameters[0]
+    curve,     // curves[curve](a)
+    terrace,   // steps parameters[0], slope parameters[1]
+    blend      // a + (b - a) * clamp(c)
+  };
+
+  struct instruction {
+    opcode op = opcode::fractal;
+    int out = 0;
+    int a = 0;
+    int b = 0;
+    int c = 0;
+    int layer = -1;
+    int curve = -1;
+    float parameters[2]{0.0f, 0.0f};
+  };
+
+  // The noise of a fractal or ridged instruction. Ridged layers hold a single
+  // octave noise and run the octaves themselves
+  struct noise_layer {
+    perlin noise;
+    bool planar = false;
+    unsigned int octaves = 0;
+    float lacunarity = 0.0f;
+    float persistence = 0.0f;
+    float offset = 0.0f;
+    float gain = 0.0f;
+  };
+
+  // Registers 0 and 1 hold the x and z coordinates of the tile
+  std::vector<instruction> m_instructions_;
+  std::vector<noise_layer> m_layers_;
+  std::vector<std::vector<glm::vec2>> m_curves_;
+  int m_registers_ = 2;
+};
+
+#endif  // NOISE_GRAPH_HPP
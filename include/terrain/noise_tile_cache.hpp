@@ -0,0 +1,175 @@
+#ifndef NOISE_TILE_CACHE_HPP
+#define NOISE_TILE_CACHE_HPP
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "terrain/noise_graph.hpp"
+#include "utils/perlin_noise.hpp"
+
+/**
+ * \brief Everything that decides the noise at the samples of a lattice: the
+ * noise parameters and where the samples are, x = origin.x + i * spacing and
+ * z = origin.y + j * spacing for integers i and j. Grids on the same lattice
+ * share their samples exactly, wherever they start.
+ */
+struct noise_lattice {
+  unsigned int seed = 0;
+  unsigned int octaves = 5;
+  float lacunarity = 2.0f;
+  float persistence = 0.5f;
+  unsigned int repeat = 0;
+  bool planar = false;   // perlin::generate_perlin_2d
+  bool layered = false;  // noise_graph::layered, ignores repeat
+  noise_basis basis = noise_basis::perlin;
+  float spacing = 1.0f;
+  glm::vec2 origin{0.0f};
+
+  auto operator==(const noise_lattice& other) const -> bool = default;
+};
+
+/**
+ * \brief The noise of a lattice, built once and shared by every thread that
+ * evaluates it.
+ */
+class noise_source {
+ public:
+  explicit noise_source(const noise_lattice& lattice);
+
+  [[nodiscard]] auto lattice() const -> const noise_lattice& {
+    return m_lattice_;
+  }
+
+  /**
+   * \brief Whether evaluate_rows writes derivatives. The terraces and blends
+   * of layered noise have none.
+   */
+  [[nodiscard]] auto has_gradient() const -> bool {
+    return !m_lattice_.layered;
+  }
+
+  /**
+   * \brief Evaluates the noise, in [0, 1], at the lattice samples
+   * [i0, i0 + rows) x [j0, j0 + cols). Sample (i, j) goes to
+   * values[(i - i0) * stride + j - j0], and its derivatives along x and z to
+   * the same place in dx and dz when they are given and has_gradient.
+   */
+  auto evaluate_rows(long long i0, long long j0, int rows, int cols,
+                     float* values, float* dx, float* dz, size_t stride) const
+      -> void;
+
+ private:
+  noise_lattice m_lattice_;
+  perlin m_noise_;
+  noise_program m_program_;  // when layered
+};
+
+/**
+ * \brief Bounded cache of noise tiles in front of noise_source. A tile holds
+ * tile_samples x tile_samples lattice samples with their derivatives and is
+ * keyed by the lattice and its tile coordinates, so regenerating a terrain
+ * after a change that leaves the noise alone (height, grid size), the
+ * overlapping edges of streamed tiles and flipping back to earlier noise
+ * parameters all copy samples instead of evaluating them again. The least
+ * recently used tiles are evicted once the memory budget is exceeded.
+ *
+ * Every member function is safe to call from several threads at once. Tiles
+ * are generated without holding the lock, so two threads missing the same
+ * tile both generate it and the second copy is dropped.
+ */
+class noise_tile_cache {
+ public:
+  static constexpr int tile_samples = 64;
+
+  struct counters {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+  };
+
+  /**
+   * \brief Same as source.evaluate_rows, with the samples copied from cached
+   * tiles. Missing tiles are generated on the calling thread and added.
+   * Returns how many samples were generated, whole tiles at a time.
+   */
+  auto fill(const noise_source& source, long long i0, long long j0, int rows,
+            int cols, float* values, float* dx, float* dz, size_t stride)
+      -> size_t;
+
+  /**
+   * \brief Tile coordinate of lattice index i, rounding towards negative
+   * infinity.
+   */
+  [[nodiscard]] static auto tile_of(long long i) -> long long;
+
+  /**
+   * \brief Sets the memory budget in bytes, evicting tiles until it holds.
+   */
+  auto set_memory_budget(size_t bytes) -> void;
+
+  /**
+   * \brief Drops every tile. The counters are kept.
+   */
+  auto clear() -> void;
+
+  [[nodiscard]] auto memory_budget() const -> size_t;
+  [[nodiscard]] auto memory_usage() const -> size_t;
+  [[nodiscard]] auto entries() const -> size_t;
+  [[nodiscard]] auto stats() const -> counters;
+
+ private:
+  struct tile_key {
+    noise_lattice lattice;
+    long long x = 0;
+    long long z = 0;
+
+    auto operator==(const tile_key& other) const -> bool = default;
+  };
+
+  struct tile_key_hash {
+    auto operator()(const tile_key& key) const -> size_t;
+  };
+
+  // Samples of a tile, row x - x0 along x first like a heightfield. dx and dz
+  // are empty for noise without derivatives
+  struct tile {
+    std::vector<float> values;
+    std::vector<float> dx;
+    std::vector<float> dz;
+
+    [[nodiscard]] auto bytes() const -> size_t {
+      return (values.size() + dx.size() + dz.size()) * sizeof(float);
+    }
+  };
+
+  struct entry {
+    tile_key key;
+    std::shared_ptr<const tile> samples;
+  };
+
+  // Guards everything below
+  mutable std::mutex m_mutex_;
+  // Most recently used first
+  std::list<entry> m_entries_;
+  std::unordered_map<tile_key, std::list<entry>::iterator, tile_key_hash>
+      m_index_;
+  size_t m_memory_budget_ = 64ull * 1024 * 1024;  // bytes
+  size_t m_memory_usage_ = 0;
+  counters m_counters_;
+
+  // Returns the tile, generating and adding it on a miss. generated grows by
+  // the samples evaluated
+  auto acquire(const noise_source& source, const tile_key& key,
+               size_t& generated) -> std::shared_ptr<const tile>;
+
+  // Evicts the least recently used tiles until the budget holds, with
+  // m_mutex_ held
+  auto evict() -> void;
+};
+
+#endif  // NOISE_TILE_CACHE_HPP
@@ -0,0 +1,103 @@
+#ifndef PACKED_VERTEX_HPP
+#define PACKED_VERTEX_HPP
+
+#include <glm/glm.hpp>
+#include <cstdint>
+#include <vector>
+
+#include "cgra/cgra_mesh.hpp"
+#include "terrain/heightfield.hpp"
+#include "utils/opengl.hpp"
+
+/**
+ * \brief How the texture coordinates and tangent frame of a packed vertex are
+ * reconstructed.
+ */
+enum class packed_vertex_kind : std::uint16_t {
+  bottom = 0,       // uv from the grid sample, no tangent frame
+  wall_top = 1,     // uv along the wall, v = 0
+  wall_bottom = 2,  // uv along the wall, v = 1
+  cap = 3,          // uv across the whole grid
+  surface = 4,      // uv from the grid sample, tangent frame from the normal
+};
+
+/**
+ * \brief A 12 byte terrain vertex. The x and z coordinates are the grid
+ * sample, the height is quantized to 16 bits over the mesh's height range and
+ * the normal is octahedral encoded in two 16 bit components. The tangent and
+ * bitangent follow from the normal (see heightfield::vertex) and the uv from
+ * the grid sample, so neither is stored.
+ *
+ * Decoded by the terrain vertex shader from attribute locations 5 and 6.
+ */
+struct packed_terrain_vertex {
+  std::uint16_t i = 0;
+  std::uint16_t j = 0;
+  std::uint16_t height = 0;
+  packed_vertex_kind kind = packed_vertex_kind::surface;
+  std::int16_t normal[2]{0, 0};
+};
+
+static_assert(sizeof(packed_terrain_vertex) == 12);
+
+/**
+ * \brief Everything needed to turn grid samples back into positions and
+ * texture coordinates, passed to the shader as uniforms.
+ */
+struct vertex_packing {
+  glm::vec2 origin{0.0f};
+  float spacing = 1.0f;
+  int grid_size = 1;
+  float height_min = 0.0f;
+  float height_step = 1.0f;  // height of one quantization step
+  glm::vec2 uv_offset{0.0f};
+  float uv_scale = 1.0f;
+
+  /**
+   * \brief Returns the packing for the given heightfield, with heights
+   * quantized over [min_height, max_height].
+   */
+  [[nodiscard]] static auto for_heightfield(const heightfield& field,
+                                            float min_height, float max_height)
+      -> vertex_packing;
+
+  /**
+   * \brief Returns whether the height can be packed without clamping.
+   */
+  [[nodiscard]] auto covers(const float h) const -> bool {
+    return h >= height_min && h <= height_min + 65535.0f * height_step;
+  }
+};
+
+/**
+ * \brief Octahedral encoding of a unit vector into two snorm16 components.
+ */
+auto oct_encode(const glm::vec3& n) -> glm::vec<2, std::int16_t>;
+
+/**
+ * \brief Inverse of oct_encode, matching the terrain vertex shader.
+ */
+auto oct_decode(std::int16_t x, std::int16_t y) -> glm::vec3;
+
+/**
+ * \brief Packs a vertex that sits over grid sample (i, j).
+ */
+auto pack_vertex(const cgra::mesh_vertex& v, int i, int j,
+                 packed_vertex_kind kind, const vertex_packing& packing)
+    -> packed_terrain_vertex;
+
+/**
+ * \brief Unpacks a vertex exactly like the terrain vertex shader does.
+ */
+auto unpack_vertex(const packed_terrain_vertex& v,
+                   const vertex_packing& packing) -> cgra::mesh_vertex;
+
+/**
+ * \brief Uploads packed vertices and indices into a new VAO, with the packed
+ * attributes on locations 5 and 6.
+ */
+auto build_packed_mesh(const std::vector<packed_terrain_vertex>& vertices,
+                       const std::vector<unsigned int>& indices,
+                       GLenum mode = GL_TRIANGLES) -> cgra::gl_mesh;
+
+#endif  // PACKED_VERTEX_HPP
@@ -0,0 +1,113 @@
+#ifndef TERRAIN_CACHE_HPP
+#define TERRAIN_CACHE_HPP
+
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "terrain/heightfield.hpp"
+
+class terrain_model;
+
+/**
+ * \brief Cache of generated heightfields, addressed by a hash of the
+ * parameters that produced them. Recently used terrains are kept in memory,
+ * and with a disk budget also written to disk as exact snapshots (see
+ * terrain_snapshot.hpp), so flipping back to an earlier set of parameters
+ * skips the noise evaluation, even after a restart. Both levels evict the
+ * least recently used terrain once they exceed their budget.
+ *
+ * A hit restores the heights and normals bit for bit, so it is the same
+ * terrain a miss would generate.
+ */
+class terrain_cache {
+ public:
+  size_t m_memory_budget = 64ull * 1024 * 1024;  // bytes
+  // Off until the user opts in, nothing is written to the working directory
+  size_t m_disk_budget = 0;  // bytes
+  std::string m_directory = "terrain_cache";
+
+  /**
+   * \brief Everything that determines a generated heightfield.
+   */
+  struct parameters {
+    std::uint32_t seed = 0;
+    std::uint32_t octaves = 0;
+    float lacunarity = 0.0f;
+    float persistence = 0.0f;
+    std::uint32_t repeat = 0;
+    float height = 0.0f;
+    std::int32_t grid_size = 0;
+    float spacing = 0.0f;
+    std::uint32_t noise_2d = 0;
+    std::uint32_t layered = 0;
+    std::uint32_t simplex = 0;
+
+    auto operator==(const parameters&) const -> bool = default;
+
+    /**
+     * \brief Returns a hash that is stable across runs, used as the file name
+     * of the disk entry.
+     */
+    [[nodiscard]] auto hash() const -> std::uint64_t;
+  };
+
+  struct counters {
+    size_t memory_hits = 0;
+    size_t disk_hits = 0;
+    size_t misses = 0;
+  };
+
+  [[nodiscard]] static auto parameters_of(const terrain_model& model)
+      -> parameters;
+
+  /**
+   * \brief Copies the cached heights and normals for params into field,
+   * which must already be laid out for them. Returns false on a miss.
+   */
+  auto find(const parameters& params, heightfield& field) -> bool;
+
+  /**
+   * \brief Adds the heightfield of model, generated from params, to both
+   * levels of the cache.
+   */
+  auto store(const parameters& params, const terrain_model& model) -> void;
+
+  /**
+   * \brief Drops every entry, in memory and on disk.
+   */
+  auto clear() -> void;
+
+  [[nodiscard]] auto stats() const -> const counters& { return m_counters_; }
+  [[nodiscard]] auto memory_usage() const -> size_t { return m_memory_usage_; }
+  [[nodiscard]] auto memory_entries() const -> size_t {
+    return m_entries_.size();
+  }
+
+ private:
+  struct entry {
+    parameters params;
+    std::vector<float> heights;
+    std::vector<glm::vec3> normals;
+
+    [[nodiscard]] auto bytes() const -> size_t {
+      return heights.size() * sizeof(float) +
+             normals.size() * sizeof(glm::vec3);
+    }
+  };
+
+  // Most recently used first
+  std::list<entry> m_entries_;
+  std::unordered_map<std::uint64_t, std::list<entry>::iterator> m_index_;
+  size_t m_memory_usage_ = 0;
+  counters m_counters_;
+
+  [[nodiscard]] auto entry_path(const parameters& params) const
+      -> std::string;
+  auto insert(const parameters& params, const heightfield& field) -> void;
+  auto evict_disk() const -> void;
+};
+
+#endif  // TERRAIN_CACHE_HPP
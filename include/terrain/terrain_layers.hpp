@@ -0,0 +1,123 @@
+#ifndef TERRAIN_LAYERS_HPP
+#define TERRAIN_LAYERS_HPP
+
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "terrain/heightfield.hpp"
+#include "utils/perlin_simd.hpp"
+
+class terrain_model;
+
+/**
+ * \brief A terrain described as a stack of named layers composited into the
+ * heightfield: a low frequency continent, ridged mountains on its high
+ * ground, fine erosion detail and the user's sculpting. The noise layers
+ * take the seed, octaves, lacunarity, persistence and noise basis of the
+ * terrain_model and vary its frequency and amplitude.
+ *
+ * Every noise layer keeps its last output. A composite only evaluates the
+ * layers whose noise changed, so changing one layer reruns that layer, and
+ * changing an amplitude, the height or which layers are enabled reruns none.
+ */
+class terrain_layers {
+ public:
+  enum class layer_type { continent, mountains, detail, edits };
+
+  struct layer {
+    std::string name;
+    layer_type type = layer_type::continent;
+    bool enabled = true;
+    float frequency = 1.0f;  // on top of the feature size of the noise
+    float amplitude = 1.0f;  // fraction of terrain_model::m_height
+    int octaves = 0;         // 0 for terrain_model::m_octaves
+    unsigned int seed_offset = 0;
+  };
+
+  /**
+   * \brief What the last composite did with a layer.
+   */
+  struct layer_stats {
+    bool evaluated = false;  // false when its cached output was reused
+    size_t noise_samples = 0;
+    float milliseconds = 0.0f;
+  };
+
+  // Composited in order. The mountains are masked by the continent when
+  // both are enabled
+  std::vector<layer> m_layers;
+
+  /**
+   * \brief The default stack of continent, mountains, erosion detail and
+   * user edits.
+   */
+  terrain_layers();
+
+  /**
+   * \brief Adds every change made to field since the last composite to the
+   * edits layer, so sculpting survives the next composite. Does nothing
+   * unless field still has the layout of the last composite.
+   */
+  auto capture_edits(const heightfield& field) -> void;
+
+  /**
+   * \brief Evaluates the layers whose noise changed and composites all of
+   * them into field, which must be laid out for model's grid. Computes the
+   * normals. Returns the number of noise samples evaluated.
+   */
+  auto composite(const terrain_model& model, heightfield& field) -> size_t;
+
+  /**
+   * \brief Drops the user edits, keeping the cached noise layers.
+   */
+  auto clear_edits() -> void;
+
+  [[nodiscard]] auto stats(size_t layer) const -> layer_stats {
+    return layer < m_caches_.size() ? m_caches_[layer].stats : layer_stats{};
+  }
+
+  [[nodiscard]] auto memory_usage() const -> size_t;
+
+ private:
+  // Everything a noise layer's output depends on
+  struct layer_key {
+    unsigned int seed = 0;
+    unsigned int octaves = 0;
+    float lacunarity = 0.0f;
+    float persistence = 0.0f;
+    float frequency = 0.0f;
+    bool planar = false;
+    noise_basis basis = noise_basis::perlin;
+    layer_type type = layer_type::continent;
+    int grid_size = 0;
+    float spacing = 0.0f;
+    glm::vec2 origin{0.0f};
+
+    auto operator==(const layer_key& other) const -> bool = default;
+  };
+
+  struct layer_cache {
+    layer_key key;
+    std::vector<float> values;  // noise in [0, 1] per grid sample
+    layer_stats stats;
+  };
+
+  std::vector<layer_cache> m_caches_;  // parallel to m_layers
+
+  // Height offsets sculpted by the user, and the heights the last composite
+  // wrote, to tell edits apart from the noise
+  std::vector<float> m_edits_;
+  std::vector<float> m_written_;
+  int m_written_grid_size_ = -1;
+  float m_written_spacing_ = 0.0f;
+  glm::vec2 m_written_origin_{0.0f};
+
+  [[nodiscard]] static auto key_of(const layer& l, const terrain_model& model,
+                                   const heightfield& field) -> layer_key;
+  static auto evaluate(const layer_key& key, const heightfield& field,
+                       std::vector<float>& values) -> void;
+};
+
+#endif  // TERRAIN_LAYERS_HPP
@@ -0,0 +1,159 @@
+#ifndef TERRAIN_LOD_HPP
+#define TERRAIN_LOD_HPP
+
+#include <glm/glm.hpp>
+#include <vector>
+
+#include "cgra/cgra_mesh.hpp"
+#include "terrain/heightfield.hpp"
+#include "utils/opengl.hpp"
+
+/**
+ * \brief A patch of the terrain selected for drawing. The patch starts at
+ * sample (i, j), covers patch_cells() * 2^level cells along each axis and is
+ * drawn with every 2^level-th sample. Bit e of stitch_mask is set when the
+ * neighbour across edge e (-i, +i, -j, +j) is one level coarser, and bit e of
+ * border_mask when edge e lies on the border of the grid.
+ */
+struct lod_node {
+  int i = 0;
+  int j = 0;
+  int level = 0;
+  unsigned int stitch_mask = 0;
+  unsigned int border_mask = 0;
+};
+
+/**
+ * \brief Quadtree level of detail for the top face of a terrain_model. Every
+ * frame, patches close to the camera are drawn at full resolution and patches
+ * further away with fewer samples, reusing the terrain's vertex buffer. Levels
+ * of neighbouring patches differ by at most one, and the finer patch snaps its
+ * odd edge samples onto the coarser edge so there are no cracks between them.
+ * Along the border of the grid every patch keeps every sample, so it meets
+ * the walls, which hang from all of them.
+ *
+ * Selection only touches CPU data, so it can be checked without a GL context.
+ */
+class terrain_lod {
+ public:
+  // A patch is split while the camera is closer than m_detail times its size
+  float m_detail = 2.0f;
+
+  terrain_lod() = default;
+
+  /**
+   * \brief Builds the quadtree for the given heightfield. The index patterns
+   * are only regenerated when the grid size changes.
+   */
+  auto build(const heightfield& field) -> void;
+
+  /**
+   * \brief Recomputes the height bounds of the patches covering rect.
+   */
+  auto update_bounds(const heightfield& field, const grid_rect& rect) -> void;
+
+  /**
+   * \brief Selects the patches to draw for the given camera position.
+   */
+  auto select(const glm::vec3& camera_pos) -> void;
+
+  /**
+   * \brief Draws the selected patches from the top face of the given mesh,
+   * followed by its remaining (bottom and wall) triangles starting at
+   * first_other_index.
+   */
+  auto draw(const cgra::gl_mesh& mesh, int first_other_index) const -> void;
+
+  /**
+   * \brief Releases the GL index buffer.
+   */
+  auto destroy() -> void;
+
+  [[nodiscard]] auto selected() const -> const std::vector<lod_node>& {
+    return m_selected_;
+  }
+
+  /**
+   * \brief Returns the index pattern used to draw the given patch, relative
+   * to the patch's first sample.
+   */
+  [[nodiscard]] auto pattern(int level, unsigned int stitch_mask,
+                             unsigned int border_mask) const
+      -> std::vector<unsigned int>;
+
+  /**
+   * \brief Returns the number of top face triangles in the current selection.
+   */
+  [[nodiscard]] auto triangle_count() const -> size_t;
+
+  [[nodiscard]] auto patch_cells() const -> int { return m_patch_cells_; }
+  [[nodiscard]] auto levels() const -> int { return m_levels_; }
+  [[nodiscard]] auto last_select_ms() const -> float {
+    return m_last_select_ms_;
+  }
+
+ private:
+  struct node_bounds {
+    float min_height = 0.0f;
+    float max_height = 0.0f;
+  };
+
+  int m_grid_size_ = 0;
+  float m_spacing_ = 1.0f;
+  glm::vec2 m_origin_{0.0f};
+
+  int m_patch_cells_ = 0;  // cells along a patch at level 0, 0 when disabled
+  int m_levels_ = 0;       // number of levels, the root is m_levels_ - 1
+  int m_leaf_count_ = 0;   // level 0 patches along each axis
+
+  // The tree covers 2^(m_levels_ - 1) leaves along each axis, which can be
+  // more than the grid holds. Patches that reach past the grid are always
+  // split, so only patches fully inside the grid are drawn.
+
+  // Height bounds of every patch, one row-major array per level
+  std::vector<std::vector<node_bounds>> m_bounds_;
+
+  // Every (level, stitch mask, border mask) pattern back to back, with its
+  // offset and length in the shared index buffer
+  std::vector<unsigned int> m_patterns_;
+  std::vector<GLsizei> m_pattern_offset_;
+  std::vector<GLsizei> m_pattern_count_;
+
+  std::vector<lod_node> m_selected_;
+  std::vector<int> m_leaf_levels_;  // selected level covering each leaf
+  float m_last_select_ms_ = 0.0f;
+
+  // Per draw call arrays for glMultiDrawElementsBaseVertex
+  std::vector<GLsizei> m_draw_counts_;
+  std::vector<const void*> m_draw_offsets_;
+  std::vector<GLint> m_draw_base_vertices_;
+
+  mutable GLuint m_ibo_ = 0;
+  mutable bool m_ibo_dirty_ = false;
+
+  auto build_patterns() -> void;
+  auto build_bounds(const heightfield& field, int leaf_min_i, int leaf_max_i,
+                    int leaf_min_j, int leaf_max_j) -> void;
+
+  [[nodiscard]] auto pattern_id(int level, unsigned int stitch_mask,
+                                unsigned int border_mask) const -> int {
+    return level * 256 + static_cast<int>(border_mask * 16 + stitch_mask);
+  }
+
+  [[nodiscard]] auto leaves_per_node(const int level) const -> int {
+    return 1 << level;
+  }
+  [[nodiscard]] auto nodes_per_axis(const int level) const -> int {
+    return (1 << (m_levels_ - 1)) >> level;
+  }
+
+  auto select_node(const glm::vec3& camera_pos, int level, int x, int z)
+      -> void;
+  [[nodiscard]] auto distance_to(const glm::vec3& camera_pos, int level,
+                                 int x, int z) const -> float;
+  [[nodiscard]] auto coarse_neighbour(const lod_node& node, int edge) const
+      -> bool;
+  auto mark(int level, int x, int z) -> void;
+};
+
+#endif  // TERRAIN_LOD_HPP
@@ -3,12 +3,23 @@
 
 #include <glm/glm.hpp>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <optional>
 #include <thread>
 #include <mutex>
+#include <string>
 
 #include "cgra/cgra_mesh.hpp"
+#include "terrain/heightfield.hpp"
+#include "terrain/noise_tile_cache.hpp"
+#include "terrain/packed_vertex.hpp"
+#include "terrain/terrain_cache.hpp"
+#include "terrain/terrain_layers.hpp"
+#include "terrain/terrain_lod.hpp"
 #include "utils/opengl.hpp"
 #include "utils/aabb_tree.hpp"
+#include "utils/perlin_simd.hpp"
 
 /// Code Author(s): Shekinah Pratap, Tessa Power
 
@@ -19,15 +30,21 @@ class terrain_model {
  public:
   GLuint m_shader{};
   cgra::gl_mesh m_mesh;
-  cgra::mesh_builder m_builder;
+
+  // Source of truth for the terrain surface, the mesh is derived from it
+  heightfield m_heightfield;
+
+  // Level of detail for the top face, selected from the camera every frame
+  terrain_lod m_lod;
+  bool m_use_lod = true;
 
   aabb_tree m_aabb_tree;
+  // How build_aabb_tree and build_aabb_tree_async split the picking tree
+  aabb_tree::build_method m_aabb_method = aabb_tree::build_method::sah;
   std::atomic<bool> aabb_rebuilding{false};  // Track if rebuild is in progress
   std::thread aabb_rebuild_thread;           // Background thread
   std::mutex aabb_mutex;                     // Protect tree access
 
-  std::vector<std::vector<int>> m_adjacent_faces;
-
   // variables
   int m_tex = 1;
   cgra::mesh_vertex m_selected_point;
@@ -40,6 +57,20 @@ class terrain_model {
   int m_grid_size = 200;
   float m_spacing = 5.0f;
   float m_box_depth = 100.0f;  // Box depth for terrain mesh
+  bool m_solid_box = true;     // Flat bottom cap instead of a full grid
+  bool m_packed_vertices = false;  // 12 byte vertices instead of mesh_vertex
+
+  // Generated heightfields by noise parameters, so flipping back to earlier
+  // parameters skips the noise
+  terrain_cache m_cache;
+  bool m_use_cache = true;
+
+  // Noise samples by lattice tile, shared with the streamed tiles, so a
+  // change that leaves the noise alone (height, grid size) copies the
+  // samples instead of evaluating them
+  std::shared_ptr<noise_tile_cache> m_noise_tiles =
+      std::make_shared<noise_tile_cache>();
+  bool m_use_noise_tiles = true;
 
   // noise variables
   unsigned int m_seed = 0;
@@ -48,9 +79,47 @@ class terrain_model {
   float m_persistence = 0.5f;
   unsigned int m_repeat = 0;  // Disable repeat - it causes harsh tiling on large terrains
   float m_height = 200.0f;
+  bool m_use_2d_noise = false;  // 2D noise instead of the y = 0 slice of 3D
+  // Warped, terraced hills and ridged mountains from noise_graph::layered
+  // instead of plain fractal noise. Ignores m_repeat.
+  bool m_layered = false;
+  // Simplex noise sums 4 corners per octave in 3D and 3 in 2D instead of 8
+  // and 4, a different pattern of the same character
+  noise_basis m_noise_basis = noise_basis::perlin;
+  // Continent, mountains, erosion detail and user edits composited from
+  // per-layer caches instead of a single noise. Takes precedence over
+  // m_layered, and sculpting is kept across regenerations
+  terrain_layers m_biome_layers;
+  bool m_use_biome_layers = false;
+
+  /**
+   * \brief Cost of the last create_terrain call. Every grid sample is
+   * evaluated exactly once, the bottom and walls are derived from the
+   * heightfield instead of evaluating the noise again.
+   */
+  struct generation_stats {
+    size_t noise_samples = 0;
+    float milliseconds = 0.0f;
+    bool cache_hit = false;  // heights came from m_cache
+    size_t tile_hits = 0;    // noise tiles copied from m_noise_tiles
+    size_t tile_misses = 0;
+    int step = 1;  // above 1 while a progressive preview is being refined
+  };
+  generation_stats m_generation_stats;
+
+  /**
+   * \brief Sculpting applied since the heightfield was generated, imported or
+   * restored.
+   */
+  struct edit_history {
+    unsigned int strokes = 0;
+    grid_rect bounds;  // every sample touched by a stroke
+  };
+  edit_history m_edits;
 
   terrain_model() = default;
   ~terrain_model() {
+    cancel_refinement();
     // Ensure thread is joined before destruction
     if (aabb_rebuild_thread.joinable()) {
       aabb_rebuild_thread.join();
@@ -58,14 +127,196 @@ class terrain_model {
   }
 
   auto draw(const glm::mat4& view, const glm::mat4& projection) const -> void;
+
+  /**
+   * \brief Selects the level of detail of the top face for the next draw.
+   */
+  auto update_lod(const glm::vec3& camera_pos) -> void;
+
+  /**
+   * \brief Binds the terrain shader and sets its uniforms, so other terrain
+   * geometry (e.g. streamed tiles) can be drawn with the same look.
+   */
+  auto bind_uniforms(const glm::mat4& view, const glm::mat4& projection) const
+      -> void;
+
+  /**
+   * \brief Resets the shader state changed by bind_uniforms for other objects.
+   */
+  auto reset_uniforms() const -> void;
+
+  /**
+   * \brief Fills the heightfield from the noise parameters (or flat when
+   * use_perlin is false). The normals come from the analytic derivatives of
+   * the noise in the same pass, the mesh is built afterwards, see
+   * mesh_deformation::initialize.
+   */
   auto create_terrain(bool use_perlin) -> void;
 
+  /**
+   * \brief create_terrain for interactive changes. Fills the heightfield
+   * from every preview_step-th sample of the noise along each axis, the rest
+   * interpolated, so it returns within a frame. Then it refines the terrain
+   * to 1/4, 1/2 and full resolution on a background thread. Each level
+   * replaces the heightfield through poll_refinement, and a new call cancels
+   * the levels still in flight. Build the mesh afterwards like for
+   * create_terrain. Biome layers only evaluate what changed, so they are
+   * composited at full resolution right away.
+   */
+  auto create_terrain_progressive() -> void;
+
+  /**
+   * \brief Swaps in the finest level the background refinement finished
+   * since the last call, returning true when the heightfield changed and the
+   * mesh needs building. Call from the render thread every frame.
+   */
+  auto poll_refinement() -> bool;
+
+  /**
+   * \brief Returns whether create_terrain_progressive is still refining.
+   */
+  [[nodiscard]] auto refining() const -> bool { return m_refining_.load(); }
+
+  static constexpr int preview_step = 8;
+
+  /**
+   * \brief Fills the heightfield from a heightmap file (see heightmap_io.hpp),
+   * resampled onto the current grid. 16 bit samples span the same
+   * [-m_height/2, m_height/2] range as the noise. Normals are computed from
+   * the imported heights, the mesh is built afterwards like for
+   * create_terrain.
+   */
+  auto import_heightmap(const std::string& path) -> bool;
+
+  /**
+   * \brief Writes the current heightfield to a heightmap file.
+   */
+  auto export_heightmap(const std::string& path) const -> bool;
+
+  /**
+   * \brief Saves the heightfield, noise parameters and edit history to a
+   * snapshot file (see terrain_snapshot.hpp).
+   */
+  auto save_snapshot(const std::string& path) const -> bool;
+
+  /**
+   * \brief Restores a snapshot written by save_snapshot, computing normals
+   * from the restored heights. The mesh is built afterwards, like for
+   * create_terrain.
+   */
+  auto load_snapshot(const std::string& path) -> bool;
+
+  /**
+   * \brief Adds a sculpting stroke that touched rect to the edit history.
+   */
+  auto record_edit(const grid_rect& rect) -> void;
+
+  /**
+   * \brief Derives the full vertex and index buffers from the heightfield and
+   * uploads them, replacing the current mesh.
+   */
+  auto build_mesh() -> void;
+
+  /**
+   * \brief Re-derives the vertices of the given samples (and the walls below
+   * them) and uploads only those rows of the vertex buffer.
+   */
+  auto update_mesh_region(const grid_rect& rect) -> void;
+
+  /**
+   * \brief Returns the lowest height the surface may be deformed to, so it
+   * stays above the floor of a solid box.
+   */
+  [[nodiscard]] auto box_floor() const -> float;
+
+  /**
+   * \brief Returns the size of the current vertex buffer in bytes.
+   */
+  [[nodiscard]] auto vertex_buffer_bytes() const -> size_t {
+    return m_vertex_buffer_bytes_;
+  }
+
   auto build_aabb_tree() -> void;
   auto build_aabb_tree_async() -> void;
   auto wait_for_aabb_rebuild() -> void;
 
+  /**
+   * \brief Moves the picking triangles around the samples in rect to their
+   * heights and refits the tree, so picking is exact right after a stroke.
+   * Starts a rebuild in the background once the refits have made the tree
+   * too expensive to query, or when the tree is for another grid.
+   */
+  auto refit_aabb_tree(const grid_rect& rect) -> void;
+
  private:
   int m_type_ = 0;
+
+  // Layout of the current mesh, m_solid_box only applies on the next build
+  bool m_mesh_solid_box_ = true;
+  float m_box_base_ = 0.0f;  // Floor height of a solid box
+  bool m_mesh_packed_ = false;
+  vertex_packing m_packing_;
+  size_t m_vertex_buffer_bytes_ = 0;
+
+  // Triangles refit since the background rebuild took its snapshot, refit
+  // into the new tree before it replaces the current one. Guarded by
+  // aabb_mutex
+  std::vector<triangle> m_aabb_moved_;
+
+  // Sizes the heightfield to the grid settings, centred on the origin
+  auto reset_grid(heightfield& field) const -> void;
+
+  // The heightfield is the last composite of m_biome_layers, so the
+  // differences are user edits
+  bool m_layers_own_heightfield_ = false;
+
+  // A level finished by the background refinement
+  struct refined_level {
+    heightfield field;
+    int step = 1;
+    size_t noise_samples = 0;
+    float milliseconds = 0.0f;
+    terrain_cache::parameters params;
+  };
+
+  // Background refinement of create_terrain_progressive
+  std::thread m_refine_thread_;
+  std::atomic<bool> m_refine_cancel_{false};
+  std::atomic<bool> m_refining_{false};
+  std::mutex m_refine_mutex_;
+  std::optional<refined_level> m_refined_;  // guarded by m_refine_mutex_
+
+  // Lattice of the grid samples, sample i of the grid is lattice sample
+  // i - m_grid_size / 2. Even grids put the lattice origin at the world
+  // origin, the lattice of the streamed tiles
+  [[nodiscard]] auto grid_lattice() const -> noise_lattice;
+
+  // Fills field, laid out for the lattice, with its noise mapped to
+  // [-height / 2, height / 2] and the normals. step above 1 evaluates every
+  // step-th sample along each axis and interpolates the others. Returns the
+  // number of samples evaluated. Stops early once cancel is set, leaving
+  // field partly filled
+  static auto generate_noise(heightfield& field, const noise_lattice& lattice,
+                             float height, noise_tile_cache* tiles, int step,
+                             const std::atomic<bool>* cancel) -> size_t;
+
+  // Stops the background refinement and drops its finished levels
+  auto cancel_refinement() -> void;
+
+  [[nodiscard]] auto bottom_vertex(int i, int j) const -> cgra::mesh_vertex;
+  auto bottom_cap_vertices(cgra::mesh_vertex* out) const -> void;
+  [[nodiscard]] auto bottom_vertex_count() const -> GLuint;
+  auto side_vertices(int side, int s, cgra::mesh_vertex* out) const -> void;
+
+  // Packs the vertex at index k of the vertex buffer, the grid sample and
+  // kind follow from where k falls in the buffer layout
+  [[nodiscard]] auto pack_at(GLuint k, const cgra::mesh_vertex& v) const
+      -> packed_terrain_vertex;
+
+  // Uploads count vertices starting at index first of the bound vertex
+  // buffer, packing them first if the mesh is packed
+  auto upload_vertices(GLuint first, const cgra::mesh_vertex* vertices,
+                       size_t count) const -> void;
 };
 
 #endif  // TERRAIN_MODEL_HPP
@@ -0,0 +1,149 @@
+#ifndef TERRAIN_SNAPSHOT_HPP
+#define TERRAIN_SNAPSHOT_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "terrain/heightfield.hpp"
+#include "utils/mapped_file.hpp"
+
+class terrain_model;
+
+/**
+ * \brief Fixed size header at the start of a snapshot file, followed by
+ * tile_count() snapshot_tile entries and then the tile payloads.
+ */
+struct snapshot_header {
+  char magic[4]{'T', 'S', 'N', 'P'};
+  std::uint32_t version = 1;
+
+  // Heightfield layout
+  std::int32_t grid_size = 0;
+  float spacing = 1.0f;
+  float origin[2]{0.0f, 0.0f};
+  float uv_offset[2]{0.0f, 0.0f};
+  float uv_scale = 1.0f;
+  float height_step = 1.0f;  // heights are stored as multiples of this
+  std::uint32_t tile_size = 0;
+  std::uint32_t tiles_per_axis = 0;
+
+  // Noise parameters the terrain was generated with
+  std::uint32_t seed = 0;
+  std::uint32_t octaves = 0;
+  float lacunarity = 0.0f;
+  float persistence = 0.0f;
+  std::uint32_t repeat = 0;
+  float height = 0.0f;
+
+  // Mesh settings
+  float box_depth = 0.0f;
+  std::uint32_t solid_box = 1;
+
+  // Sculpting applied on top of the generated terrain
+  std::uint32_t edit_strokes = 0;
+  std::int32_t edit_bounds[4]{0, -1, 0, -1};  // i_min, i_max, j_min, j_max
+
+  // Bit flags below. Also pads the header so the tile directory after it is
+  // 8 byte aligned
+  std::uint32_t flags = 0;
+
+  // Set when terrain_model::m_use_2d_noise and m_layered were on, and when
+  // m_noise_basis was simplex
+  static constexpr std::uint32_t flag_noise_2d = 1;
+  static constexpr std::uint32_t flag_layered = 2;
+  static constexpr std::uint32_t flag_simplex = 4;
+  // Set for terrain_snapshot::save(..., true): heights are stored as their
+  // float bits instead of multiples of height_step, and each tile carries
+  // its samples' normals after them
+  static constexpr std::uint32_t flag_exact = 8;
+};
+
+/**
+ * \brief Where a tile's payload sits in the file.
+ */
+struct snapshot_tile {
+  std::uint64_t offset = 0;
+  std::uint32_t size = 0;
+  std::uint32_t reserved = 0;
+};
+
+/**
+ * \brief Binary snapshot of a terrain: the heightfield, the noise parameters
+ * and the edit history, so a sculpted terrain survives a restart.
+ *
+ * Heights are quantized to multiples of height_step and stored in square
+ * tiles. Within a tile every sample is predicted from its already decoded
+ * neighbours (left + up - up-left) and only the zigzag varint encoded
+ * difference is stored, which takes one or two bytes on smooth terrain.
+ * Tiles are independent, so a mapped snapshot can decode any tile on its own
+ * and restoring decodes all of them in parallel straight from the mapping.
+ *
+ * Exact snapshots, used by terrain_cache, predict the bit patterns of the
+ * heights instead, which round trips them losslessly in three to four bytes,
+ * and store the 12 byte normals as they were rather than recomputing them.
+ */
+class terrain_snapshot {
+ public:
+  // Samples along each side of a tile
+  static constexpr int tile_size = 64;
+  // Largest grid open accepts, 2^30 samples. Keeps the layout arithmetic on
+  // a header read from disk far from overflowing
+  static constexpr int max_grid_size = 1 << 15;
+  // Quantization step, heights round trip to within half of it
+  static constexpr float height_step = 1.0f / 1024.0f;
+
+  /**
+   * \brief Writes a snapshot of the model to path. An exact snapshot restores
+   * the heights and normals bit for bit.
+   */
+  static auto save(const std::string& path, const terrain_model& model,
+                   bool exact = false) -> bool;
+
+  /**
+   * \brief Maps the snapshot at path and checks its header and tile
+   * directory, including that the grid is at most max_grid_size and the edit
+   * bounds lie on it. No tile is decoded yet.
+   */
+  auto open(const std::string& path) -> bool;
+
+  [[nodiscard]] auto is_open() const -> bool { return m_file_.is_open(); }
+  [[nodiscard]] auto header() const -> const snapshot_header& {
+    return *m_header_;
+  }
+  [[nodiscard]] auto tile_count() const -> int;
+  [[nodiscard]] auto is_exact() const -> bool {
+    return (m_header_->flags & snapshot_header::flag_exact) != 0;
+  }
+
+  /**
+   * \brief Returns the samples covered by tile t.
+   */
+  [[nodiscard]] auto tile_rect(int t) const -> grid_rect;
+
+  /**
+   * \brief Decodes tile t into field, which must already have the snapshot's
+   * grid size, along with the normals of an exact snapshot. Returns false
+   * when the tile data is corrupt.
+   */
+  auto decode_tile(int t, heightfield& field) const -> bool;
+
+  /**
+   * \brief Decodes every tile into field, in parallel. field must already
+   * have the snapshot's grid size.
+   */
+  auto decode(heightfield& field) const -> bool;
+
+  /**
+   * \brief Applies the stored parameters to model and decodes every tile into
+   * its heightfield. Normals, unless the snapshot is exact, and the mesh are
+   * derived afterwards, like for terrain_model::create_terrain.
+   */
+  auto restore(terrain_model& model) const -> bool;
+
+ private:
+  mapped_file m_file_;
+  const snapshot_header* m_header_ = nullptr;
+  const snapshot_tile* m_tiles_ = nullptr;
+};
+
+#endif  // TERRAIN_SNAPSHOT_HPP
@@ -0,0 +1,158 @@
+#ifndef TERRAIN_TILE_MANAGER_HPP
+#define TERRAIN_TILE_MANAGER_HPP
+
+#include <glm/glm.hpp>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "cgra/cgra_mesh.hpp"
+#include "terrain/noise_tile_cache.hpp"
+#include "terrain/terrain_model.hpp"
+
+/**
+ * \brief Streams an unbounded terrain around the camera as a grid of square
+ * tiles. Tiles are generated on background threads from the same perlin
+ * noise as terrain_model, sampled in world space so neighbouring tiles share
+ * their edge samples exactly and meet without seams. The samples go through
+ * the terrain's noise tile cache, so overlapping tile borders, tiles that
+ * come back into view and the terrain model itself reuse them. Finished
+ * tiles are uploaded on the render thread a few per frame, and tiles far
+ * from the camera are evicted once the memory budget is exceeded.
+ */
+class terrain_tile_manager {
+ public:
+  int m_tile_cells = 64;     // cells along each side of a tile
+  int m_view_radius = 6;     // tiles kept around the camera in each direction
+  int m_uploads_per_frame = 4;
+  size_t m_memory_budget = size_t{256} << 20;  // bytes
+
+  terrain_tile_manager() = default;
+  ~terrain_tile_manager();
+
+  terrain_tile_manager(const terrain_tile_manager&) = delete;
+  terrain_tile_manager& operator=(const terrain_tile_manager&) = delete;
+
+  /**
+   * \brief Copies the noise and layout parameters from the given terrain,
+   * and its noise tile cache when the terrain uses one. Tiles generated with
+   * different parameters are discarded.
+   */
+  auto configure(const terrain_model& terrain) -> void;
+
+  /**
+   * \brief Requests the tiles around the camera, uploads finished tiles and
+   * evicts distant ones. Call once per frame from the render thread.
+   */
+  auto update(const glm::vec3& camera_pos) -> void;
+
+  /**
+   * \brief Draws every uploaded tile with the given terrain's shader setup.
+   */
+  auto draw(const terrain_model& style, const glm::mat4& view,
+            const glm::mat4& projection) const -> void;
+
+  /**
+   * \brief Destroys all tiles and drops any queued work.
+   */
+  auto clear() -> void;
+
+  [[nodiscard]] auto loaded_tiles() const -> size_t { return m_tiles_.size(); }
+  [[nodiscard]] auto pending_tiles() const -> size_t {
+    return m_requested_.size();
+  }
+  [[nodiscard]] auto memory_usage() const -> size_t { return m_memory_used_; }
+
+ private:
+  struct tile_key {
+    int x;
+    int z;
+
+    auto operator==(const tile_key& other) const -> bool {
+      return x == other.x && z == other.z;
+    }
+  };
+
+  struct tile_key_hash {
+    auto operator()(const tile_key& key) const -> size_t {
+      const auto packed =
+          (static_cast<unsigned long long>(static_cast<unsigned int>(key.x))
+           << 32) |
+          static_cast<unsigned int>(key.z);
+      return std::hash<unsigned long long>()(packed);
+    }
+  };
+
+  struct tile {
+    tile_key key{};
+    cgra::gl_mesh mesh;
+    size_t bytes = 0;
+  };
+
+  // A finished tile waiting to be uploaded by the render thread
+  struct generated_tile {
+    tile_key key{};
+    cgra::mesh_builder builder;
+  };
+
+  // Everything that decides the content of a tile, tiles generated with
+  // different settings are discarded
+  struct tile_settings {
+    unsigned int seed = 0;
+    unsigned int octaves = 5;
+    float lacunarity = 2.0f;
+    float persistence = 0.5f;
+    unsigned int repeat = 0;
+    float height = 200.0f;
+    bool noise_2d = false;
+    bool layered = false;
+    noise_basis basis = noise_basis::perlin;
+    float spacing = 5.0f;
+    float uv_scale = 0.05f;
+    int tile_cells = 64;
+
+    auto operator==(const tile_settings& other) const -> bool = default;
+  };
+
+  // Settings of one generation together with the noise built from them,
+  // shared between the workers
+  struct tile_source {
+    tile_settings settings;
+    std::shared_ptr<const noise_source> noise;
+    std::shared_ptr<noise_tile_cache> cache;  // null to evaluate every sample
+  };
+
+  std::unordered_map<tile_key, tile, tile_key_hash> m_tiles_;
+  std::unordered_set<tile_key, tile_key_hash> m_requested_;
+  size_t m_memory_used_ = 0;
+
+  // Shared with the workers, guarded by m_mutex_
+  std::mutex m_mutex_;
+  std::condition_variable m_work_available_;
+  std::deque<tile_key> m_queue_;
+  std::vector<generated_tile> m_finished_;
+  std::shared_ptr<const tile_source> m_source_;
+  unsigned int m_generation_ = 0;
+  bool m_stop_ = false;
+
+  std::vector<std::thread> m_workers_;
+
+  auto start_workers() -> void;
+  auto worker_loop() -> void;
+
+  [[nodiscard]] static auto generate_tile(const tile_source& source,
+                                          const tile_key& key)
+      -> cgra::mesh_builder;
+
+  [[nodiscard]] auto tile_distance(const tile_key& key,
+                                   const glm::vec3& camera_pos) const -> float;
+  [[nodiscard]] auto tile_bytes() const -> size_t;
+  auto evict(const glm::vec3& camera_pos) -> void;
+};
+
+#endif  // TERRAIN_TILE_MANAGER_HPP
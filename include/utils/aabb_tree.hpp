@@ -2,8 +2,10 @@
 #define AABB_TREE_HPP
 
 #include <glm/glm.hpp>
-#include <vector>
+#include <cfloat>
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 /// Code Author: Tessa Power
 ///
@@ -39,6 +41,12 @@ struct aabb {
 
         return tmax >= tmin && tmax >= 0;
     }
+
+    auto surface_area() const -> float {
+        glm::vec3 extent = max - min;
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z +
+                       extent.z * extent.x);
+    }
 };
 
 struct triangle {
@@ -46,32 +54,187 @@ struct triangle {
     unsigned int index;  // Original triangle index
 };
 
+/// The tree is stored flat: every node lives in one array in depth-first
+/// order, so the left child of an interior node is the node after it and
+/// only the right child is stored. Leaves refer to a range of one array of
+/// triangle indices.
 class aabb_tree {
 public:
+  // How build splits the triangles of a node
+  enum class build_method {
+    median,  // Halves at the median centroid along the longest axis
+    sah,     // Binned surface area heuristic, cheaper trees to query
+    lbvh,    // Karras' radix tree over the centroids sorted along a Morton
+             // curve, every node found on its own in one parallel pass. The
+             // fastest to build, for meshes rebuilt every edit
+  };
+
+  build_method method = build_method::sah;
+
+  // Threads build uses, 0 for one per hardware thread. The tree is the same
+  // for any number of threads
+  int threads = 0;
+
+  // How much refits may raise the SAH cost over the build's before
+  // needs_rebuild
+  float max_cost_growth = 1.25f;
+
   auto build(const std::vector<glm::vec3>& vertices,
              const std::vector<unsigned int>& indices) -> void;
 
+  // Moves the triangles to their new vertices, matched by index, and
+  // refits the bounds of their leaves and the nodes above them. Only the
+  // nodes whose bounds change are visited, so a local edit costs its
+  // triangles plus about a path to the root instead of a build
+  auto refit(const std::vector<triangle>& moved) -> void;
+
+  // Whether refits have grown the SAH cost past max_cost_growth times the
+  // build's, so queries gain from building the tree again
+  auto needs_rebuild() const -> bool {
+    return query_cost > max_cost_growth * built_cost;
+  }
+
   // Returns list of triangle indices that might intersect the ray
   auto query_ray(const glm::vec3& origin, const glm::vec3& direction) const
       -> std::vector<unsigned int>;
 
   auto get_triangles() const -> const std::vector<triangle>& { return triangles; }
 
+  auto node_count() const -> size_t { return nodes.size(); }
+
+  // Bytes held by the nodes, triangle indices and triangles, and the links
+  // refit walks up
+  auto memory_usage() const -> size_t {
+    return nodes.capacity() * sizeof(node) +
+           leaf_indices.capacity() * sizeof(unsigned int) +
+           triangles.capacity() * sizeof(triangle) +
+           (parents.capacity() + leaves.capacity()) * sizeof(unsigned int);
+  }
+
+  // Expected cost of a ray query by the surface area heuristic: the node
+  // visits and triangle tests of a ray through the root's bounds, each node
+  // weighted by the chance the ray hits it. Computed by build and kept up
+  // to date by refit
+  auto sah_cost() const -> float { return query_cost; }
+
+  // sah_cost right after the last build
+  auto built_sah_cost() const -> float { return built_cost; }
+
 private:
   struct node {
         aabb bounds;
-        std::unique_ptr<node> left;
-        std::unique_ptr<node> right;
-        std::vector<unsigned int> triangle_indices;  // Only populated in leaves
-        bool is_leaf;
+        unsigned int offset;  // Right child, or first of leaf_indices in leaves
+        unsigned int count;   // Triangles in leaves, 0 for interior nodes
   };
+  static_assert(sizeof(node) == 32, "two nodes per cache line");
+
+    // Bounds and centroid of a triangle, computed once per build. The
+    // builders partition these in place so every pass over a node reads
+    // memory in order, the leaves copy out the triangle indices at the end.
+    // Plain data, so the arrays are left uninitialised and first written by
+    // the threads that use them
+    struct primitive {
+        glm::vec3 min;
+        glm::vec3 max;
+        glm::vec3 centroid;
+        unsigned int index;
+
+        auto add_to(aabb& bounds) const -> void {
+            bounds.min = glm::min(bounds.min, min);
+            bounds.max = glm::max(bounds.max, max);
+        }
+    };
+
+    // Bounds query_ray's stack, the builders stop before it
+    static constexpr int max_depth = 64;
+
+    // Surface area heuristic: centroid bins per axis, the cost of visiting
+    // a node relative to testing a triangle, and the largest leaf made
+    // when splitting costs more
+    static constexpr int sah_bins = 16;
+    static constexpr float traversal_cost = 1.0f;
+    static constexpr float intersection_cost = 1.0f;
+    static constexpr unsigned int max_leaf_size = 8;
+
+    // LBVH: triangles per leaf, and the most triangles sorted by 30-bit
+    // Morton codes before longer ones. A surface only fills about 2^20 of
+    // the 2^30 cells of 30-bit codes, so more triangles start sharing them
+    static constexpr unsigned int lbvh_leaf_size = 4;
+    static constexpr unsigned int morton_30_bit_limit = 1u << 18;
+
+    // Fewest triangles a thread works on, in a pass over a node or in a
+    // subtree built as a task of its own
+    static constexpr unsigned int min_parallel_count = 16384;
+
+    // What the builders share during a build
+    struct build_state {
+        std::unique_ptr<primitive[]> prims;
+        std::unique_ptr<primitive[]> scratch;  // For SAH and LBVH
+        // Sorted Morton codes of the LBVH, with the triangle index below
+        std::unique_ptr<std::uint64_t[]> codes;
+        unsigned int count = 0;
+        int workers = 1;
+
+        // Whether the top of the tree is split across the workers
+        [[nodiscard]] auto parallel() const -> bool {
+            return workers > 1 && count >= 2 * min_parallel_count;
+        }
+    };
+
+    // Bounds of a node, and the size of its first half once split. 0 when
+    // the node is a leaf
+    struct split {
+        aabb bounds;
+        unsigned int mid = 0;
+    };
 
-    std::unique_ptr<node> root;
+    std::vector<node> nodes;
+    std::vector<unsigned int> leaf_indices;
     std::vector<triangle> triangles;
-
-    auto build_recursive(std::vector<unsigned int>& tri_indices, int depth) -> std::unique_ptr<node>;
-    auto query_recursive(const node* node, const glm::vec3& origin,
-        const glm::vec3& dir_inv, std::vector<unsigned int>& results) const -> void;
+    std::vector<unsigned int> parents;  // Per node, the root's is 0
+    std::vector<unsigned int> leaves;   // Per triangle, the leaf holding it
+    // Sum of node_cost over the nodes, query_cost before dividing by the
+    // root's area
+    double weighted_area = 0.0;
+    float query_cost = 0.0f;
+    float built_cost = 0.0f;
+
+    // A node's share of the SAH cost, times the root's surface area
+    static auto node_cost(const node& node) -> double;
+    // Sets query_cost from weighted_area and the root's bounds
+    auto update_sah_cost() -> void;
+    // Fills parents and leaves for refit
+    auto link_nodes(int workers) -> void;
+    // Nodes the median builder creates for count triangles at depth
+    static auto count_nodes(size_t count, int depth) -> size_t;
+
+    // Decides how to split state.prims[first, first + count) and partitions
+    // it, with the passes over it spread over blocks threads
+    auto split_node(build_state& state, unsigned int first,
+        unsigned int count, int depth, int blocks) -> split;
+    auto split_median(build_state& state, unsigned int first,
+        unsigned int count, int depth, int blocks) -> split;
+    auto split_sah(build_state& state, unsigned int first,
+        unsigned int count, int depth, int blocks) -> split;
+    // Sorts state.prims by the Morton codes of their centroids into
+    // state.codes
+    auto sort_morton(build_state& state) -> void;
+    // Builds nodes from the sorted state.codes bottom-up, without splitting
+    // ranges from the root down
+    auto build_lbvh(build_state& state) -> void;
+
+    // Appends the subtree of state.prims[first, first + count) to out on the
+    // calling thread. Right children are relative to the start of out
+    auto build_subtree(build_state& state, std::vector<node>& out,
+        unsigned int first, unsigned int count, int depth) -> void;
+    // Splits the large nodes at the top with every thread on each pass, then
+    // builds the subtrees below them as tasks and joins them depth-first into
+    // nodes, allocated once at its exact size. A serial build is one task
+    auto build_tasks(build_state& state) -> void;
+    // Sets out[at] to a leaf over state.prims[first, first + count)
+    auto make_leaf(const build_state& state, std::vector<node>& out,
+        unsigned int at, unsigned int first, unsigned int count)
+        -> unsigned int;
 };
 
 #endif // AABB_TREE_HPP
@@ -5,8 +5,6 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <terrain/terrain_model.hpp>
 
-#include "intersections.hpp"
-
 /// Code Author: Tessa Power
 ///
 /// Created with the help of the Camera tutorial from:
@@ -85,7 +83,24 @@ class camera {
   auto update(const float delta_time, const terrain_model& model) noexcept
       -> void {
     m_delta_time_ = delta_time;
-    update_position(model);
+    update_position(&model);
+  }
+
+  /**
+   * \brief Updates the camera given the given time since the last frame,
+   * without checking for collisions (e.g. over streamed terrain).
+   * \param delta_time The time since the last frame.
+   */
+  auto update(const float delta_time) noexcept -> void {
+    m_delta_time_ = delta_time;
+    update_position(nullptr);
+  }
+
+  /**
+   * \brief Returns the camera's position.
+   */
+  [[nodiscard]] auto position() const noexcept -> const glm::vec3& {
+    return m_position_;
   }
 
   /**
@@ -136,9 +151,9 @@ class camera {
   /**
    * \brief Updates the position of the camera, taking into account the terrain
    * model to avoid collisions. \param model The terrain model being used in the
-   * application.
+   * application, or nullptr to move freely.
    */
-  auto update_position(const terrain_model& model) -> void {
+  auto update_position(const terrain_model* model) -> void {
     const float speed = m_speed_ * m_delta_time_;
     glm::vec3 delta{};
 
@@ -169,7 +184,7 @@ class camera {
     // If it is colliding, reduce the speed to the default speed, otherwise move
     // like normal
     if (m_current_direction_ != rest) {
-      if (!does_collide(m_position_ + delta, model, delta)) {
+      if (model == nullptr || !does_collide(m_position_ + delta, *model)) {
         m_position_ += delta;
         m_speed_ = glm::min(m_max_speed_, m_speed_ + m_acceleration_);
       } else {  // Reset the speed to default speed if the camera has collided
@@ -183,32 +198,18 @@ class camera {
    * \brief Returns whether the camera will collide with the terrain if it moves
    * to the given new position. \param new_pos The new position of the camera.
    * \param model The terrain model being used in the application.
-   * \param direction The direction vector of the camera's movement.
    */
-  [[nodiscard]] auto does_collide(const glm::vec3& new_pos,
-                                  const terrain_model& model,
-                                  const glm::vec3& direction) const noexcept
+  [[nodiscard]] static auto does_collide(const glm::vec3& new_pos,
+                                         const terrain_model& model) noexcept
       -> bool {
-    // Iterate through the model's mesh vertices and test for intersection
-    const auto size = model.m_builder.m_vertices.size();
-    for (size_t i = 0; i < size; ++i) {
-      const cgra::mesh_vertex v = model.m_builder.m_vertices[i];
-
-      // Check if this vertex is within a reasonable distance of the new
-      // position to avoid unnecessary calculations
-      const auto x = new_pos.x - v.pos.x;
-      const auto y = new_pos.y - v.pos.y;
-      const auto z = new_pos.z - v.pos.z;
-      const auto distance_sq = x * x + y * y + z * z;
-      if (distance_sq > m_speed_) continue;
-
-      // Check if the ray intersects with the vertex
-      if (ray_intersects_vertex(m_position_, direction, static_cast<int>(i),
-                                model) && new_pos.y <= v.pos.y)
-        return true;
+    // Only the terrain footprint is solid, the camera can fly around it
+    const heightfield& field = model.m_heightfield;
+    if (field.sample_count() == 0 || !field.contains(new_pos.x, new_pos.z)) {
+      return false;
     }
 
-    return false;
+    // Colliding if the new position is at or below the surface beneath it
+    return new_pos.y <= field.sample(new_pos.x, new_pos.z);
   }
 };
 
@@ -52,36 +52,6 @@ inline auto ray_intersects_triangle(const glm::vec3& ray_origin,
   return t > epsilon;
 }
 
-/**
- * \brief Returns whether the ray starting from the given origin and going in
- * the given direction intersects with the vertex found at given index on the
- * given model.
- */
-inline auto ray_intersects_vertex(const glm::vec3& ray_origin,
-                                  const glm::vec3& ray_direction,
-                                  const int vertex_idx,
-                                  const terrain_model& model) -> bool
-{
-  // Iterate through the adjacent faces of the vertex
-  for (size_t i = 0; i < model.m_adjacent_faces[vertex_idx].size(); i += 3) {
-    // Get the vertices of the triangle formed by the current adjacent faces
-    const glm::vec3& v0 =
-        model.m_builder.m_vertices[model.m_adjacent_faces[vertex_idx][i]].pos;
-    const glm::vec3& v1 =
-        model.m_builder.m_vertices[model.m_adjacent_faces[vertex_idx][i + 1]]
-            .pos;
-    const glm::vec3& v2 =
-        model.m_builder.m_vertices[model.m_adjacent_faces[vertex_idx][i + 2]]
-            .pos;
-
-    // Check if the ray intersects with the triangle
-    if (ray_intersects_triangle(ray_origin, ray_direction, v0, v1, v2))
-      return true;
-  }
-
-  return false; // No intersection
-}
-
 /**
  * \brief Fast ray-mesh intersection using AABB tree acceleration.
  * Returns the closest hit and the vertex from the terrain model.
@@ -125,24 +95,11 @@ inline auto ray_intersects_mesh_fast(const glm::vec3& ray_origin,
   }
 
   if (found_hit) {
-    // Calculate the number of top face vertices
-    const size_t top_vertices_count = (model.m_grid_size + 1) * (model.m_grid_size + 1);
-    
-    // Find the closest vertex in the TOP FACE ONLY to the hit point
-    float min_dist = std::numeric_limits<float>::max();
-    int closest_vertex_idx = 0;
-
-    // Only search through top face vertices
-    for (size_t i = 0; i < top_vertices_count; ++i) {
-      float dist =
-          glm::length(model.m_builder.m_vertices[i].pos - closest_hit_point);
-      if (dist < min_dist) {
-        min_dist = dist;
-        closest_vertex_idx = i;
-      }
-    }
+    // The closest top face vertex is the nearest sample of the heightfield
+    const glm::ivec2 closest = model.m_heightfield.nearest_sample(
+        closest_hit_point.x, closest_hit_point.z);
 
-    hit_vertex = model.m_builder.m_vertices[closest_vertex_idx];
+    hit_vertex = model.m_heightfield.vertex(closest.x, closest.y);
     return true;
   }
 
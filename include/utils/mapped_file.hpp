@@ -0,0 +1,44 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <cstddef>
+#include <string>
+
+/**
+ * \brief A whole file mapped read-only into memory. Pages are only read from
+ * disk when they are first touched, so parts of a large file that are never
+ * looked at cost nothing.
+ */
+class mapped_file {
+ public:
+  mapped_file() = default;
+  explicit mapped_file(const std::string& path) { open(path); }
+  ~mapped_file() { close(); }
+
+  mapped_file(const mapped_file&) = delete;
+  auto operator=(const mapped_file&) -> mapped_file& = delete;
+  mapped_file(mapped_file&& other) noexcept;
+  auto operator=(mapped_file&& other) noexcept -> mapped_file&;
+
+  /**
+   * \brief Maps the file at path, closing any previous mapping. Returns false
+   * when the file cannot be opened or is empty.
+   */
+  auto open(const std::string& path) -> bool;
+
+  auto close() -> void;
+
+  [[nodiscard]] auto is_open() const -> bool { return m_data_ != nullptr; }
+  [[nodiscard]] auto data() const -> const std::byte* { return m_data_; }
+  [[nodiscard]] auto size() const -> size_t { return m_size_; }
+
+ private:
+  const std::byte* m_data_ = nullptr;
+  size_t m_size_ = 0;
+#ifdef _WIN32
+  void* m_file_handle_ = nullptr;
+  void* m_mapping_handle_ = nullptr;
+#endif
+};
+
+#endif  // MAPPED_FILE_HPP
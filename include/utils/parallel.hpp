@@ -0,0 +1,97 @@
+#ifndef PARALLEL_HPP
+#define PARALLEL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/// Helpers for splitting index ranges across worker threads.
+
+/**
+ * \brief Splits [begin, end) into contiguous blocks and calls
+ * fn(block_begin, block_end) once per block, each block on its own thread.
+ * Blocks are never smaller than min_block indices, so small ranges simply run
+ * on the calling thread. Every block must write to disjoint memory; when it
+ * does, the result does not depend on how many threads were used. At most
+ * max_threads blocks are used, 0 for one per hardware thread.
+ */
+template <typename Fn>
+auto parallel_for_blocks(const int begin, const int end, Fn&& fn,
+                         const int min_block = 1, const int max_threads = 0)
+    -> void {
+  const int count = end - begin;
+  if (count <= 0) return;
+
+  const int hardware_threads =
+      max_threads > 0
+          ? max_threads
+          : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int num_blocks =
+      std::clamp(count / std::max(1, min_block), 1, hardware_threads);
+
+  if (num_blocks == 1) {
+    fn(begin, end);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_blocks - 1);
+
+  const int block_size = count / num_blocks;
+  const int remainder = count % num_blocks;
+
+  int block_begin = begin;
+  for (auto b = 0; b < num_blocks; ++b) {
+    const int block_end = block_begin + block_size + (b < remainder ? 1 : 0);
+
+    // The calling thread takes the last block instead of idling in join()
+    if (b == num_blocks - 1) {
+      fn(block_begin, block_end);
+    } else {
+      threads.emplace_back(
+          [&fn, block_begin, block_end]() { fn(block_begin, block_end); });
+    }
+
+    block_begin = block_end;
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+/**
+ * \brief Calls fn(i) for every i in [begin, end) on up to max_threads threads,
+ * 0 for one per hardware thread. The indices are handed out in order, one at
+ * a time, to whichever thread is free, so items of uneven cost keep every
+ * thread busy. Put the most expensive items first.
+ */
+template <typename Fn>
+auto parallel_for_dynamic(const int begin, const int end, Fn&& fn,
+                          const int max_threads = 0) -> void {
+  const int count = end - begin;
+  if (count <= 0) return;
+
+  const int hardware_threads =
+      max_threads > 0
+          ? max_threads
+          : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  const int num_threads = std::min(count, hardware_threads);
+
+  std::atomic<int> next{begin};
+  const auto work = [&fn, &next, end]() {
+    for (int i = next++; i < end; i = next++) fn(i);
+  };
+
+  std::vector<std::thread> threads;
+  threads.reserve(num_threads - 1);
+  for (auto t = 1; t < num_threads; ++t) threads.emplace_back(work);
+  work();
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+#endif  // PARALLEL_HPP
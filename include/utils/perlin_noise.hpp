@@ -1,36 +1,231 @@
 #ifndef PERLIN_NOISE_HPP
 #define PERLIN_NOISE_HPP
 
+#include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <vector>
 
+#include "utils/perlin_simd.hpp"
+
 class perlin {
  public:
-  // initialize with set or seeded permutation vector
+  // World units per noise lattice cell at the first octave
+  static constexpr float feature_size = 200.0f;
+
+  // initialize with set or seeded permutation vector. basis picks the lattice
+  // noise behind every generate function, both hash their corners with the
+  // seeded permutation, simplex through a key drawn from it
   perlin(unsigned int seed, unsigned int octaves, float lacunarity,
-         float persistence, unsigned int repeat);
+         float persistence, unsigned int repeat,
+         noise_basis basis = noise_basis::perlin);
 
   [[nodiscard]] auto generate_perlin(float x, float y, float z) const -> float;
 
+  /**
+   * \brief Writes generate_perlin(x[k], 0, z[k]) to out[k] for every k < n,
+   * evaluating 4, 8 or 16 points at once with the instruction set returned by
+   * simd_level(). Points left over at the end, and every point when repeat is
+   * set, go through the scalar path. The kernels do the same float
+   * operations in the same order as generate_perlin, so results are
+   * identical.
+   */
+  auto generate_perlin_batch(const float* x, const float* z, float* out,
+                             size_t n) const -> void;
+
+  /**
+   * \brief generate_perlin_batch at (x[k], y[k], z[k]), for volumes such as
+   * the clouds. Same instruction sets and the same results as
+   * generate_perlin.
+   */
+  auto generate_perlin_volume_batch(const float* x, const float* y,
+                                    const float* z, float* out, size_t n) const
+      -> void;
+
+  /**
+   * \brief Fractal 2D gradient noise at (x, z), in [0, 1] like
+   * generate_perlin. Each octave interpolates the four corners of a unit
+   * square instead of the eight of a cube, with the gradients the 3D noise
+   * has on the y = 0 plane, so heightfields keep the same character at about
+   * half the cost of generate_perlin(x, 0, z). The pattern itself differs.
+   */
+  [[nodiscard]] auto generate_perlin_2d(float x, float z) const -> float;
+
+  /**
+   * \brief generate_perlin_batch for generate_perlin_2d.
+   */
+  auto generate_perlin_2d_batch(const float* x, const float* z, float* out,
+                                size_t n) const -> void;
+
+  /**
+   * \brief generate_perlin_batch that also writes the derivatives of each
+   * value along x and z to dx[k] and dz[k], differentiated analytically
+   * through every octave, on the same instruction sets. The values are
+   * identical to generate_perlin_batch.
+   */
+  auto generate_perlin_gradient_batch(const float* x, const float* z,
+                                      float* out, float* dx, float* dz,
+                                      size_t n) const -> void;
+
+  /**
+   * \brief generate_perlin_gradient_batch for generate_perlin_2d.
+   */
+  auto generate_perlin_2d_gradient_batch(const float* x, const float* z,
+                                         float* out, float* dx, float* dz,
+                                         size_t n) const -> void;
+
+  /**
+   * \brief Instruction set used by generate_perlin_batch, the fastest one the
+   * CPU supports unless lowered with set_simd_level.
+   */
+  [[nodiscard]] static auto simd_level() -> perlin_simd;
+
+  /**
+   * \brief Selects the instruction set for generate_perlin_batch, clamped to
+   * what the CPU supports.
+   */
+  static auto set_simd_level(perlin_simd level) -> void;
+
+  [[nodiscard]] static auto simd_name(perlin_simd level) -> const char*;
+
+  [[nodiscard]] static auto basis_name(noise_basis basis) -> const char*;
+
+  [[nodiscard]] auto basis() const -> noise_basis { return m_basis_; }
+
  private:
+  // Instantiation of fractal for octave counts above this one loops over
+  // m_octaves_ at runtime
+  static constexpr unsigned int max_unrolled_octaves = 10;
+  static constexpr unsigned int dynamic_octaves = 0;
+
+  // Fractal noise specialized for one configuration: a point, a row of
+  // points at y = 0, the same row with derivatives and a row of points
+  // anywhere
+  struct fractal_kernels {
+    float (perlin::*point)(float x, float y, float z) const;
+    void (perlin::*span)(const float* x, const float* z, float* out,
+                         size_t n) const;
+    void (perlin::*gradient_span)(const float* x, const float* z, float* out,
+                                  float* dx, float* dz, size_t n) const;
+    void (perlin::*volume_span)(const float* x, const float* y, const float* z,
+                                float* out, size_t n) const;
+  };
+
   std::vector<int> m_p_;
+  // the permutation mixed into the simplex corner hashes, see simplex_hash
+  std::uint32_t m_simplex_key_ = 0;
 
   unsigned int m_repeat_;
+  noise_basis m_basis_;
 
   // octave params
   unsigned int m_octaves_;
   float m_lacunarity_;
   float m_persistence_;
 
+  // per octave frequency and amplitude, and their normalization
+  std::vector<float> m_frequency_;
+  std::vector<float> m_amplitude_;
+  float m_max_value_ = 0.0f;
+
+  // picked for the octave count and repeat in the constructor
+  fractal_kernels m_kernels_3d_{};
+  fractal_kernels m_kernels_2d_{};
+
+  template <noise_basis Basis>
+  auto select_kernels() -> void;
+
+  template <bool Repeat, bool Planar, noise_basis Basis>
+  static auto kernels_for(unsigned int octaves) -> fractal_kernels;
+
+  // Planar selects noise_2d or simplex_2d, which ignore y
+  template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+  auto fractal(float x, float y, float z) const -> float;
+
+  template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+  auto fractal_span(const float* x, const float* z, float* out,
+                    size_t n) const -> void;
+
+  template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+  auto fractal_volume_span(const float* x, const float* y, const float* z,
+                           float* out, size_t n) const -> void;
+
+  template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+  auto fractal_gradient_span(const float* x, const float* z, float* out,
+                             float* dx, float* dz, size_t n) const -> void;
+
+  // One coordinate of a point of noise_cached: its lattice cell, the offset
+  // into it and the fade of that. at is the unscaled coordinate it was
+  // computed from, so a coordinate shared with the previous point is reused
+  struct lattice_axis {
+    float at = std::numeric_limits<float>::quiet_NaN();
+    int cell = 0;
+    float offset = 0.0f;
+    float fade = 0.0f;
+  };
+
+  // Gradients of the 8 corners of the lattice cube last evaluated in
+  struct lattice_cell {
+    int xi = -1;
+    int yi = -1;
+    int zi = -1;
+    float gx[8] = {};
+    float gy[8] = {};
+    float gz[8] = {};
+  };
+
+  template <bool Repeat>
   [[nodiscard]] auto noise(float x, float y, float z) const -> float;
 
+  // Scales coordinate at by frequency into axis, unless it already holds it
+  template <bool Repeat>
+  auto update_axis(float at, float frequency, lattice_axis& axis) const
+      -> void;
+
+  // noise for a volume walked one octave at a time: the corners are hashed
+  // only when the point leaves the cube of the previous one, with the
+  // gradients from tables, which only pays off when they are reused
+  [[nodiscard]] auto noise_cached(const lattice_axis& x, const lattice_axis& y,
+                                  const lattice_axis& z,
+                                  lattice_cell& cell) const -> float;
+
+  // noise at y = 0 or noise_2d, with its derivatives along x and z
+  template <bool Repeat, bool Planar>
+  auto noise_gradient(float x, float z, float& dx, float& dz) const -> float;
+
+  template <bool Repeat>
+  [[nodiscard]] auto noise_2d(float x, float z) const -> float;
+
+  // Simplex noise with the gradients of grad and grad_2d, scaled to about
+  // the range of noise
+  template <bool Repeat>
+  [[nodiscard]] auto simplex(float x, float y, float z) const -> float;
+
+  template <bool Repeat>
+  [[nodiscard]] auto simplex_2d(float x, float z) const -> float;
+
+  // simplex at y = 0 or simplex_2d, with its derivatives along x and z
+  template <bool Repeat, bool Planar>
+  auto simplex_gradient(float x, float z, float& dx, float& dz) const
+      -> float;
+
+  // shared by generate_perlin_batch and generate_perlin_2d_batch
+  auto batch(const fractal_kernels& kernels, bool planar, const float* x,
+             const float* z, float* out, size_t n) const -> void;
+  auto gradient_batch(const fractal_kernels& kernels, bool planar,
+                      const float* x, const float* z, float* out, float* dx,
+                      float* dz, size_t n) const -> void;
+
   // smooth transition between gradients with ease curve
   static auto fade(float t) -> float;
+  static auto fade_derivative(float t) -> float;
 
   // linearly interpolate between a and b
   // weight w should be a float between 0 and 1
   static auto lerp(float a, float b, float w) -> float;
 
   static auto grad(int hash, float x, float y, float z) -> float;
+  static auto grad_2d(int hash, float x, float z) -> float;
 
   // increment number to ensure repetition
   [[nodiscard]] auto inc(int num) const -> int;
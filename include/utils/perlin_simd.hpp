@@ -0,0 +1,160 @@
+#ifndef PERLIN_SIMD_HPP
+#define PERLIN_SIMD_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/// Vectorized kernels behind perlin::generate_perlin_batch. Each kernel is
+/// compiled for its instruction set only and is picked at runtime, so the
+/// binary still runs on CPUs without it.
+
+/**
+ * \brief Instruction sets generate_perlin_batch can run on, from slowest to
+ * fastest.
+ */
+enum class perlin_simd { scalar, sse41, avx2, avx512 };
+
+/**
+ * \brief Lattice noise summed by the fractal: Perlin's gradient noise over
+ * cubes (squares in 2D), or simplex noise over the tetrahedra (triangles) of
+ * a skewed lattice, 4 corners in 3D and 3 in 2D instead of 8 and 4.
+ */
+enum class noise_basis { perlin, simplex };
+
+namespace perlin_kernels {
+/**
+ * \brief Everything a kernel needs from a perlin instance.
+ */
+struct fractal_params {
+  const int* permutation = nullptr;  // 512 entries
+  unsigned int octaves = 0;
+  float lacunarity = 0.0f;
+  float persistence = 0.0f;
+  bool planar = false;  // perlin::noise_2d instead of perlin::noise at y = 0
+  noise_basis basis = noise_basis::perlin;
+};
+
+// Skew factors from the cube lattice to the simplex lattice and back, the
+// squared radius of a corner's contribution and the scale of the sum of the
+// corners, whose gradients are those of perlin::grad doubled. The scales give
+// simplex noise the standard deviation of Perlin's (0.27 in 3D, 0.24 in 2D),
+// so switching the basis keeps the relief of a terrain and the cover of the
+// clouds. Shared by the scalar and vector simplex noise so both compute the
+// same values
+inline constexpr float simplex_skew_3d = 1.0f / 3.0f;
+inline constexpr float simplex_unskew_3d = 1.0f / 6.0f;
+inline constexpr float simplex_skew_2d = 0.36602540378f;    // (sqrt(3) - 1) / 2
+inline constexpr float simplex_unskew_2d = 0.21132486540f;  // (3 - sqrt(3)) / 6
+inline constexpr float simplex_radius = 0.5f;
+inline constexpr float simplex_scale_3d = 26.5f;
+inline constexpr float simplex_scale_2d = 20.0f;
+
+// Simplex noise hashes its corners with arithmetic instead of the
+// permutation, which the vector kernels could only read with gathers. The
+// lattice coordinates are packed 10 bits apart and multiplied by
+// simplex_mix_1, so the input of a corner is that of its cell plus
+// simplex_cell(i, j, k) of its offset, and a key drawn from the permutation
+// is added so the seed still shuffles the gradients. simplex_hash mixes the
+// input and its top 4 bits pick one of the 16 of perlin::grad
+inline constexpr int simplex_y_shift = 10;
+inline constexpr int simplex_z_shift = 20;
+inline constexpr std::uint32_t simplex_mix_1 = 0x9E3779B1u;
+inline constexpr std::uint32_t simplex_mix_2 = 0x85EBCA77u;
+
+inline constexpr auto simplex_cell(const int x, const int y, const int z)
+    -> std::uint32_t {
+  const auto packed = static_cast<std::uint32_t>(x) +
+                      (static_cast<std::uint32_t>(y) << simplex_y_shift) +
+                      (static_cast<std::uint32_t>(z) << simplex_z_shift);
+  return packed * simplex_mix_1;
+}
+
+inline auto simplex_key(const int* permutation) -> std::uint32_t {
+  return static_cast<std::uint32_t>(permutation[0] | permutation[1] << 8 |
+                                    permutation[2] << 16 |
+                                    permutation[3] << 24);
+}
+
+inline constexpr auto simplex_hash(const std::uint32_t corner) -> int {
+  const std::uint32_t h = corner ^ corner >> 15;
+  return static_cast<int>((h * simplex_mix_2) >> 28);
+}
+
+// The offsets of the second and third corners of a simplex from the first,
+// and the simplex_cell of their steps, by the order of the offsets x0, y0
+// and z0 of a point from the first corner: bit 0 is set for x0 >= y0, bit 1
+// for x0 >= z0 and bit 2 for y0 >= z0. The second corner adds the unskew to
+// every offset and steps along the largest, subtracting 1 from it, the third
+// adds twice the unskew and steps along the two largest. Orders 2 and 5
+// cannot occur. Looking the corners up keeps the order, which is random, off
+// branches, and the AVX2 kernels permute the tables by the order of a lane
+inline constexpr float simplex_stay_1 = simplex_unskew_3d;
+inline constexpr float simplex_step_1 = simplex_unskew_3d - 1.0f;
+inline constexpr float simplex_stay_2 = 2.0f * simplex_unskew_3d;
+inline constexpr float simplex_step_2 = 2.0f * simplex_unskew_3d - 1.0f;
+alignas(32) inline constexpr float simplex_x1[8] = {
+    simplex_stay_1, simplex_stay_1, simplex_stay_1, simplex_step_1,
+    simplex_stay_1, simplex_stay_1, simplex_stay_1, simplex_step_1};
+alignas(32) inline constexpr float simplex_y1[8] = {
+    simplex_stay_1, simplex_stay_1, simplex_stay_1, simplex_stay_1,
+    simplex_step_1, simplex_stay_1, simplex_step_1, simplex_stay_1};
+alignas(32) inline constexpr float simplex_z1[8] = {
+    simplex_step_1, simplex_step_1, simplex_stay_1, simplex_stay_1,
+    simplex_stay_1, simplex_stay_1, simplex_stay_1, simplex_stay_1};
+alignas(32) inline constexpr std::uint32_t simplex_cell_1[8] = {
+    simplex_cell(0, 0, 1), simplex_cell(0, 0, 1),
+    simplex_cell(0, 0, 0), simplex_cell(1, 0, 0),
+    simplex_cell(0, 1, 0), simplex_cell(0, 0, 0),
+    simplex_cell(0, 1, 0), simplex_cell(1, 0, 0)};
+alignas(32) inline constexpr float simplex_x2[8] = {
+    simplex_stay_2, simplex_step_2, simplex_step_2, simplex_step_2,
+    simplex_stay_2, simplex_step_2, simplex_step_2, simplex_step_2};
+alignas(32) inline constexpr float simplex_y2[8] = {
+    simplex_step_2, simplex_stay_2, simplex_step_2, simplex_stay_2,
+    simplex_step_2, simplex_step_2, simplex_step_2, simplex_step_2};
+alignas(32) inline constexpr float simplex_z2[8] = {
+    simplex_step_2, simplex_step_2, simplex_step_2, simplex_step_2,
+    simplex_step_2, simplex_step_2, simplex_stay_2, simplex_stay_2};
+alignas(32) inline constexpr std::uint32_t simplex_cell_2[8] = {
+    simplex_cell(0, 1, 1), simplex_cell(1, 0, 1),
+    simplex_cell(1, 1, 1), simplex_cell(1, 0, 1),
+    simplex_cell(0, 1, 1), simplex_cell(1, 1, 1),
+    simplex_cell(1, 1, 0), simplex_cell(1, 1, 0)};
+
+/**
+ * \brief Returns the fastest instruction set supported by the CPU and OS.
+ */
+auto detect() -> perlin_simd;
+
+/**
+ * \brief Returns how many points the kernel for level evaluates at once.
+ */
+auto lanes(perlin_simd level) -> size_t;
+
+/**
+ * \brief Evaluates the fractal noise at (x[k], 0, z[k]), or the 2D noise at
+ * (x[k], z[k]) when params.planar is set, into out[k] for the first
+ * n - n % lanes(level) points, returning how many were written. The rest is
+ * left for the scalar path.
+ */
+auto fractal(perlin_simd level, const fractal_params& params, const float* x,
+             const float* z, float* out, size_t n) -> size_t;
+
+/**
+ * \brief fractal at (x[k], y[k], z[k]), the full 3D noise for volumes.
+ * params.planar is ignored.
+ */
+auto fractal_volume(perlin_simd level, const fractal_params& params,
+                    const float* x, const float* y, const float* z,
+                    float* out, size_t n) -> size_t;
+
+/**
+ * \brief fractal that also writes the derivatives of out[k] along x and z to
+ * dx[k] and dz[k].
+ */
+auto fractal_gradient(perlin_simd level, const fractal_params& params,
+                      const float* x, const float* z, float* out, float* dx,
+                      float* dz, size_t n) -> size_t;
+}  // namespace perlin_kernels
+
+#endif  // PERLIN_SIMD_HPP
@@ -14,12 +14,23 @@ uniform float uHeightScale;
 uniform sampler2D uLeavesHeight;
 uniform int uType;
 
+// packed terrain vertices (see packed_vertex.hpp)
+uniform int uPacked;
+uniform vec2 uGridOrigin;
+uniform float uGridSpacing;
+uniform float uGridSize;
+uniform vec2 uHeightQuantization; // minimum height, height per step
+uniform vec2 uUvOffset;
+uniform float uUvScale;
+
 // mesh data
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aTexCoord;
 layout(location = 3) in vec3 aTangent;
 layout(location = 4) in vec3 aBitangent;
+layout(location = 5) in uvec4 aPackedSample; // i, j, height, kind
+layout(location = 6) in ivec2 aPackedNormal; // octahedral normal
 
 // model data (this must match the input of the vertex shader)
 out VertexData {
@@ -32,40 +43,86 @@ out VertexData {
     vec3 worldNormal;  // World-space normal for side detection
 } v_out;
 
+vec3 octDecode(ivec2 e) {
+    vec2 p = clamp(vec2(e) / 32767.0, -1.0, 1.0);
+    vec3 n = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    float t = max(-n.y, 0.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.z += n.z >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
 void main() {
-    vec3 new_position = aPosition;
+    vec3 position = aPosition;
+    vec3 normal = aNormal;
+    vec2 texCoord = aTexCoord;
+    vec3 tangent = aTangent;
+    vec3 bitangent = aBitangent;
+
+    // Rebuild the full vertex from its grid sample, same as unpack_vertex
+    if (uPacked == 1) {
+        vec2 ij = vec2(aPackedSample.xy);
+        uint kind = aPackedSample.w;
+        position = vec3(uGridOrigin.x + ij.x * uGridSpacing,
+                        uHeightQuantization.x + float(aPackedSample.z) * uHeightQuantization.y,
+                        uGridOrigin.y + ij.y * uGridSpacing);
+        normal = octDecode(aPackedNormal);
+
+        if (kind == 1u || kind == 2u) {
+            texCoord = vec2((abs(normal.x) > 0.5 ? ij.y : ij.x) / uGridSize,
+                            kind == 1u ? 0.0 : 1.0);
+        } else if (kind == 3u) {
+            texCoord = ij / uGridSize;
+        } else {
+            texCoord = (uUvOffset + ij) * uUvScale;
+        }
+
+        tangent = vec3(0.0);
+        bitangent = vec3(0.0);
+        if (kind == 4u) {
+            if (normal.y > 0.0001) {
+                tangent = normalize(vec3(1.0, -normal.x / normal.y, 0.0));
+                bitangent = normalize(vec3(0.0, -normal.z / normal.y, 1.0));
+            } else {
+                tangent = vec3(1.0, 0.0, 0.0);
+                bitangent = vec3(0.0, 0.0, 1.0);
+            }
+        }
+    }
+
+    vec3 new_position = position;
 
     // if terrain mesh
     if (uType != -1) { 
         // Sample the heightmap texture to get the height value
-        float y = aPosition[1];
+        float y = position[1];
         float height = 0.0f;
         if (uType == 1) {
-            height = texture(uLeavesHeight, aTexCoord).r;
+            height = texture(uLeavesHeight, texCoord).r;
         } else if (y > uHeightChange1) {
-            height = texture(uHeightTexture1, aTexCoord).r;
+            height = texture(uHeightTexture1, texCoord).r;
         } else if (y > uHeightChange2) {
-            height = texture(uHeightTexture2, aTexCoord).r;
+            height = texture(uHeightTexture2, texCoord).r;
         } else {
-            height = texture(uHeightTexture3, aTexCoord).r;
+            height = texture(uHeightTexture3, texCoord).r;
         }
 
         height = (height * 2.0f) - 1.0f; // range -1 to 1
         if (uType == 1) height /= 5.0f;
         if (uType == 2) height = 0.0f;
         // Adjust the position based on the height and terrain scale, using the normal direction
-        new_position = aPosition + (aNormal * height * uHeightScale);
+        new_position = position + (normal * height * uHeightScale);
     }
 
     // transform vertex data to viewspace
     v_out.position = (uModelViewMatrix * vec4(new_position, 1.0f)).xyz;
-    v_out.normal = normalize((uModelViewMatrix * vec4(aNormal, 0.0f)).xyz);
-    v_out.textureCoord = aTexCoord;
+    v_out.normal = normalize((uModelViewMatrix * vec4(normal, 0.0f)).xyz);
+    v_out.textureCoord = texCoord;
     v_out.vertexPosition = new_position;
-    v_out.tangent = normalize((uModelViewMatrix * vec4(aTangent, 0.0f)).xyz);
-    v_out.bitangent = normalize((uModelViewMatrix * vec4(aBitangent, 0.0f)).xyz);
+    v_out.tangent = normalize((uModelViewMatrix * vec4(tangent, 0.0f)).xyz);
+    v_out.bitangent = normalize((uModelViewMatrix * vec4(bitangent, 0.0f)).xyz);
     // Store world-space normal for side detection in fragment shader
-    v_out.worldNormal = aNormal;
+    v_out.worldNormal = normal;
 
     // set the screenspace position (needed for converting to fragment data)
     gl_Position = uProjectionMatrix * uModelViewMatrix * vec4(new_position, 1);
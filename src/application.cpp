@@ -3,6 +3,7 @@
 #include <imgui.h>
 
 #include <chrono>
+#include <filesystem>
 #include <glm/gtc/matrix_transform.hpp>
 #include <random>
 #include <string>
@@ -45,7 +46,11 @@ application::application(GLFWwindow *window)
 
   // create terrain mesh
   m_terrain_.m_shader = terrain_shader;
-  m_terrain_.create_terrain(m_use_perlin_);
+  // Pick up the sculpted terrain from the last session when there is one
+  if (!std::filesystem::exists(m_snapshot_path_) ||
+      !m_terrain_.load_snapshot(m_snapshot_path_)) {
+    m_terrain_.create_terrain(m_use_perlin_);
+  }
   m_terrain_.build_aabb_tree();  // Synchronous for initial build
   m_mesh_deform_.set_model(m_terrain_);
   m_mesh_deform_.initialize();
@@ -70,19 +75,15 @@ application::application(GLFWwindow *window)
 
   std::random_device rd;
   std::mt19937 gen(rd());
-  
-  // Only place trees on top face vertices (not on sides or bottom)
-  const int top_vertices_count = (m_terrain_.m_grid_size + 1) * (m_terrain_.m_grid_size + 1);
-  std::uniform_int_distribution<int> rand_vertices(0, top_vertices_count - 1);
   std::uniform_real_distribution<float> size_tree(3.0f, 7.0f);
 
   for (auto i = 0; i < m_num_trees_; ++i) {
     tree t;
     t.m_shader = shader;
-    m_tree_positions_.push_back(rand_vertices(gen));
     m_trees_.push_back(t);
     m_tree_sizes_.push_back(size_tree(gen));
   }
+  place_trees();
 
   m_trees_[0].generate_leaves(5, 500);
   m_trees_[0].generate_tree();
@@ -94,6 +95,27 @@ application::application(GLFWwindow *window)
   }
 }
 
+application::~application() {
+  if (m_save_on_exit_ && m_terrain_.m_edits.strokes > 0) {
+    m_terrain_.save_snapshot(m_snapshot_path_);
+  }
+}
+
+auto application::place_trees() -> void {
+  std::random_device rd;
+  std::mt19937 gen(rd());
+
+  // Only place trees on top face vertices (not on sides or bottom)
+  const int top_vertices_count =
+      static_cast<int>(m_terrain_.m_heightfield.sample_count());
+  std::uniform_int_distribution<int> rand_vertices(0, top_vertices_count - 1);
+
+  m_tree_positions_.clear();
+  for (auto i = 0; i < m_num_trees_; ++i) {
+    m_tree_positions_.push_back(rand_vertices(gen));
+  }
+}
+
 auto application::render() -> void {
   // Retrieve the window height
   int width, height;
@@ -116,7 +138,24 @@ auto application::render() -> void {
   const auto current_frame = static_cast<float>(glfwGetTime());
   m_delta_time_ = current_frame - m_last_frame_;
   m_last_frame_ = current_frame;
-  m_camera_.update(m_delta_time_, m_terrain_);
+  // Levels of a progressive regeneration finished in the background. Picking
+  // waits for the full resolution terrain
+  if (m_terrain_.poll_refinement()) {
+    m_mesh_deform_.initialize();
+    if (m_terrain_.m_generation_stats.step == 1) m_terrain_aabb_stale_ = true;
+  }
+  if (m_terrain_aabb_stale_ && !m_terrain_.aabb_rebuilding.load()) {
+    m_terrain_.build_aabb_tree_async();
+    m_terrain_aabb_stale_ = false;
+  }
+
+  if (m_stream_terrain_) {
+    // The streamed terrain has no collision data, so the camera flies freely
+    m_camera_.update(m_delta_time_);
+    m_tiles_.update(m_camera_.position());
+  } else {
+    m_camera_.update(m_delta_time_, m_terrain_);
+  }
 
   const glm::mat4 projection = glm::perspective(
       1.f, static_cast<float>(width) / static_cast<float>(height), 0.1f,
@@ -125,7 +164,12 @@ auto application::render() -> void {
   glPolygonMode(GL_FRONT_AND_BACK, (m_show_wireframe_) ? GL_LINE : GL_FILL);
 
   // draw the terrain first to not mess up the other objects!!!!
-  m_terrain_.draw(m_camera_.view_matrix(), projection);
+  if (m_stream_terrain_) {
+    m_tiles_.draw(m_terrain_, m_camera_.view_matrix(), projection);
+  } else {
+    m_terrain_.update_lod(m_camera_.position());
+    m_terrain_.draw(m_camera_.view_matrix(), projection);
+  }
   m_mesh_deform_.m_view = m_camera_.view_matrix();
   m_mesh_deform_.m_projection = projection;
 
@@ -141,11 +185,12 @@ auto application::render() -> void {
   const auto size = static_cast<int>(m_trees_.size());
   for (auto i = 0; i < size; i++) {
     m_trees_[i].draw(m_camera_.view_matrix(), projection);
-    auto terrain_vertices =
-        m_terrain_.m_builder.get_vertex(m_tree_positions_[i]);
+    const glm::vec3 tree_position =
+        m_terrain_.m_heightfield.position(
+            static_cast<size_t>(m_tree_positions_[i]));
 
     const glm::mat4 translation_matrix =
-        glm::translate(glm::mat4(1.0f), terrain_vertices.pos);
+        glm::translate(glm::mat4(1.0f), tree_position);
     m_trees_[i].m_model_translate = translation_matrix;
     m_trees_[i].m_model_scale = glm::vec3(m_tree_sizes_[i]);
   }
@@ -176,6 +221,15 @@ auto application::render_gui() -> void {
   
     ImGui::Checkbox("Wireframe", &m_show_wireframe_);
     ImGui::SameLine();
+    ImGui::Checkbox("Terrain LOD", &m_terrain_.m_use_lod);
+    if (m_terrain_.m_use_lod) {
+      ImGui::SliderFloat("LOD Detail", &m_terrain_.m_lod.m_detail, 0.5f, 8.0f);
+      ImGui::Text("LOD %zu patches, %zu triangles, %.3f ms",
+                  m_terrain_.m_lod.selected().size(),
+                  m_terrain_.m_lod.triangle_count(),
+                  static_cast<double>(m_terrain_.m_lod.last_select_ms()));
+    }
+    ImGui::SameLine();
     if (ImGui::Button("Screenshot")) cgra::rgba_image::screenshot(true);
   }
 
@@ -218,6 +272,11 @@ auto application::render_gui() -> void {
                            20.0f)) {
       m_clouds_.simulate();
     }
+
+    if (ImGui::Combo("Cloud Noise", reinterpret_cast<int*>(&m_clouds_.basis),
+                     "Perlin\0Simplex\0", 2)) {
+      m_clouds_.simulate();
+    }
   }
 
 // === MESH EDITING & TEXTURING SECTION ===
@@ -252,15 +311,84 @@ auto application::render_gui() -> void {
                                  m_terrain_.m_strength);
     }
 
-    ImGui::SliderInt("Octaves", reinterpret_cast<int *>(&m_terrain_.m_octaves),
-                     1, 10);
-    ImGui::SliderFloat("Lacunarity", &m_terrain_.m_lacunarity, 0.0f, 10.0f);
-    ImGui::SliderFloat("Persistence", &m_terrain_.m_persistence, 0.0f, 10.0f);
-    ImGui::SliderFloat("Height", &m_terrain_.m_height, 0.0f, 1000.0f);
-    ImGui::SliderInt("Repeats", reinterpret_cast<int *>(&m_terrain_.m_repeat),
-                     0, 10);
-    ImGui::SliderInt("Seed", reinterpret_cast<int *>(&m_terrain_.m_seed), 0,
-                     100);
+    // Any change to the noise regenerates the terrain progressively when
+    // Auto Regenerate is on
+    bool noise_changed = false;
+    noise_changed |= ImGui::SliderInt(
+        "Octaves", reinterpret_cast<int *>(&m_terrain_.m_octaves), 1, 10);
+    noise_changed |= ImGui::SliderFloat("Lacunarity", &m_terrain_.m_lacunarity,
+                                        0.0f, 10.0f);
+    noise_changed |= ImGui::SliderFloat(
+        "Persistence", &m_terrain_.m_persistence, 0.0f, 10.0f);
+    noise_changed |=
+        ImGui::SliderFloat("Height", &m_terrain_.m_height, 0.0f, 1000.0f);
+    noise_changed |= ImGui::SliderInt(
+        "Repeats", reinterpret_cast<int *>(&m_terrain_.m_repeat), 0, 10);
+    noise_changed |= ImGui::SliderInt(
+        "Seed", reinterpret_cast<int *>(&m_terrain_.m_seed), 0, 100);
+    noise_changed |= ImGui::Checkbox("2D Noise", &m_terrain_.m_use_2d_noise);
+    ImGui::SameLine();
+    noise_changed |= ImGui::Checkbox("Layered", &m_terrain_.m_layered);
+    noise_changed |= ImGui::Combo(
+        "Noise", reinterpret_cast<int *>(&m_terrain_.m_noise_basis),
+        "Perlin\0Simplex\0", 2);
+    noise_changed |=
+        ImGui::Checkbox("Biome Layers", &m_terrain_.m_use_biome_layers);
+    ImGui::SameLine();
+    ImGui::Checkbox("Auto Regenerate", &m_auto_regenerate_);
+
+    if (m_terrain_.m_use_biome_layers && ImGui::TreeNode("Layers")) {
+      // Each change recomposites right away, only the changed layer is
+      // evaluated again
+      terrain_layers& layers = m_terrain_.m_biome_layers;
+      bool layers_changed = false;
+      for (size_t l = 0; l < layers.m_layers.size(); ++l) {
+        terrain_layers::layer& layer = layers.m_layers[l];
+        ImGui::PushID(static_cast<int>(l));
+        layers_changed |= ImGui::Checkbox(layer.name.c_str(), &layer.enabled);
+        if (layer.type == terrain_layers::layer_type::edits) {
+          ImGui::SameLine();
+          if (ImGui::Button("Clear Edits")) {
+            layers.clear_edits();
+            layers_changed = true;
+          }
+        } else {
+          const terrain_layers::layer_stats stats = layers.stats(l);
+          ImGui::SameLine();
+          if (stats.evaluated) {
+            ImGui::Text("evaluated in %.2f ms",
+                        static_cast<double>(stats.milliseconds));
+          } else {
+            ImGui::Text("cached");
+          }
+          layers_changed |= ImGui::SliderFloat("Frequency", &layer.frequency,
+                                               0.05f, 8.0f);
+          layers_changed |= ImGui::SliderFloat("Amplitude", &layer.amplitude,
+                                               0.0f, 2.0f);
+          layers_changed |= ImGui::SliderInt("Layer Octaves", &layer.octaves,
+                                             0, 10);
+        }
+        ImGui::PopID();
+      }
+      ImGui::Text("Layer memory %.1f MB",
+                  static_cast<double>(layers.memory_usage()) / (1 << 20));
+      ImGui::TreePop();
+
+      if (layers_changed && m_use_perlin_) {
+        m_terrain_.create_terrain(true);
+        m_mesh_deform_.initialize();
+        m_terrain_aabb_stale_ = true;
+      }
+    }
+
+    if (noise_changed && m_auto_regenerate_ && m_use_perlin_) {
+      // A coarse preview now, the full terrain arrives through
+      // poll_refinement in render
+      m_terrain_.create_terrain_progressive();
+      m_mesh_deform_.initialize();
+      if (m_terrain_.m_generation_stats.step == 1) m_terrain_aabb_stale_ = true;
+      if (m_stream_terrain_) m_tiles_.configure(m_terrain_);
+    }
 
     bool not_flat = !m_use_perlin_;
     if (ImGui::Checkbox("Perlin", &m_use_perlin_)) not_flat = !m_use_perlin_;
@@ -269,12 +397,144 @@ auto application::render_gui() -> void {
     if (ImGui::Checkbox("Flat", &not_flat)) m_use_perlin_ = !not_flat;
 
     ImGui::SameLine();
-    if (ImGui::Button("Recreate Terrain")) {
-      m_terrain_.create_terrain(m_use_perlin_);
+    ImGui::Checkbox("Solid Box", &m_terrain_.m_solid_box);
+
+    ImGui::SameLine();
+    // Derives normals, mesh and picking from a freshly filled heightfield
+    const auto rebuild_terrain = [this] {
       m_terrain_.build_aabb_tree();
       m_mesh_deform_.set_model(m_terrain_);
       m_mesh_deform_.initialize();
+    };
+
+    if (ImGui::Button("Recreate Terrain")) {
+      m_terrain_.create_terrain(m_use_perlin_);
+      rebuild_terrain();
+      if (m_stream_terrain_) m_tiles_.configure(m_terrain_);
+    }
+
+    ImGui::Text("Generated %zu noise samples in %.2f ms%s",
+                m_terrain_.m_generation_stats.noise_samples,
+                static_cast<double>(m_terrain_.m_generation_stats.milliseconds),
+                m_terrain_.m_generation_stats.cache_hit ? " (cached)" : "");
+    if (m_terrain_.m_generation_stats.step > 1) {
+      ImGui::SameLine();
+      ImGui::Text("at 1/%d resolution, refining",
+                  m_terrain_.m_generation_stats.step);
+    }
+
+    if (ImGui::Combo("Picking Tree",
+                     reinterpret_cast<int *>(&m_terrain_.m_aabb_method),
+                     "Median\0SAH\0LBVH\0", 3)) {
+      m_terrain_aabb_stale_ = true;
+    }
+    {
+      std::lock_guard<std::mutex> lock(m_terrain_.aabb_mutex);
+      const aabb_tree& tree = m_terrain_.m_aabb_tree;
+      ImGui::Text("%zu nodes, %.1f MB, SAH cost %.1f (%.1f built)",
+                  tree.node_count(),
+                  static_cast<double>(tree.memory_usage()) / (1 << 20),
+                  static_cast<double>(tree.sah_cost()),
+                  static_cast<double>(tree.built_sah_cost()));
+    }
+
+    ImGui::Checkbox("Cache Terrains", &m_terrain_.m_use_cache);
+    if (m_terrain_.m_use_cache) {
+      terrain_cache& cache = m_terrain_.m_cache;
+
+      int memory_mb = static_cast<int>(cache.m_memory_budget >> 20);
+      if (ImGui::SliderInt("Cache Memory (MB)", &memory_mb, 0, 1024)) {
+        cache.m_memory_budget = static_cast<size_t>(memory_mb) << 20;
+      }
+      int disk_mb = static_cast<int>(cache.m_disk_budget >> 20);
+      if (ImGui::SliderInt("Cache Disk (MB)", &disk_mb, 0, 4096)) {
+        cache.m_disk_budget = static_cast<size_t>(disk_mb) << 20;
+      }
+
+      ImGui::Text("Cache %zu memory hits, %zu disk hits, %zu misses",
+                  cache.stats().memory_hits, cache.stats().disk_hits,
+                  cache.stats().misses);
+      ImGui::Text("Cache memory %.1f MB in %zu terrains",
+                  static_cast<double>(cache.memory_usage()) / (1 << 20),
+                  cache.memory_entries());
+      if (ImGui::Button("Clear Cache")) cache.clear();
+    }
+
+    if (ImGui::Checkbox("Cache Noise Tiles", &m_terrain_.m_use_noise_tiles)) {
+      if (m_stream_terrain_) m_tiles_.configure(m_terrain_);
+    }
+    if (m_terrain_.m_use_noise_tiles) {
+      noise_tile_cache& tiles = *m_terrain_.m_noise_tiles;
+
+      int tiles_mb = static_cast<int>(tiles.memory_budget() >> 20);
+      if (ImGui::SliderInt("Noise Tiles (MB)", &tiles_mb, 0, 1024)) {
+        tiles.set_memory_budget(static_cast<size_t>(tiles_mb) << 20);
+      }
+
+      const noise_tile_cache::counters counters = tiles.stats();
+      ImGui::Text("Noise tiles %zu hits, %zu misses, %zu evictions",
+                  counters.hits, counters.misses, counters.evictions);
+      ImGui::Text("Noise tiles %.1f MB in %zu tiles",
+                  static_cast<double>(tiles.memory_usage()) / (1 << 20),
+                  tiles.entries());
+      if (ImGui::Button("Clear Noise Tiles")) tiles.clear();
     }
+
+    if (ImGui::Checkbox("Packed Vertices", &m_terrain_.m_packed_vertices)) {
+      m_terrain_.build_mesh();
+    }
+    ImGui::SameLine();
+    ImGui::Text("Vertex buffer: %.2f MB",
+                static_cast<double>(m_terrain_.vertex_buffer_bytes()) /
+                    (1024.0 * 1024.0));
+
+    ImGui::InputText("Heightmap", m_heightmap_path_,
+                     sizeof(m_heightmap_path_));
+    if (ImGui::Button("Import Heightmap")) {
+      if (m_terrain_.import_heightmap(m_heightmap_path_)) rebuild_terrain();
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export Heightmap")) {
+      m_terrain_.export_heightmap(m_heightmap_path_);
+    }
+
+    ImGui::InputText("Snapshot", m_snapshot_path_, sizeof(m_snapshot_path_));
+    if (ImGui::Button("Save Snapshot")) {
+      m_terrain_.save_snapshot(m_snapshot_path_);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Load Snapshot")) {
+      if (m_terrain_.load_snapshot(m_snapshot_path_)) {
+        rebuild_terrain();
+        place_trees();
+      }
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("Save On Exit", &m_save_on_exit_);
+    ImGui::Text("%u edits since generation", m_terrain_.m_edits.strokes);
+  }
+
+  // === TERRAIN STREAMING SECTION ===
+  if (ImGui::CollapsingHeader("Terrain Streaming")) {
+    if (ImGui::Checkbox("Stream Terrain", &m_stream_terrain_)) {
+      if (m_stream_terrain_) {
+        m_tiles_.configure(m_terrain_);
+      } else {
+        m_tiles_.clear();
+      }
+    }
+
+    ImGui::SliderInt("View Radius", &m_tiles_.m_view_radius, 1, 16);
+
+    int budget_mb = static_cast<int>(m_tiles_.m_memory_budget >> 20);
+    if (ImGui::SliderInt("Memory Budget (MB)", &budget_mb, 16, 2048)) {
+      m_tiles_.m_memory_budget = static_cast<size_t>(budget_mb) << 20;
+    }
+
+    ImGui::Text("Tiles %zu loaded, %zu pending", m_tiles_.loaded_tiles(),
+                m_tiles_.pending_tiles());
+    ImGui::Text("Tile memory %.1f MB",
+                static_cast<double>(m_tiles_.memory_usage()) / (1 << 20));
   }
 
   // === TREE SETTINGS SECTION ===
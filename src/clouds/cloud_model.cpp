@@ -1,43 +1,79 @@
 #include "clouds/cloud_model.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 
-#include "PerlinNoise.hpp"
 #include "cgra/cgra_wavefront.hpp"
 #include "mesh/simplified_mesh.hpp"
+#include "utils/parallel.hpp"
+#include "utils/perlin_noise.hpp"
 
 auto cloud_falloff(const float x) -> float {
   return 1.0f - ((x - 1.0f) * (x - 1.0f));
 }
 
 auto cloud_model::simulate() -> void {
+  const auto start = std::chrono::steady_clock::now();
+
   // Generate volumetric data
   cloud_data =
       std::vector(size.x, std::vector(size.y, std::vector(size.z, 1.0f)));
 
-  const siv::PerlinNoise perlin{0};
+  // The terrain's noise in 3D. Its lattice cells are perlin::feature_size
+  // units wide, so stretch the grid to one cell per noise_scale voxels
+  const perlin noise{0, 3, 2.0f, 0.5f, 0, basis};
+  const glm::vec3 stretch = perlin::feature_size / noise_scale;
 
-  for (int x = 0; x < size.x; x++) {
-    for (int y = 0; y < size.y; y++) {
-      for (int z = 0; z < size.z; z++) {
-        double noise = perlin.octave3D_01(
-            (x / noise_scale.x), y / noise_scale.y, z / noise_scale.z, 3);
+  const int width = static_cast<int>(cloud_data.size());
+  const int height = width > 0 ? static_cast<int>(cloud_data[0].size()) : 0;
+  const int depth = height > 0 ? static_cast<int>(cloud_data[0][0].size()) : 0;
 
-        // Fade out at top and bottom
-        if (y > size.y - fade_out_range) {
-          noise *= cloud_falloff(1.0f - (y - (size.y - fade_out_range)) /
-                                           fade_out_range);
-        } else if (y < fade_out_range) {
-          noise *= cloud_falloff(y / fade_out_range);
-        }
+  parallel_for_blocks(
+      0, width,
+      [&](const int x_begin, const int x_end) {
+        // Each (x, y) column along z is one batch of noise
+        std::vector<float> xs(depth);
+        std::vector<float> ys(depth);
+        std::vector<float> zs(depth);
+        std::vector<float> values(depth);
+        for (auto z = 0; z < depth; ++z) zs[z] = z * stretch.z;
+
+        for (auto x = x_begin; x < x_end; ++x) {
+          std::ranges::fill(xs, x * stretch.x);
+          for (auto y = 0; y < height; ++y) {
+            std::ranges::fill(ys, y * stretch.y);
+            noise.generate_perlin_volume_batch(xs.data(), ys.data(),
+                                               zs.data(), values.data(),
+                                               values.size());
 
-        // 1 is not solid, 0 is solid
-        cloud_data[x][y][z] = noise > cloud_threshold ? 0.0f : 1.0f;
-      }
-    }
-  }
+            // Fade out at top and bottom
+            float fade = 1.0f;
+            if (y > size.y - fade_out_range) {
+              fade = cloud_falloff(1.0f - (y - (size.y - fade_out_range)) /
+                                              fade_out_range);
+            } else if (y < fade_out_range) {
+              fade = cloud_falloff(y / fade_out_range);
+            }
+
+            // 1 is not solid, 0 is solid
+            std::vector<float>& column = cloud_data[x][y];
+            for (auto z = 0; z < depth; ++z) {
+              column[z] = values[z] * fade > cloud_threshold ? 0.0f : 1.0f;
+            }
+          }
+        }
+      },
+      1);
 
-  std::cout << "Finished building noise map\n";
+  const float ms = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Built a " << width << "x" << height << "x" << depth
+            << " cloud noise map in " << ms << " ms with "
+            << perlin::basis_name(basis) << " noise on "
+            << perlin::simd_name(perlin::simd_level()) << std::endl;
 
   mesh.m_grid = cloud_data;
   mesh.m_bb_top_right = size;
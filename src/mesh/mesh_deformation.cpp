@@ -2,24 +2,11 @@
 #include "utils/intersections.hpp"
 
 auto mesh_deformation::initialize() -> void {
-  // Calculate the number of top face vertices
-  const GLuint top_vertices_count = (m_model_->m_grid_size + 1) * (m_model_->m_grid_size + 1);
-  
-  // Only clear normals for top face vertices that will be recomputed
-  for (size_t i = 0; i < top_vertices_count; ++i) {
-    m_model_->m_builder.m_vertices[i].norm = {0.0f, 0.0f, 0.0f};
-  }
-
-  // Recompute vertex normals for top face
-  compute_vertex_normals();
+  // The heightfield comes with its normals: generated terrain gets them from
+  // the noise derivatives, imported and restored terrain computes them
 
-  // Recompute TBN for top face
-  recompute_tbn();
-
-  // Destroy if mesh exists
-  if (m_model_->m_mesh.vao != 0) m_model_->m_mesh.destroy();
-  // Rebuild mesh
-  m_model_->m_mesh = m_model_->m_builder.build();
+  // Rebuild mesh, the tangent frames are derived from the normals
+  m_model_->build_mesh();
 }
 
 auto mesh_deformation::set_model(const terrain_model& m) -> void {
@@ -35,420 +22,94 @@ auto mesh_deformation::deform_mesh(const cgra::mesh_vertex& center,
   std::cout << "Center: (" << center.pos.x << ", " << center.pos.y << ", "
             << center.pos.z << ")" << std::endl;
 
+  heightfield& field = m_model_->m_heightfield;
+
   int vertices_affected = 0;
   float max_displacement = 0.0f;
-  int sample_vertex_idx = -1;
+  glm::ivec2 sample_vertex{-1};
   float sample_vertex_y_before = 0.0f;
 
   // Precalculate radius squared for faster distance checks
   const float radius_sq = deformation_radius * deformation_radius;
 
-  // Calculate the index offset for bottom vertices
-  const GLuint top_vertices_count = (m_model_->m_grid_size + 1) * (m_model_->m_grid_size + 1);
+  // Only visit the samples under the brush instead of the whole grid
+  const grid_rect rect = field.region(center.pos, deformation_radius);
 
-  // ONLY process top face vertices for deformation
-  for (size_t idx = 0; idx < top_vertices_count; ++idx) {
-    cgra::mesh_vertex& v = m_model_->m_builder.m_vertices[idx];
+  for (auto i = rect.i_min; i <= rect.i_max; ++i) {
+    for (auto j = rect.j_min; j <= rect.j_max; ++j) {
+      // Calculate SQUARED distance (faster - no sqrt needed)
+      const float dx = field.x(i) - center.pos.x;
+      const float dz = field.z(j) - center.pos.z;
+      const float dist_sq = dx * dx + dz * dz;
 
-    // Calculate SQUARED distance (faster - no sqrt needed yet)
-    const float dist_sq = (v.pos.x - center.pos.x) * (v.pos.x - center.pos.x) +
-                          (v.pos.z - center.pos.z) * (v.pos.z - center.pos.z);
-
-    // SKIP vertices outside the deformation radius
-    if (dist_sq > radius_sq) {
-      continue;
-    }
-
-    // Now calculate actual distance only for vertices we're modifying
-    const float distance = std::sqrt(dist_sq);
+      // SKIP vertices outside the deformation radius
+      if (dist_sq > radius_sq) {
+        continue;
+      }
 
-    // Calculate a normalized strength based on distance
-    float normalized_strength =
-        std::exp(-dist_sq / (radius_sq * 0.33f));  // Use dist_sq directly
+      // Calculate a normalized strength based on distance
+      float normalized_strength = std::exp(-dist_sq / (radius_sq * 0.33f));
 
-    // Ensure that the strength is in the range [0, 1]
-    normalized_strength = std::max(0.0f, std::min(1.0f, normalized_strength));
+      // Ensure that the strength is in the range [0, 1]
+      normalized_strength = std::max(0.0f, std::min(1.0f, normalized_strength));
 
-    // Scale the deformation strength
-    const float deformation_strength =
-        max_deformation_strength * normalized_strength;
+      // Scale the deformation strength
+      const float deformation_strength =
+          max_deformation_strength * normalized_strength;
 
-    // Apply the deformation
-    const float displacement =
-        is_bump ? deformation_strength : -deformation_strength;
+      // Apply the deformation
+      const float displacement =
+          is_bump ? deformation_strength : -deformation_strength;
 
-    if (std::abs(displacement) > 0.01f) {
-      if (vertices_affected == 0) {
-        sample_vertex_idx = idx;
-        sample_vertex_y_before = v.pos.y;
+      if (std::abs(displacement) > 0.01f) {
+        if (vertices_affected == 0) {
+          sample_vertex = {i, j};
+          sample_vertex_y_before = field.height(i, j);
+        }
+        vertices_affected++;
+        max_displacement = std::max(max_displacement, std::abs(displacement));
       }
-      vertices_affected++;
-      max_displacement = std::max(max_displacement, std::abs(displacement));
-    }
 
-    // Update the vertex position
-    v.pos.y += displacement;
-
-    // Get corresponding bottom vertex position
-    const float bottom_y = m_model_->m_builder.m_vertices[idx + top_vertices_count].pos.y;
-    // Ensure top vertex stays above bottom vertex (with small margin)
-    const float min_y = bottom_y + 0.1f;  // 0.1 unit margin
-    if (v.pos.y < min_y) {
-      v.pos.y = min_y;
+      // Update the vertex height, excavating stops at the floor of the box
+      field.set_height(i, j, glm::max(field.height(i, j) + displacement,
+                                      m_model_->box_floor()));
     }
-
-    // Clear the normal for this affected vertex - will be recomputed
-    v.norm = {0.0f, 0.0f, 0.0f};
   }
 
   std::cout << "Vertices affected: " << vertices_affected << std::endl;
   std::cout << "Max displacement: " << max_displacement << std::endl;
 
-  if (sample_vertex_idx >= 0) {
-    float sample_vertex_y_after =
-        m_model_->m_builder.m_vertices[sample_vertex_idx].pos.y;
-    std::cout << "Sample vertex [" << sample_vertex_idx
+  if (sample_vertex.x >= 0) {
+    std::cout << "Sample vertex [" << field.index(sample_vertex.x, sample_vertex.y)
               << "] Y: " << sample_vertex_y_before << " -> "
-              << sample_vertex_y_after << std::endl;
-  }
-
-  // Recompute normals for affected area (with slightly larger radius to catch neighboring vertices)
-  compute_vertex_normals_partial(center.pos, deformation_radius * 1.2f);
-
-  // Recompute TBN only for affected area
-  recompute_tbn_partial(center.pos, deformation_radius);
-
-  if (m_model_->m_mesh.vao != 0) {
-    glBindBuffer(GL_ARRAY_BUFFER, m_model_->m_mesh.vbo);
-    glBufferSubData(
-        GL_ARRAY_BUFFER, 0,
-        m_model_->m_builder.m_vertices.size() * sizeof(cgra::mesh_vertex),
-        m_model_->m_builder.m_vertices.data());
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-  } else {
-    m_model_->m_mesh = m_model_->m_builder.build();
-  }
-
-  m_model_->build_aabb_tree_async();
-  std::cout << "Mesh updated!" << std::endl;
-}
-
-auto mesh_deformation::recompute_tbn() -> void {
-  for (auto i = 0; i < m_model_->m_grid_size; ++i) {
-    for (auto j = 0; j < m_model_->m_grid_size; ++j) {
-      const int k1 = i * (m_model_->m_grid_size + 1) + j;
-      const int k2 = k1 + 1;
-      const int k3 = (i + 1) * (m_model_->m_grid_size + 1) + j;
-      const int k4 = k3 + 1;
-
-      calculate_tbn(m_model_->m_builder, true, k1, k2, k3, k4);
-      calculate_tbn(m_model_->m_builder, false, k1, k2, k3, k4);
-    }
-  }
-}
-
-auto mesh_deformation::recompute_tbn_partial(const glm::vec3& center,
-                                             float radius) -> void {
-  // Calculate grid bounds for affected area
-  const float grid_cell_size = m_model_->m_spacing;
-  const int grid_size = m_model_->m_grid_size;
-
-  // Convert world position to grid coordinates
-  const float total_width = grid_cell_size * static_cast<float>(grid_size);
-  const float x_offset = -total_width / 2.0f;
-  const float z_offset = -total_width / 2.0f;
-
-  const int center_i = static_cast<int>((center.x - x_offset) / grid_cell_size);
-  const int center_j = static_cast<int>((center.z - z_offset) / grid_cell_size);
-
-  // Calculate grid radius
-  const int grid_radius = static_cast<int>(std::ceil(radius / grid_cell_size)) + 1;
-
-  const int i_min = glm::max(0, center_i - grid_radius);
-  const int i_max = glm::min(grid_size - 1, center_i + grid_radius);
-  const int j_min = glm::max(0, center_j - grid_radius);
-  const int j_max = glm::min(grid_size - 1, center_j + grid_radius);
-
-  // Multi-threaded TBN computation
-  const int num_threads = std::thread::hardware_concurrency();
-  std::vector<std::thread> threads;
-
-  int rows_per_thread = (i_max - i_min + 1) / num_threads;
-
-  for (auto t = 0; t < num_threads; ++t) {
-    int start_i = i_min + t * rows_per_thread;
-    int end_i = (t == num_threads - 1) ? i_max : start_i + rows_per_thread - 1;
-
-    threads.emplace_back([this, start_i, end_i, j_min, j_max, grid_size]() {
-      for (auto i = start_i; i <= end_i; ++i) {
-        for (auto j = j_min; j <= j_max; ++j) {
-          const int k1 = i * (grid_size + 1) + j;
-          const int k2 = k1 + 1;
-          const int k3 = (i + 1) * (grid_size + 1) + j;
-          const int k4 = k3 + 1;
-
-          calculate_tbn(m_model_->m_builder, true, k1, k2, k3, k4);
-          calculate_tbn(m_model_->m_builder, false, k1, k2, k3, k4);
-        }
-      }
-    });
-  }
-
-  for (auto& thread : threads) {
-    thread.join();
-  }
-}
-
-auto mesh_deformation::calculate_tbn(cgra::mesh_builder& mb, bool top_left,
-                                     int k1, int k2, int k3, int k4) -> void {
-  // triangles positions
-  glm::vec3 pos1 = mb.m_vertices.at(k1).pos;
-  glm::vec3 pos2 = mb.m_vertices.at(k3).pos;
-  glm::vec3 pos3 = mb.m_vertices.at(k2).pos;
-  glm::vec3 pos4 = mb.m_vertices.at(k4).pos;
-
-  // uv positions
-  glm::vec2 uv1 = mb.m_vertices.at(k1).uv;
-  glm::vec2 uv2 = mb.m_vertices.at(k3).uv;
-  glm::vec2 uv3 = mb.m_vertices.at(k2).uv;
-  glm::vec2 uv4 = mb.m_vertices.at(k4).uv;
-
-  glm::vec3 edge1, edge2;
-  glm::vec2 delta_uv1, delta_uv2;
-  if (top_left) {
-    // calculate tangent and bitangent for top left triangle
-    edge1 = pos2 - pos1;
-    edge2 = pos3 - pos1;
-
-    // delta UVs
-    delta_uv1 = uv2 - uv1;
-    delta_uv2 = uv3 - uv1;
-  } else {
-    // calculate tangent and bitangent for bot right triangle
-    edge1 = pos3 - pos4;
-    edge2 = pos2 - pos4;
-
-    // delta UVs
-    delta_uv1 = uv3 - uv4;
-    delta_uv2 = uv2 - uv4;
+              << field.height(sample_vertex.x, sample_vertex.y) << std::endl;
   }
 
-  glm::vec3 tangent{};
-  glm::vec3 bitangent{};
-  
-  float denominator = delta_uv1.x * delta_uv2.y - delta_uv2.x * delta_uv1.y;
-  
-  // Avoid division by zero or very small denominators
-  if (std::abs(denominator) < 0.0001f) {
-    // Use the triangle's edges as fallback for tangent/bitangent
-    tangent = glm::normalize(edge1);
-    bitangent = glm::normalize(edge2);
-  } else {
-    float f = 1.0f / denominator;
-
-    tangent.x = f * (delta_uv2.y * edge1.x - delta_uv1.y * edge2.x);
-    tangent.y = f * (delta_uv2.y * edge1.y - delta_uv1.y * edge2.y);
-    tangent.z = f * (delta_uv2.y * edge1.z - delta_uv1.y * edge2.z);
-
-    bitangent.x = f * (-delta_uv2.x * edge1.x + delta_uv1.x * edge2.x);
-    bitangent.y = f * (-delta_uv2.x * edge1.y + delta_uv1.x * edge2.y);
-    bitangent.z = f * (-delta_uv2.x * edge1.z + delta_uv1.x * edge2.z);
-
-    // Safety check and normalize tangent and bitangent
-    float tangent_length = glm::length(tangent);
-    float bitangent_length = glm::length(bitangent);
-    
-    if (tangent_length > 0.0001f) {
-      tangent = tangent / tangent_length;
-    } else {
-      tangent = glm::vec3(1.0f, 0.0f, 0.0f); // Default tangent
-    }
-    
-    if (bitangent_length > 0.0001f) {
-      bitangent = bitangent / bitangent_length;
-    } else {
-      bitangent = glm::vec3(0.0f, 0.0f, 1.0f); // Default bitangent
-    }
-  }
+  m_model_->record_edit(rect);
 
-  if (top_left) {
-    // store tangent and bitangent in vertex attributes for top left triangle
-    mb.m_vertices.at(k1).tang = tangent;
-    mb.m_vertices.at(k2).tang = tangent;
-    mb.m_vertices.at(k3).tang = tangent;
-
-    mb.m_vertices.at(k1).bitang = bitangent;
-    mb.m_vertices.at(k2).bitang = bitangent;
-    mb.m_vertices.at(k3).bitang = bitangent;
-  } else {
-    // store tangent and bitangent in vertex attributes for bot right triangle
-    mb.m_vertices.at(k2).tang = tangent;
-    mb.m_vertices.at(k4).tang = tangent;
-    mb.m_vertices.at(k3).tang = tangent;
-
-    mb.m_vertices.at(k2).bitang = bitangent;
-    mb.m_vertices.at(k4).bitang = bitangent;
-    mb.m_vertices.at(k3).bitang = bitangent;
-  }
-}
+  // Normals change for the moved samples and their direct neighbours
+  const grid_rect dirty = field.expand(rect, 1);
+  field.compute_normals(dirty);
 
-auto mesh_deformation::calculate_face_normal(const glm::vec3& vertex1,
-                                             const glm::vec3& vertex2,
-                                             const glm::vec3& vertex3)
-    -> glm::vec3 {
-  // Calculate two edge vectors of the triangle
-  const glm::vec3 edge_1 = vertex2 - vertex1;
-  const glm::vec3 edge_2 = vertex3 - vertex1;
-
-  // Calculate the cross product of the two edge vectors to get the face normal
-  glm::vec3 face_normal = cross(edge_1, edge_2);
-
-  // Check if the normal is valid (non-zero length) before normalizing
-  float length_sq = glm::dot(face_normal, face_normal);
-  if (length_sq > 0.0001f) {
-    // Normalize the face normal to ensure it has a unit length
-    face_normal = normalize(face_normal);
-  } else {
-    // Degenerate triangle (zero area), return a default upward normal
-    face_normal = glm::vec3(0.0f, 1.0f, 0.0f);
-  }
+  // Upload only the rows that changed
+  m_model_->update_mesh_region(dirty);
 
-  return face_normal;
+  // Picking follows the stroke at once, rebuilding only once the tree
+  // degrades
+  m_model_->refit_aabb_tree(rect);
+  std::cout << "Mesh updated!" << std::endl;
 }
 
 auto mesh_deformation::compute_vertex_normals() -> void {
-  // Calculate the number of top face vertices
-  const GLuint top_vertices_count = (m_model_->m_grid_size + 1) * (m_model_->m_grid_size + 1);
-  
-  // Only compute normals for top face vertices (bottom and sides have fixed normals)
-  for (size_t v_idx = 0; v_idx < top_vertices_count; ++v_idx) {
-    // Check if vertex has adjacent faces
-    if (v_idx >= m_model_->m_adjacent_faces.size() || 
-        m_model_->m_adjacent_faces[v_idx].empty()) {
-      // No adjacent faces - use default upward normal for top face
-      m_model_->m_builder.m_vertices[v_idx].norm = glm::vec3(0.0f, 1.0f, 0.0f);
-      continue;
-    }
-
-    glm::vec3 new_normal = {0.0f, 0.0f, 0.0f};
-    int valid_face_count = 0;
-
-    // Iterate through adjacent faces of the current vertex
-    for (size_t i = 0; i < m_model_->m_adjacent_faces[v_idx].size(); i += 3) {
-      // Get the vertices of the adjacent face (assuming that each face stores
-      // its vertex indices)
-      const glm::vec3& vertex1 =
-          m_model_->m_builder.m_vertices[m_model_->m_adjacent_faces[v_idx].at(i)]
-              .pos;
-      const glm::vec3& vertex2 =
-          m_model_->m_builder
-              .m_vertices[m_model_->m_adjacent_faces[v_idx].at(i + 1)]
-              .pos;
-      const glm::vec3& vertex3 =
-          m_model_->m_builder
-              .m_vertices[m_model_->m_adjacent_faces[v_idx].at(i + 2)]
-              .pos;
-
-      // Calculate the face normal using the vertices
-      const glm::vec3 face_normal =
-          calculate_face_normal(vertex1, vertex2, vertex3);
-
-      // Only accumulate if the face normal is valid (not zero)
-      float face_normal_length_sq = glm::dot(face_normal, face_normal);
-      if (face_normal_length_sq > 0.0001f) {
-        new_normal += face_normal;
-        valid_face_count++;
-      }
-    }
-
-    // Check if normal is valid before normalizing
-    float normal_length_sq = glm::dot(new_normal, new_normal);
-    if (normal_length_sq > 0.0001f && valid_face_count > 0) {
-      new_normal = normalize(new_normal);
-      
-      // Final safety check: ensure normalized normal is still valid
-      if (glm::length(new_normal) > 0.9f) {
-        m_model_->m_builder.m_vertices[v_idx].norm = new_normal;
-      } else {
-        // If somehow still invalid, default to upward normal
-        m_model_->m_builder.m_vertices[v_idx].norm = glm::vec3(0.0f, 1.0f, 0.0f);
-      }
-    } else {
-      // Fallback to upward-facing normal if calculation fails
-      m_model_->m_builder.m_vertices[v_idx].norm = glm::vec3(0.0f, 1.0f, 0.0f);
-    }
-  }
+  // Only compute normals for top face vertices (bottom and sides have fixed
+  // normals)
+  m_model_->m_heightfield.compute_normals();
 }
 
-
 auto mesh_deformation::compute_vertex_normals_partial(const glm::vec3& center,
                                                       float radius) -> void {
-  float radius_squared = radius * radius;  // Match the deformation radius exactly
-  
-  // Calculate the number of top face vertices
-  const GLuint top_vertices_count = (m_model_->m_grid_size + 1) * (m_model_->m_grid_size + 1);
-
-  // Only compute normals for top face vertices
-  for (size_t v_idx = 0; v_idx < top_vertices_count; ++v_idx) {
-    auto& vertex = m_model_->m_builder.m_vertices[v_idx];
-
-    // Skip vertices far from deformation
-    float dist_sq = (vertex.pos.x - center.x) * (vertex.pos.x - center.x) +
-                    (vertex.pos.z - center.z) * (vertex.pos.z - center.z);
-    if (dist_sq > radius_squared) continue;
-
-    if (v_idx >= m_model_->m_adjacent_faces.size() || 
-        m_model_->m_adjacent_faces[v_idx].empty()) {
-      // No adjacent faces - use default upward normal
-      vertex.norm = glm::vec3(0.0f, 1.0f, 0.0f);
-      continue;
-    }
-
-    glm::vec3 new_normal = {0.0f, 0.0f, 0.0f};
-    int valid_face_count = 0;
-
-    for (size_t i = 0; i < m_model_->m_adjacent_faces[v_idx].size(); i += 3) {
-      const glm::vec3& vertex1 =
-          m_model_->m_builder
-              .m_vertices[m_model_->m_adjacent_faces[v_idx].at(i)]
-              .pos;
-      const glm::vec3& vertex2 =
-          m_model_->m_builder
-              .m_vertices[m_model_->m_adjacent_faces[v_idx].at(i + 1)]
-              .pos;
-      const glm::vec3& vertex3 =
-          m_model_->m_builder
-              .m_vertices[m_model_->m_adjacent_faces[v_idx].at(i + 2)]
-              .pos;
-
-      const glm::vec3 face_normal =
-          calculate_face_normal(vertex1, vertex2, vertex3);
-      
-      // Only accumulate if the face normal is valid
-      float face_normal_length_sq = glm::dot(face_normal, face_normal);
-      if (face_normal_length_sq > 0.0001f) {
-        new_normal += face_normal;
-        valid_face_count++;
-      }
-    }
-
-    // Check if normal is valid before normalizing
-    float normal_length_sq = glm::dot(new_normal, new_normal);
-    if (normal_length_sq > 0.0001f && valid_face_count > 0) {
-      new_normal = normalize(new_normal);
-      
-      // Final safety check: ensure normalized normal is still valid
-      if (glm::length(new_normal) > 0.9f) {
-        vertex.norm = new_normal;
-      } else {
-        // If somehow still invalid, default to upward normal
-        vertex.norm = glm::vec3(0.0f, 1.0f, 0.0f);
-      }
-    } else {
-      // Fallback to upward-facing normal if calculation fails
-      vertex.norm = glm::vec3(0.0f, 1.0f, 0.0f);
-    }
-  }
+  heightfield& field = m_model_->m_heightfield;
+  field.compute_normals(field.expand(field.region(center, radius), 1));
 }
 
 // TODO: check if this signature actually needs to use doubles
@@ -0,0 +1,186 @@
+#include "terrain/heightfield.hpp"
+
+#include <cmath>
+
+#include "utils/parallel.hpp"
+
+heightfield::heightfield(const int grid_size, const float spacing,
+                         const glm::vec2& origin) {
+  resize(grid_size, spacing, origin);
+}
+
+auto heightfield::resize(const int grid_size, const float spacing,
+                         const glm::vec2& origin) -> void {
+  m_grid_size_ = grid_size;
+  m_spacing_ = spacing;
+  m_origin_ = origin;
+
+  const size_t count = static_cast<size_t>(resolution()) * resolution();
+  m_heights_.assign(count, 0.0f);
+  m_normals_.assign(count, glm::vec3(0.0f, 1.0f, 0.0f));
+}
+
+auto heightfield::contains(const float x, const float z) const -> bool {
+  const float extent = m_spacing_ * static_cast<float>(m_grid_size_);
+  return x >= m_origin_.x && x <= m_origin_.x + extent && z >= m_origin_.y &&
+         z <= m_origin_.y + extent;
+}
+
+auto heightfield::nearest_sample(const float x, const float z) const
+    -> glm::ivec2 {
+  const int i = static_cast<int>(std::lround((x - m_origin_.x) / m_spacing_));
+  const int j = static_cast<int>(std::lround((z - m_origin_.y) / m_spacing_));
+
+  return {glm::clamp(i, 0, m_grid_size_), glm::clamp(j, 0, m_grid_size_)};
+}
+
+auto heightfield::sample(const float x, const float z) const -> float {
+  // Continuous grid coordinates, clamped to the grid
+  const float gx = glm::clamp((x - m_origin_.x) / m_spacing_, 0.0f,
+                              static_cast<float>(m_grid_size_));
+  const float gz = glm::clamp((z - m_origin_.y) / m_spacing_, 0.0f,
+                              static_cast<float>(m_grid_size_));
+
+  // Cell containing the point, keeping the far edge inside the last cell
+  const int i = glm::min(static_cast<int>(gx), m_grid_size_ - 1);
+  const int j = glm::min(static_cast<int>(gz), m_grid_size_ - 1);
+  const float fx = gx - static_cast<float>(i);
+  const float fz = gz - static_cast<float>(j);
+
+  const float h00 = height(i, j);
+  const float h10 = height(i + 1, j);
+  const float h01 = height(i, j + 1);
+  const float h11 = height(i + 1, j + 1);
+
+  // Each cell is split along the (i + 1, j) - (i, j + 1) diagonal
+  if (fx + fz <= 1.0f) {
+    return h00 + fx * (h10 - h00) + fz * (h01 - h00);
+  }
+
+  return h11 + (1.0f - fx) * (h01 - h11) + (1.0f - fz) * (h10 - h11);
+}
+
+auto heightfield::region(const glm::vec3& center, const float radius) const
+    -> grid_rect {
+  const float gx = (center.x - m_origin_.x) / m_spacing_;
+  const float gz = (center.z - m_origin_.y) / m_spacing_;
+  const float grid_radius = radius / m_spacing_;
+
+  grid_rect rect;
+  rect.i_min = glm::max(0, static_cast<int>(std::floor(gx - grid_radius)));
+  rect.i_max =
+      glm::min(m_grid_size_, static_cast<int>(std::ceil(gx + grid_radius)));
+  rect.j_min = glm::max(0, static_cast<int>(std::floor(gz - grid_radius)));
+  rect.j_max =
+      glm::min(m_grid_size_, static_cast<int>(std::ceil(gz + grid_radius)));
+
+  return rect;
+}
+
+auto heightfield::expand(const grid_rect& rect, const int samples) const
+    -> grid_rect {
+  if (rect.empty()) return rect;
+
+  return {glm::max(0, rect.i_min - samples),
+          glm::min(m_grid_size_, rect.i_max + samples),
+          glm::max(0, rect.j_min - samples),
+          glm::min(m_grid_size_, rect.j_max + samples)};
+}
+
+auto heightfield::compute_normals(const grid_rect& rect) -> void {
+  if (rect.empty()) return;
+
+  parallel_for_blocks(
+      rect.i_min, rect.i_max + 1,
+      [this, &rect](const int row_begin, const int row_end) {
+        for (auto i = row_begin; i < row_end; ++i) {
+          for (auto j = rect.j_min; j <= rect.j_max; ++j) {
+            m_normals_[index(i, j)] = compute_normal(i, j);
+          }
+        }
+      },
+      16);
+}
+
+auto heightfield::compute_normals() -> void {
+  compute_normals({0, m_grid_size_, 0, m_grid_size_});
+}
+
+auto heightfield::compute_normal(const int i, const int j) const -> glm::vec3 {
+  glm::vec3 new_normal = {0.0f, 0.0f, 0.0f};
+
+  auto add_triangle = [&](const int i1, const int j1, const int i2,
+                          const int j2, const int i3, const int j3) {
+    new_normal += face_normal(position(i1, j1), position(i2, j2),
+                              position(i3, j3));
+  };
+
+  // Visit the triangles that share this sample in the order the cells are
+  // laid out, the first triangle of a cell is (k1, k2, k3) and the second is
+  // (k2, k4, k3)
+  if (i > 0 && j > 0) {
+    // This sample is k4 of cell (i - 1, j - 1)
+    add_triangle(i - 1, j, i, j, i, j - 1);
+  }
+  if (i > 0 && j < m_grid_size_) {
+    // This sample is k3 of cell (i - 1, j)
+    add_triangle(i - 1, j, i - 1, j + 1, i, j);
+    add_triangle(i - 1, j + 1, i, j + 1, i, j);
+  }
+  if (i < m_grid_size_ && j > 0) {
+    // This sample is k2 of cell (i, j - 1)
+    add_triangle(i, j - 1, i, j, i + 1, j - 1);
+    add_triangle(i, j, i + 1, j, i + 1, j - 1);
+  }
+  if (i < m_grid_size_ && j < m_grid_size_) {
+    // This sample is k1 of cell (i, j)
+    add_triangle(i, j, i, j + 1, i + 1, j);
+  }
+
+  // Check if normal is valid before normalizing, fall back to facing upwards
+  if (glm::dot(new_normal, new_normal) > 0.0001f) {
+    return glm::normalize(new_normal);
+  }
+
+  return {0.0f, 1.0f, 0.0f};
+}
+
+auto heightfield::face_normal(const glm::vec3& vertex1,
+                              const glm::vec3& vertex2,
+                              const glm::vec3& vertex3) -> glm::vec3 {
+  // Calculate the cross product of the two edge vectors to get the face normal
+  const glm::vec3 face_normal = glm::cross(vertex2 - vertex1, vertex3 - vertex1);
+
+  // Degenerate triangle (zero area), use a default upward normal
+  if (glm::dot(face_normal, face_normal) <= 0.0001f) {
+    return {0.0f, 1.0f, 0.0f};
+  }
+
+  return glm::normalize(face_normal);
+}
+
+auto heightfield::vertex(const int i, const int j) const -> cgra::mesh_vertex {
+  cgra::mesh_vertex v;
+  v.pos = position(i, j);
+  v.norm = normal(i, j);
+  v.uv = (m_uv_offset_ + glm::vec2(static_cast<float>(i),
+                                   static_cast<float>(j))) *
+         m_uv_scale_;
+
+  // The surface slope along x and z follows from the normal, which gives the
+  // tangent (along +i) and bitangent (along +j) without revisiting neighbours
+  if (v.norm.y > 0.0001f) {
+    v.tang = glm::normalize(glm::vec3(1.0f, -v.norm.x / v.norm.y, 0.0f));
+    v.bitang = glm::normalize(glm::vec3(0.0f, -v.norm.z / v.norm.y, 1.0f));
+  } else {
+    v.tang = {1.0f, 0.0f, 0.0f};
+    v.bitang = {0.0f, 0.0f, 1.0f};
+  }
+
+  return v;
+}
+
+auto heightfield::memory_usage() const -> size_t {
+  return m_heights_.capacity() * sizeof(float) +
+         m_normals_.capacity() * sizeof(glm::vec3);
+}
@@ -0,0 +1,517 @@
+#include "terrain/heightmap_io.hpp"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+namespace {
+// Rows read or written at a time
+constexpr int block_rows = 64;
+
+auto lower_extension(const std::string& path) -> std::string {
+  std::string ext = std::filesystem::path(path).extension().string();
+  std::ranges::transform(ext, ext.begin(), [](const unsigned char c) {
+    return static_cast<char>(std::tolower(c));
+  });
+  return ext;
+}
+
+auto sample_bytes(const heightmap_format format) -> int {
+  return format == heightmap_format::f32 ? 4 : 2;
+}
+
+// Converts between host and little endian byte order
+auto little_endian(std::uint16_t v) -> std::uint16_t {
+  if constexpr (std::endian::native == std::endian::big) v = std::byteswap(v);
+  return v;
+}
+
+auto little_endian(const float v) -> float {
+  if constexpr (std::endian::native == std::endian::big) {
+    return std::bit_cast<float>(std::byteswap(std::bit_cast<std::uint32_t>(v)));
+  }
+  return v;
+}
+
+/**
+ * \brief Rows of a heightmap converted to heights.
+ */
+class row_source {
+ public:
+  int m_width = 0;
+  int m_height = 0;
+
+  virtual ~row_source() = default;
+
+  /**
+   * \brief Writes count rows starting at first into out, m_width heights per
+   * row.
+   */
+  virtual auto read_rows(int first, int count, float* out) -> bool = 0;
+};
+
+/**
+ * \brief Headerless square R16 or float file, read from disk on demand.
+ */
+class raw_source final : public row_source {
+ public:
+  raw_source(const std::string& path, const heightmap_format format,
+             const float min_height, const float max_height)
+      : m_format_(format),
+        m_min_(min_height),
+        m_scale_((max_height - min_height) / 65535.0f) {
+    std::error_code error;
+    const auto bytes = std::filesystem::file_size(path, error);
+    if (error) return;
+
+    const auto samples = bytes / sample_bytes(format);
+    const auto side = static_cast<std::uintmax_t>(
+        std::llround(std::sqrt(static_cast<double>(samples))));
+    if (side < 2 || side * side * sample_bytes(format) != bytes) {
+      std::cerr << "Error: RAW heightmap " << path
+                << " is not a square grid of samples\n";
+      return;
+    }
+
+    m_file_.open(path, std::ios::binary);
+    if (!m_file_) return;
+
+    m_width = m_height = static_cast<int>(side);
+  }
+
+  auto read_rows(const int first, const int count, float* out)
+      -> bool override {
+    const auto row_bytes =
+        static_cast<std::streamoff>(m_width) * sample_bytes(m_format_);
+    const size_t samples = static_cast<size_t>(count) * m_width;
+
+    m_file_.seekg(first * row_bytes);
+    if (m_format_ == heightmap_format::f32) {
+      m_file_.read(reinterpret_cast<char*>(out), count * row_bytes);
+      if (!m_file_) return false;
+      for (size_t s = 0; s < samples; ++s) out[s] = little_endian(out[s]);
+      return true;
+    }
+
+    m_buffer_.resize(samples);
+    m_file_.read(reinterpret_cast<char*>(m_buffer_.data()), count * row_bytes);
+    if (!m_file_) return false;
+    for (size_t s = 0; s < samples; ++s) {
+      out[s] = m_min_ + static_cast<float>(little_endian(m_buffer_[s])) *
+                            m_scale_;
+    }
+    return true;
+  }
+
+ private:
+  heightmap_format m_format_;
+  float m_min_;
+  float m_scale_;
+  std::ifstream m_file_;
+  std::vector<std::uint16_t> m_buffer_;
+};
+
+/**
+ * \brief PNG decoded by stb. PNG rows are deflate compressed as one stream,
+ * so the image is decoded whole and handed out a block at a time.
+ */
+class png_source final : public row_source {
+ public:
+  png_source(const std::string& path, const float min_height,
+             const float max_height)
+      : m_min_(min_height), m_scale_((max_height - min_height) / 65535.0f) {
+    // rgba_image flips on load, heightmaps keep the first row at j = 0
+    stbi_set_flip_vertically_on_load(false);
+    m_data_ = stbi_load_16(path.c_str(), &m_width, &m_height, nullptr, 1);
+    if (!m_data_) m_width = m_height = 0;
+  }
+
+  ~png_source() override { stbi_image_free(m_data_); }
+
+  png_source(const png_source&) = delete;
+  auto operator=(const png_source&) -> png_source& = delete;
+
+  auto read_rows(const int first, const int count, float* out)
+      -> bool override {
+    const stbi_us* in = m_data_ + static_cast<size_t>(first) * m_width;
+    const size_t samples = static_cast<size_t>(count) * m_width;
+    for (size_t s = 0; s < samples; ++s) {
+      out[s] = m_min_ + static_cast<float>(in[s]) * m_scale_;
+    }
+    return true;
+  }
+
+ private:
+  float m_min_;
+  float m_scale_;
+  stbi_us* m_data_ = nullptr;
+};
+
+/**
+ * \brief Keeps the two most recently used blocks of rows, so bilinear
+ * sampling of consecutive rows reads every block at most once.
+ */
+class row_cache {
+ public:
+  explicit row_cache(row_source& source) : m_source_(source) {}
+
+  /**
+   * \brief Returns row r, or nullptr when it could not be read.
+   */
+  auto row(const int r) -> const float* {
+    const int index = r / block_rows;
+    block* target = &m_blocks_[0];
+    for (auto& b : m_blocks_) {
+      if (b.index == index) {
+        target = &b;
+        break;
+      }
+      if (b.last_use < target->last_use) target = &b;
+    }
+
+    if (target->index != index) {
+      const int first = index * block_rows;
+      const int count = std::min(block_rows, m_source_.m_height - first);
+      target->rows.resize(static_cast<size_t>(count) * m_source_.m_width);
+      if (!m_source_.read_rows(first, count, target->rows.data())) {
+        target->index = -1;
+        return nullptr;
+      }
+      target->index = index;
+      ++m_blocks_read_;
+    }
+
+    target->last_use = ++m_clock_;
+    return target->rows.data() +
+           static_cast<size_t>(r - index * block_rows) * m_source_.m_width;
+  }
+
+  [[nodiscard]] auto blocks_read() const -> int { return m_blocks_read_; }
+
+ private:
+  struct block {
+    int index = -1;
+    unsigned int last_use = 0;
+    std::vector<float> rows;
+  };
+
+  row_source& m_source_;
+  std::array<block, 2> m_blocks_;
+  unsigned int m_clock_ = 0;
+  int m_blocks_read_ = 0;
+};
+
+auto to_sample16(const float h, const float min_height, const float max_height,
+                 size_t& clamped) -> std::uint16_t {
+  const float t = (h - min_height) / (max_height - min_height);
+  if (t < 0.0f || t > 1.0f) ++clamped;
+  return static_cast<std::uint16_t>(
+      std::lround(std::clamp(t, 0.0f, 1.0f) * 65535.0f));
+}
+
+constexpr auto crc_table = [] {
+  std::array<std::uint32_t, 256> table{};
+  for (std::uint32_t n = 0; n < 256; ++n) {
+    std::uint32_t c = n;
+    for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+    table[n] = c;
+  }
+  return table;
+}();
+
+auto put_u32_be(std::vector<unsigned char>& out, const std::uint32_t v)
+    -> void {
+  out.push_back(static_cast<unsigned char>(v >> 24));
+  out.push_back(static_cast<unsigned char>(v >> 16));
+  out.push_back(static_cast<unsigned char>(v >> 8));
+  out.push_back(static_cast<unsigned char>(v));
+}
+
+/**
+ * \brief Writes a 16 bit grayscale PNG a block of rows at a time. stb only
+ * writes 8 bit PNGs, so the image data is wrapped in stored (uncompressed)
+ * deflate blocks, one IDAT chunk per block of rows.
+ */
+class png16_writer {
+ public:
+  png16_writer(std::ofstream& out, const int width, const int height)
+      : m_out_(out), m_width_(width), m_rows_left_(height) {
+    static constexpr unsigned char signature[] = {0x89, 'P',  'N',  'G',
+                                                  '\r', '\n', 0x1A, '\n'};
+    m_out_.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+
+    std::vector<unsigned char> header;
+    put_u32_be(header, static_cast<std::uint32_t>(width));
+    put_u32_be(header, static_cast<std::uint32_t>(height));
+    // 16 bit grayscale, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), {16, 0, 0, 0, 0});
+    write_chunk("IHDR", header);
+  }
+
+  /**
+   * \brief Appends count rows of m_width samples each.
+   */
+  auto write_rows(const std::uint16_t* samples, const int count) -> void {
+    const size_t row_bytes = 1 + 2 * static_cast<size_t>(m_width_);
+    m_raw_.resize(row_bytes * count);
+    for (auto r = 0; r < count; ++r) {
+      unsigned char* row = m_raw_.data() + r * row_bytes;
+      row[0] = 0;  // filter type none
+      for (auto x = 0; x < m_width_; ++x) {
+        const std::uint16_t v = samples[static_cast<size_t>(r) * m_width_ + x];
+        row[1 + 2 * x] = static_cast<unsigned char>(v >> 8);
+        row[2 + 2 * x] = static_cast<unsigned char>(v);
+      }
+    }
+    update_adler(m_raw_);
+
+    m_rows_left_ -= count;
+    const bool last = m_rows_left_ == 0;
+
+    m_chunk_.clear();
+    if (m_first_) {
+      m_chunk_.insert(m_chunk_.end(), {0x78, 0x01});  // zlib, no compression
+      m_first_ = false;
+    }
+
+    for (size_t offset = 0; offset < m_raw_.size(); offset += 65535) {
+      const auto length =
+          static_cast<std::uint16_t>(std::min<size_t>(65535, m_raw_.size() - offset));
+      const auto inverse = static_cast<std::uint16_t>(~length);
+      const bool final_block = last && offset + length == m_raw_.size();
+      m_chunk_.push_back(final_block ? 1 : 0);
+      m_chunk_.push_back(static_cast<unsigned char>(length));
+      m_chunk_.push_back(static_cast<unsigned char>(length >> 8));
+      m_chunk_.push_back(static_cast<unsigned char>(inverse));
+      m_chunk_.push_back(static_cast<unsigned char>(inverse >> 8));
+      m_chunk_.insert(m_chunk_.end(), m_raw_.begin() + offset,
+                      m_raw_.begin() + offset + length);
+    }
+
+    if (last) put_u32_be(m_chunk_, (m_adler_b_ << 16) | m_adler_a_);
+    write_chunk("IDAT", m_chunk_);
+    if (last) write_chunk("IEND", {});
+  }
+
+ private:
+  std::ofstream& m_out_;
+  int m_width_;
+  int m_rows_left_;
+  bool m_first_ = true;
+  std::uint32_t m_adler_a_ = 1;
+  std::uint32_t m_adler_b_ = 0;
+  std::vector<unsigned char> m_raw_;
+  std::vector<unsigned char> m_chunk_;
+
+  auto update_adler(const std::vector<unsigned char>& data) -> void {
+    // 5552 bytes is the most that can be summed before the modulo overflows
+    for (size_t offset = 0; offset < data.size(); offset += 5552) {
+      const size_t end = std::min(data.size(), offset + 5552);
+      for (size_t k = offset; k < end; ++k) {
+        m_adler_a_ += data[k];
+        m_adler_b_ += m_adler_a_;
+      }
+      m_adler_a_ %= 65521;
+      m_adler_b_ %= 65521;
+    }
+  }
+
+  auto write_chunk(const char* type, const std::vector<unsigned char>& data)
+      -> void {
+    std::vector<unsigned char> length;
+    put_u32_be(length, static_cast<std::uint32_t>(data.size()));
+    m_out_.write(reinterpret_cast<const char*>(length.data()), 4);
+    m_out_.write(type, 4);
+    m_out_.write(reinterpret_cast<const char*>(data.data()),
+                 static_cast<std::streamsize>(data.size()));
+
+    std::uint32_t crc = 0xFFFFFFFFu;
+    const auto update = [&crc](const unsigned char byte) {
+      crc = crc_table[(crc ^ byte) & 0xFF] ^ (crc >> 8);
+    };
+    for (auto k = 0; k < 4; ++k) update(static_cast<unsigned char>(type[k]));
+    for (const auto byte : data) update(byte);
+
+    std::vector<unsigned char> checksum;
+    put_u32_be(checksum, crc ^ 0xFFFFFFFFu);
+    m_out_.write(reinterpret_cast<const char*>(checksum.data()), 4);
+  }
+};
+}  // namespace
+
+auto heightmap_format_from_path(const std::string& path)
+    -> std::optional<heightmap_format> {
+  const std::string ext = lower_extension(path);
+  if (ext == ".png") return heightmap_format::png16;
+  if (ext == ".r16" || ext == ".raw") return heightmap_format::r16;
+  if (ext == ".r32" || ext == ".f32") return heightmap_format::f32;
+  return std::nullopt;
+}
+
+auto import_heightmap(const std::string& path, heightfield& field,
+                      const float min_height, const float max_height) -> bool {
+  const auto start = std::chrono::steady_clock::now();
+
+  const auto format = heightmap_format_from_path(path);
+  if (!format) {
+    std::cerr << "Error: Unknown heightmap format " << path << '\n';
+    return false;
+  }
+
+  std::unique_ptr<row_source> source;
+  if (*format == heightmap_format::png16) {
+    source = std::make_unique<png_source>(path, min_height, max_height);
+  } else {
+    source =
+        std::make_unique<raw_source>(path, *format, min_height, max_height);
+  }
+  if (source->m_width == 0 || source->m_height == 0) {
+    std::cerr << "Error: Failed to open heightmap " << path << '\n';
+    return false;
+  }
+
+  const int grid_size = field.grid_size();
+  const int resolution = field.resolution();
+  const float step_x = static_cast<float>(source->m_width - 1) /
+                       static_cast<float>(std::max(grid_size, 1));
+  const float step_y = static_cast<float>(source->m_height - 1) /
+                       static_cast<float>(std::max(grid_size, 1));
+
+  // Source columns and weights are the same for every row
+  std::vector<int> column(resolution);
+  std::vector<float> column_t(resolution);
+  for (auto i = 0; i < resolution; ++i) {
+    const float sx = static_cast<float>(i) * step_x;
+    column[i] = std::min(static_cast<int>(sx), source->m_width - 2);
+    column[i] = std::max(column[i], 0);
+    column_t[i] = sx - static_cast<float>(column[i]);
+  }
+
+  // Fill a copy so a failed read leaves the field as it was
+  std::vector<float> heights(field.sample_count());
+  row_cache rows(*source);
+  for (auto j = 0; j < resolution; ++j) {
+    const float sy = static_cast<float>(j) * step_y;
+    const int r0 =
+        std::max(std::min(static_cast<int>(sy), source->m_height - 2), 0);
+    const int r1 = std::min(r0 + 1, source->m_height - 1);
+    const float ty = sy - static_cast<float>(r0);
+
+    const float* row0 = rows.row(r0);
+    const float* row1 = row0 ? rows.row(r1) : nullptr;
+    if (!row1) {
+      std::cerr << "Error: Failed to read heightmap " << path << '\n';
+      return false;
+    }
+
+    for (auto i = 0; i < resolution; ++i) {
+      const int c0 = column[i];
+      const int c1 = std::min(c0 + 1, source->m_width - 1);
+      const float t = column_t[i];
+      const float top = row0[c0] + (row0[c1] - row0[c0]) * t;
+      const float bottom = row1[c0] + (row1[c1] - row1[c0]) * t;
+      heights[field.index(i, j)] = top + (bottom - top) * ty;
+    }
+  }
+
+  field.heights() = std::move(heights);
+
+  const float ms = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Imported " << source->m_width << "x" << source->m_height
+            << " heightmap " << path << " onto " << resolution << "x"
+            << resolution << " samples in " << ms << " ms ("
+            << rows.blocks_read() << " blocks of " << block_rows << " rows)"
+            << std::endl;
+  return true;
+}
+
+auto export_heightmap(const std::string& path, const heightfield& field,
+                      const float min_height, const float max_height) -> bool {
+  const auto start = std::chrono::steady_clock::now();
+
+  const auto format = heightmap_format_from_path(path);
+  if (!format) {
+    std::cerr << "Error: Unknown heightmap format " << path << '\n';
+    return false;
+  }
+
+  std::ofstream out(path, std::ios::binary);
+  if (!out) {
+    std::cerr << "Error: Failed to write heightmap " << path << '\n';
+    return false;
+  }
+
+  const int resolution = field.resolution();
+  std::optional<png16_writer> png;
+  if (*format == heightmap_format::png16) png.emplace(out, resolution, resolution);
+
+  std::vector<float> floats;
+  std::vector<std::uint16_t> samples;
+  size_t clamped = 0;
+
+  for (auto first = 0; first < resolution; first += block_rows) {
+    const int count = std::min(block_rows, resolution - first);
+    const size_t block_samples = static_cast<size_t>(count) * resolution;
+
+    if (*format == heightmap_format::f32) {
+      floats.resize(block_samples);
+      for (auto r = 0; r < count; ++r) {
+        for (auto i = 0; i < resolution; ++i) {
+          floats[static_cast<size_t>(r) * resolution + i] =
+              little_endian(field.height(i, first + r));
+        }
+      }
+      out.write(reinterpret_cast<const char*>(floats.data()),
+                static_cast<std::streamsize>(block_samples * sizeof(float)));
+      continue;
+    }
+
+    samples.resize(block_samples);
+    for (auto r = 0; r < count; ++r) {
+      for (auto i = 0; i < resolution; ++i) {
+        samples[static_cast<size_t>(r) * resolution + i] = to_sample16(
+            field.height(i, first + r), min_height, max_height, clamped);
+      }
+    }
+
+    if (png) {
+      png->write_rows(samples.data(), count);
+    } else {
+      for (auto& s : samples) s = little_endian(s);
+      out.write(reinterpret_cast<const char*>(samples.data()),
+                static_cast<std::streamsize>(block_samples * 2));
+    }
+  }
+
+  if (!out) {
+    std::cerr << "Error: Failed to write heightmap " << path << '\n';
+    return false;
+  }
+
+  if (clamped > 0) {
+    std::cout << "Warning: " << clamped << " heights were outside ["
+              << min_height << ", " << max_height << "] and were clamped"
+              << std::endl;
+  }
+
+  const float ms = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Exported " << resolution << "x" << resolution
+            << " heightmap " << path << " in " << ms << " ms" << std::endl;
+  return true;
+}
@@ -0,0 +1,357 @@
+#include "terrain/noise_graph.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+auto noise_graph::fractal(const noise_settings& settings) -> int {
+  node n;
+  n.type = node_type::fractal;
+  n.settings = settings;
+  return add(std::move(n));
+}
+
+auto noise_graph::ridged(const noise_settings& settings, const float offset,
+                         const float gain) -> int {
+  node n;
+  n.type = node_type::ridged;
+  n.settings = settings;
+  n.parameters[0] = offset;
+  n.parameters[1] = gain;
+  return add(std::move(n));
+}
+
+auto noise_graph::warp(const int source, const int dx, const int dz,
+                       const float amount) -> int {
+  node n;
+  n.type = node_type::warp;
+  n.inputs[0] = source;
+  n.inputs[1] = dx;
+  n.inputs[2] = dz;
+  n.parameters[0] = amount;
+  return add(std::move(n));
+}
+
+auto noise_graph::curve(const int input, std::vector<glm::vec2> points)
+    -> int {
+  if (points.empty()) {
+    std::cerr << "Error: Noise graph curve needs at least one point\n";
+    return -1;
+  }
+
+  node n;
+  n.type = node_type::curve;
+  n.inputs[0] = input;
+  std::ranges::sort(points, {}, [](const glm::vec2& p) { return p.x; });
+  n.points = std::move(points);
+  return add(std::move(n));
+}
+
+auto noise_graph::terrace(const int input, const int steps, const float slope)
+    -> int {
+  node n;
+  n.type = node_type::terrace;
+  n.inputs[0] = input;
+  n.parameters[0] = static_cast<float>(std::max(steps, 1));
+  n.parameters[1] = std::clamp(slope, 0.0f, 1.0f);
+  return add(std::move(n));
+}
+
+auto noise_graph::blend(const int a, const int b, const int mask) -> int {
+  node n;
+  n.type = node_type::blend;
+  n.inputs[0] = a;
+  n.inputs[1] = b;
+  n.inputs[2] = mask;
+  return add(std::move(n));
+}
+
+auto noise_graph::add(node n) -> int {
+  for (const int input : n.inputs) {
+    if (input >= static_cast<int>(m_nodes_.size())) {
+      std::cerr << "Error: Noise graph node input " << input
+                << " does not exist\n";
+      return -1;
+    }
+  }
+
+  const int inputs = n.type == node_type::curve || n.type == node_type::terrace
+                         ? 1
+                         : n.type == node_type::warp ||
+                                   n.type == node_type::blend
+                               ? 3
+                               : 0;
+  for (auto k = 0; k < inputs; ++k) {
+    if (n.inputs[k] < 0) {
+      std::cerr << "Error: Noise graph node is missing an input\n";
+      return -1;
+    }
+  }
+
+  m_nodes_.push_back(std::move(n));
+  return static_cast<int>(m_nodes_.size()) - 1;
+}
+
+auto noise_graph::compile(const int output) const -> noise_program {
+  noise_program program;
+  if (output < 0 || output >= static_cast<int>(m_nodes_.size())) {
+    std::cerr << "Error: Noise graph output " << output << " does not exist\n";
+    return program;
+  }
+
+  std::map<std::array<int, 3>, int> emitted;
+  emit(output, 0, 1, program, emitted);
+  return program;
+}
+
+auto noise_graph::emit(const int id, const int x, const int z,
+                       noise_program& program,
+                       std::map<std::array<int, 3>, int>& emitted) const
+    -> int {
+  // A node used by several others, at the same coordinates, runs once
+  if (const auto it = emitted.find({id, x, z}); it != emitted.end()) {
+    return it->second;
+  }
+
+  using opcode = noise_program::opcode;
+  const node& n = m_nodes_[id];
+  const auto push = [&program](noise_program::instruction instruction) {
+    instruction.out = program.m_registers_++;
+    program.m_instructions_.push_back(instruction);
+    return instruction.out;
+  };
+
+  int result = 0;
+  switch (n.type) {
+    case node_type::fractal:
+    case node_type::ridged: {
+      const noise_settings& settings = n.settings;
+      int sx = x;
+      int sz = z;
+      if (settings.frequency != 1.0f) {
+        sx = push({opcode::scale, 0, x, 0, 0, -1, -1, {settings.frequency}});
+        sz = push({opcode::scale, 0, z, 0, 0, -1, -1, {settings.frequency}});
+      }
+
+      noise_program::instruction instruction;
+      instruction.a = sx;
+      instruction.b = sz;
+      instruction.layer = static_cast<int>(program.m_layers_.size());
+      if (n.type == node_type::fractal) {
+        instruction.op = opcode::fractal;
+        program.m_layers_.push_back(
+            {perlin(settings.seed, settings.octaves, settings.lacunarity,
+                    settings.persistence, 0, settings.basis),
+             settings.planar});
+      } else {
+        instruction.op = opcode::ridged;
+        // Scaled coordinates, one octave of noise and the octave weights
+        instruction.c = program.m_registers_;
+        program.m_registers_ += 4;
+        program.m_layers_.push_back(
+            {perlin(settings.seed, 1, settings.lacunarity,
+                    settings.persistence, 0, settings.basis),
+             settings.planar, settings.octaves, settings.lacunarity,
+             settings.persistence, n.parameters[0], n.parameters[1]});
+      }
+      result = push(instruction);
+      break;
+    }
+    case node_type::warp: {
+      const int dx = emit(n.inputs[1], x, z, program, emitted);
+      const int dz = emit(n.inputs[2], x, z, program, emitted);
+      const int wx =
+          push({opcode::displace, 0, x, dx, 0, -1, -1, {n.parameters[0]}});
+      const int wz =
+          push({opcode::displace, 0, z, dz, 0, -1, -1, {n.parameters[0]}});
+      result = emit(n.inputs[0], wx, wz, program, emitted);
+      break;
+    }
+    case node_type::curve: {
+      const int a = emit(n.inputs[0], x, z, program, emitted);
+      const int curve = static_cast<int>(program.m_curves_.size());
+      program.m_curves_.push_back(n.points);
+      result = push({opcode::curve, 0, a, 0, 0, -1, curve});
+      break;
+    }
+    case node_type::terrace: {
+      const int a = emit(n.inputs[0], x, z, program, emitted);
+      result = push({opcode::terrace, 0, a, 0, 0, -1, -1,
+                     {n.parameters[0], n.parameters[1]}});
+      break;
+    }
+    case node_type::blend: {
+      const int a = emit(n.inputs[0], x, z, program, emitted);
+      const int b = emit(n.inputs[1], x, z, program, emitted);
+      const int c = emit(n.inputs[2], x, z, program, emitted);
+      result = push({opcode::blend, 0, a, b, c});
+      break;
+    }
+  }
+
+  emitted[{id, x, z}] = result;
+  return result;
+}
+
+auto noise_graph::layered(const noise_settings& base) -> noise_program {
+  noise_graph graph;
+
+  // Hills: the base noise, warped by two low frequency noises and terraced
+  noise_settings offsets = base;
+  offsets.octaves = 3;
+  offsets.frequency = 0.5f;
+  offsets.seed = base.seed + 1;
+  const int warp_x = graph.fractal(offsets);
+  offsets.seed = base.seed + 2;
+  const int warp_z = graph.fractal(offsets);
+  const int hills = graph.terrace(
+      graph.warp(graph.fractal(base), warp_x, warp_z, 150.0f), 16, 0.4f);
+
+  // Mountains
+  noise_settings ridges = base;
+  ridges.seed = base.seed + 3;
+  ridges.frequency = 0.75f;
+  const int mountains = graph.curve(graph.ridged(ridges),
+                                    {{0.0f, 0.3f}, {1.0f, 1.0f}});
+
+  // Which of the two, with a short transition between them
+  noise_settings mask = base;
+  mask.seed = base.seed + 4;
+  mask.octaves = 2;
+  mask.frequency = 0.25f;
+  const int selector =
+      graph.curve(graph.fractal(mask), {{0.45f, 0.0f}, {0.55f, 1.0f}});
+
+  return graph.compile(graph.blend(hills, mountains, selector));
+}
+
+auto noise_program::evaluate(const float* x, const float* z, float* out,
+                             const size_t n) const -> void {
+  if (m_instructions_.empty()) {
+    std::fill(out, out + n, 0.5f);
+    return;
+  }
+
+  std::vector<float> scratch(static_cast<size_t>(m_registers_) * tile_samples);
+  std::vector<float*> registers(m_registers_);
+  for (auto r = 0; r < m_registers_; ++r) {
+    registers[r] = scratch.data() + static_cast<size_t>(r) * tile_samples;
+  }
+  const int output = m_instructions_.back().out;
+
+  for (size_t begin = 0; begin < n; begin += tile_samples) {
+    const size_t count = std::min(tile_samples, n - begin);
+    std::copy_n(x + begin, count, registers[0]);
+    std::copy_n(z + begin, count, registers[1]);
+    registers[output] = out + begin;
+
+    for (const instruction& in : m_instructions_) {
+      float* result = registers[in.out];
+      const float* a = registers[in.a];
+      const float* b = registers[in.b];
+
+      switch (in.op) {
+        case opcode::fractal: {
+          const noise_layer& layer = m_layers_[in.layer];
+          if (layer.planar) {
+            layer.noise.generate_perlin_2d_batch(a, b, result, count);
+          } else {
+            layer.noise.generate_perlin_batch(a, b, result, count);
+          }
+          break;
+        }
+        case opcode::ridged: {
+          const noise_layer& layer = m_layers_[in.layer];
+          float* sx = registers[in.c];
+          float* sz = registers[in.c + 1];
+          float* value = registers[in.c + 2];
+          float* weight = registers[in.c + 3];
+          std::fill_n(result, count, 0.0f);
+          std::fill_n(weight, count, 1.0f);
+
+          float frequency = 1.0f;
+          float amplitude = 1.0f;
+          float max_value = 0.0f;
+          for (unsigned int o = 0; o < layer.octaves; ++o) {
+            for (size_t k = 0; k < count; ++k) {
+              sx[k] = a[k] * frequency;
+              sz[k] = b[k] * frequency;
+            }
+            if (layer.planar) {
+              layer.noise.generate_perlin_2d_batch(sx, sz, value, count);
+            } else {
+              layer.noise.generate_perlin_batch(sx, sz, value, count);
+            }
+
+            for (size_t k = 0; k < count; ++k) {
+              float signal =
+                  layer.offset - std::abs(2.0f * value[k] - 1.0f);
+              signal *= signal * weight[k];
+              weight[k] = std::clamp(signal * layer.gain, 0.0f, 1.0f);
+              result[k] += signal * amplitude;
+            }
+
+            max_value += amplitude * layer.offset * layer.offset;
+            frequency *= layer.lacunarity;
+            amplitude *= layer.persistence;
+          }
+
+          if (max_value > 0.0f) {
+            for (size_t k = 0; k < count; ++k) result[k] /= max_value;
+          }
+          break;
+        }
+        case opcode::scale:
+          for (size_t k = 0; k < count; ++k) {
+            result[k] = a[k] * in.parameters[0];
+          }
+          break;
+        case opcode::displace:
+          for (size_t k = 0; k < count; ++k) {
+            result[k] = a[k] + (2.0f * b[k] - 1.0f) * in.parameters[0];
+          }
+          break;
+        case opcode::curve: {
+          const std::vector<glm::vec2>& points = m_curves_[in.curve];
+          for (size_t k = 0; k < count; ++k) {
+            const auto upper = std::ranges::upper_bound(
+                points, a[k], {}, [](const glm::vec2& p) { return p.x; });
+            if (upper == points.begin()) {
+              result[k] = points.front().y;
+            } else if (upper == points.end()) {
+              result[k] = points.back().y;
+            } else {
+              const glm::vec2& p0 = *(upper - 1);
+              const glm::vec2& p1 = *upper;
+              result[k] = p0.y + (p1.y - p0.y) * (a[k] - p0.x) / (p1.x - p0.x);
+            }
+          }
+          break;
+        }
+        case opcode::terrace: {
+          const float steps = in.parameters[0];
+          const float slope = in.parameters[1];
+          for (size_t k = 0; k < count; ++k) {
+            const float t = a[k] * steps;
+            const float step = std::floor(t);
+            // Flat for the first 1 - slope of each step, then a linear rise
+            const float rise =
+                slope > 0.0f
+                    ? std::clamp((t - step - (1.0f - slope)) / slope, 0.0f,
+                                 1.0f)
+                    : 0.0f;
+            result[k] = (step + rise) / steps;
+          }
+          break;
+        }
+        case opcode::blend: {
+          const float* c = registers[in.c];
+          for (size_t k = 0; k < count; ++k) {
+            result[k] = a[k] + (b[k] - a[k]) * std::clamp(c[k], 0.0f, 1.0f);
+          }
+          break;
+        }
+      }
+    }
+  }
+}
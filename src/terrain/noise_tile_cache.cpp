@@ -0,0 +1,207 @@
+#include "terrain/noise_tile_cache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+noise_source::noise_source(const noise_lattice& lattice)
+    : m_lattice_(lattice),
+      m_noise_(lattice.seed, lattice.octaves, lattice.lacunarity,
+               lattice.persistence, lattice.repeat, lattice.basis) {
+  if (lattice.layered) {
+    m_program_ = noise_graph::layered({lattice.seed, lattice.octaves,
+                                       lattice.lacunarity, lattice.persistence,
+                                       1.0f, lattice.planar, lattice.basis});
+  }
+}
+
+auto noise_source::evaluate_rows(const long long i0, const long long j0,
+                                 const int rows, const int cols, float* values,
+                                 float* dx, float* dz, const size_t stride)
+    const -> void {
+  if (rows <= 0 || cols <= 0) return;
+
+  const noise_lattice& lattice = m_lattice_;
+  const bool gradient = has_gradient() && dx && dz;
+
+  // A row of samples shares x, so the noise goes straight into it, a whole
+  // row per batch
+  std::vector<float> xs(cols);
+  std::vector<float> zs(cols);
+  for (auto j = 0; j < cols; ++j) {
+    zs[j] = lattice.origin.y + static_cast<float>(j0 + j) * lattice.spacing;
+  }
+
+  for (auto i = 0; i < rows; ++i) {
+    std::ranges::fill(xs, lattice.origin.x +
+                              static_cast<float>(i0 + i) * lattice.spacing);
+    const size_t offset = static_cast<size_t>(i) * stride;
+    float* row = values + offset;
+
+    if (lattice.layered) {
+      m_program_.evaluate(xs.data(), zs.data(), row, xs.size());
+    } else if (gradient && lattice.planar) {
+      m_noise_.generate_perlin_2d_gradient_batch(
+          xs.data(), zs.data(), row, dx + offset, dz + offset, xs.size());
+    } else if (gradient) {
+      m_noise_.generate_perlin_gradient_batch(
+          xs.data(), zs.data(), row, dx + offset, dz + offset, xs.size());
+    } else if (lattice.planar) {
+      m_noise_.generate_perlin_2d_batch(xs.data(), zs.data(), row, xs.size());
+    } else {
+      m_noise_.generate_perlin_batch(xs.data(), zs.data(), row, xs.size());
+    }
+  }
+}
+
+auto noise_tile_cache::tile_key_hash::operator()(const tile_key& key) const
+    -> size_t {
+  const noise_lattice& lattice = key.lattice;
+  size_t h = std::hash<long long>()(key.x);
+  const auto mix = [&h](const std::uint64_t v) {
+    h ^= std::hash<std::uint64_t>()(v) + 0x9E3779B97F4A7C15ull + (h << 6) +
+         (h >> 2);
+  };
+  mix(static_cast<std::uint64_t>(key.z));
+  mix(lattice.seed);
+  mix(lattice.octaves);
+  mix(std::bit_cast<std::uint32_t>(lattice.lacunarity));
+  mix(std::bit_cast<std::uint32_t>(lattice.persistence));
+  mix(lattice.repeat);
+  mix((lattice.planar ? 1u : 0u) | (lattice.layered ? 2u : 0u) |
+      (static_cast<std::uint32_t>(lattice.basis) << 2));
+  mix(std::bit_cast<std::uint32_t>(lattice.spacing));
+  mix(std::bit_cast<std::uint32_t>(lattice.origin.x));
+  mix(std::bit_cast<std::uint32_t>(lattice.origin.y));
+  return h;
+}
+
+auto noise_tile_cache::tile_of(const long long i) -> long long {
+  return (i >= 0 ? i : i - (tile_samples - 1)) / tile_samples;
+}
+
+auto noise_tile_cache::fill(const noise_source& source, const long long i0,
+                            const long long j0, const int rows,
+                            const int cols, float* values, float* dx,
+                            float* dz, const size_t stride) -> size_t {
+  if (rows <= 0 || cols <= 0) return 0;
+
+  const bool gradient = source.has_gradient() && dx && dz;
+  size_t generated = 0;
+
+  tile_key key{source.lattice()};
+  for (key.x = tile_of(i0); key.x <= tile_of(i0 + rows - 1); ++key.x) {
+    for (key.z = tile_of(j0); key.z <= tile_of(j0 + cols - 1); ++key.z) {
+      const std::shared_ptr<const tile> samples =
+          acquire(source, key, generated);
+
+      // Part of the tile inside the requested samples
+      const long long tile_i = key.x * tile_samples;
+      const long long tile_j = key.z * tile_samples;
+      const long long i_begin = std::max(i0, tile_i);
+      const long long i_end = std::min(i0 + rows, tile_i + tile_samples);
+      const long long j_begin = std::max(j0, tile_j);
+      const long long j_end = std::min(j0 + cols, tile_j + tile_samples);
+      const auto count = static_cast<size_t>(j_end - j_begin);
+
+      for (long long i = i_begin; i < i_end; ++i) {
+        const auto from =
+            static_cast<size_t>((i - tile_i) * tile_samples + j_begin - tile_j);
+        const auto to = static_cast<size_t>(i - i0) * stride +
+                        static_cast<size_t>(j_begin - j0);
+        std::copy_n(samples->values.data() + from, count, values + to);
+        if (gradient) {
+          std::copy_n(samples->dx.data() + from, count, dx + to);
+          std::copy_n(samples->dz.data() + from, count, dz + to);
+        }
+      }
+    }
+  }
+
+  return generated;
+}
+
+auto noise_tile_cache::acquire(const noise_source& source, const tile_key& key,
+                               size_t& generated)
+    -> std::shared_ptr<const tile> {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_);
+    if (const auto it = m_index_.find(key); it != m_index_.end()) {
+      m_entries_.splice(m_entries_.begin(), m_entries_, it->second);
+      ++m_counters_.hits;
+      return it->second->samples;
+    }
+    ++m_counters_.misses;
+  }
+
+  // Always with derivatives when the noise has them, so the tile serves
+  // callers with and without
+  constexpr size_t samples = static_cast<size_t>(tile_samples) * tile_samples;
+  auto generated_tile = std::make_shared<tile>();
+  generated_tile->values.resize(samples);
+  if (source.has_gradient()) {
+    generated_tile->dx.resize(samples);
+    generated_tile->dz.resize(samples);
+  }
+  source.evaluate_rows(key.x * tile_samples, key.z * tile_samples,
+                       tile_samples, tile_samples,
+                       generated_tile->values.data(),
+                       generated_tile->dx.data(), generated_tile->dz.data(),
+                       tile_samples);
+  generated += samples;
+
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  // Another thread generated the same tile in the meantime
+  if (const auto it = m_index_.find(key); it != m_index_.end()) {
+    return it->second->samples;
+  }
+
+  m_entries_.push_front({key, generated_tile});
+  m_index_.emplace(key, m_entries_.begin());
+  m_memory_usage_ += generated_tile->bytes();
+  evict();
+  return generated_tile;
+}
+
+auto noise_tile_cache::evict() -> void {
+  while (m_memory_usage_ > m_memory_budget_ && !m_entries_.empty()) {
+    const entry& last = m_entries_.back();
+    m_memory_usage_ -= last.samples->bytes();
+    m_index_.erase(last.key);
+    m_entries_.pop_back();
+    ++m_counters_.evictions;
+  }
+}
+
+auto noise_tile_cache::set_memory_budget(const size_t bytes) -> void {
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  m_memory_budget_ = bytes;
+  evict();
+}
+
+auto noise_tile_cache::clear() -> void {
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  m_entries_.clear();
+  m_index_.clear();
+  m_memory_usage_ = 0;
+}
+
+auto noise_tile_cache::memory_budget() const -> size_t {
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  return m_memory_budget_;
+}
+
+auto noise_tile_cache::memory_usage() const -> size_t {
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  return m_memory_usage_;
+}
+
+auto noise_tile_cache::entries() const -> size_t {
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  return m_entries_.size();
+}
+
+auto noise_tile_cache::stats() const -> counters {
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  return m_counters_;
+}
@@ -0,0 +1,156 @@
+#include "terrain/packed_vertex.hpp"
+
+#include <cmath>
+
+namespace {
+auto sign_not_zero(const float v) -> float { return v >= 0.0f ? 1.0f : -1.0f; }
+
+auto to_snorm16(const float v) -> std::int16_t {
+  return static_cast<std::int16_t>(
+      std::lround(glm::clamp(v, -1.0f, 1.0f) * 32767.0f));
+}
+}  // namespace
+
+auto vertex_packing::for_heightfield(const heightfield& field,
+                                     const float min_height,
+                                     const float max_height) -> vertex_packing {
+  vertex_packing packing;
+  packing.origin = field.origin();
+  packing.spacing = field.spacing();
+  packing.grid_size = field.grid_size();
+  packing.height_min = min_height;
+  // A flat terrain still needs a non-zero step
+  packing.height_step = glm::max(max_height - min_height, 1.0f) / 65535.0f;
+  packing.uv_offset = field.uv_offset();
+  packing.uv_scale = field.uv_scale();
+
+  return packing;
+}
+
+auto oct_encode(const glm::vec3& n) -> glm::vec<2, std::int16_t> {
+  // Project onto the octahedron |x| + |y| + |z| = 1 around the y axis, so
+  // normals close to up (most of a terrain) land in the middle of the map
+  const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+  float px = n.x / l1;
+  float pz = n.z / l1;
+
+  // Fold the lower half over the diagonals
+  if (n.y < 0.0f) {
+    const float fx = (1.0f - std::abs(pz)) * sign_not_zero(px);
+    const float fz = (1.0f - std::abs(px)) * sign_not_zero(pz);
+    px = fx;
+    pz = fz;
+  }
+
+  return {to_snorm16(px), to_snorm16(pz)};
+}
+
+auto oct_decode(const std::int16_t x, const std::int16_t y) -> glm::vec3 {
+  const float px = glm::clamp(static_cast<float>(x) / 32767.0f, -1.0f, 1.0f);
+  const float pz = glm::clamp(static_cast<float>(y) / 32767.0f, -1.0f, 1.0f);
+
+  glm::vec3 n(px, 1.0f - std::abs(px) - std::abs(pz), pz);
+  const float t = glm::max(-n.y, 0.0f);
+  n.x += n.x >= 0.0f ? -t : t;
+  n.z += n.z >= 0.0f ? -t : t;
+
+  return glm::normalize(n);
+}
+
+auto pack_vertex(const cgra::mesh_vertex& v, const int i, const int j,
+                 const packed_vertex_kind kind, const vertex_packing& packing)
+    -> packed_terrain_vertex {
+  packed_terrain_vertex p;
+  p.i = static_cast<std::uint16_t>(i);
+  p.j = static_cast<std::uint16_t>(j);
+  p.height = static_cast<std::uint16_t>(std::lround(
+      glm::clamp((v.pos.y - packing.height_min) / packing.height_step, 0.0f,
+                 65535.0f)));
+  p.kind = kind;
+
+  const auto normal = oct_encode(v.norm);
+  p.normal[0] = normal.x;
+  p.normal[1] = normal.y;
+
+  return p;
+}
+
+auto unpack_vertex(const packed_terrain_vertex& p,
+                   const vertex_packing& packing) -> cgra::mesh_vertex {
+  const float fi = static_cast<float>(p.i);
+  const float fj = static_cast<float>(p.j);
+  const float grid = static_cast<float>(packing.grid_size);
+
+  cgra::mesh_vertex v;
+  v.pos = {packing.origin.x + fi * packing.spacing,
+           packing.height_min + static_cast<float>(p.height) * packing.height_step,
+           packing.origin.y + fj * packing.spacing};
+  v.norm = oct_decode(p.normal[0], p.normal[1]);
+
+  switch (p.kind) {
+    case packed_vertex_kind::wall_top:
+    case packed_vertex_kind::wall_bottom:
+      // Walls facing +-x run along j, walls facing +-z along i
+      v.uv = {(std::abs(v.norm.x) > 0.5f ? fj : fi) / grid,
+              p.kind == packed_vertex_kind::wall_top ? 0.0f : 1.0f};
+      break;
+    case packed_vertex_kind::cap:
+      v.uv = {fi / grid, fj / grid};
+      break;
+    default:
+      v.uv = (packing.uv_offset + glm::vec2(fi, fj)) * packing.uv_scale;
+      break;
+  }
+
+  // Same tangent frame as heightfield::vertex
+  if (p.kind == packed_vertex_kind::surface) {
+    if (v.norm.y > 0.0001f) {
+      v.tang = glm::normalize(glm::vec3(1.0f, -v.norm.x / v.norm.y, 0.0f));
+      v.bitang = glm::normalize(glm::vec3(0.0f, -v.norm.z / v.norm.y, 1.0f));
+    } else {
+      v.tang = {1.0f, 0.0f, 0.0f};
+      v.bitang = {0.0f, 0.0f, 1.0f};
+    }
+  }
+
+  return v;
+}
+
+auto build_packed_mesh(const std::vector<packed_terrain_vertex>& vertices,
+                       const std::vector<unsigned int>& indices,
+                       const GLenum mode) -> cgra::gl_mesh {
+  cgra::gl_mesh m;
+  glGenVertexArrays(1, &m.vao);
+  glGenBuffers(1, &m.vbo);
+  glGenBuffers(1, &m.ibo);
+
+  glBindVertexArray(m.vao);
+
+  glBindBuffer(GL_ARRAY_BUFFER, m.vbo);
+  glBufferData(GL_ARRAY_BUFFER,
+               vertices.size() * sizeof(packed_terrain_vertex),
+               vertices.data(), GL_STATIC_DRAW);
+
+  // location=5 : grid sample, quantized height and kind (4 x uint16)
+  glEnableVertexAttribArray(5);
+  glVertexAttribIPointer(
+      5, 4, GL_UNSIGNED_SHORT, sizeof(packed_terrain_vertex),
+      reinterpret_cast<void*>(offsetof(packed_terrain_vertex, i)));
+
+  // location=6 : octahedral normal (2 x int16)
+  glEnableVertexAttribArray(6);
+  glVertexAttribIPointer(
+      6, 2, GL_SHORT, sizeof(packed_terrain_vertex),
+      reinterpret_cast<void*>(offsetof(packed_terrain_vertex, normal)));
+
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m.ibo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(),
+               indices.data(), GL_STATIC_DRAW);
+
+  m.index_count = static_cast<int>(indices.size());
+  m.mode = mode;
+
+  glBindVertexArray(0);
+
+  return m;
+}
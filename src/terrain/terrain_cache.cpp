@@ -0,0 +1,198 @@
+#include "terrain/terrain_cache.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+#include "terrain/terrain_model.hpp"
+#include "terrain/terrain_snapshot.hpp"
+
+namespace fs = std::filesystem;
+
+namespace {
+// FNV-1a, so the hash and with it the disk entry names never change between
+// runs or compilers
+auto fnv1a(std::uint64_t hash, const std::uint32_t v) -> std::uint64_t {
+  for (auto k = 0; k < 4; ++k) {
+    hash ^= (v >> (8 * k)) & 0xFF;
+    hash *= 0x100000001B3ull;
+  }
+  return hash;
+}
+}  // namespace
+
+auto terrain_cache::parameters::hash() const -> std::uint64_t {
+  std::uint64_t h = 0xCBF29CE484222325ull;
+  h = fnv1a(h, seed);
+  h = fnv1a(h, octaves);
+  h = fnv1a(h, std::bit_cast<std::uint32_t>(lacunarity));
+  h = fnv1a(h, std::bit_cast<std::uint32_t>(persistence));
+  h = fnv1a(h, repeat);
+  h = fnv1a(h, std::bit_cast<std::uint32_t>(height));
+  h = fnv1a(h, static_cast<std::uint32_t>(grid_size));
+  h = fnv1a(h, std::bit_cast<std::uint32_t>(spacing));
+  h = fnv1a(h, noise_2d);
+  h = fnv1a(h, layered);
+  // Only hashed when set, so entries written before simplex noise existed
+  // keep their names
+  if (simplex != 0) h = fnv1a(h, simplex);
+  return h;
+}
+
+auto terrain_cache::parameters_of(const terrain_model& model) -> parameters {
+  parameters params;
+  params.seed = model.m_seed;
+  params.octaves = model.m_octaves;
+  params.lacunarity = model.m_lacunarity;
+  params.persistence = model.m_persistence;
+  params.repeat = model.m_repeat;
+  params.height = model.m_height;
+  params.grid_size = model.m_grid_size;
+  params.spacing = model.m_spacing;
+  params.noise_2d = model.m_use_2d_noise ? 1 : 0;
+  params.layered = model.m_layered ? 1 : 0;
+  params.simplex = model.m_noise_basis == noise_basis::simplex ? 1 : 0;
+  return params;
+}
+
+auto terrain_cache::find(const parameters& params, heightfield& field)
+    -> bool {
+  const std::uint64_t key = params.hash();
+
+  if (const auto it = m_index_.find(key);
+      it != m_index_.end() && it->second->params == params) {
+    m_entries_.splice(m_entries_.begin(), m_entries_, it->second);
+    field.heights() = it->second->heights;
+    field.normals() = it->second->normals;
+    ++m_counters_.memory_hits;
+    return true;
+  }
+
+  const std::string path = entry_path(params);
+  std::error_code error;
+  if (fs::exists(path, error)) {
+    terrain_snapshot snapshot;
+    if (snapshot.open(path)) {
+      // The hash only names the file, the header tells whether it really
+      // holds these parameters
+      const snapshot_header& header = snapshot.header();
+      const auto flag = [&header](const std::uint32_t bit) -> std::uint32_t {
+        return (header.flags & bit) != 0 ? 1 : 0;
+      };
+      const parameters stored{header.seed,
+                              header.octaves,
+                              header.lacunarity,
+                              header.persistence,
+                              header.repeat,
+                              header.height,
+                              header.grid_size,
+                              header.spacing,
+                              flag(snapshot_header::flag_noise_2d),
+                              flag(snapshot_header::flag_layered),
+                              flag(snapshot_header::flag_simplex)};
+      // Entries from before the cache kept them exact would quantize the
+      // heights, they are regenerated and overwritten
+      if (stored == params && snapshot.is_exact() && snapshot.decode(field)) {
+        // Mark the entry as recently used for disk eviction
+        fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+        insert(params, field);
+        ++m_counters_.disk_hits;
+        return true;
+      }
+    }
+  }
+
+  ++m_counters_.misses;
+  return false;
+}
+
+auto terrain_cache::store(const parameters& params, const terrain_model& model)
+    -> void {
+  insert(params, model.m_heightfield);
+
+  if (m_disk_budget == 0) return;
+
+  std::error_code error;
+  fs::create_directories(m_directory, error);
+  if (error) {
+    std::cerr << "Error: Failed to create terrain cache directory "
+              << m_directory << '\n';
+    return;
+  }
+
+  terrain_snapshot::save(entry_path(params), model, true);
+  evict_disk();
+}
+
+auto terrain_cache::clear() -> void {
+  m_entries_.clear();
+  m_index_.clear();
+  m_memory_usage_ = 0;
+  m_counters_ = {};
+
+  std::error_code error;
+  for (const auto& file : fs::directory_iterator(m_directory, error)) {
+    if (file.path().extension() == ".tsnap") fs::remove(file.path(), error);
+  }
+}
+
+auto terrain_cache::entry_path(const parameters& params) const
+    -> std::string {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%016llx.tsnap",
+                static_cast<unsigned long long>(params.hash()));
+  return (fs::path(m_directory) / name).string();
+}
+
+auto terrain_cache::insert(const parameters& params, const heightfield& field)
+    -> void {
+  const std::uint64_t key = params.hash();
+
+  if (const auto it = m_index_.find(key); it != m_index_.end()) {
+    m_memory_usage_ -= it->second->bytes();
+    m_entries_.erase(it->second);
+    m_index_.erase(it);
+  }
+
+  const size_t bytes =
+      field.sample_count() * (sizeof(float) + sizeof(glm::vec3));
+  if (bytes > m_memory_budget) return;
+
+  m_entries_.push_front({params, field.heights(), field.normals()});
+  m_index_[key] = m_entries_.begin();
+  m_memory_usage_ += bytes;
+
+  while (m_memory_usage_ > m_memory_budget) {
+    const entry& oldest = m_entries_.back();
+    m_memory_usage_ -= oldest.bytes();
+    m_index_.erase(oldest.params.hash());
+    m_entries_.pop_back();
+  }
+}
+
+auto terrain_cache::evict_disk() const -> void {
+  struct disk_entry {
+    fs::path path;
+    fs::file_time_type last_used;
+    std::uintmax_t size;
+  };
+
+  std::vector<disk_entry> files;
+  std::uintmax_t total = 0;
+  std::error_code error;
+  for (const auto& file : fs::directory_iterator(m_directory, error)) {
+    if (file.path().extension() != ".tsnap") continue;
+    files.push_back({file.path(), file.last_write_time(error),
+                     file.file_size(error)});
+    total += files.back().size;
+  }
+
+  std::ranges::sort(files, {}, &disk_entry::last_used);
+  for (const auto& file : files) {
+    if (total <= m_disk_budget) break;
+    fs::remove(file.path, error);
+    total -= file.size;
+  }
+}
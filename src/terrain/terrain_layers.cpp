@@ -0,0 +1,169 @@
+#include "terrain/terrain_layers.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#include "terrain/noise_graph.hpp"
+#include "terrain/terrain_model.hpp"
+#include "utils/parallel.hpp"
+
+terrain_layers::terrain_layers() {
+  // Broad land masses, mountain ranges on their high ground and a fine
+  // layer of erosion detail on top
+  m_layers.push_back(
+      {"Continent", layer_type::continent, true, 0.35f, 1.0f, 0, 10});
+  m_layers.push_back(
+      {"Mountains", layer_type::mountains, true, 1.0f, 0.3f, 0, 11});
+  m_layers.push_back(
+      {"Erosion Detail", layer_type::detail, true, 4.0f, 0.08f, 3, 12});
+  m_layers.push_back({"User Edits", layer_type::edits});
+}
+
+auto terrain_layers::capture_edits(const heightfield& field) -> void {
+  if (field.grid_size() != m_written_grid_size_ ||
+      field.spacing() != m_written_spacing_ ||
+      field.origin() != m_written_origin_ ||
+      field.sample_count() != m_written_.size()) {
+    return;
+  }
+
+  m_edits_.resize(m_written_.size(), 0.0f);
+  const std::vector<float>& heights = field.heights();
+  for (size_t k = 0; k < heights.size(); ++k) {
+    m_edits_[k] += heights[k] - m_written_[k];
+  }
+}
+
+auto terrain_layers::composite(const terrain_model& model, heightfield& field)
+    -> size_t {
+  const size_t samples = field.sample_count();
+  m_caches_.resize(m_layers.size());
+
+  // Edits belong to the grid they were made on
+  if (field.grid_size() != m_written_grid_size_ ||
+      field.spacing() != m_written_spacing_ ||
+      field.origin() != m_written_origin_) {
+    m_edits_.clear();
+  }
+  m_edits_.resize(samples, 0.0f);
+
+  size_t evaluated = 0;
+  const float* continent = nullptr;
+  for (size_t l = 0; l < m_layers.size(); ++l) {
+    const layer& settings = m_layers[l];
+    layer_cache& cache = m_caches_[l];
+    cache.stats = {};
+    if (settings.type == layer_type::edits || !settings.enabled) continue;
+
+    const layer_key key = key_of(settings, model, field);
+    if (key != cache.key || cache.values.size() != samples) {
+      const auto start = std::chrono::steady_clock::now();
+      evaluate(key, field, cache.values);
+      cache.key = key;
+      cache.stats = {true, samples,
+                     std::chrono::duration<float, std::milli>(
+                         std::chrono::steady_clock::now() - start)
+                         .count()};
+      evaluated += samples;
+    }
+
+    if (settings.type == layer_type::continent && !continent) {
+      continent = cache.values.data();
+    }
+  }
+
+  // Noise in [0, 1] to heights, the continent and detail around zero and the
+  // mountains upwards
+  const float height = model.m_height;
+  std::vector<float>& heights = field.heights();
+  std::ranges::fill(heights, 0.0f);
+  for (size_t l = 0; l < m_layers.size(); ++l) {
+    const layer& settings = m_layers[l];
+    if (!settings.enabled) continue;
+
+    const float scale = settings.amplitude * height;
+    const std::vector<float>& values = m_caches_[l].values;
+    switch (settings.type) {
+      case layer_type::continent:
+      case layer_type::detail:
+        for (size_t k = 0; k < samples; ++k) {
+          heights[k] += (values[k] - 0.5f) * scale;
+        }
+        break;
+      case layer_type::mountains:
+        for (size_t k = 0; k < samples; ++k) {
+          const float mask =
+              continent ? glm::smoothstep(0.5f, 0.6f, continent[k]) : 1.0f;
+          heights[k] += values[k] * mask * scale;
+        }
+        break;
+      case layer_type::edits:
+        for (size_t k = 0; k < samples; ++k) heights[k] += m_edits_[k];
+        break;
+    }
+  }
+
+  field.compute_normals();
+
+  m_written_ = heights;
+  m_written_grid_size_ = field.grid_size();
+  m_written_spacing_ = field.spacing();
+  m_written_origin_ = field.origin();
+  return evaluated;
+}
+
+auto terrain_layers::clear_edits() -> void {
+  std::ranges::fill(m_edits_, 0.0f);
+}
+
+auto terrain_layers::memory_usage() const -> size_t {
+  size_t floats = m_edits_.size() + m_written_.size();
+  for (const layer_cache& cache : m_caches_) floats += cache.values.size();
+  return floats * sizeof(float);
+}
+
+auto terrain_layers::key_of(const layer& l, const terrain_model& model,
+                            const heightfield& field) -> layer_key {
+  layer_key key;
+  key.seed = model.m_seed + l.seed_offset;
+  key.octaves = l.octaves > 0 ? static_cast<unsigned int>(l.octaves)
+                              : model.m_octaves;
+  key.lacunarity = model.m_lacunarity;
+  key.persistence = model.m_persistence;
+  key.frequency = l.frequency;
+  key.planar = model.m_use_2d_noise;
+  key.basis = model.m_noise_basis;
+  key.type = l.type;
+  key.grid_size = field.grid_size();
+  key.spacing = field.spacing();
+  key.origin = field.origin();
+  return key;
+}
+
+auto terrain_layers::evaluate(const layer_key& key, const heightfield& field,
+                              std::vector<float>& values) -> void {
+  noise_graph graph;
+  const noise_graph::noise_settings settings{
+      key.seed,      key.octaves, key.lacunarity, key.persistence,
+      key.frequency, key.planar,  key.basis};
+  const noise_program program = graph.compile(
+      key.type == layer_type::mountains ? graph.ridged(settings)
+                                        : graph.fractal(settings));
+
+  const int resolution = field.resolution();
+  values.resize(field.sample_count());
+  parallel_for_blocks(
+      0, resolution,
+      [&](const int row_begin, const int row_end) {
+        std::vector<float> xs(resolution);
+        std::vector<float> zs(resolution);
+        for (auto j = 0; j < resolution; ++j) zs[j] = field.z(j);
+
+        for (auto i = row_begin; i < row_end; ++i) {
+          std::ranges::fill(xs, field.x(i));
+          program.evaluate(xs.data(), zs.data(),
+                           values.data() + field.index(i, 0), xs.size());
+        }
+      },
+      16);
+}
@@ -0,0 +1,480 @@
+#include "terrain/terrain_lod.hpp"
+
+#include <chrono>
+#include <limits>
+#include <tuple>
+
+namespace {
+// Number of trailing zero bits, i.e. how many times value halves evenly
+auto halvings(int value) -> int {
+  int count = 0;
+  while (value > 0 && value % 2 == 0) {
+    value /= 2;
+    ++count;
+  }
+  return count;
+}
+}  // namespace
+
+auto terrain_lod::build(const heightfield& field) -> void {
+  m_spacing_ = field.spacing();
+  m_origin_ = field.origin();
+
+  if (field.grid_size() != m_grid_size_) {
+    m_grid_size_ = field.grid_size();
+
+    // Patches have an even number of cells so a coarser neighbour's samples
+    // land on every other sample of the finer patch's edge. Prefer the patch
+    // size that leaves the most levels before the grid stops halving evenly,
+    // then the smallest.
+    m_patch_cells_ = 0;
+    int best = -1;
+    for (auto cells = 8; cells <= 64; cells += 2) {
+      if (m_grid_size_ % cells != 0) continue;
+
+      const int score = halvings(m_grid_size_ / cells);
+      if (score > best) {
+        best = score;
+        m_patch_cells_ = cells;
+      }
+    }
+
+    // Small grids are a single patch
+    if (m_patch_cells_ == 0 && m_grid_size_ > 0 && m_grid_size_ <= 64 &&
+        m_grid_size_ % 2 == 0) {
+      m_patch_cells_ = m_grid_size_;
+    }
+
+    if (m_patch_cells_ == 0) {
+      std::cout << "Terrain LOD disabled, no even patch size divides the "
+                << m_grid_size_ << " cell grid" << std::endl;
+      m_levels_ = 0;
+      m_leaf_count_ = 0;
+      m_patterns_.clear();
+      m_selected_.clear();
+      m_bounds_.clear();
+      return;
+    }
+
+    m_leaf_count_ = m_grid_size_ / m_patch_cells_;
+    m_levels_ = 1;
+    while ((1 << (m_levels_ - 1)) < m_leaf_count_) ++m_levels_;
+
+    build_patterns();
+
+    m_bounds_.assign(m_levels_, {});
+    for (auto level = 0; level < m_levels_; ++level) {
+      const int count = nodes_per_axis(level);
+      m_bounds_[level].assign(static_cast<size_t>(count) * count, {});
+    }
+    m_leaf_levels_.assign(static_cast<size_t>(m_leaf_count_) * m_leaf_count_,
+                          0);
+
+    std::cout << "Terrain LOD uses " << m_patch_cells_ << " cell patches over "
+              << m_levels_ << " levels" << std::endl;
+  }
+
+  if (m_patch_cells_ == 0) return;
+
+  build_bounds(field, 0, m_leaf_count_ - 1, 0, m_leaf_count_ - 1);
+}
+
+auto terrain_lod::update_bounds(const heightfield& field, const grid_rect& rect)
+    -> void {
+  if (m_patch_cells_ == 0 || rect.empty()) return;
+
+  // Samples on a patch edge belong to the patches on both sides
+  const auto first_leaf = [this](const int sample) {
+    return glm::max(0, (sample - 1) / m_patch_cells_);
+  };
+  const auto last_leaf = [this](const int sample) {
+    return glm::min(m_leaf_count_ - 1, sample / m_patch_cells_);
+  };
+
+  build_bounds(field, first_leaf(rect.i_min), last_leaf(rect.i_max),
+               first_leaf(rect.j_min), last_leaf(rect.j_max));
+}
+
+auto terrain_lod::build_bounds(const heightfield& field, const int leaf_min_i,
+                               const int leaf_max_i, const int leaf_min_j,
+                               const int leaf_max_j) -> void {
+  constexpr float inf = std::numeric_limits<float>::infinity();
+
+  // Leaves straight from the samples, leaves past the grid stay empty
+  const int leaves = nodes_per_axis(0);
+  for (auto x = leaf_min_i; x <= leaf_max_i; ++x) {
+    for (auto z = leaf_min_j; z <= leaf_max_j; ++z) {
+      node_bounds bounds{inf, -inf};
+      for (auto i = x * m_patch_cells_; i <= (x + 1) * m_patch_cells_; ++i) {
+        for (auto j = z * m_patch_cells_; j <= (z + 1) * m_patch_cells_; ++j) {
+          const float h = field.height(i, j);
+          bounds.min_height = glm::min(bounds.min_height, h);
+          bounds.max_height = glm::max(bounds.max_height, h);
+        }
+      }
+      m_bounds_[0][x * leaves + z] = bounds;
+    }
+  }
+
+  if (leaf_min_i == 0 && leaf_min_j == 0 && leaf_max_i == m_leaf_count_ - 1 &&
+      leaf_max_j == m_leaf_count_ - 1) {
+    for (auto x = 0; x < leaves; ++x) {
+      for (auto z = 0; z < leaves; ++z) {
+        if (x >= m_leaf_count_ || z >= m_leaf_count_) {
+          m_bounds_[0][x * leaves + z] = {inf, -inf};
+        }
+      }
+    }
+  }
+
+  // Then every parent of the touched leaves from its four children
+  for (auto level = 1; level < m_levels_; ++level) {
+    const int count = nodes_per_axis(level);
+    const int child_count = nodes_per_axis(level - 1);
+
+    for (auto x = leaf_min_i >> level; x <= leaf_max_i >> level; ++x) {
+      for (auto z = leaf_min_j >> level; z <= leaf_max_j >> level; ++z) {
+        node_bounds bounds{inf, -inf};
+        for (auto c = 0; c < 4; ++c) {
+          const node_bounds& child =
+              m_bounds_[level - 1][(2 * x + c / 2) * child_count + 2 * z +
+                                   c % 2];
+          bounds.min_height = glm::min(bounds.min_height, child.min_height);
+          bounds.max_height = glm::max(bounds.max_height, child.max_height);
+        }
+        m_bounds_[level][x * count + z] = bounds;
+      }
+    }
+  }
+}
+
+auto terrain_lod::pattern(const int level, const unsigned int stitch_mask,
+                          const unsigned int border_mask) const
+    -> std::vector<unsigned int> {
+  const int cells = m_patch_cells_;
+  const int step = 1 << level;
+  const int span = cells * step;
+  const unsigned int row_length = m_grid_size_ + 1;
+
+  // Samples as (i, j) offsets from the patch's first sample. Odd samples on a
+  // stitched edge move onto the previous even sample, which lies on the
+  // coarser neighbour's edge. Triangles that collapse are dropped.
+  const auto sample = [&](int a, int b) {
+    if ((a == 0 && (stitch_mask & 1u)) || (a == cells && (stitch_mask & 2u))) {
+      b -= b % 2;
+    }
+    if ((b == 0 && (stitch_mask & 4u)) || (b == cells && (stitch_mask & 8u))) {
+      a -= a % 2;
+    }
+    return glm::ivec2(a * step, b * step);
+  };
+
+  // The walls hang from every sample of the grid's border, so an edge along
+  // it has to pass through all of them
+  const auto on_border = [&](const glm::ivec2& p, const glm::ivec2& q) {
+    return (p.x == q.x && ((p.x == 0 && (border_mask & 1u)) ||
+                           (p.x == span && (border_mask & 2u)))) ||
+           (p.y == q.y && ((p.y == 0 && (border_mask & 4u)) ||
+                           (p.y == span && (border_mask & 8u))));
+  };
+
+  std::vector<unsigned int> indices;
+  indices.reserve(6 * static_cast<size_t>(cells) * cells);
+
+  const auto push = [&](const glm::ivec2& p) {
+    indices.push_back(static_cast<unsigned int>(p.x) * row_length +
+                      static_cast<unsigned int>(p.y));
+  };
+
+  // A triangle with an edge on the border becomes a fan from its third
+  // corner to every sample of that edge, keeping the winding
+  const auto push_triangle = [&](glm::ivec2 p, glm::ivec2 q, glm::ivec2 r) {
+    if (p == q || q == r || p == r) return;
+
+    for (auto rotation = 0; rotation < 3; ++rotation) {
+      if (on_border(p, q)) {
+        const glm::ivec2 delta = glm::sign(q - p);
+        for (glm::ivec2 f = p; f != q; f += delta) {
+          push(f);
+          push(f + delta);
+          push(r);
+        }
+        return;
+      }
+      std::tie(p, q, r) = std::tuple(q, r, p);
+    }
+
+    push(p);
+    push(q);
+    push(r);
+  };
+
+  // Same triangulation and winding as the full resolution top face
+  for (auto a = 0; a < cells; ++a) {
+    for (auto b = 0; b < cells; ++b) {
+      const glm::ivec2 k1 = sample(a, b);
+      const glm::ivec2 k2 = sample(a, b + 1);
+      const glm::ivec2 k3 = sample(a + 1, b);
+      const glm::ivec2 k4 = sample(a + 1, b + 1);
+
+      // When the +i and +j edges are both stitched, the usual diagonal of
+      // the far corner cell would pass straight through k1. When both edges
+      // of a corner cell lie on the border, they would share a triangle. In
+      // both cases the cell is split along the other diagonal instead
+      const bool far_corner = a == cells - 1 && b == cells - 1;
+      const bool near_corner = a == 0 && b == 0;
+      if ((far_corner && (stitch_mask & 2u) && (stitch_mask & 8u)) ||
+          (far_corner && (border_mask & 2u) && (border_mask & 8u)) ||
+          (near_corner && (border_mask & 1u) && (border_mask & 4u))) {
+        push_triangle(k1, k2, k4);
+        push_triangle(k1, k4, k3);
+      } else {
+        push_triangle(k1, k2, k3);
+        push_triangle(k2, k4, k3);
+      }
+    }
+  }
+
+  return indices;
+}
+
+auto terrain_lod::build_patterns() -> void {
+  m_patterns_.clear();
+  m_pattern_offset_.assign(static_cast<size_t>(m_levels_) * 256, 0);
+  m_pattern_count_.assign(static_cast<size_t>(m_levels_) * 256, 0);
+
+  // Patches are square and aligned to the grid, so a patch touches no border,
+  // one, two at a corner, or all four when it is the whole grid. Stitched
+  // edges always have a neighbour, so they are never on the border
+  constexpr unsigned int border_masks[] = {0, 1, 2, 4, 8, 5, 6, 9, 10, 15};
+  for (auto level = 0; level < m_levels_; ++level) {
+    for (const unsigned int border : border_masks) {
+      for (auto stitch = 0u; stitch < 16u; ++stitch) {
+        if (stitch & border) continue;
+
+        const std::vector<unsigned int> indices =
+            pattern(level, stitch, border);
+        const int id = pattern_id(level, stitch, border);
+
+        m_pattern_offset_[id] = static_cast<GLsizei>(m_patterns_.size());
+        m_pattern_count_[id] = static_cast<GLsizei>(indices.size());
+        m_patterns_.insert(m_patterns_.end(), indices.begin(), indices.end());
+      }
+    }
+  }
+
+  m_ibo_dirty_ = true;
+}
+
+auto terrain_lod::select(const glm::vec3& camera_pos) -> void {
+  m_selected_.clear();
+  if (m_patch_cells_ == 0) return;
+
+  const auto start = std::chrono::steady_clock::now();
+
+  select_node(camera_pos, m_levels_ - 1, 0, 0);
+
+  // Split patches until no neighbour is more than one level finer, so every
+  // edge can be stitched. Splitting only ever refines, so this terminates.
+  bool changed = true;
+  while (changed) {
+    changed = false;
+
+    for (size_t n = 0; n < m_selected_.size(); ++n) {
+      const lod_node node = m_selected_[n];
+      if (node.level == 0) continue;
+
+      const int span = leaves_per_node(node.level);
+      const int x = node.i / m_patch_cells_;
+      const int z = node.j / m_patch_cells_;
+
+      bool split = false;
+      for (auto s = 0; s < span && !split; ++s) {
+        const auto too_fine = [&](const int lx, const int lz) {
+          return lx >= 0 && lz >= 0 && lx < m_leaf_count_ &&
+                 lz < m_leaf_count_ &&
+                 m_leaf_levels_[lx * m_leaf_count_ + lz] < node.level - 1;
+        };
+        split = too_fine(x - 1, z + s) || too_fine(x + span, z + s) ||
+                too_fine(x + s, z - 1) || too_fine(x + s, z + span);
+      }
+      if (!split) continue;
+
+      const int level = node.level - 1;
+      const int child_x = (x >> level);
+      const int child_z = (z >> level);
+      const int child_cells = m_patch_cells_ << level;
+
+      m_selected_[n] = {node.i, node.j, level, 0};
+      m_selected_.push_back({node.i + child_cells, node.j, level, 0});
+      m_selected_.push_back({node.i, node.j + child_cells, level, 0});
+      m_selected_.push_back(
+          {node.i + child_cells, node.j + child_cells, level, 0});
+      mark(level, child_x, child_z);
+      mark(level, child_x + 1, child_z);
+      mark(level, child_x, child_z + 1);
+      mark(level, child_x + 1, child_z + 1);
+
+      changed = true;
+    }
+  }
+
+  // Stitch every edge that borders a coarser patch, and collect the draws
+  const GLint row_length = m_grid_size_ + 1;
+  m_draw_counts_.clear();
+  m_draw_offsets_.clear();
+  m_draw_base_vertices_.clear();
+
+  for (auto& node : m_selected_) {
+    const int cells = m_patch_cells_ << node.level;
+    node.border_mask = (node.i == 0 ? 1u : 0u) |
+                       (node.i + cells == m_grid_size_ ? 2u : 0u) |
+                       (node.j == 0 ? 4u : 0u) |
+                       (node.j + cells == m_grid_size_ ? 8u : 0u);
+    for (auto edge = 0; edge < 4; ++edge) {
+      if (coarse_neighbour(node, edge)) node.stitch_mask |= 1u << edge;
+    }
+
+    const int id = pattern_id(node.level, node.stitch_mask, node.border_mask);
+    m_draw_counts_.push_back(m_pattern_count_[id]);
+    m_draw_offsets_.push_back(reinterpret_cast<const void*>(
+        static_cast<size_t>(m_pattern_offset_[id]) * sizeof(unsigned int)));
+    m_draw_base_vertices_.push_back(node.i * row_length + node.j);
+  }
+
+  m_last_select_ms_ = std::chrono::duration<float, std::milli>(
+                          std::chrono::steady_clock::now() - start)
+                          .count();
+}
+
+auto terrain_lod::select_node(const glm::vec3& camera_pos, const int level,
+                              const int x, const int z) -> void {
+  const int span = leaves_per_node(level);
+
+  // Entirely past the grid
+  if (x * span >= m_leaf_count_ || z * span >= m_leaf_count_) return;
+
+  const bool partial =
+      (x + 1) * span > m_leaf_count_ || (z + 1) * span > m_leaf_count_;
+  const float size = static_cast<float>(m_patch_cells_ * span) * m_spacing_;
+
+  if (level > 0 &&
+      (partial || distance_to(camera_pos, level, x, z) < m_detail * size)) {
+    for (auto c = 0; c < 4; ++c) {
+      select_node(camera_pos, level - 1, 2 * x + c / 2, 2 * z + c % 2);
+    }
+    return;
+  }
+
+  const int cells = m_patch_cells_ * span;
+  m_selected_.push_back({x * cells, z * cells, level, 0});
+  mark(level, x, z);
+}
+
+auto terrain_lod::distance_to(const glm::vec3& camera_pos, const int level,
+                              const int x, const int z) const -> float {
+  const node_bounds& bounds = m_bounds_[level][x * nodes_per_axis(level) + z];
+  const float size =
+      static_cast<float>(m_patch_cells_ * leaves_per_node(level)) * m_spacing_;
+
+  const glm::vec3 box_min(m_origin_.x + static_cast<float>(x) * size,
+                          bounds.min_height,
+                          m_origin_.y + static_cast<float>(z) * size);
+  const glm::vec3 box_max(box_min.x + size, bounds.max_height,
+                          box_min.z + size);
+
+  // Closest point of the patch's bounding box
+  const glm::vec3 closest = glm::clamp(camera_pos, box_min, box_max);
+  return glm::distance(camera_pos, closest);
+}
+
+auto terrain_lod::coarse_neighbour(const lod_node& node, const int edge) const
+    -> bool {
+  const int span = leaves_per_node(node.level);
+  const int x = node.i / m_patch_cells_;
+  const int z = node.j / m_patch_cells_;
+
+  // A coarser neighbour covers the whole edge, so one leaf beside it is enough
+  int lx = x;
+  int lz = z;
+  switch (edge) {
+    case 0:
+      lx = x - 1;
+      break;
+    case 1:
+      lx = x + span;
+      break;
+    case 2:
+      lz = z - 1;
+      break;
+    default:
+      lz = z + span;
+      break;
+  }
+
+  if (lx < 0 || lz < 0 || lx >= m_leaf_count_ || lz >= m_leaf_count_) {
+    return false;
+  }
+
+  return m_leaf_levels_[lx * m_leaf_count_ + lz] > node.level;
+}
+
+auto terrain_lod::mark(const int level, const int x, const int z) -> void {
+  const int span = leaves_per_node(level);
+  for (auto lx = x * span; lx < (x + 1) * span; ++lx) {
+    for (auto lz = z * span; lz < (z + 1) * span; ++lz) {
+      m_leaf_levels_[lx * m_leaf_count_ + lz] = level;
+    }
+  }
+}
+
+auto terrain_lod::triangle_count() const -> size_t {
+  size_t count = 0;
+  for (const GLsizei c : m_draw_counts_) {
+    count += static_cast<size_t>(c) / 3;
+  }
+
+  return count;
+}
+
+auto terrain_lod::draw(const cgra::gl_mesh& mesh,
+                       const int first_other_index) const -> void {
+  if (mesh.vao == 0) return;
+
+  if (m_patch_cells_ == 0 || m_selected_.empty()) {
+    mesh.draw();
+    return;
+  }
+
+  // The element buffer binding is VAO state, so it is only touched with the
+  // terrain's VAO bound. Whatever VAO was drawn last is left alone
+  glBindVertexArray(mesh.vao);
+
+  // Patches index straight into the terrain's vertex buffer, only the index
+  // buffer bound to the VAO is swapped for the draw
+  if (m_ibo_ == 0) glGenBuffers(1, &m_ibo_);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo_);
+  if (m_ibo_dirty_) {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 m_patterns_.size() * sizeof(unsigned int), m_patterns_.data(),
+                 GL_STATIC_DRAW);
+    m_ibo_dirty_ = false;
+  }
+  glMultiDrawElementsBaseVertex(
+      mesh.mode, m_draw_counts_.data(), GL_UNSIGNED_INT, m_draw_offsets_.data(),
+      static_cast<GLsizei>(m_draw_counts_.size()),
+      m_draw_base_vertices_.data());
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
+
+  // Bottom and walls at full resolution
+  glDrawElements(mesh.mode, mesh.index_count - first_other_index,
+                 GL_UNSIGNED_INT,
+                 reinterpret_cast<void*>(static_cast<size_t>(first_other_index) *
+                                         sizeof(unsigned int)));
+}
+
+auto terrain_lod::destroy() -> void {
+  if (m_ibo_ != 0) glDeleteBuffers(1, &m_ibo_);
+  m_ibo_ = 0;
+  m_ibo_dirty_ = true;
+}
@@ -1,289 +1,802 @@
 #include "terrain/terrain_model.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <glm/gtc/type_ptr.hpp>
+#include <limits>
 
+#include "terrain/heightmap_io.hpp"
+#include "terrain/terrain_cache.hpp"
+#include "terrain/terrain_snapshot.hpp"
+#include "utils/parallel.hpp"
 #include "utils/perlin_noise.hpp"
 
+namespace {
+// Outward normals of the front, back, left and right walls
+auto side_normal(const int side) -> glm::vec3 {
+  switch (side) {
+    case 0:
+      return {0.0f, 0.0f, -1.0f};
+    case 1:
+      return {0.0f, 0.0f, 1.0f};
+    case 2:
+      return {-1.0f, 0.0f, 0.0f};
+    default:
+      return {1.0f, 0.0f, 0.0f};
+  }
+}
+
+// Grid sample under edge sample s of the given wall
+auto side_sample(const int side, const int s, const int grid_size)
+    -> glm::ivec2 {
+  switch (side) {
+    case 0:
+      return {s, 0};
+    case 1:
+      return {s, grid_size};
+    case 2:
+      return {0, s};
+    default:
+      return {grid_size, s};
+  }
+}
+
+// Collects the positions and triangles of the top face for the AABB tree,
+// each triangle appears exactly once
+auto collect_triangles(const heightfield& field,
+                       std::vector<glm::vec3>& positions,
+                       std::vector<unsigned int>& indices) -> void {
+  const int grid_size = field.grid_size();
+  const int row_length = field.resolution();
+
+  positions.resize(field.sample_count());
+  indices.resize(6 * static_cast<size_t>(grid_size) * grid_size);
+
+  parallel_for_blocks(
+      0, row_length,
+      [&](const int row_begin, const int row_end) {
+        for (auto i = row_begin; i < row_end; ++i) {
+          for (auto j = 0; j <= grid_size; ++j) {
+            positions[field.index(i, j)] = field.position(i, j);
+          }
+
+          if (i == grid_size) continue;
+
+          for (auto j = 0; j < grid_size; ++j) {
+            const unsigned int k1 = i * row_length + j;
+            const unsigned int k2 = k1 + 1;
+            const unsigned int k3 = (i + 1) * row_length + j;
+            const unsigned int k4 = k3 + 1;
+
+            auto* out = &indices[(static_cast<size_t>(i) * grid_size + j) * 6];
+            out[0] = k1, out[1] = k2, out[2] = k3;
+            out[3] = k2, out[4] = k4, out[5] = k3;
+          }
+        }
+      },
+      16);
+}
+}  // namespace
+
 auto terrain_model::create_terrain(bool use_perlin) -> void {
-  cgra::mesh_builder mb;
-  cgra::mesh_vertex mv;
+  cancel_refinement();
+  const auto start = std::chrono::steady_clock::now();
 
-  auto terrain =
-      perlin(m_seed, m_octaves, m_lacunarity, m_persistence, m_repeat);
+  // Sculpting on a composite of the layers becomes their edits layer
+  const bool biome = use_perlin && m_use_biome_layers;
+  if (biome && m_layers_own_heightfield_) {
+    m_biome_layers.capture_edits(m_heightfield);
+  }
 
-  // Calculate the total width and length of the grid
-  const float total_width = m_spacing * static_cast<float>(m_grid_size);
-  const float total_length = m_spacing * static_cast<float>(m_grid_size);
-
-  // Calculate the offset to center the grid
-  const float x_offset = -total_width / 2.0f;
-  const float z_offset = -total_length / 2.0f;
-
-  // Box depth (how deep the box extends below the terrain)
-  // This value determines the "thickness" of the terrain mesh, creating walls
-  // that prevent the camera from going through the bottom
-  const float box_depth = m_box_depth;
-
-  // Create a 2D array to store adjacent faces for each vertex (only for top face)
-  m_adjacent_faces =
-      std::vector<std::vector<int>>((m_grid_size + 1) * (m_grid_size + 1));
-
-  // Generate the TOP grid vertices
-  for (auto i = 0; i <= m_grid_size; ++i) {
-    for (auto j = 0; j <= m_grid_size; ++j) {
-      // Calculate vertex position (x, y, z) with increased spacing and centered
-      float x = static_cast<float>(i) * m_spacing + x_offset;
-      float z = static_cast<float>(j) * m_spacing + z_offset;
-      
-      // Generate Perlin noise height
-      // terrain.generate_perlin returns [0, 1], so we map it to [-m_height/2, m_height/2]
-      float y = 0.0f;
-      if (use_perlin) {
-        float noise_value = terrain.generate_perlin(x, 0.0f, z);
-        // Map from [0, 1] to [-m_height/2, m_height/2]
-        y = (noise_value * m_height) - (m_height / 2.0f);
-      }
+  reset_grid(m_heightfield);
+  if (!biome) m_edits = {};
 
-      mv.pos = {x, y, z};
+  const auto params = terrain_cache::parameters_of(*this);
+  const bool cache_hit = use_perlin && !biome && m_use_cache &&
+                         m_cache.find(params, m_heightfield);
 
-      // Normal vectors for flat ground (facing up)
-      mv.norm = {0.0f, 1.0f, 0.0f};
+  const noise_tile_cache::counters tiles_before = m_noise_tiles->stats();
+  size_t generated = 0;
 
-      // Texture coordinates (u, v) can be set as desired
-      mv.uv = {static_cast<float>(i) * 10.0f / static_cast<float>(m_grid_size),
-               static_cast<float>(j) * 10.0f / static_cast<float>(m_grid_size)};
+  if (biome) {
+    generated = m_biome_layers.composite(*this, m_heightfield);
+  } else if (use_perlin && !cache_hit) {
+    generated = generate_noise(
+        m_heightfield, grid_lattice(), m_height,
+        m_use_noise_tiles ? m_noise_tiles.get() : nullptr, 1, nullptr);
+  }
 
-      mb.push_vertex(mv);
+  const noise_tile_cache::counters tiles_after = m_noise_tiles->stats();
+  m_generation_stats.noise_samples = generated;
+  m_generation_stats.milliseconds = std::chrono::duration<float, std::milli>(
+                                        std::chrono::steady_clock::now() - start)
+                                        .count();
+  m_generation_stats.cache_hit = cache_hit;
+  // Streamed tiles may be filled at the same time, so these are approximate
+  m_generation_stats.tile_hits = tiles_after.hits - tiles_before.hits;
+  m_generation_stats.tile_misses = tiles_after.misses - tiles_before.misses;
+  m_generation_stats.step = 1;
+  m_layers_own_heightfield_ = biome;
+
+  if (use_perlin && !biome && !cache_hit && m_use_cache) {
+    m_cache.store(params, *this);
+  }
+}
+
+auto terrain_model::create_terrain_progressive() -> void {
+  if (m_use_biome_layers) {
+    create_terrain(true);
+    return;
+  }
+
+  cancel_refinement();
+  m_layers_own_heightfield_ = false;
+  const auto start = std::chrono::steady_clock::now();
+  const auto elapsed = [start] {
+    return std::chrono::duration<float, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+
+  reset_grid(m_heightfield);
+  m_edits = {};
+
+  const auto params = terrain_cache::parameters_of(*this);
+  if (m_use_cache && m_cache.find(params, m_heightfield)) {
+    m_generation_stats = {0, elapsed(), true, 0, 0, 1};
+    return;
+  }
+
+  const noise_lattice lattice = grid_lattice();
+  const size_t preview_samples = generate_noise(
+      m_heightfield, lattice, m_height, nullptr, preview_step, nullptr);
+  m_generation_stats = {preview_samples, elapsed(), false, 0, 0,
+                        preview_step};
+
+  // Each level starts over from the noise, so the finer ones only depend on
+  // the parameters captured here, not on later changes in the GUI
+  std::shared_ptr<noise_tile_cache> tiles =
+      m_use_noise_tiles ? m_noise_tiles : nullptr;
+  m_refining_.store(true);
+  m_refine_thread_ = std::thread([this, field = m_heightfield, lattice,
+                                  height = m_height, tiles, params, elapsed,
+                                  samples = preview_samples]() mutable {
+    for (auto step = preview_step / 2; step >= 1; step /= 2) {
+      // Only the full resolution level goes through the noise tiles, the
+      // previews would fill them with lattices nothing else uses
+      samples += generate_noise(field, lattice, height,
+                                step == 1 ? tiles.get() : nullptr, step,
+                                &m_refine_cancel_);
+      if (m_refine_cancel_.load()) break;
+
+      std::lock_guard<std::mutex> lock(m_refine_mutex_);
+      m_refined_ = refined_level{field, step, samples, elapsed(), params};
+    }
+    m_refining_.store(false);
+  });
+}
+
+auto terrain_model::poll_refinement() -> bool {
+  std::optional<refined_level> level;
+  {
+    std::lock_guard<std::mutex> lock(m_refine_mutex_);
+    level.swap(m_refined_);
+  }
+  if (!level) return false;
+
+  // Sculpting on the preview is replaced along with it
+  m_heightfield = std::move(level->field);
+  m_edits = {};
+  m_generation_stats = {level->noise_samples, level->milliseconds, false, 0,
+                        0, level->step};
+
+  if (level->step == 1) {
+    std::cout << "Refined terrain to full resolution with "
+              << level->noise_samples << " noise samples in "
+              << level->milliseconds << " ms" << std::endl;
+    // Only when nothing changed since the refinement started, the cache
+    // names the entry by the current parameters
+    if (m_use_cache && terrain_cache::parameters_of(*this) == level->params) {
+      m_cache.store(level->params, *this);
     }
   }
+  return true;
+}
+
+auto terrain_model::cancel_refinement() -> void {
+  if (m_refine_thread_.joinable()) {
+    m_refine_cancel_.store(true);
+    m_refine_thread_.join();
+    m_refine_cancel_.store(false);
+  }
+
+  std::lock_guard<std::mutex> lock(m_refine_mutex_);
+  m_refined_.reset();
+}
+
+auto terrain_model::generate_noise(heightfield& field,
+                                   const noise_lattice& lattice,
+                                   const float height,
+                                   noise_tile_cache* tiles, const int step,
+                                   const std::atomic<bool>* cancel)
+    -> size_t {
+  const auto cancelled = [cancel] { return cancel && cancel->load(); };
+  const int resolution = field.resolution();
+  const long long shift = field.grid_size() / 2;  // see grid_lattice
+  float* heights = field.heights().data();
+
+  if (step > 1) {
+    // Every step-th grid sample on a coarse lattice, one more past the edge
+    // when the grid isn't a multiple of step
+    const int coarse = (field.grid_size() + step - 1) / step + 1;
+    noise_lattice preview = lattice;
+    preview.spacing = lattice.spacing * static_cast<float>(step);
+    preview.origin =
+        lattice.origin - static_cast<float>(shift) * lattice.spacing;
+    std::vector<float> samples(static_cast<size_t>(coarse) * coarse);
+    noise_source(preview).evaluate_rows(0, 0, coarse, coarse, samples.data(),
+                                        nullptr, nullptr, coarse);
+    if (cancelled()) return samples.size();
+
+    // Bilinear between the coarse samples, with the slope of the same patch
+    // for the normals, much cheaper than computing them from the heights
+    const float slope_scale = height / preview.spacing;
+    parallel_for_blocks(
+        0, resolution,
+        [&](const int row_begin, const int row_end) {
+          const auto inv_step = 1.0f / static_cast<float>(step);
+          for (auto i = row_begin; i < row_end; ++i) {
+            const int ci = std::min(i / step, coarse - 2);
+            const float fi = static_cast<float>(i - ci * step) * inv_step;
+            const float* row0 = samples.data() + ci * coarse;
+            const float* row1 = row0 + coarse;
+            for (auto j = 0; j < resolution; ++j) {
+              const int cj = std::min(j / step, coarse - 2);
+              const float fj = static_cast<float>(j - cj * step) * inv_step;
+              const float top = row0[cj] + (row0[cj + 1] - row0[cj]) * fj;
+              const float bottom = row1[cj] + (row1[cj + 1] - row1[cj]) * fj;
+              const float value = top + (bottom - top) * fi;
+              const float along_j = (row0[cj + 1] - row0[cj]) +
+                                    ((row1[cj + 1] - row1[cj]) -
+                                     (row0[cj + 1] - row0[cj])) *
+                                        fi;
+              heights[field.index(i, j)] = (value * height) - (height / 2.0f);
+              field.set_slope(i, j, (bottom - top) * slope_scale,
+                              along_j * slope_scale);
+            }
+          }
+        },
+        16);
+    return samples.size();
+  }
 
-  const GLuint top_vertices_count = (m_grid_size + 1) * (m_grid_size + 1);
+  const noise_source source(lattice);
+  std::atomic<size_t> generated{0};
 
-  // Generate the BOTTOM grid vertices (same x, z positions but lower y)
-  for (auto i = 0; i <= m_grid_size; ++i) {
-    for (auto j = 0; j <= m_grid_size; ++j) {
-      float x = static_cast<float>(i) * m_spacing + x_offset;
-      float z = static_cast<float>(j) * m_spacing + z_offset;
-      
-      float y = -box_depth;
-      if (use_perlin) {
-        float noise_value = terrain.generate_perlin(x, 0.0f, z);
-        y = (noise_value * m_height) - (m_height / 2.0f) - box_depth;
+  // The noise derivatives give exact normals in the same pass
+  std::vector<float> dxs;
+  std::vector<float> dzs;
+  if (source.has_gradient()) {
+    dxs.resize(field.sample_count());
+    dzs.resize(field.sample_count());
+  }
+
+  if (tiles) {
+    // One block per noise tile, so no two threads generate the same tile
+    const long long first = noise_tile_cache::tile_of(-shift);
+    const auto count = static_cast<int>(
+        noise_tile_cache::tile_of(resolution - 1 - shift) - first + 1);
+    parallel_for_blocks(0, count * count, [&](const int begin,
+                                              const int end) {
+      for (auto t = begin; t < end && !cancelled(); ++t) {
+        constexpr long long size = noise_tile_cache::tile_samples;
+        const long long tile_i = (first + t / count) * size + shift;
+        const long long tile_j = (first + t % count) * size + shift;
+        const auto i0 = static_cast<int>(std::max(tile_i, 0ll));
+        const auto j0 = static_cast<int>(std::max(tile_j, 0ll));
+        const auto i1 = static_cast<int>(
+            std::min(tile_i + size, static_cast<long long>(resolution)));
+        const auto j1 = static_cast<int>(
+            std::min(tile_j + size, static_cast<long long>(resolution)));
+
+        const size_t k = field.index(i0, j0);
+        generated += tiles->fill(source, i0 - shift, j0 - shift, i1 - i0,
+                                 j1 - j0, heights + k,
+                                 dxs.empty() ? nullptr : dxs.data() + k,
+                                 dzs.empty() ? nullptr : dzs.data() + k,
+                                 resolution);
       }
+    });
+  } else {
+    parallel_for_blocks(
+        0, resolution,
+        [&](const int row_begin, const int row_end) {
+          for (auto i = row_begin; i < row_end && !cancelled(); ++i) {
+            const size_t k = field.index(i, 0);
+            source.evaluate_rows(i - shift, -shift, 1, resolution,
+                                 heights + k,
+                                 dxs.empty() ? nullptr : dxs.data() + k,
+                                 dzs.empty() ? nullptr : dzs.data() + k,
+                                 resolution);
+            generated += resolution;
+          }
+        },
+        16);
+  }
+  if (cancelled()) return generated;
+
+  // The noise is in [0, 1], so we map it to [-height/2, height/2]
+  parallel_for_blocks(
+      0, resolution,
+      [&](const int row_begin, const int row_end) {
+        for (auto i = row_begin; i < row_end; ++i) {
+          for (auto j = 0; j < resolution; ++j) {
+            const size_t k = field.index(i, j);
+            heights[k] = (heights[k] * height) - (height / 2.0f);
+            if (!dxs.empty()) {
+              field.set_slope(i, j, dxs[k] * height, dzs[k] * height);
+            }
+          }
+        }
+      },
+      16);
+  // Terraces and blends have no derivatives to carry
+  if (dxs.empty()) field.compute_normals();
+  return generated;
+}
 
-      mv.pos = {x, y, z};
+auto terrain_model::import_heightmap(const std::string& path) -> bool {
+  cancel_refinement();
+  const auto start = std::chrono::steady_clock::now();
 
-      // Normal vectors for bottom (facing down)
-      mv.norm = {0.0f, -1.0f, 0.0f};
+  heightfield field;
+  reset_grid(field);
+  if (!::import_heightmap(path, field, -m_height / 2.0f, m_height / 2.0f)) {
+    return false;
+  }
+  field.compute_normals();
+  m_heightfield = std::move(field);
+  m_edits = {};
+  m_layers_own_heightfield_ = false;
+
+  m_generation_stats.noise_samples = 0;
+  m_generation_stats.cache_hit = false;
+  m_generation_stats.milliseconds = std::chrono::duration<float, std::milli>(
+                                        std::chrono::steady_clock::now() - start)
+                                        .count();
+  return true;
+}
 
-      // Texture coordinates
-      mv.uv = {static_cast<float>(i) * 10.0f / static_cast<float>(m_grid_size),
-               static_cast<float>(j) * 10.0f / static_cast<float>(m_grid_size)};
+auto terrain_model::export_heightmap(const std::string& path) const -> bool {
+  return ::export_heightmap(path, m_heightfield, -m_height / 2.0f,
+                            m_height / 2.0f);
+}
 
-      mb.push_vertex(mv);
-    }
+auto terrain_model::save_snapshot(const std::string& path) const -> bool {
+  return terrain_snapshot::save(path, *this);
+}
+
+auto terrain_model::load_snapshot(const std::string& path) -> bool {
+  cancel_refinement();
+  const auto start = std::chrono::steady_clock::now();
+
+  terrain_snapshot snapshot;
+  if (!snapshot.open(path) || !snapshot.restore(*this)) return false;
+  m_layers_own_heightfield_ = false;
+
+  m_generation_stats.noise_samples = 0;
+  m_generation_stats.cache_hit = false;
+  m_generation_stats.milliseconds = std::chrono::duration<float, std::milli>(
+                                        std::chrono::steady_clock::now() - start)
+                                        .count();
+  std::cout << "Restored snapshot " << path << " ("
+            << m_heightfield.sample_count() << " samples, " << m_edits.strokes
+            << " edits) in " << m_generation_stats.milliseconds << " ms"
+            << std::endl;
+  return true;
+}
+
+auto terrain_model::record_edit(const grid_rect& rect) -> void {
+  if (rect.empty()) return;
+
+  ++m_edits.strokes;
+  grid_rect& bounds = m_edits.bounds;
+  if (bounds.empty()) {
+    bounds = rect;
+    return;
   }
+  bounds.i_min = std::min(bounds.i_min, rect.i_min);
+  bounds.i_max = std::max(bounds.i_max, rect.i_max);
+  bounds.j_min = std::min(bounds.j_min, rect.j_min);
+  bounds.j_max = std::max(bounds.j_max, rect.j_max);
+}
 
-  // Store base vertex count for side vertices
-  const GLuint base_vertex_count = mb.m_vertices.size();
+auto terrain_model::reset_grid(heightfield& field) const -> void {
+  // Center the grid on the origin
+  const float total_width = m_spacing * static_cast<float>(m_grid_size);
+  field.resize(m_grid_size, m_spacing,
+               glm::vec2(-total_width / 2.0f, -total_width / 2.0f));
+  field.set_uv_mapping(glm::vec2(0.0f),
+                       10.0f / static_cast<float>(m_grid_size));
+}
 
-  // Generate vertices for SIDE WALLS with proper normals
-  // Front side (z = z_offset, normal pointing in -z direction)
-  for (auto i = 0; i <= m_grid_size; ++i) {
-    float x = static_cast<float>(i) * m_spacing + x_offset;
-    float z = z_offset;
-    
-    float y_top = 0.0f;
-    if (use_perlin) {
-      float noise_value = terrain.generate_perlin(x, 0.0f, z);
-      y_top = (noise_value * m_height) - (m_height / 2.0f);
-    }
-    float y_bottom = use_perlin ? y_top - box_depth : -box_depth;
-
-    // Top vertex of front side
-    mv.pos = {x, y_top, z};
-    mv.norm = {0.0f, 0.0f, -1.0f};  // Front face normal
-    mv.uv = {static_cast<float>(i) / static_cast<float>(m_grid_size), 0.0f};
-    mb.push_vertex(mv);
-
-    // Bottom vertex of front side
-    mv.pos = {x, y_bottom, z};
-    mv.norm = {0.0f, 0.0f, -1.0f};  // Front face normal
-    mv.uv = {static_cast<float>(i) / static_cast<float>(m_grid_size), 1.0f};
-    mb.push_vertex(mv);
-  }
-
-  const GLuint front_side_start = base_vertex_count;
-
-  // Back side (z = z_offset + total_length, normal pointing in +z direction)
-  for (auto i = 0; i <= m_grid_size; ++i) {
-    float x = static_cast<float>(i) * m_spacing + x_offset;
-    float z = z_offset + total_length;
-    
-    float y_top = 0.0f;
-    if (use_perlin) {
-      float noise_value = terrain.generate_perlin(x, 0.0f, z);
-      y_top = (noise_value * m_height) - (m_height / 2.0f);
-    }
-    float y_bottom = use_perlin ? y_top - box_depth : -box_depth;
-
-    // Top vertex of back side
-    mv.pos = {x, y_top, z};
-    mv.norm = {0.0f, 0.0f, 1.0f};  // Back face normal
-    mv.uv = {static_cast<float>(i) / static_cast<float>(m_grid_size), 0.0f};
-    mb.push_vertex(mv);
-
-    // Bottom vertex of back side
-    mv.pos = {x, y_bottom, z};
-    mv.norm = {0.0f, 0.0f, 1.0f};  // Back face normal
-    mv.uv = {static_cast<float>(i) / static_cast<float>(m_grid_size), 1.0f};
-    mb.push_vertex(mv);
-  }
-
-  const GLuint back_side_start = front_side_start + (m_grid_size + 1) * 2;
-
-  // Left side (x = x_offset, normal pointing in -x direction)
-  for (auto j = 0; j <= m_grid_size; ++j) {
-    float x = x_offset;
-    float z = static_cast<float>(j) * m_spacing + z_offset;
-    
-    float y_top = 0.0f;
-    if (use_perlin) {
-      float noise_value = terrain.generate_perlin(x, 0.0f, z);
-      y_top = (noise_value * m_height) - (m_height / 2.0f);
+auto terrain_model::grid_lattice() const -> noise_lattice {
+  noise_lattice lattice;
+  lattice.seed = m_seed;
+  lattice.octaves = m_octaves;
+  lattice.lacunarity = m_lacunarity;
+  lattice.persistence = m_persistence;
+  lattice.repeat = m_repeat;
+  lattice.planar = m_use_2d_noise;
+  lattice.layered = m_layered;
+  lattice.basis = m_noise_basis;
+  lattice.spacing = m_spacing;
+  // Exactly zero for even grids, see reset_grid
+  const float total_width = m_spacing * static_cast<float>(m_grid_size);
+  const float origin = -total_width / 2.0f +
+                       static_cast<float>(m_grid_size / 2) * m_spacing;
+  lattice.origin = glm::vec2(origin);
+  return lattice;
+}
+
+auto terrain_model::bottom_vertex(const int i, const int j) const
+    -> cgra::mesh_vertex {
+  // Same x, z position as the top but box_depth lower, normal facing down
+  cgra::mesh_vertex mv = m_heightfield.vertex(i, j);
+  mv.pos.y -= m_box_depth;
+  mv.norm = {0.0f, -1.0f, 0.0f};
+  mv.tang = {0.0f};
+  mv.bitang = {0.0f};
+
+  return mv;
+}
+
+auto terrain_model::side_vertices(const int side, const int s,
+                                  cgra::mesh_vertex* out) const -> void {
+  const glm::ivec2 ij = side_sample(side, s, m_grid_size);
+  const float u = static_cast<float>(s) / static_cast<float>(m_grid_size);
+
+  // Top vertex of side
+  out[0].pos = m_heightfield.position(ij.x, ij.y);
+  out[0].norm = side_normal(side);
+  out[0].uv = {u, 0.0f};
+
+  // Bottom vertex of side, on the flat floor of a solid box or box_depth
+  // below the surface otherwise
+  out[1].pos = out[0].pos;
+  out[1].pos.y = m_mesh_solid_box_ ? m_box_base_ : out[0].pos.y - m_box_depth;
+  out[1].norm = side_normal(side);
+  out[1].uv = {u, 1.0f};
+}
+
+auto terrain_model::bottom_cap_vertices(cgra::mesh_vertex* out) const -> void {
+  // Corners (0, 0), (0, n), (n, 0), (n, n), laid out like the grid samples
+  for (auto c = 0; c < 4; ++c) {
+    const int i = (c / 2) * m_grid_size;
+    const int j = (c % 2) * m_grid_size;
+
+    out[c].pos = {m_heightfield.x(i), m_box_base_, m_heightfield.z(j)};
+    out[c].norm = {0.0f, -1.0f, 0.0f};
+    out[c].uv = {static_cast<float>(c / 2), static_cast<float>(c % 2)};
+  }
+}
+
+auto terrain_model::bottom_vertex_count() const -> GLuint {
+  const GLuint row_length = m_grid_size + 1;
+  return m_mesh_solid_box_ ? 4 : row_length * row_length;
+}
+
+auto terrain_model::box_floor() const -> float {
+  // Keep the surface just above the floor so the walls never fold over
+  return m_mesh_solid_box_ ? m_box_base_ + 0.1f
+                           : -std::numeric_limits<float>::infinity();
+}
+
+auto terrain_model::build_mesh() -> void {
+  cgra::mesh_builder mb;
+
+  const int grid_size = m_grid_size;
+  const int row_length = grid_size + 1;
+
+  // A solid box has a flat floor box_depth below the lowest sample
+  m_mesh_solid_box_ = m_solid_box;
+  if (m_mesh_solid_box_) {
+    const auto& heights = m_heightfield.heights();
+    m_box_base_ = *std::ranges::min_element(heights) - m_box_depth;
+  }
+
+  // Layout of the vertex buffer: top grid, bottom (a full grid, or the four
+  // corners of a solid box), then the four walls (front, back, left, right)
+  // with a top/bottom vertex pair per edge sample
+  const GLuint top_vertices_count = row_length * row_length;
+  const GLuint sides_start = top_vertices_count + bottom_vertex_count();
+
+  // Layout of the index buffer: top cells, bottom, then the four walls
+  const size_t face_index_count = 6 * static_cast<size_t>(grid_size) * grid_size;
+  const size_t bottom_index_count = m_mesh_solid_box_ ? 6 : face_index_count;
+  const size_t side_index_count = 6 * static_cast<size_t>(grid_size);
+  const size_t sides_index_start = face_index_count + bottom_index_count;
+
+  // Preallocate everything up front so each block writes straight into its
+  // own slots
+  mb.m_vertices.resize(sides_start + 4 * row_length * 2);
+  mb.m_indices.resize(sides_index_start + 4 * side_index_count);
+
+  parallel_for_blocks(
+      0, row_length,
+      [&](const int row_begin, const int row_end) {
+        for (auto i = row_begin; i < row_end; ++i) {
+          for (auto j = 0; j <= grid_size; ++j) {
+            const GLuint k = i * row_length + j;
+            mb.m_vertices[k] = m_heightfield.vertex(i, j);
+            if (!m_mesh_solid_box_) {
+              mb.m_vertices[top_vertices_count + k] = bottom_vertex(i, j);
+            }
+          }
+
+          if (i == grid_size) continue;
+
+          for (auto j = 0; j < grid_size; ++j) {
+            const GLuint k1 = i * row_length + j;
+            const GLuint k2 = k1 + 1;
+            const GLuint k3 = (i + 1) * row_length + j;
+            const GLuint k4 = k3 + 1;
+
+            // TOP face (only these are interactable)
+            auto* top =
+                &mb.m_indices[(static_cast<size_t>(i) * grid_size + j) * 6];
+            top[0] = k1, top[1] = k2, top[2] = k3;  // First triangle
+            top[3] = k2, top[4] = k4, top[5] = k3;  // Second triangle
+
+            if (m_mesh_solid_box_) continue;
+
+            // BOTTOM face, reverse winding order (so normals face down/out)
+            auto* bottom = top + face_index_count;
+            bottom[0] = top_vertices_count + k1;
+            bottom[1] = top_vertices_count + k3;
+            bottom[2] = top_vertices_count + k2;
+            bottom[3] = top_vertices_count + k2;
+            bottom[4] = top_vertices_count + k3;
+            bottom[5] = top_vertices_count + k4;
+          }
+        }
+      },
+      16);
+
+  // BOTTOM cap of a solid box, two triangles facing down
+  if (m_mesh_solid_box_) {
+    bottom_cap_vertices(&mb.m_vertices[top_vertices_count]);
+
+    auto* bottom = &mb.m_indices[face_index_count];
+    bottom[0] = top_vertices_count + 0;
+    bottom[1] = top_vertices_count + 2;
+    bottom[2] = top_vertices_count + 1;
+    bottom[3] = top_vertices_count + 1;
+    bottom[4] = top_vertices_count + 2;
+    bottom[5] = top_vertices_count + 3;
+  }
+
+  // SIDE WALLS, skirts hanging from the edge samples with dedicated vertices
+  // so they get flat normals. The front and right walls wind one way, the
+  // back and left walls the other, so that every wall faces outwards.
+  for (auto side = 0; side < 4; ++side) {
+    const GLuint side_start = sides_start + side * row_length * 2;
+    const bool flip = side == 1 || side == 2;
+
+    for (auto s = 0; s <= grid_size; ++s) {
+      side_vertices(side, s, &mb.m_vertices[side_start + s * 2]);
     }
-    float y_bottom = use_perlin ? y_top - box_depth : -box_depth;
-
-    // Top vertex of left side
-    mv.pos = {x, y_top, z};
-    mv.norm = {-1.0f, 0.0f, 0.0f};  // Left face normal
-    mv.uv = {static_cast<float>(j) / static_cast<float>(m_grid_size), 0.0f};
-    mb.push_vertex(mv);
-
-    // Bottom vertex of left side
-    mv.pos = {x, y_bottom, z};
-    mv.norm = {-1.0f, 0.0f, 0.0f};  // Left face normal
-    mv.uv = {static_cast<float>(j) / static_cast<float>(m_grid_size), 1.0f};
-    mb.push_vertex(mv);
-  }
-
-  const GLuint left_side_start = back_side_start + (m_grid_size + 1) * 2;
-
-  // Right side (x = x_offset + total_width, normal pointing in +x direction)
-  for (auto j = 0; j <= m_grid_size; ++j) {
-    float x = x_offset + total_width;
-    float z = static_cast<float>(j) * m_spacing + z_offset;
-    
-    float y_top = 0.0f;
-    if (use_perlin) {
-      float noise_value = terrain.generate_perlin(x, 0.0f, z);
-      y_top = (noise_value * m_height) - (m_height / 2.0f);
+
+    auto* out = &mb.m_indices[sides_index_start + side * side_index_count];
+    for (auto s = 0; s < grid_size; ++s, out += 6) {
+      const GLuint top_left = side_start + s * 2;
+      const GLuint bottom_left = top_left + 1;
+      const GLuint top_right = side_start + (s + 1) * 2;
+      const GLuint bottom_right = top_right + 1;
+
+      if (flip) {
+        out[0] = top_left, out[1] = top_right, out[2] = bottom_left;
+        out[3] = top_right, out[4] = bottom_right, out[5] = bottom_left;
+      } else {
+        out[0] = top_left, out[1] = bottom_left, out[2] = top_right;
+        out[3] = top_right, out[4] = bottom_left, out[5] = bottom_right;
+      }
     }
-    float y_bottom = use_perlin ? y_top - box_depth : -box_depth;
-
-    // Top vertex of right side
-    mv.pos = {x, y_top, z};
-    mv.norm = {1.0f, 0.0f, 0.0f};  // Right face normal
-    mv.uv = {static_cast<float>(j) / static_cast<float>(m_grid_size), 0.0f};
-    mb.push_vertex(mv);
-
-    // Bottom vertex of right side
-    mv.pos = {x, y_bottom, z};
-    mv.norm = {1.0f, 0.0f, 0.0f};  // Right face normal
-    mv.uv = {static_cast<float>(j) / static_cast<float>(m_grid_size), 1.0f};
-    mb.push_vertex(mv);
-  }
-
-  const GLuint right_side_start = left_side_start + (m_grid_size + 1) * 2;
-
-  // Generate triangle indices for the TOP face (only these are interactable)
-  for (auto i = 0; i < m_grid_size; ++i) {
-    for (auto j = 0; j < m_grid_size; ++j) {
-      const GLuint k1 = i * (m_grid_size + 1) + j;
-      const GLuint k2 = k1 + 1;
-      const GLuint k3 = (i + 1) * (m_grid_size + 1) + j;
-      const GLuint k4 = k3 + 1;
-
-      mb.push_indices({k1, k2, k3});  // First triangle
-      mb.push_indices({k2, k4, k3}); // Second triangle
-
-      // Helper lambda to add triangle to adjacent faces (ONLY for top face)
-      auto add_triangle = [&](int v1, int v2, int v3) {
-        m_adjacent_faces[v1].insert(m_adjacent_faces[v1].end(), {v1, v2, v3});
-        m_adjacent_faces[v2].insert(m_adjacent_faces[v2].end(), {v1, v2, v3});
-        m_adjacent_faces[v3].insert(m_adjacent_faces[v3].end(), {v1, v2, v3});
-      };
-
-      add_triangle(k1, k2, k3);
-      add_triangle(k2, k4, k3);
+  }
+
+  // Destroy if mesh exists
+  if (m_mesh.vao != 0) m_mesh.destroy();
+
+  m_mesh_packed_ = m_packed_vertices;
+  if (m_mesh_packed_) {
+    // Quantize heights over the mesh's range, with headroom so edits rarely
+    // need a full rebuild
+    float min_height = std::numeric_limits<float>::max();
+    float max_height = std::numeric_limits<float>::lowest();
+    for (const auto& v : mb.m_vertices) {
+      min_height = glm::min(min_height, v.pos.y);
+      max_height = glm::max(max_height, v.pos.y);
     }
+    const float headroom = m_height / 2.0f;
+    m_packing_ = vertex_packing::for_heightfield(
+        m_heightfield, min_height - headroom, max_height + headroom);
+
+    std::vector<packed_terrain_vertex> packed(mb.m_vertices.size());
+    parallel_for_blocks(
+        0, static_cast<int>(packed.size()),
+        [&](const int begin, const int end) {
+          for (auto k = begin; k < end; ++k) {
+            packed[k] = pack_at(k, mb.m_vertices[k]);
+          }
+        },
+        4096);
+
+    m_mesh = build_packed_mesh(packed, mb.m_indices, mb.m_mode);
+    m_vertex_buffer_bytes_ = packed.size() * sizeof(packed_terrain_vertex);
+  } else {
+    m_mesh = mb.build();
+    m_vertex_buffer_bytes_ = mb.m_vertices.size() * sizeof(cgra::mesh_vertex);
   }
 
-  // Generate triangle indices for the BOTTOM face (not interactable, no adjacent faces)
-  for (auto i = 0; i < m_grid_size; ++i) {
-    for (auto j = 0; j < m_grid_size; ++j) {
-      const GLuint k1 = top_vertices_count + i * (m_grid_size + 1) + j;
-      const GLuint k2 = k1 + 1;
-      const GLuint k3 = top_vertices_count + (i + 1) * (m_grid_size + 1) + j;
-      const GLuint k4 = k3 + 1;
+  std::cout << "Terrain mesh has " << mb.m_vertices.size() << " vertices ("
+            << m_vertex_buffer_bytes_ << " bytes) and "
+            << mb.m_indices.size() / 3 << " triangles" << std::endl;
+
+  m_lod.build(m_heightfield);
+}
+
+auto terrain_model::update_mesh_region(const grid_rect& rect) -> void {
+  if (rect.empty()) return;
+
+  if (m_mesh.vao == 0) {
+    build_mesh();
+    return;
+  }
 
-      // Reverse winding order for bottom face (so normals face down/out)
-      mb.push_indices({k1, k3, k2});  // First triangle
-      mb.push_indices({k2, k3, k4}); // Second triangle
+  // Heights outside the packed range need a new quantization
+  if (m_mesh_packed_) {
+    for (auto i = rect.i_min; i <= rect.i_max; ++i) {
+      for (auto j = rect.j_min; j <= rect.j_max; ++j) {
+        const float h = m_heightfield.height(i, j);
+        if (!m_packing_.covers(h) ||
+            (!m_mesh_solid_box_ && !m_packing_.covers(h - m_box_depth))) {
+          build_mesh();
+          return;
+        }
+      }
     }
   }
 
-  // Generate SIDE WALLS indices using the dedicated side vertices
-  // Front side
-  for (auto i = 0; i < m_grid_size; ++i) {
-    GLuint top_left = front_side_start + i * 2;
-    GLuint bottom_left = top_left + 1;
-    GLuint top_right = front_side_start + (i + 1) * 2;
-    GLuint bottom_right = top_right + 1;
+  const int row_length = m_grid_size + 1;
+  const GLuint top_vertices_count = row_length * row_length;
+  const int span = rect.j_max - rect.j_min + 1;
+  std::vector<cgra::mesh_vertex> row(span);
 
-    mb.push_indices({top_left, bottom_left, top_right});
-    mb.push_indices({top_right, bottom_left, bottom_right});
-  }
+  glBindBuffer(GL_ARRAY_BUFFER, m_mesh.vbo);
+
+  // Vertices of a grid row are contiguous, so each row is a single upload
+  for (auto i = rect.i_min; i <= rect.i_max; ++i) {
+    const GLintptr first = i * row_length + rect.j_min;
+
+    for (auto j = rect.j_min; j <= rect.j_max; ++j) {
+      row[j - rect.j_min] = m_heightfield.vertex(i, j);
+    }
+    upload_vertices(first, row.data(), row.size());
 
-  // Back side
-  for (auto i = 0; i < m_grid_size; ++i) {
-    GLuint top_left = back_side_start + i * 2;
-    GLuint bottom_left = top_left + 1;
-    GLuint top_right = back_side_start + (i + 1) * 2;
-    GLuint bottom_right = top_right + 1;
+    // The floor of a solid box doesn't follow the surface
+    if (m_mesh_solid_box_) continue;
 
-    mb.push_indices({top_left, top_right, bottom_left});
-    mb.push_indices({top_right, bottom_right, bottom_left});
+    for (auto j = rect.j_min; j <= rect.j_max; ++j) {
+      row[j - rect.j_min] = bottom_vertex(i, j);
+    }
+    upload_vertices(top_vertices_count + first, row.data(), row.size());
   }
 
-  // Left side
-  for (auto j = 0; j < m_grid_size; ++j) {
-    GLuint top_left = left_side_start + j * 2;
-    GLuint bottom_left = top_left + 1;
-    GLuint top_right = left_side_start + (j + 1) * 2;
-    GLuint bottom_right = top_right + 1;
+  // Walls only change when the edit reaches the border of the grid
+  if (rect.touches_border(m_grid_size)) {
+    std::vector<cgra::mesh_vertex> sides(4 * row_length * 2);
+    for (auto side = 0; side < 4; ++side) {
+      for (auto s = 0; s <= m_grid_size; ++s) {
+        side_vertices(side, s, &sides[(side * row_length + s) * 2]);
+      }
+    }
+    upload_vertices(top_vertices_count + bottom_vertex_count(), sides.data(),
+                    sides.size());
+  }
 
-    mb.push_indices({top_left, top_right, bottom_left});
-    mb.push_indices({top_right, bottom_right, bottom_left});
+  glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+  m_lod.update_bounds(m_heightfield, rect);
+}
+
+auto terrain_model::pack_at(const GLuint k, const cgra::mesh_vertex& v) const
+    -> packed_terrain_vertex {
+  const GLuint row_length = m_grid_size + 1;
+  const GLuint top_vertices_count = row_length * row_length;
+  const GLuint sides_start = top_vertices_count + bottom_vertex_count();
+
+  if (k < top_vertices_count) {
+    return pack_vertex(v, k / row_length, k % row_length,
+                       packed_vertex_kind::surface, m_packing_);
   }
 
-  // Right side
-  for (auto j = 0; j < m_grid_size; ++j) {
-    GLuint top_left = right_side_start + j * 2;
-    GLuint bottom_left = top_left + 1;
-    GLuint top_right = right_side_start + (j + 1) * 2;
-    GLuint bottom_right = top_right + 1;
+  if (k < sides_start) {
+    const GLuint b = k - top_vertices_count;
+    if (m_mesh_solid_box_) {
+      return pack_vertex(v, (b / 2) * m_grid_size, (b % 2) * m_grid_size,
+                         packed_vertex_kind::cap, m_packing_);
+    }
+    return pack_vertex(v, b / row_length, b % row_length,
+                       packed_vertex_kind::bottom, m_packing_);
+  }
 
-    mb.push_indices({top_left, bottom_left, top_right});
-    mb.push_indices({top_right, bottom_left, bottom_right});
+  // Walls hold a top/bottom pair per edge sample
+  const GLuint w = k - sides_start;
+  const int side = static_cast<int>(w / (2 * row_length));
+  const int s = static_cast<int>((w % (2 * row_length)) / 2);
+  const glm::ivec2 ij = side_sample(side, s, m_grid_size);
+
+  return pack_vertex(v, ij.x, ij.y,
+                     w % 2 == 0 ? packed_vertex_kind::wall_top
+                                : packed_vertex_kind::wall_bottom,
+                     m_packing_);
+}
+
+auto terrain_model::upload_vertices(const GLuint first,
+                                    const cgra::mesh_vertex* vertices,
+                                    const size_t count) const -> void {
+  if (!m_mesh_packed_) {
+    glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(cgra::mesh_vertex),
+                    count * sizeof(cgra::mesh_vertex), vertices);
+    return;
   }
 
-  m_builder = mb;
-  m_mesh = mb.build();
+  std::vector<packed_terrain_vertex> packed(count);
+  for (size_t v = 0; v < count; ++v) {
+    packed[v] = pack_at(first + static_cast<GLuint>(v), vertices[v]);
+  }
+  glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(packed_terrain_vertex),
+                  count * sizeof(packed_terrain_vertex), packed.data());
 }
 
 auto terrain_model::draw(const glm::mat4& view,
                          const glm::mat4& projection) const -> void {
+  bind_uniforms(view, projection);
+
+  // Tell the shader how to decode packed vertices
+  if (m_mesh_packed_) {
+    glUniform1i(glGetUniformLocation(m_shader, "uPacked"), 1);
+    glUniform2f(glGetUniformLocation(m_shader, "uGridOrigin"),
+                m_packing_.origin.x, m_packing_.origin.y);
+    glUniform1f(glGetUniformLocation(m_shader, "uGridSpacing"),
+                m_packing_.spacing);
+    glUniform1f(glGetUniformLocation(m_shader, "uGridSize"),
+                static_cast<float>(m_packing_.grid_size));
+    glUniform2f(glGetUniformLocation(m_shader, "uHeightQuantization"),
+                m_packing_.height_min, m_packing_.height_step);
+    glUniform2f(glGetUniformLocation(m_shader, "uUvOffset"),
+                m_packing_.uv_offset.x, m_packing_.uv_offset.y);
+    glUniform1f(glGetUniformLocation(m_shader, "uUvScale"),
+                m_packing_.uv_scale);
+  }
+
+  if (m_use_lod) {
+    // The top face comes first in the index buffer, followed by the bottom
+    // and walls
+    m_lod.draw(m_mesh, 6 * m_grid_size * m_grid_size);
+  } else {
+    m_mesh.draw();  // draw
+  }
+
+  reset_uniforms();
+}
+
+auto terrain_model::update_lod(const glm::vec3& camera_pos) -> void {
+  if (m_use_lod) m_lod.select(camera_pos);
+}
+
+auto terrain_model::bind_uniforms(const glm::mat4& view,
+                                  const glm::mat4& projection) const -> void {
   glUseProgram(m_shader);
   // Set uniform values
   glUniform3f(glGetUniformLocation(m_shader, "uCenter"), m_selected_point.pos.x,
@@ -298,41 +811,38 @@ auto terrain_model::draw(const glm::mat4& view,
   glUniform1iv(glGetUniformLocation(m_shader, "uTex"), 1, &m_tex);
   glUniform1f(glGetUniformLocation(m_shader, "uHeightScale"), m_height_scale);
   glUniform1iv(glGetUniformLocation(m_shader, "uType"), 1, &m_type_);
+  glUniform1i(glGetUniformLocation(m_shader, "uPacked"), 0);
   glUniformMatrix4fv(glGetUniformLocation(m_shader, "uProjectionMatrix"), 1,
                      false, value_ptr(projection));
   glUniformMatrix4fv(glGetUniformLocation(m_shader, "uModelViewMatrix"), 1,
                      false, value_ptr(view));
+}
 
-  m_mesh.draw();  // draw
-
+auto terrain_model::reset_uniforms() const -> void {
   // reset for other objects
   constexpr int reset = -1;
   glUniform1iv(glGetUniformLocation(m_shader, "uType"), 1, &reset);
+  glUniform1i(glGetUniformLocation(m_shader, "uPacked"), 0);
 }
 
 void terrain_model::build_aabb_tree() {
-  // Collect all vertex positions
+  // Collect the top face positions and triangles from the heightfield
   std::vector<glm::vec3> positions;
-  positions.reserve(m_builder.m_vertices.size());
-
-  for (const auto& vertex : m_builder.m_vertices) {
-    positions.push_back(vertex.pos);
-  }
-
-  // Flatten m_adjacent_faces into a single index list
   std::vector<unsigned int> flat_indices;
-
-  for (const auto& vertex_faces : m_adjacent_faces) {
-    for (unsigned int idx : vertex_faces) {
-      flat_indices.push_back(idx);
-    }
-  }
+  collect_triangles(m_heightfield, positions, flat_indices);
 
   // Build the AABB tree with flat indices
+  const auto start = std::chrono::steady_clock::now();
+  m_aabb_tree.method = m_aabb_method;
   m_aabb_tree.build(positions, flat_indices);
+  const std::chrono::duration<float, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
 
   std::cout << "Built AABB tree with " << flat_indices.size() / 3
-            << " triangles" << std::endl;
+            << " triangles in " << m_aabb_tree.node_count() << " nodes ("
+            << m_aabb_tree.memory_usage() / (1024.0 * 1024.0) << " MB) in "
+            << elapsed.count() << " ms, SAH cost "
+            << m_aabb_tree.sah_cost() << std::endl;
 }
 
 void terrain_model::build_aabb_tree_async() {
@@ -348,33 +858,33 @@ void terrain_model::build_aabb_tree_async() {
 
   // Start background rebuild
   aabb_rebuilding.store(true);
+  {
+    // The snapshot below has every refit so far
+    std::lock_guard<std::mutex> lock(aabb_mutex);
+    m_aabb_moved_.clear();
+  }
 
-  aabb_rebuild_thread = std::thread([this]() {
+  // Snapshot the heightfield so later edits can't race with the rebuild
+  aabb_rebuild_thread = std::thread([this, field = m_heightfield,
+                                     method = m_aabb_method]() {
     std::cout << "Starting async AABB tree rebuild..." << std::endl;
 
-    // Collect vertex positions
+    // Collect vertex positions and triangles
     std::vector<glm::vec3> positions;
-    positions.reserve(m_builder.m_vertices.size());
-
-    for (const auto& vertex : m_builder.m_vertices) {
-      positions.push_back(vertex.pos);
-    }
-
-    // Flatten indices
     std::vector<unsigned int> flat_indices;
-    for (const auto& vertex_faces : m_adjacent_faces) {
-      for (unsigned int idx : vertex_faces) {
-        flat_indices.push_back(idx);
-      }
-    }
+    collect_triangles(field, positions, flat_indices);
 
     // Build new tree (this is the slow part, happens in background)
     aabb_tree new_tree;
+    new_tree.method = method;
     new_tree.build(positions, flat_indices);
 
-    // Swap in the new tree (fast, lock protected)
+    // Catch up with the strokes made during the build and swap in the new
+    // tree (fast, lock protected)
     {
       std::lock_guard<std::mutex> lock(aabb_mutex);
+      new_tree.refit(m_aabb_moved_);
+      m_aabb_moved_.clear();
       m_aabb_tree = std::move(new_tree);
     }
 
@@ -390,3 +900,51 @@ void terrain_model::wait_for_aabb_rebuild() {
     aabb_rebuild_thread.join();
   }
 }
+
+auto terrain_model::refit_aabb_tree(const grid_rect& rect) -> void {
+  if (rect.empty()) return;
+
+  const heightfield& field = m_heightfield;
+  const int grid_size = field.grid_size();
+
+  // Every cell with a corner in rect, cell (i, j) holds triangles
+  // 2 * (i * grid_size + j) and the one after, as collect_triangles lays
+  // them out
+  const int i_begin = std::max(rect.i_min - 1, 0);
+  const int i_end = std::min(rect.i_max, grid_size - 1);
+  const int j_begin = std::max(rect.j_min - 1, 0);
+  const int j_end = std::min(rect.j_max, grid_size - 1);
+  if (i_end < i_begin || j_end < j_begin) return;
+
+  std::vector<triangle> moved;
+  moved.reserve(2 * static_cast<size_t>(i_end - i_begin + 1) *
+                (j_end - j_begin + 1));
+  for (auto i = i_begin; i <= i_end; ++i) {
+    for (auto j = j_begin; j <= j_end; ++j) {
+      const glm::vec3 p1 = field.position(i, j);
+      const glm::vec3 p2 = field.position(i, j + 1);
+      const glm::vec3 p3 = field.position(i + 1, j);
+      const glm::vec3 p4 = field.position(i + 1, j + 1);
+      const auto t = 2 * (static_cast<unsigned int>(i) * grid_size + j);
+      moved.push_back({p1, p2, p3, t});
+      moved.push_back({p2, p4, p3, t + 1});
+    }
+  }
+
+  bool rebuild = false;
+  {
+    std::lock_guard<std::mutex> lock(aabb_mutex);
+    if (m_aabb_tree.get_triangles().size() !=
+        2 * static_cast<size_t>(grid_size) * grid_size) {
+      rebuild = true;
+    } else {
+      m_aabb_tree.refit(moved);
+      rebuild = m_aabb_tree.needs_rebuild();
+    }
+    if (aabb_rebuilding.load()) {
+      m_aabb_moved_.insert(m_aabb_moved_.end(), moved.begin(), moved.end());
+    }
+  }
+
+  if (rebuild) build_aabb_tree_async();
+}
@@ -0,0 +1,391 @@
+#include "terrain/terrain_snapshot.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <type_traits>
+#include <vector>
+
+#include "terrain/terrain_model.hpp"
+#include "utils/parallel.hpp"
+
+// The file is read in place from the mapping, so its layout is the in-memory
+// layout of these structs on a little endian machine
+static_assert(std::endian::native == std::endian::little);
+static_assert(std::is_trivially_copyable_v<snapshot_header>);
+static_assert(sizeof(snapshot_header) % alignof(snapshot_tile) == 0);
+static_assert(sizeof(snapshot_tile) == 16);
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float));
+
+namespace {
+auto zigzag(const std::int32_t v) -> std::uint32_t {
+  return (static_cast<std::uint32_t>(v) << 1) ^
+         static_cast<std::uint32_t>(v >> 31);
+}
+
+auto unzigzag(const std::uint32_t v) -> std::int32_t {
+  return static_cast<std::int32_t>(v >> 1) ^ -static_cast<std::int32_t>(v & 1);
+}
+
+auto put_varint(std::vector<unsigned char>& out, std::uint32_t v) -> void {
+  while (v >= 0x80) {
+    out.push_back(static_cast<unsigned char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<unsigned char>(v));
+}
+
+// Prediction for sample (a, b) of a tile from its left, upper and upper left
+// neighbours in the quantized tile q, row length w. Unsigned so the float bits
+// of exact snapshots wrap instead of overflowing, which gives the same
+// residuals as signed arithmetic for quantized heights
+auto predict(const std::uint32_t* q, const int w, const int a, const int b)
+    -> std::uint32_t {
+  if (a == 0 && b == 0) return 0;
+  if (a == 0) return q[b - 1];
+  if (b == 0) return q[(a - 1) * w];
+  return q[(a - 1) * w + b] + q[a * w + b - 1] - q[(a - 1) * w + b - 1];
+}
+
+auto tile_rect(const int t, const int tiles_per_axis, const int resolution)
+    -> grid_rect {
+  const int ti = t / tiles_per_axis;
+  const int tj = t % tiles_per_axis;
+  grid_rect rect;
+  rect.i_min = ti * terrain_snapshot::tile_size;
+  rect.i_max = std::min(rect.i_min + terrain_snapshot::tile_size, resolution) - 1;
+  rect.j_min = tj * terrain_snapshot::tile_size;
+  rect.j_max = std::min(rect.j_min + terrain_snapshot::tile_size, resolution) - 1;
+  return rect;
+}
+
+auto encode_tile(const heightfield& field, const grid_rect& rect,
+                 const bool exact, std::vector<unsigned char>& out) -> void {
+  const int h = rect.i_max - rect.i_min + 1;
+  const int w = rect.j_max - rect.j_min + 1;
+
+  std::vector<std::uint32_t> q(static_cast<size_t>(h) * w);
+  for (auto a = 0; a < h; ++a) {
+    for (auto b = 0; b < w; ++b) {
+      const float height = field.height(rect.i_min + a, rect.j_min + b);
+      q[a * w + b] =
+          exact ? std::bit_cast<std::uint32_t>(height)
+                : static_cast<std::uint32_t>(static_cast<std::int32_t>(
+                      std::lround(height / terrain_snapshot::height_step)));
+    }
+  }
+
+  out.clear();
+  for (auto a = 0; a < h; ++a) {
+    for (auto b = 0; b < w; ++b) {
+      put_varint(out, zigzag(static_cast<std::int32_t>(
+                          q[a * w + b] - predict(q.data(), w, a, b))));
+    }
+  }
+  if (!exact) return;
+
+  // Normals go after the heights as they are, they do not predict well
+  for (auto a = 0; a < h; ++a) {
+    for (auto b = 0; b < w; ++b) {
+      const glm::vec3 normal = field.normal(rect.i_min + a, rect.j_min + b);
+      const auto* bytes = reinterpret_cast<const unsigned char*>(&normal);
+      out.insert(out.end(), bytes, bytes + sizeof(glm::vec3));
+    }
+  }
+}
+}  // namespace
+
+auto terrain_snapshot::save(const std::string& path,
+                            const terrain_model& model, const bool exact)
+    -> bool {
+  const auto start = std::chrono::steady_clock::now();
+  const heightfield& field = model.m_heightfield;
+
+  snapshot_header header;
+  header.grid_size = field.grid_size();
+  header.spacing = field.spacing();
+  header.origin[0] = field.origin().x;
+  header.origin[1] = field.origin().y;
+  header.uv_offset[0] = field.uv_offset().x;
+  header.uv_offset[1] = field.uv_offset().y;
+  header.uv_scale = field.uv_scale();
+  header.height_step = height_step;
+  header.tile_size = tile_size;
+  header.tiles_per_axis = static_cast<std::uint32_t>(
+      (field.resolution() + tile_size - 1) / tile_size);
+
+  header.seed = model.m_seed;
+  header.octaves = model.m_octaves;
+  header.lacunarity = model.m_lacunarity;
+  header.persistence = model.m_persistence;
+  header.repeat = model.m_repeat;
+  header.height = model.m_height;
+  if (model.m_use_2d_noise) header.flags |= snapshot_header::flag_noise_2d;
+  if (model.m_layered) header.flags |= snapshot_header::flag_layered;
+  if (model.m_noise_basis == noise_basis::simplex) {
+    header.flags |= snapshot_header::flag_simplex;
+  }
+  if (exact) header.flags |= snapshot_header::flag_exact;
+  header.box_depth = model.m_box_depth;
+  header.solid_box = model.m_solid_box ? 1 : 0;
+
+  header.edit_strokes = model.m_edits.strokes;
+  header.edit_bounds[0] = model.m_edits.bounds.i_min;
+  header.edit_bounds[1] = model.m_edits.bounds.i_max;
+  header.edit_bounds[2] = model.m_edits.bounds.j_min;
+  header.edit_bounds[3] = model.m_edits.bounds.j_max;
+
+  // Tiles compress independently, so encode them in parallel
+  const int tiles_per_axis = static_cast<int>(header.tiles_per_axis);
+  const int count = tiles_per_axis * tiles_per_axis;
+  std::vector<std::vector<unsigned char>> payloads(count);
+  parallel_for_blocks(
+      0, count,
+      [&](const int begin, const int end) {
+        for (auto t = begin; t < end; ++t) {
+          encode_tile(field, ::tile_rect(t, tiles_per_axis, field.resolution()),
+                      exact, payloads[t]);
+        }
+      },
+      4);
+
+  std::vector<snapshot_tile> directory(count);
+  std::uint64_t offset =
+      sizeof(snapshot_header) + sizeof(snapshot_tile) * directory.size();
+  for (auto t = 0; t < count; ++t) {
+    directory[t].offset = offset;
+    directory[t].size = static_cast<std::uint32_t>(payloads[t].size());
+    offset += payloads[t].size();
+  }
+
+  // Write next to the target and rename it into place, so a crash or a full
+  // disk never leaves a half written snapshot where the last good one was
+  const std::string temp_path = path + ".tmp";
+  {
+    std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(directory.data()),
+              static_cast<std::streamsize>(sizeof(snapshot_tile) * count));
+    for (const auto& payload : payloads) {
+      out.write(reinterpret_cast<const char*>(payload.data()),
+                static_cast<std::streamsize>(payload.size()));
+    }
+    out.close();
+
+    if (!out) {
+      std::cerr << "Error: Failed to write snapshot " << path << '\n';
+      std::error_code ignored;
+      std::filesystem::remove(temp_path, ignored);
+      return false;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temp_path, path, error);
+  if (error) {
+    std::cerr << "Error: Failed to replace snapshot " << path << ": "
+              << error.message() << '\n';
+    std::filesystem::remove(temp_path, error);
+    return false;
+  }
+
+  const float ms = std::chrono::duration<float, std::milli>(
+                       std::chrono::steady_clock::now() - start)
+                       .count();
+  std::cout << "Saved snapshot " << path << ": " << offset << " bytes for "
+            << field.sample_count() << " samples ("
+            << static_cast<float>(offset) /
+                   static_cast<float>(field.sample_count())
+            << " bytes per sample) in " << ms << " ms" << std::endl;
+  return true;
+}
+
+auto terrain_snapshot::open(const std::string& path) -> bool {
+  m_header_ = nullptr;
+  m_tiles_ = nullptr;
+
+  if (!m_file_.open(path)) {
+    std::cerr << "Error: Failed to open snapshot " << path << '\n';
+    return false;
+  }
+
+  const auto fail = [&](const char* reason) {
+    std::cerr << "Error: Snapshot " << path << " " << reason << '\n';
+    m_header_ = nullptr;
+    m_tiles_ = nullptr;
+    m_file_.close();
+    return false;
+  };
+
+  if (m_file_.size() < sizeof(snapshot_header)) return fail("is truncated");
+
+  const auto* header =
+      reinterpret_cast<const snapshot_header*>(m_file_.data());
+  if (std::memcmp(header->magic, "TSNP", 4) != 0) {
+    return fail("is not a terrain snapshot");
+  }
+  if (header->version != 1) return fail("has an unsupported version");
+  // The grid size is bounded first, the tile count below is computed from it
+  if (header->grid_size < 1 || header->grid_size > max_grid_size) {
+    return fail("has an invalid grid size");
+  }
+  if (header->tile_size != tile_size ||
+      header->tiles_per_axis !=
+          static_cast<std::uint32_t>((header->grid_size + tile_size) /
+                                     tile_size)) {
+    return fail("has an invalid grid layout");
+  }
+  // The edited region of the grid, restore keeps it for record_edit to grow
+  const std::int32_t* bounds = header->edit_bounds;
+  const bool no_edits = bounds[1] < bounds[0] || bounds[3] < bounds[2];
+  if (!no_edits && (bounds[0] < 0 || bounds[1] > header->grid_size ||
+                    bounds[2] < 0 || bounds[3] > header->grid_size)) {
+    return fail("has edit bounds outside its grid");
+  }
+  // Both scale every decoded value, a zero, negative or NaN one would
+  // silently produce a broken terrain
+  if (!std::isfinite(header->spacing) || header->spacing <= 0.0f ||
+      !std::isfinite(header->height_step) || header->height_step <= 0.0f) {
+    return fail("has an invalid spacing or height step");
+  }
+
+  m_header_ = header;
+  const size_t directory_end =
+      sizeof(snapshot_header) + sizeof(snapshot_tile) * tile_count();
+  if (m_file_.size() < directory_end) return fail("is truncated");
+
+  m_tiles_ = reinterpret_cast<const snapshot_tile*>(m_file_.data() +
+                                                    sizeof(snapshot_header));
+  for (auto t = 0; t < tile_count(); ++t) {
+    // Compared this way round so a huge offset cannot wrap the sum
+    if (m_tiles_[t].offset < directory_end ||
+        m_tiles_[t].offset > m_file_.size() ||
+        m_tiles_[t].size > m_file_.size() - m_tiles_[t].offset) {
+      return fail("has a corrupt tile directory");
+    }
+  }
+
+  return true;
+}
+
+auto terrain_snapshot::tile_count() const -> int {
+  return static_cast<int>(m_header_->tiles_per_axis * m_header_->tiles_per_axis);
+}
+
+auto terrain_snapshot::tile_rect(const int t) const -> grid_rect {
+  return ::tile_rect(t, static_cast<int>(m_header_->tiles_per_axis),
+                     m_header_->grid_size + 1);
+}
+
+auto terrain_snapshot::decode_tile(const int t, heightfield& field) const
+    -> bool {
+  const grid_rect rect = tile_rect(t);
+  const int h = rect.i_max - rect.i_min + 1;
+  const int w = rect.j_max - rect.j_min + 1;
+
+  const auto* in =
+      reinterpret_cast<const unsigned char*>(m_file_.data() + m_tiles_[t].offset);
+  const auto* end = in + m_tiles_[t].size;
+
+  // Two rows of quantized heights are enough for the predictor
+  std::vector<std::uint32_t> q(2 * static_cast<size_t>(w));
+  const float step = m_header_->height_step;
+  const bool exact = is_exact();
+
+  for (auto a = 0; a < h; ++a) {
+    std::uint32_t* row = q.data() + (a & 1) * w;
+    const std::uint32_t* up = q.data() + ((a + 1) & 1) * w;
+
+    for (auto b = 0; b < w; ++b) {
+      std::uint32_t v = 0;
+      for (int shift = 0;; shift += 7) {
+        if (in == end || shift > 28) return false;
+        const unsigned char byte = *in++;
+        v |= static_cast<std::uint32_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) break;
+      }
+
+      std::uint32_t prediction = 0;
+      if (a == 0) {
+        prediction = b == 0 ? 0 : row[b - 1];
+      } else if (b == 0) {
+        prediction = up[0];
+      } else {
+        prediction = up[b] + row[b - 1] - up[b - 1];
+      }
+
+      row[b] = prediction + static_cast<std::uint32_t>(unzigzag(v));
+      field.set_height(
+          rect.i_min + a, rect.j_min + b,
+          exact ? std::bit_cast<float>(row[b])
+                : static_cast<float>(static_cast<std::int32_t>(row[b])) * step);
+    }
+  }
+  if (!exact) return in == end;
+
+  if (end - in != static_cast<std::ptrdiff_t>(sizeof(glm::vec3)) * h * w) {
+    return false;
+  }
+  for (auto a = 0; a < h; ++a) {
+    for (auto b = 0; b < w; ++b) {
+      glm::vec3 normal;
+      std::memcpy(&normal, in, sizeof(glm::vec3));
+      in += sizeof(glm::vec3);
+      field.set_normal(rect.i_min + a, rect.j_min + b, normal);
+    }
+  }
+  return true;
+}
+
+auto terrain_snapshot::decode(heightfield& field) const -> bool {
+  std::atomic<bool> ok{true};
+  parallel_for_blocks(
+      0, tile_count(),
+      [&](const int begin, const int end) {
+        for (auto t = begin; t < end; ++t) {
+          if (!decode_tile(t, field)) ok = false;
+        }
+      },
+      4);
+
+  if (!ok) std::cerr << "Error: Snapshot has corrupt tile data\n";
+  return ok;
+}
+
+auto terrain_snapshot::restore(terrain_model& model) const -> bool {
+  const snapshot_header& header = *m_header_;
+
+  heightfield field(header.grid_size, header.spacing,
+                    glm::vec2(header.origin[0], header.origin[1]));
+  field.set_uv_mapping(glm::vec2(header.uv_offset[0], header.uv_offset[1]),
+                       header.uv_scale);
+  if (!decode(field)) return false;
+  if (!is_exact()) field.compute_normals();
+
+  model.m_heightfield = std::move(field);
+  model.m_grid_size = header.grid_size;
+  model.m_spacing = header.spacing;
+  model.m_seed = header.seed;
+  model.m_octaves = header.octaves;
+  model.m_lacunarity = header.lacunarity;
+  model.m_persistence = header.persistence;
+  model.m_repeat = header.repeat;
+  model.m_height = header.height;
+  model.m_use_2d_noise = (header.flags & snapshot_header::flag_noise_2d) != 0;
+  model.m_layered = (header.flags & snapshot_header::flag_layered) != 0;
+  model.m_noise_basis = (header.flags & snapshot_header::flag_simplex) != 0
+                            ? noise_basis::simplex
+                            : noise_basis::perlin;
+  model.m_box_depth = header.box_depth;
+  model.m_solid_box = header.solid_box != 0;
+  model.m_edits.strokes = header.edit_strokes;
+  model.m_edits.bounds = {header.edit_bounds[0], header.edit_bounds[1],
+                          header.edit_bounds[2], header.edit_bounds[3]};
+  return true;
+}
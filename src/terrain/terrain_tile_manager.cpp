@@ -0,0 +1,348 @@
+#include "terrain/terrain_tile_manager.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include "terrain/heightfield.hpp"
+
+terrain_tile_manager::~terrain_tile_manager() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_);
+    m_stop_ = true;
+    m_queue_.clear();
+  }
+  m_work_available_.notify_all();
+
+  for (auto& worker : m_workers_) {
+    worker.join();
+  }
+}
+
+auto terrain_tile_manager::configure(const terrain_model& terrain) -> void {
+  tile_settings settings;
+  settings.seed = terrain.m_seed;
+  settings.octaves = terrain.m_octaves;
+  settings.lacunarity = terrain.m_lacunarity;
+  settings.persistence = terrain.m_persistence;
+  settings.repeat = terrain.m_repeat;
+  settings.height = terrain.m_height;
+  settings.noise_2d = terrain.m_use_2d_noise;
+  settings.layered = terrain.m_layered;
+  settings.basis = terrain.m_noise_basis;
+  settings.spacing = terrain.m_spacing;
+  // Same texture density as the terrain model
+  settings.uv_scale = 10.0f / static_cast<float>(terrain.m_grid_size);
+  settings.tile_cells = glm::max(1, m_tile_cells);
+
+  std::shared_ptr<noise_tile_cache> cache =
+      terrain.m_use_noise_tiles ? terrain.m_noise_tiles : nullptr;
+
+  if (m_source_ && m_source_->settings == settings) {
+    // The cache only changes where the samples come from, not their values,
+    // so the loaded tiles stay
+    if (m_source_->cache != cache) {
+      auto source = std::make_shared<tile_source>(*m_source_);
+      source->cache = std::move(cache);
+      std::lock_guard<std::mutex> lock(m_mutex_);
+      m_source_ = std::move(source);
+    }
+    return;
+  }
+
+  clear();
+
+  // Sample index k of the tiles lies at k * spacing
+  noise_lattice lattice;
+  lattice.seed = settings.seed;
+  lattice.octaves = settings.octaves;
+  lattice.lacunarity = settings.lacunarity;
+  lattice.persistence = settings.persistence;
+  lattice.repeat = settings.repeat;
+  lattice.planar = settings.noise_2d;
+  lattice.layered = settings.layered;
+  lattice.basis = settings.basis;
+  lattice.spacing = settings.spacing;
+
+  auto source = std::make_shared<tile_source>();
+  source->settings = settings;
+  source->noise = std::make_shared<const noise_source>(lattice);
+  source->cache = std::move(cache);
+
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  m_source_ = std::move(source);
+}
+
+auto terrain_tile_manager::clear() -> void {
+  for (auto& [key, t] : m_tiles_) {
+    t.mesh.destroy();
+  }
+  m_tiles_.clear();
+  m_requested_.clear();
+  m_memory_used_ = 0;
+
+  // Tiles still being generated belong to the old generation, the workers
+  // drop them when they finish
+  std::lock_guard<std::mutex> lock(m_mutex_);
+  m_queue_.clear();
+  m_finished_.clear();
+  ++m_generation_;
+}
+
+auto terrain_tile_manager::update(const glm::vec3& camera_pos) -> void {
+  if (!m_source_) return;
+
+  start_workers();
+
+  // Upload a few finished tiles per frame so a burst of tiles can't stall
+  // the render thread
+  std::vector<generated_tile> finished;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex_);
+    const size_t count = glm::min(
+        m_finished_.size(),
+        static_cast<size_t>(glm::max(1, m_uploads_per_frame)));
+    finished.assign(std::make_move_iterator(m_finished_.begin()),
+                    std::make_move_iterator(m_finished_.begin() + count));
+    m_finished_.erase(m_finished_.begin(), m_finished_.begin() + count);
+  }
+
+  for (auto& generated : finished) {
+    m_requested_.erase(generated.key);
+
+    tile t;
+    t.key = generated.key;
+    t.mesh = generated.builder.build();
+    t.bytes = generated.builder.m_vertices.size() * sizeof(cgra::mesh_vertex) +
+              generated.builder.m_indices.size() * sizeof(unsigned int);
+    m_memory_used_ += t.bytes;
+    m_tiles_.emplace(t.key, std::move(t));
+  }
+
+  evict(camera_pos);
+
+  // Tiles in view, nearest first
+  const float tile_size =
+      m_source_->settings.spacing *
+      static_cast<float>(m_source_->settings.tile_cells);
+  const int center_x = static_cast<int>(std::floor(camera_pos.x / tile_size));
+  const int center_z = static_cast<int>(std::floor(camera_pos.z / tile_size));
+
+  std::vector<tile_key> wanted;
+  for (auto dx = -m_view_radius; dx <= m_view_radius; ++dx) {
+    for (auto dz = -m_view_radius; dz <= m_view_radius; ++dz) {
+      wanted.push_back({center_x + dx, center_z + dz});
+    }
+  }
+  std::ranges::sort(wanted, [&](const tile_key& a, const tile_key& b) {
+    return tile_distance(a, camera_pos) < tile_distance(b, camera_pos);
+  });
+
+  std::lock_guard<std::mutex> lock(m_mutex_);
+
+  // Drop queued tiles the camera has moved away from
+  std::erase_if(m_queue_, [&](const tile_key& key) {
+    const bool in_view = std::abs(key.x - center_x) <= m_view_radius &&
+                         std::abs(key.z - center_z) <= m_view_radius;
+    if (!in_view) m_requested_.erase(key);
+    return !in_view;
+  });
+
+  // Only request what still fits in the budget once the queued tiles arrive
+  size_t projected = m_memory_used_ + m_requested_.size() * tile_bytes();
+  for (const auto& key : wanted) {
+    if (m_tiles_.contains(key) || m_requested_.contains(key)) continue;
+    if (projected + tile_bytes() > m_memory_budget) break;
+
+    m_requested_.insert(key);
+    m_queue_.push_back(key);
+    projected += tile_bytes();
+  }
+
+  std::ranges::sort(m_queue_, [&](const tile_key& a, const tile_key& b) {
+    return tile_distance(a, camera_pos) < tile_distance(b, camera_pos);
+  });
+
+  m_work_available_.notify_all();
+}
+
+auto terrain_tile_manager::evict(const glm::vec3& camera_pos) -> void {
+  if (m_memory_used_ <= m_memory_budget) return;
+
+  const float tile_size =
+      m_source_->settings.spacing *
+      static_cast<float>(m_source_->settings.tile_cells);
+  const int center_x = static_cast<int>(std::floor(camera_pos.x / tile_size));
+  const int center_z = static_cast<int>(std::floor(camera_pos.z / tile_size));
+
+  // Tiles outside the view, farthest first. Tiles in view are never evicted,
+  // the budget instead limits how many new tiles get requested.
+  std::vector<tile_key> candidates;
+  for (const auto& [key, t] : m_tiles_) {
+    if (std::abs(key.x - center_x) > m_view_radius ||
+        std::abs(key.z - center_z) > m_view_radius) {
+      candidates.push_back(key);
+    }
+  }
+  std::ranges::sort(candidates, [&](const tile_key& a, const tile_key& b) {
+    return tile_distance(a, camera_pos) > tile_distance(b, camera_pos);
+  });
+
+  for (const auto& key : candidates) {
+    if (m_memory_used_ <= m_memory_budget) break;
+
+    const auto it = m_tiles_.find(key);
+    it->second.mesh.destroy();
+    m_memory_used_ -= it->second.bytes;
+    m_tiles_.erase(it);
+  }
+}
+
+auto terrain_tile_manager::draw(const terrain_model& style,
+                                const glm::mat4& view,
+                                const glm::mat4& projection) const -> void {
+  style.bind_uniforms(view, projection);
+
+  for (const auto& [key, t] : m_tiles_) {
+    t.mesh.draw();
+  }
+
+  style.reset_uniforms();
+}
+
+auto terrain_tile_manager::start_workers() -> void {
+  if (!m_workers_.empty()) return;
+
+  // Leave a core for the render thread
+  const int count = glm::max(
+      1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+  for (auto i = 0; i < count; ++i) {
+    m_workers_.emplace_back([this]() { worker_loop(); });
+  }
+}
+
+auto terrain_tile_manager::worker_loop() -> void {
+  while (true) {
+    tile_key key{};
+    unsigned int generation = 0;
+    std::shared_ptr<const tile_source> source;
+
+    {
+      std::unique_lock<std::mutex> lock(m_mutex_);
+      m_work_available_.wait(lock,
+                             [this]() { return m_stop_ || !m_queue_.empty(); });
+      if (m_stop_) return;
+
+      key = m_queue_.front();
+      m_queue_.pop_front();
+      generation = m_generation_;
+      source = m_source_;
+    }
+
+    // Generation happens without holding the lock
+    cgra::mesh_builder builder = generate_tile(*source, key);
+
+    std::lock_guard<std::mutex> lock(m_mutex_);
+    if (generation == m_generation_) {
+      m_finished_.push_back({key, std::move(builder)});
+    }
+  }
+}
+
+auto terrain_tile_manager::generate_tile(const tile_source& source,
+                                         const tile_key& key)
+    -> cgra::mesh_builder {
+  const tile_settings& settings = source.settings;
+  const int cells = settings.tile_cells;
+  const int row_length = cells + 1;
+
+  // Global index of the first sample of the tile. Samples on a shared edge
+  // have the same global index in both tiles, so they get bit-identical
+  // positions and heights.
+  const long long start_x = static_cast<long long>(key.x) * cells;
+  const long long start_z = static_cast<long long>(key.z) * cells;
+
+  // Generate one extra sample on every side so the edge normals see the
+  // neighbouring tile's triangles
+  heightfield field(cells + 2, settings.spacing,
+                    glm::vec2(static_cast<float>(start_x - 1),
+                              static_cast<float>(start_z - 1)) *
+                        settings.spacing);
+
+  // Wrap the texture coordinates by whole texture repeats so they stay
+  // precise far from the origin
+  const double period = 1.0 / static_cast<double>(settings.uv_scale);
+  const auto wrap = [period](const long long index) {
+    const double wrapped = std::fmod(static_cast<double>(index), period);
+    return static_cast<float>(wrapped < 0.0 ? wrapped + period : wrapped);
+  };
+  field.set_uv_mapping(glm::vec2(wrap(start_x - 1), wrap(start_z - 1)),
+                       settings.uv_scale);
+
+  const auto world = [&settings](const long long index) {
+    return static_cast<float>(index) * settings.spacing;
+  };
+
+  const int resolution = field.resolution();
+  float* heights = field.heights().data();
+  if (source.cache) {
+    source.cache->fill(*source.noise, start_x - 1, start_z - 1, resolution,
+                       resolution, heights, nullptr, nullptr, resolution);
+  } else {
+    source.noise->evaluate_rows(start_x - 1, start_z - 1, resolution,
+                                resolution, heights, nullptr, nullptr,
+                                resolution);
+  }
+  for (size_t k = 0; k < field.sample_count(); ++k) {
+    heights[k] = (heights[k] * settings.height) - (settings.height / 2.0f);
+  }
+
+  field.compute_normals();
+
+  cgra::mesh_builder mb;
+  mb.m_vertices.resize(static_cast<size_t>(row_length) * row_length);
+  mb.m_indices.resize(6 * static_cast<size_t>(cells) * cells);
+
+  for (auto i = 0; i <= cells; ++i) {
+    for (auto j = 0; j <= cells; ++j) {
+      cgra::mesh_vertex v = field.vertex(i + 1, j + 1);
+      v.pos.x = world(start_x + i);
+      v.pos.z = world(start_z + j);
+      mb.m_vertices[i * row_length + j] = v;
+    }
+  }
+
+  // Same triangulation as the terrain model's top face
+  for (auto i = 0; i < cells; ++i) {
+    for (auto j = 0; j < cells; ++j) {
+      const GLuint k1 = i * row_length + j;
+      const GLuint k2 = k1 + 1;
+      const GLuint k3 = (i + 1) * row_length + j;
+      const GLuint k4 = k3 + 1;
+
+      auto* out = &mb.m_indices[(static_cast<size_t>(i) * cells + j) * 6];
+      out[0] = k1, out[1] = k2, out[2] = k3;
+      out[3] = k2, out[4] = k4, out[5] = k3;
+    }
+  }
+
+  return mb;
+}
+
+auto terrain_tile_manager::tile_distance(const tile_key& key,
+                                         const glm::vec3& camera_pos) const
+    -> float {
+  const float tile_size =
+      m_source_->settings.spacing *
+      static_cast<float>(m_source_->settings.tile_cells);
+  const glm::vec2 center =
+      (glm::vec2(static_cast<float>(key.x), static_cast<float>(key.z)) + 0.5f) *
+      tile_size;
+
+  return glm::distance(center, glm::vec2(camera_pos.x, camera_pos.z));
+}
+
+auto terrain_tile_manager::tile_bytes() const -> size_t {
+  const auto cells = static_cast<size_t>(m_source_->settings.tile_cells);
+  return (cells + 1) * (cells + 1) * sizeof(cgra::mesh_vertex) +
+         6 * cells * cells * sizeof(unsigned int);
+}
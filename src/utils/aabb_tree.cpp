@@ -1,102 +1,922 @@
 #include "utils/aabb_tree.hpp"
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <thread>
+
+#include "utils/parallel.hpp"
+
+namespace {
+// Start of block b when [first, first + count) is cut into blocks
+auto block_begin(unsigned int first, unsigned int count, int b, int blocks)
+    -> unsigned int {
+    return first + static_cast<unsigned int>(
+        static_cast<unsigned long long>(count) * b / blocks);
+}
+
+// Calls fn(b, begin, end) for every block of [first, first + count), each
+// block on its own thread
+template <typename Fn>
+auto for_each_block(unsigned int first, unsigned int count, int blocks,
+    Fn&& fn) -> void {
+    parallel_for_blocks(0, blocks, [&](int block_first, int block_last) {
+        for (int b = block_first; b < block_last; b++) {
+            fn(b, block_begin(first, count, b, blocks),
+               block_begin(first, count, b + 1, blocks));
+        }
+    }, 1, blocks);
+}
+
+// Runs pass(part, begin, end) over every block into a part of its own and
+// merges the parts in block order
+template <typename T, typename Pass, typename Merge>
+auto reduce_blocks(unsigned int first, unsigned int count, int blocks,
+    Pass&& pass, Merge&& merge) -> T {
+    if (blocks == 1) {
+        T part{};
+        pass(part, first, first + count);
+        return part;
+    }
+
+    std::vector<T> parts(blocks);
+    for_each_block(first, count, blocks,
+        [&](int b, unsigned int begin, unsigned int end) {
+            pass(parts[b], begin, end);
+        });
+    for (int b = 1; b < blocks; b++) merge(parts[0], parts[b]);
+    return parts[0];
+}
+
+// Moves the items of items[first, first + count) that satisfy pred in front
+// of the others, both in their original order, and returns how many did.
+// Being stable, the result does not depend on the number of blocks
+template <typename T, typename Pred>
+auto partition_stable(T* items, T* scratch,
+    unsigned int first, unsigned int count, int blocks, Pred&& pred)
+    -> unsigned int {
+    if (blocks == 1) {
+        unsigned int left = first;
+        unsigned int right = first;
+        for (unsigned int i = first; i < first + count; i++) {
+            if (pred(items[i])) {
+                items[left++] = items[i];
+            } else {
+                scratch[right++] = items[i];
+            }
+        }
+        std::copy(scratch + first, scratch + right, items + left);
+        return left - first;
+    }
+
+    // Count the left items of every block, then each block scatters its
+    // items to where they end up
+    std::vector<unsigned int> lefts(blocks);
+    for_each_block(first, count, blocks,
+        [&](int b, unsigned int begin, unsigned int end) {
+            unsigned int in_left = 0;
+            for (unsigned int i = begin; i < end; i++) in_left += pred(items[i]);
+            lefts[b] = in_left;
+        });
+
+    unsigned int total_left = 0;
+    for (unsigned int in_left : lefts) total_left += in_left;
+
+    std::vector<unsigned int> left_at(blocks);
+    std::vector<unsigned int> right_at(blocks);
+    unsigned int left = first;
+    unsigned int right = first + total_left;
+    for (int b = 0; b < blocks; b++) {
+        left_at[b] = left;
+        right_at[b] = right;
+        const unsigned int size = block_begin(first, count, b + 1, blocks) -
+                                  block_begin(first, count, b, blocks);
+        left += lefts[b];
+        right += size - lefts[b];
+    }
+
+    for_each_block(first, count, blocks,
+        [&](int b, unsigned int begin, unsigned int end) {
+            unsigned int to_left = left_at[b];
+            unsigned int to_right = right_at[b];
+            for (unsigned int i = begin; i < end; i++) {
+                scratch[pred(items[i]) ? to_left++ : to_right++] = items[i];
+            }
+        });
+    for_each_block(first, count, blocks,
+        [&](int, unsigned int begin, unsigned int end) {
+            std::copy(scratch + begin, scratch + end, items + begin);
+        });
+
+    return total_left;
+}
+
+// Spreads the low 21 bits of x to every third bit
+auto spread_bits(std::uint64_t x) -> std::uint64_t {
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+// Sorts keys[0, count) by bits [shift, shift + bits) with a least
+// significant digit radix sort, 8 bits per pass, ping-ponging with scratch.
+// Stable, so the order is the same for any number of blocks. Returns
+// whichever of keys and scratch holds the result
+auto radix_sort(std::uint64_t* keys, std::uint64_t* scratch,
+    unsigned int count, int shift, int bits, int blocks) -> std::uint64_t* {
+    constexpr int radix = 256;
+    std::vector<std::array<unsigned int, radix>> offsets(blocks);
+
+    for (int pass = shift; pass < shift + bits; pass += 8) {
+        const auto digit = [pass](std::uint64_t key) {
+            return static_cast<unsigned int>(key >> pass) & (radix - 1);
+        };
+
+        for_each_block(0, count, blocks,
+            [&](int b, unsigned int begin, unsigned int end) {
+                offsets[b].fill(0);
+                for (unsigned int i = begin; i < end; i++) {
+                    offsets[b][digit(keys[i])]++;
+                }
+            });
+
+        // Every digit goes after the smaller ones, and within a digit the
+        // keys of each block after those of the blocks before it
+        unsigned int at = 0;
+        for (int d = 0; d < radix; d++) {
+            for (int b = 0; b < blocks; b++) {
+                const unsigned int in_block = offsets[b][d];
+                offsets[b][d] = at;
+                at += in_block;
+            }
+        }
+
+        for_each_block(0, count, blocks,
+            [&](int b, unsigned int begin, unsigned int end) {
+                for (unsigned int i = begin; i < end; i++) {
+                    scratch[offsets[b][digit(keys[i])]++] = keys[i];
+                }
+            });
+        std::swap(keys, scratch);
+    }
+
+    return keys;
+}
+}  // namespace
 
 auto aabb_tree::build(const std::vector<glm::vec3>& vertices,
     const std::vector<unsigned int>& indices) -> void {
-    triangles.clear();
+    const size_t count = indices.size() / 3;
 
-    // Build triangle list
-    for (size_t i = 0; i < indices.size(); i += 3) {
-        triangle tri{};
-        tri.v0 = vertices[indices[i]];
-        tri.v1 = vertices[indices[i + 1]];
-        tri.v2 = vertices[indices[i + 2]];
-        tri.index = i / 3;
-        triangles.push_back(tri);
-    }
+    build_state state;
+    state.workers = threads > 0
+        ? threads
+        : std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+
+    // Build triangle list, with the bounds and centroids the builders use
+    triangles.resize(count);
+    leaf_indices.resize(count);
+    state.prims = std::make_unique_for_overwrite<primitive[]>(count);
+    state.count = count;
+    parallel_for_blocks(0, static_cast<int>(count), [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            triangle& tri = triangles[i];
+            tri.v0 = vertices[indices[3 * i]];
+            tri.v1 = vertices[indices[3 * i + 1]];
+            tri.v2 = vertices[indices[3 * i + 2]];
+            tri.index = i;
+
+            primitive& prim = state.prims[i];
+            prim.min = glm::min(glm::min(tri.v0, tri.v1), tri.v2);
+            prim.max = glm::max(glm::max(tri.v0, tri.v1), tri.v2);
+            prim.centroid = (tri.v0 + tri.v1 + tri.v2) / 3.0f;
+            prim.index = i;
+        }
+    }, min_parallel_count, state.workers);
+
+    nodes.clear();
+    parents.clear();
+    leaves.clear();
+    weighted_area = 0.0;
+    query_cost = built_cost = 0.0f;
+    if (count == 0) return;
 
-    // Build tree
-    std::vector<unsigned int> all_indices(triangles.size());
-    for (size_t i = 0; i < all_indices.size(); i++) {
-        all_indices[i] = i;
+    if (method != build_method::median) {
+        state.scratch = std::make_unique_for_overwrite<primitive[]>(count);
+    }
+    if (method == build_method::lbvh) {
+        sort_morton(state);
+        build_lbvh(state);
+    } else if (method == build_method::median && !state.parallel()) {
+        // The median split only depends on the number of triangles, so the
+        // node count is known before building
+        nodes.reserve(count_nodes(count, 0));
+        build_subtree(state, nodes, 0, count, 0);
+    } else {
+        // The other splits depend on the triangles, the node count is only
+        // known once the tasks are built
+        build_tasks(state);
     }
 
-    root = build_recursive(all_indices, 0);
+    link_nodes(state.workers);
+    for (const node& node : nodes) weighted_area += node_cost(node);
+    update_sah_cost();
+    built_cost = query_cost;
 }
 
-auto aabb_tree::build_recursive(
-    std::vector<unsigned int>& tri_indices, int depth) -> std::unique_ptr<aabb_tree::node> {
+auto aabb_tree::count_nodes(size_t count, int depth) -> size_t {
+    if (count <= 4 || depth > 20) return 1;
+
+    const size_t mid = count / 2;
+    return 1 + count_nodes(mid, depth + 1) + count_nodes(count - mid, depth + 1);
+}
+
+auto aabb_tree::split_node(build_state& state, unsigned int first,
+    unsigned int count, int depth, int blocks) -> split {
+    return method == build_method::median
+        ? split_median(state, first, count, depth, blocks)
+        : split_sah(state, first, count, depth, blocks);
+}
 
-    auto node = std::make_unique<aabb_tree::node>();
-    node->is_leaf = false;
+auto aabb_tree::split_median(build_state& state, unsigned int first,
+    unsigned int count, int depth, int blocks) -> split {
+    primitive* prims = state.prims.get();
 
     // Compute bounds for this node
-    for (unsigned int idx : tri_indices) {
-        const triangle& tri = triangles[idx];
-        node->bounds.expand(tri.v0);
-        node->bounds.expand(tri.v1);
-        node->bounds.expand(tri.v2);
-    }
+    split result;
+    result.bounds = reduce_blocks<aabb>(first, count, blocks,
+        [&](aabb& bounds, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                prims[i].add_to(bounds);
+            }
+        },
+        [](aabb& bounds, const aabb& other) { bounds.expand(other); });
 
     // Leaf condition: few triangles or max depth
-    if (tri_indices.size() <= 4 || depth > 20) {
-        node->is_leaf = true;
-        node->triangle_indices = tri_indices;
-        return node;
-    }
+    if (count <= 4 || depth > 20) return result;
 
     // Find longest axis
-    glm::vec3 extent = node->bounds.max - node->bounds.min;
+    glm::vec3 extent = result.bounds.max - result.bounds.min;
     int axis = 0;
     if (extent.y > extent.x) axis = 1;
     if (extent.z > extent[axis]) axis = 2;
 
-    // Sort triangles by centroid along axis
-    std::sort(tri_indices.begin(), tri_indices.end(),
-        [this, axis](unsigned int a, unsigned int b) {
-            glm::vec3 ca = (triangles[a].v0 + triangles[a].v1 + triangles[a].v2) / 3.0f;
-            glm::vec3 cb = (triangles[b].v0 + triangles[b].v1 + triangles[b].v2) / 3.0f;
-            return ca[axis] < cb[axis];
+    // Split at the median centroid along axis, only the halves need to be
+    // apart, not sorted
+    result.mid = count / 2;
+    primitive* begin = prims + first;
+    std::nth_element(begin, begin + result.mid, begin + count,
+        [axis](const primitive& a, const primitive& b) {
+            return a.centroid[axis] < b.centroid[axis];
+        });
+    return result;
+}
+
+auto aabb_tree::split_sah(build_state& state, unsigned int first,
+    unsigned int count, int depth, int blocks) -> split {
+    const primitive* prims = state.prims.get();
+
+    struct extents {
+        aabb bounds;
+        aabb centroids;
+    };
+    const extents node = reduce_blocks<extents>(first, count, blocks,
+        [&](extents& part, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                prims[i].add_to(part.bounds);
+                part.centroids.expand(prims[i].centroid);
+            }
+        },
+        [](extents& part, const extents& other) {
+            part.bounds.expand(other.bounds);
+            part.centroids.expand(other.centroids);
         });
 
-    // Split in half
-    size_t mid = tri_indices.size() / 2;
-    std::vector<unsigned int> left_indices(tri_indices.begin(), tri_indices.begin() + mid);
-    std::vector<unsigned int> right_indices(tri_indices.begin() + mid, tri_indices.end());
+    split result;
+    result.bounds = node.bounds;
+    if (count == 1 || depth >= max_depth - 2) return result;
 
-    node->left = build_recursive(left_indices, depth + 1);
-    node->right = build_recursive(right_indices, depth + 1);
+    // Bins the centroids between the centroid bounds on every axis in one
+    // pass, then tries the split between each pair of neighbouring bins
+    const glm::vec3 extent = node.centroids.max - node.centroids.min;
+    glm::vec3 scale;
+    for (int axis = 0; axis < 3; axis++) {
+        scale[axis] = extent[axis] > 0.0f ? sah_bins / extent[axis] : 0.0f;
+    }
+    const auto bin_of = [&](const primitive& prim, int axis) {
+        const float offset = prim.centroid[axis] - node.centroids.min[axis];
+        return std::min(static_cast<int>(offset * scale[axis]), sah_bins - 1);
+    };
+
+    struct bins {
+        aabb bounds[3][sah_bins];
+        unsigned int counts[3][sah_bins] = {};
+    };
+    const bins binned = reduce_blocks<bins>(first, count, blocks,
+        [&](bins& part, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                for (int axis = 0; axis < 3; axis++) {
+                    const int bin = bin_of(prims[i], axis);
+                    prims[i].add_to(part.bounds[axis][bin]);
+                    part.counts[axis][bin]++;
+                }
+            }
+        },
+        [](bins& part, const bins& other) {
+            for (int axis = 0; axis < 3; axis++) {
+                for (int bin = 0; bin < sah_bins; bin++) {
+                    part.bounds[axis][bin].expand(other.bounds[axis][bin]);
+                    part.counts[axis][bin] += other.counts[axis][bin];
+                }
+            }
+        });
 
-    return node;
+    float best_cost = FLT_MAX;
+    int best_axis = -1;
+    int best_split = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        if (scale[axis] == 0.0f) continue;
+
+        // Area and triangles right of each split, then sweep from the left
+        float right_area[sah_bins];
+        unsigned int right_count[sah_bins];
+        aabb right;
+        unsigned int in_right = 0;
+        for (int bin = sah_bins - 1; bin > 0; bin--) {
+            right.expand(binned.bounds[axis][bin]);
+            in_right += binned.counts[axis][bin];
+            right_area[bin] = right.surface_area();
+            right_count[bin] = in_right;
+        }
+
+        aabb left;
+        unsigned int in_left = 0;
+        for (int split = 1; split < sah_bins; split++) {
+            left.expand(binned.bounds[axis][split - 1]);
+            in_left += binned.counts[axis][split - 1];
+            if (in_left == 0 || right_count[split] == 0) continue;
+
+            const float cost = left.surface_area() * in_left +
+                               right_area[split] * right_count[split];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_split = split;
+            }
+        }
+    }
+
+    if (best_axis < 0) {
+        // Every centroid in the same place, any halves are as good
+        if (count > max_leaf_size) result.mid = count / 2;
+        return result;
+    }
+
+    const float area = node.bounds.surface_area();
+    const float split_cost =
+        traversal_cost + intersection_cost * best_cost / area;
+    const float leaf_cost = intersection_cost * count;
+    if (split_cost >= leaf_cost && count <= max_leaf_size) return result;
+
+    result.mid = partition_stable(state.prims.get(), state.scratch.get(),
+        first, count, blocks, [&](const primitive& prim) {
+            return bin_of(prim, best_axis) < best_split;
+        });
+    return result;
+}
+
+auto aabb_tree::sort_morton(build_state& state) -> void {
+    const unsigned int count = state.count;
+    const int blocks = std::clamp(
+        static_cast<int>(count / min_parallel_count), 1, state.workers);
+    const primitive* prims = state.prims.get();
+
+    const aabb centroids = reduce_blocks<aabb>(0, count, blocks,
+        [&](aabb& bounds, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                bounds.expand(prims[i].centroid);
+            }
+        },
+        [](aabb& bounds, const aabb& other) { bounds.expand(other); });
+
+    // Quantizes the centroids to a grid of cubes over their bounds and
+    // interleaves the bits of the cell's coordinates. Stretching the grid to
+    // the bounds instead would split a flat terrain into thin slabs as often
+    // as across it. The triangle's index goes below the code, which makes
+    // every key unique and breaks ties the same way every time, and fewer
+    // bits per axis are used for large meshes so both fit in 64 bits
+    const int index_bits =
+        std::max(1, static_cast<int>(std::bit_width(count - 1)));
+    const int axis_bits = count <= morton_30_bit_limit
+        ? 10
+        : std::min(21, (64 - index_bits) / 3);
+    const glm::vec3 extent = centroids.max - centroids.min;
+    const float largest = std::max(std::max(extent.x, extent.y), extent.z);
+    const float scale = largest > 0.0f
+        ? static_cast<float>((1u << axis_bits) - 1) / largest
+        : 0.0f;
+
+    auto keys = std::make_unique_for_overwrite<std::uint64_t[]>(count);
+    auto key_scratch = std::make_unique_for_overwrite<std::uint64_t[]>(count);
+    for_each_block(0, count, blocks,
+        [&](int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                const glm::vec3 cell =
+                    (prims[i].centroid - centroids.min) * scale;
+                std::uint64_t code = 0;
+                for (int axis = 0; axis < 3; axis++) {
+                    code = code << 1 | spread_bits(
+                        static_cast<std::uint64_t>(cell[axis]));
+                }
+                keys[i] = code << index_bits | i;
+            }
+        });
+
+    // The keys start in index order, so sorting the code bits sorts them
+    std::uint64_t* sorted = radix_sort(keys.get(), key_scratch.get(), count,
+        index_bits, 3 * axis_bits, blocks);
+
+    // Reorder the triangles along the curve, so every node is a range of
+    // both them and the keys
+    const std::uint64_t index_mask = (std::uint64_t{1} << index_bits) - 1;
+    for_each_block(0, count, blocks,
+        [&](int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                state.scratch[i] = prims[sorted[i] & index_mask];
+            }
+        });
+    state.codes = sorted == keys.get() ? std::move(keys)
+                                       : std::move(key_scratch);
+    std::swap(state.prims, state.scratch);
+}
+
+auto aabb_tree::build_lbvh(build_state& state) -> void {
+    const unsigned int count = state.count;
+    const primitive* prims = state.prims.get();
+    if (count <= lbvh_leaf_size) {
+        nodes.resize(1);
+        for (unsigned int i = 0; i < count; i++) {
+            prims[i].add_to(nodes[0].bounds);
+        }
+        make_leaf(state, nodes, 0, 0, count);
+        return;
+    }
+
+    // A node at depth d shares its first d key bits, so it holds at most
+    // 2^(64 - d) keys and becomes a leaf before the depth limit. The search
+    // for the end of a range doubles from lbvh_leaf_size
+    static_assert(lbvh_leaf_size >= 1u << (64 - (max_depth - 2)));
+    static_assert(std::has_single_bit(lbvh_leaf_size));
+
+    // Karras' radix tree: each of the count - 1 interior nodes splits a
+    // range of the sorted keys where the highest differing bit changes.
+    // Interior node i covers the range that starts or ends at key i and
+    // reaches as far as its keys share more bits than the key just outside,
+    // so every node is found on its own from the keys around it. Its
+    // children are the interior nodes or keys at either side of the split,
+    // and interior node 0 is the root. The tree stops at nodes of
+    // lbvh_leaf_size keys or fewer, which become its leaves, so the nodes
+    // below them are never split
+    struct radix_node {
+        unsigned int first;
+        unsigned int last;
+        unsigned int split;   // Last key of the left child
+        unsigned int parent;
+        unsigned int rank;    // Nodes above it in its run
+    };
+    const unsigned int interior = count - 1;
+    auto radix = std::make_unique_for_overwrite<radix_node[]>(interior);
+    const std::uint64_t* codes = state.codes.get();
+    const int blocks = std::clamp(
+        static_cast<int>(count / min_parallel_count), 1, state.workers);
+
+    // Leading bits keys i and j share, -1 past the ends. The keys are unique
+    const auto common = [&](std::int64_t i, std::int64_t j) {
+        if (j < 0 || j >= count) return -1;
+        return std::countl_zero(codes[i] ^ codes[j]);
+    };
+    const auto size = [](unsigned int first, unsigned int last) {
+        return last - first + 1;
+    };
+    const auto is_split = [&](unsigned int i) {
+        return size(radix[i].first, radix[i].last) > lbvh_leaf_size;
+    };
+    for_each_block(0, interior, blocks,
+        [&](int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                // The range grows towards the neighbour sharing more bits
+                const std::int64_t dir =
+                    common(i, i + 1) > common(i, std::int64_t{i} - 1) ? 1 : -1;
+                const int outside = common(i, i - dir);
+                radix_node& node = radix[i];
+                if (common(i, i + lbvh_leaf_size * dir) <= outside) {
+                    // Inside a leaf, never split
+                    node.first = node.last = i;
+                    continue;
+                }
+
+                std::int64_t reach = 2 * lbvh_leaf_size;
+                while (common(i, i + reach * dir) > outside) reach *= 2;
+                std::int64_t length = 0;
+                for (std::int64_t step = reach / 2; step > 0; step /= 2) {
+                    if (common(i, i + (length + step) * dir) > outside) {
+                        length += step;
+                    }
+                }
+                node.first = dir > 0 ? i : i - length;
+                node.last = dir > 0 ? i + length : i;
+
+                // The last key from i sharing more bits with it than the
+                // other end does
+                const int inside = common(i, i + length * dir);
+                std::int64_t offset = 0;
+                std::int64_t step = length;
+                do {
+                    step = (step + 1) / 2;
+                    if (common(i, i + (offset + step) * dir) > inside) {
+                        offset += step;
+                    }
+                } while (step > 1);
+                node.split = i + offset * dir + std::min<std::int64_t>(dir, 0);
+                if (size(node.first, node.split) > lbvh_leaf_size) {
+                    radix[node.split].parent = i;
+                }
+                if (size(node.split + 1, node.last) > lbvh_leaf_size) {
+                    radix[node.split + 1].parent = i;
+                }
+            }
+        });
+
+    // Each node starts a run of nodes sharing its first key: a right child
+    // or the root, then the left children down to a leaf. Depth-first, a
+    // node follows every node starting at an earlier key and the ones above
+    // it in its run, so counting the nodes of each run places them all
+    auto starts = std::make_unique<unsigned int[]>(count + 1);
+    for_each_block(0, interior, blocks,
+        [&](int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                if (!is_split(i)) continue;
+
+                const radix_node& node = radix[i];
+                if (size(node.split + 1, node.last) <= lbvh_leaf_size) {
+                    starts[node.split + 1] = 1;
+                }
+                if (node.first != i) continue;
+
+                unsigned int rank = 0;
+                unsigned int at = i;
+                while (true) {
+                    radix[at].rank = rank++;
+                    if (size(i, radix[at].split) <= lbvh_leaf_size) break;
+                    at = radix[at].split;
+                }
+                starts[i] = rank + 1;
+            }
+        });
+
+    // Nodes starting before each key
+    std::vector<unsigned int> block_starts(blocks);
+    for_each_block(0, count, blocks,
+        [&](int b, unsigned int begin, unsigned int end) {
+            unsigned int in_block = 0;
+            for (unsigned int k = begin; k < end; k++) in_block += starts[k];
+            block_starts[b] = in_block;
+        });
+    unsigned int total = 0;
+    for (unsigned int& at : block_starts) {
+        const unsigned int in_block = at;
+        at = total;
+        total += in_block;
+    }
+    for_each_block(0, count, blocks,
+        [&](int b, unsigned int begin, unsigned int end) {
+            unsigned int at = block_starts[b];
+            for (unsigned int k = begin; k < end; k++) {
+                const unsigned int here = starts[k];
+                starts[k] = at;
+                at += here;
+            }
+        });
+    starts[count] = total;
+    nodes.resize(total);
+
+    // Every leaf takes the bounds of its triangles and climbs towards the
+    // root. The first of two children to reach a node stops there, the
+    // second merges both into it and carries on, so each node is done once
+    // after both its children on whichever thread finishes them
+    auto visits = std::make_unique<std::atomic<unsigned char>[]>(interior);
+    const auto climb = [&](unsigned int first, unsigned int last,
+        unsigned int parent) {
+        const unsigned int leaf = starts[first + 1] - 1;
+        for (unsigned int i = first; i <= last; i++) {
+            prims[i].add_to(nodes[leaf].bounds);
+        }
+        make_leaf(state, nodes, leaf, first, size(first, last));
+
+        for (unsigned int p = parent;; p = radix[p].parent) {
+            if (visits[p].fetch_add(1, std::memory_order_acq_rel) == 0) {
+                return;
+            }
+
+            // The right child starts at the key after the split
+            const radix_node& above = radix[p];
+            const unsigned int at = starts[above.first] + above.rank;
+            const unsigned int right = starts[above.split + 1];
+            node& node = nodes[at];
+            node.bounds = nodes[at + 1].bounds;
+            node.bounds.expand(nodes[right].bounds);
+            node.offset = right;
+            node.count = 0;
+            if (p == 0) return;
+        }
+    };
+    for_each_block(0, interior, blocks,
+        [&](int, unsigned int begin, unsigned int end) {
+            for (unsigned int i = begin; i < end; i++) {
+                if (!is_split(i)) continue;
+
+                const radix_node& node = radix[i];
+                if (size(node.first, node.split) <= lbvh_leaf_size) {
+                    climb(node.first, node.split, i);
+                }
+                if (size(node.split + 1, node.last) <= lbvh_leaf_size) {
+                    climb(node.split + 1, node.last, i);
+                }
+            }
+        });
+}
+
+auto aabb_tree::build_subtree(build_state& state, std::vector<node>& out,
+    unsigned int first, unsigned int count, int depth) -> void {
+    const split split = split_node(state, first, count, depth, 1);
+    const unsigned int at = out.size();
+    out.emplace_back();
+    out[at].bounds = split.bounds;
+    if (split.mid == 0) {
+        make_leaf(state, out, at, first, count);
+        return;
+    }
+
+    // The left subtree follows its parent, the right one follows the left
+    build_subtree(state, out, first, split.mid, depth + 1);
+    const unsigned int right = out.size();
+    out[at].offset = right;
+    out[at].count = 0;
+
+    build_subtree(state, out, first + split.mid, count - split.mid,
+        depth + 1);
+}
+
+auto aabb_tree::build_tasks(build_state& state) -> void {
+    // Nodes above the tasks, each either split, a leaf or a task's root
+    struct top_node {
+        aabb bounds;
+        unsigned int first = 0;
+        unsigned int count = 0;
+        int left = -1;
+        int right = -1;
+        int task = -1;
+        unsigned int at = 0;  // Index in nodes
+    };
+    struct task {
+        unsigned int first = 0;
+        unsigned int count = 0;
+        int depth = 0;
+        std::vector<node> nodes;
+        unsigned int at = 0;
+    };
+    std::vector<top_node> top;
+    std::vector<task> tasks;
+
+    // Enough tasks for every thread to stay busy when their sizes differ
+    const unsigned int task_size = state.parallel()
+        ? std::max<unsigned int>(min_parallel_count,
+            state.count / (8 * state.workers))
+        : state.count;
+
+    const auto split_top = [&](const auto& self, unsigned int first,
+        unsigned int count, int depth) -> int {
+        const int index = top.size();
+        top.push_back({});
+        top[index].first = first;
+        top[index].count = count;
+
+        if (count <= task_size) {
+            top[index].task = tasks.size();
+            tasks.push_back({first, count, depth, {}, 0});
+            return index;
+        }
+
+        const int blocks = std::clamp(
+            static_cast<int>(count / min_parallel_count), 1, state.workers);
+        const split split = split_node(state, first, count, depth, blocks);
+        top[index].bounds = split.bounds;
+        if (split.mid == 0) return index;
+
+        const int left = self(self, first, split.mid, depth + 1);
+        const int right =
+            self(self, first + split.mid, count - split.mid, depth + 1);
+        top[index].left = left;
+        top[index].right = right;
+        return index;
+    };
+    split_top(split_top, 0, state.count, 0);
+
+    // Largest tasks first, so the last ones to finish are short
+    std::vector<int> order(tasks.size());
+    for (size_t t = 0; t < order.size(); t++) order[t] = t;
+    std::stable_sort(order.begin(), order.end(), [&tasks](int a, int b) {
+        return tasks[a].count > tasks[b].count;
+    });
+    // Only the median tasks know their size up front, the others grow their
+    // nodes as they go and are freed once copied into place
+    parallel_for_dynamic(0, static_cast<int>(order.size()), [&](int i) {
+        task& task = tasks[order[i]];
+        if (method == build_method::median) {
+            task.nodes.reserve(count_nodes(task.count, task.depth));
+        }
+        build_subtree(state, task.nodes, task.first, task.count, task.depth);
+    }, state.workers);
+
+    // Lay out the top nodes and tasks depth-first, as the serial build does
+    const auto place = [&](const auto& self, int index, unsigned int at)
+        -> unsigned int {
+        top_node& node = top[index];
+        node.at = at;
+        if (node.task >= 0) {
+            tasks[node.task].at = at;
+            return at + tasks[node.task].nodes.size();
+        }
+        if (node.left < 0) return at + 1;
+
+        const unsigned int right = self(self, node.left, at + 1);
+        return self(self, node.right, right);
+    };
+    nodes.resize(place(place, 0, 0));
+
+    for (const top_node& node : top) {
+        if (node.task >= 0) continue;
+
+        nodes[node.at].bounds = node.bounds;
+        if (node.left < 0) {
+            make_leaf(state, nodes, node.at, node.first, node.count);
+        } else {
+            nodes[node.at].offset = top[node.right].at;
+            nodes[node.at].count = 0;
+        }
+    }
+
+    // Right children of the tasks are relative to their first node
+    parallel_for_dynamic(0, static_cast<int>(tasks.size()), [&](int t) {
+        const task& task = tasks[t];
+        for (size_t i = 0; i < task.nodes.size(); i++) {
+            node& node = nodes[task.at + i];
+            node = task.nodes[i];
+            if (node.count == 0) node.offset += task.at;
+        }
+    }, state.workers);
+}
+
+auto aabb_tree::make_leaf(const build_state& state, std::vector<node>& out,
+    unsigned int at, unsigned int first, unsigned int count) -> unsigned int {
+    for (unsigned int i = first; i < first + count; i++) {
+        leaf_indices[i] = state.prims[i].index;
+    }
+
+    out[at].offset = first;
+    out[at].count = count;
+    return at + 1;
+}
+
+auto aabb_tree::node_cost(const node& node) -> double {
+    const float area = node.bounds.surface_area();
+    return node.count == 0 ? traversal_cost * area
+                           : intersection_cost * node.count * area;
+}
+
+auto aabb_tree::update_sah_cost() -> void {
+    const float root_area =
+        nodes.empty() ? 0.0f : nodes[0].bounds.surface_area();
+    query_cost = root_area > 0.0f
+        ? static_cast<float>(weighted_area / root_area)
+        : 0.0f;
+}
+
+auto aabb_tree::link_nodes(int workers) -> void {
+    parents.resize(nodes.size());
+    leaves.resize(triangles.size());
+    parents[0] = 0;
+
+    // Every node is some node's child once and every triangle in one leaf,
+    // so the writes never overlap
+    parallel_for_blocks(0, static_cast<int>(nodes.size()),
+        [&](int begin, int end) {
+            for (int i = begin; i < end; i++) {
+                const node& node = nodes[i];
+                if (node.count == 0) {
+                    parents[i + 1] = i;
+                    parents[node.offset] = i;
+                    continue;
+                }
+                for (unsigned int k = node.offset;
+                     k < node.offset + node.count; k++) {
+                    leaves[leaf_indices[k]] = i;
+                }
+            }
+        }, min_parallel_count, workers);
+}
+
+auto aabb_tree::refit(const std::vector<triangle>& moved) -> void {
+    if (nodes.empty()) return;
+
+    std::vector<unsigned int> dirty;
+    dirty.reserve(moved.size());
+    for (const triangle& tri : moved) {
+        if (tri.index >= triangles.size()) continue;
+        triangles[tri.index] = tri;
+        dirty.push_back(leaves[tri.index]);
+    }
+
+    // Children come after their parents, so taking the largest dirty node
+    // first refits both children of a node before it. Nodes reached from
+    // several children come up once per child, one after the other
+    std::ranges::make_heap(dirty);
+    unsigned int previous = static_cast<unsigned int>(nodes.size());
+    while (!dirty.empty()) {
+        std::ranges::pop_heap(dirty);
+        const unsigned int at = dirty.back();
+        dirty.pop_back();
+        if (at == previous) continue;
+        previous = at;
+
+        node& node = nodes[at];
+        aabb bounds;
+        if (node.count == 0) {
+            bounds = nodes[at + 1].bounds;
+            bounds.expand(nodes[node.offset].bounds);
+        } else {
+            for (unsigned int k = node.offset; k < node.offset + node.count;
+                 k++) {
+                const triangle& tri = triangles[leaf_indices[k]];
+                bounds.expand(tri.v0);
+                bounds.expand(tri.v1);
+                bounds.expand(tri.v2);
+            }
+        }
+
+        // The nodes above only change with this one
+        if (bounds.min == node.bounds.min && bounds.max == node.bounds.max) {
+            continue;
+        }
+        weighted_area -= node_cost(node);
+        node.bounds = bounds;
+        weighted_area += node_cost(node);
+
+        if (at > 0) {
+            dirty.push_back(parents[at]);
+            std::ranges::push_heap(dirty);
+        }
+    }
+
+    update_sah_cost();
 }
 
 auto aabb_tree::query_ray(const glm::vec3& origin,
     const glm::vec3& direction) const -> std::vector<unsigned int> {
     std::vector<unsigned int> results;
+    if (nodes.empty()) return results;
+
     glm::vec3 dir_inv = 1.0f / direction;  // Precompute for efficiency
-    query_recursive(root.get(), origin, dir_inv, results);
-    return results;
-}
 
-auto aabb_tree::query_recursive(const node* node, const glm::vec3& origin,
-    const glm::vec3& dir_inv,
-    std::vector<unsigned int>& results) const -> void {
-    if (!node) return;
+    // Right children still to visit, the left child is always visited next
+    unsigned int stack[max_depth];
+    int size = 0;
+    unsigned int current = 0;
 
-    // Test ray against node's AABB
-    if (!node->bounds.intersects_ray(origin, dir_inv)) {
-        return;
-    }
+    while (true) {
+        const node& node = nodes[current];
 
-    // If leaf, add all triangles
-    if (node->is_leaf) {
-        results.insert(results.end(),
-            node->triangle_indices.begin(),
-            node->triangle_indices.end());
-        return;
+        // Test ray against node's AABB
+        if (node.bounds.intersects_ray(origin, dir_inv)) {
+            if (node.count == 0) {
+                stack[size++] = node.offset;
+                current++;
+                continue;
+            }
+
+            // If leaf, add all triangles
+            results.insert(results.end(),
+                leaf_indices.begin() + node.offset,
+                leaf_indices.begin() + node.offset + node.count);
+        }
+
+        if (size == 0) break;
+        current = stack[--size];
     }
 
-    // Recurse into children
-    query_recursive(node->left.get(), origin, dir_inv, results);
-    query_recursive(node->right.get(), origin, dir_inv, results);
+    return results;
 }
@@ -0,0 +1,107 @@
+#include "utils/mapped_file.hpp"
+
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file(mapped_file&& other) noexcept { *this = std::move(other); }
+
+auto mapped_file::operator=(mapped_file&& other) noexcept -> mapped_file& {
+  if (this != &other) {
+    close();
+    m_data_ = std::exchange(other.m_data_, nullptr);
+    m_size_ = std::exchange(other.m_size_, 0);
+#ifdef _WIN32
+    m_file_handle_ = std::exchange(other.m_file_handle_, nullptr);
+    m_mapping_handle_ = std::exchange(other.m_mapping_handle_, nullptr);
+#endif
+  }
+  return *this;
+}
+
+#ifdef _WIN32
+auto mapped_file::open(const std::string& path) -> bool {
+  close();
+
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                            nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+  if (file == INVALID_HANDLE_VALUE) return false;
+
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+    CloseHandle(file);
+    return false;
+  }
+
+  HANDLE mapping =
+      CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (!mapping) {
+    CloseHandle(file);
+    return false;
+  }
+
+  const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  if (!view) {
+    CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+
+  m_file_handle_ = file;
+  m_mapping_handle_ = mapping;
+  m_data_ = static_cast<const std::byte*>(view);
+  m_size_ = static_cast<size_t>(size.QuadPart);
+  return true;
+}
+
+auto mapped_file::close() -> void {
+  if (m_data_) UnmapViewOfFile(m_data_);
+  if (m_mapping_handle_) CloseHandle(m_mapping_handle_);
+  if (m_file_handle_) CloseHandle(m_file_handle_);
+  m_data_ = nullptr;
+  m_size_ = 0;
+  m_file_handle_ = nullptr;
+  m_mapping_handle_ = nullptr;
+}
+#else
+auto mapped_file::open(const std::string& path) -> bool {
+  close();
+
+  const int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat st {};
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    ::close(fd);
+    return false;
+  }
+
+  void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ,
+                    MAP_PRIVATE, fd, 0);
+  // The mapping keeps the file alive on its own
+  ::close(fd);
+  if (view == MAP_FAILED) return false;
+
+  m_data_ = static_cast<const std::byte*>(view);
+  m_size_ = static_cast<size_t>(st.st_size);
+  return true;
+}
+
+auto mapped_file::close() -> void {
+  if (m_data_) {
+    munmap(const_cast<std::byte*>(m_data_), m_size_);
+  }
+  m_data_ = nullptr;
+  m_size_ = 0;
+}
+#endif
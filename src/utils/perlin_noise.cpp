@@ -1,14 +1,60 @@
 #include "utils/perlin_noise.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
 #include <numeric>
 #include <random>
+#include <utility>
 #include <vector>
 
+namespace {
+// coefficients of x and z in grad_2d, the derivatives of each gradient
+constexpr float grad_2d_x[16] = {1, -1, 1, -1, 1, -1, 1, -1,
+                                 0, 0,  0, 0,  1, 0,  -1, 0};
+constexpr float grad_2d_z[16] = {0, 0, 0,  0,  1, 1, -1, -1,
+                                 1, 1, -1, -1, 0, 1, 0,  -1};
+// coefficient of y in grad, 0 for the gradients on the y = 0 plane
+constexpr float grad_y[16] = {1, 1,  -1, -1, 0, 0,  0, 0,
+                              1, -1, 1,  -1, 1, -1, 1, -1};
+
+// The gradients of the simplex noise: those of grad doubled, since the
+// vector kernels read each coefficient as the top byte of a float, which
+// holds 2 but not 1
+constexpr float simplex_grad_x[16] = {2, -2, 2, -2, 2, -2, 2, -2,
+                                      0, 0,  0, 0,  2, 0,  -2, 0};
+constexpr float simplex_grad_z[16] = {0, 0, 0,  0,  2, 2, -2, -2,
+                                      2, 2, -2, -2, 0, 2, 0,  -2};
+constexpr float simplex_grad_y[16] = {2, 2,  -2, -2, 0, 0,  0, 0,
+                                      2, -2, 2,  -2, 2, -2, 2, -2};
+
+// grad and grad_2d for the simplex noise, as table lookups. Its corners are
+// few and cheap, so a mispredicted switch per corner would dominate
+auto simplex_grad(const int h, const float x, const float y, const float z)
+    -> float {
+  return simplex_grad_x[h] * x + simplex_grad_z[h] * z + simplex_grad_y[h] * y;
+}
+
+auto simplex_grad_2d(const int h, const float x, const float z) -> float {
+  return simplex_grad_x[h] * x + simplex_grad_z[h] * z;
+}
+
+// max(r, 0) for the falloff of a simplex corner. Whether a corner is in
+// range is a coin flip, so instead of a branch the sign bit is spread into a
+// mask that clears negative values (and -0) to +0, like _mm_max_ps(r, 0)
+auto clamp_falloff(const float r) -> float {
+  const auto bits = std::bit_cast<std::int32_t>(r);
+  return std::bit_cast<float>(bits & ~(bits >> 31));
+}
+}  // namespace
+
 // initialize with set or seeded permutation vector
 perlin::perlin(const unsigned int seed, const unsigned int octaves,
                const float lacunarity, const float persistence,
-               const unsigned int repeat)
+               const unsigned int repeat, const noise_basis basis)
     : m_repeat_(repeat),
+      m_basis_(basis),
       m_octaves_(octaves),
       m_lacunarity_(lacunarity),
       m_persistence_(persistence) {
@@ -47,37 +93,320 @@ perlin::perlin(const unsigned int seed, const unsigned int octaves,
 
   // duplicate permutation vector
   m_p_.insert(m_p_.end(), m_p_.begin(), m_p_.end());
-}
+  m_simplex_key_ = perlin_kernels::simplex_key(m_p_.data());
 
-float perlin::generate_perlin(const float x, const float y,
-                              const float z) const {
-  float total = 0.0f;
+  // Same products and sum, in the same order, as accumulating them per call
   float frequency = 1.0f;
   float amplitude = 1.0f;
-  float max_value = 0.0f;
-
   for (unsigned i = 0; i < m_octaves_; i++) {
-    // Scale all coordinates consistently
-    // Divide by 200 to get appropriate feature size for large terrains
-    float sample_x = (x * frequency) / 200.0f;
-    float sample_y = (y * frequency) / 200.0f; 
-    float sample_z = (z * frequency) / 200.0f;
-    
-    total += noise(sample_x, sample_y, sample_z) * amplitude;
-
-    max_value += amplitude;
+    m_frequency_.push_back(frequency);
+    m_amplitude_.push_back(amplitude);
+    m_max_value_ += amplitude;
 
     frequency *= m_lacunarity_;
     amplitude *= m_persistence_;
   }
 
+  if (m_basis_ == noise_basis::simplex) {
+    select_kernels<noise_basis::simplex>();
+  } else {
+    select_kernels<noise_basis::perlin>();
+  }
+}
+
+template <noise_basis Basis>
+auto perlin::select_kernels() -> void {
+  if (m_repeat_ > 0) {
+    m_kernels_3d_ = kernels_for<true, false, Basis>(m_octaves_);
+    m_kernels_2d_ = kernels_for<true, true, Basis>(m_octaves_);
+  } else {
+    m_kernels_3d_ = kernels_for<false, false, Basis>(m_octaves_);
+    m_kernels_2d_ = kernels_for<false, true, Basis>(m_octaves_);
+  }
+}
+
+template <bool Repeat, bool Planar, noise_basis Basis>
+auto perlin::kernels_for(const unsigned int octaves) -> fractal_kernels {
+  return [octaves]<unsigned int... O>(
+             std::integer_sequence<unsigned int, O...>) {
+    constexpr unsigned int dynamic = dynamic_octaves;
+    fractal_kernels kernels{
+        &perlin::fractal<dynamic, Repeat, Planar, Basis>,
+        &perlin::fractal_span<dynamic, Repeat, Planar, Basis>,
+        &perlin::fractal_gradient_span<dynamic, Repeat, Planar, Basis>,
+        &perlin::fractal_volume_span<dynamic, Repeat, Planar, Basis>};
+    ((octaves == O + 1
+          ? (kernels = {&perlin::fractal<O + 1, Repeat, Planar, Basis>,
+                        &perlin::fractal_span<O + 1, Repeat, Planar, Basis>,
+                        &perlin::fractal_gradient_span<O + 1, Repeat, Planar,
+                                                       Basis>,
+                        &perlin::fractal_volume_span<O + 1, Repeat, Planar,
+                                                     Basis>},
+             0)
+          : 0),
+     ...);
+    return kernels;
+  }(std::make_integer_sequence<unsigned int, max_unrolled_octaves>{});
+}
+
+template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+auto perlin::fractal(const float x, const float y, const float z) const
+    -> float {
+  constexpr bool simplex_basis = Basis == noise_basis::simplex;
+  const auto octave = [&](const unsigned int i) {
+    // Scale all coordinates consistently
+    // Divide by feature_size to get appropriate feature size for large
+    // terrains
+    const float frequency = m_frequency_[i];
+    const float sx = (x * frequency) / feature_size;
+    const float sy = (y * frequency) / feature_size;
+    const float sz = (z * frequency) / feature_size;
+    if constexpr (Planar && simplex_basis) {
+      return simplex_2d<Repeat>(sx, sz) * m_amplitude_[i];
+    } else if constexpr (Planar) {
+      return noise_2d<Repeat>(sx, sz) * m_amplitude_[i];
+    } else if constexpr (simplex_basis) {
+      return simplex<Repeat>(sx, sy, sz) * m_amplitude_[i];
+    } else {
+      return noise<Repeat>(sx, sy, sz) * m_amplitude_[i];
+    }
+  };
+
+  float total = 0.0f;
+  if constexpr (Octaves == dynamic_octaves) {
+    for (unsigned i = 0; i < m_octaves_; i++) total += octave(i);
+  } else {
+    [&]<unsigned int... I>(std::integer_sequence<unsigned int, I...>) {
+      ((total += octave(I)), ...);
+    }(std::make_integer_sequence<unsigned int, Octaves>{});
+  }
+
   // Normalize to [-1, 1] range, then to [0, 1]
-  return (total / max_value + 1.0f) / 2.0f;
+  return (total / m_max_value_ + 1.0f) / 2.0f;
+}
+
+template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+auto perlin::fractal_span(const float* x, const float* z, float* out,
+                          const size_t n) const -> void {
+  for (size_t k = 0; k < n; ++k) {
+    out[k] = fractal<Octaves, Repeat, Planar, Basis>(x[k], 0.0f, z[k]);
+  }
+}
+
+template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+auto perlin::fractal_volume_span(const float* x, const float* y,
+                                 const float* z, float* out,
+                                 const size_t n) const -> void {
+  if constexpr (Planar || Basis == noise_basis::simplex) {
+    for (size_t k = 0; k < n; ++k) {
+      out[k] = fractal<Octaves, Repeat, Planar, Basis>(x[k], y[k], z[k]);
+    }
+  } else {
+    // One octave at a time over the whole span, so consecutive points mostly
+    // share a lattice cube, and the columns of a volume their x and y. The
+    // per point sum keeps the order of fractal
+    for (size_t k = 0; k < n; ++k) out[k] = 0.0f;
+
+    const auto octave = [&](const unsigned int i) {
+      const float frequency = m_frequency_[i];
+      lattice_axis ax;
+      lattice_axis ay;
+      lattice_axis az;
+      lattice_cell cell;
+      for (size_t k = 0; k < n; ++k) {
+        update_axis<Repeat>(x[k], frequency, ax);
+        update_axis<Repeat>(y[k], frequency, ay);
+        update_axis<Repeat>(z[k], frequency, az);
+        out[k] += noise_cached(ax, ay, az, cell) * m_amplitude_[i];
+      }
+    };
+
+    if constexpr (Octaves == dynamic_octaves) {
+      for (unsigned i = 0; i < m_octaves_; i++) octave(i);
+    } else {
+      [&]<unsigned int... I>(std::integer_sequence<unsigned int, I...>) {
+        (octave(I), ...);
+      }(std::make_integer_sequence<unsigned int, Octaves>{});
+    }
+
+    for (size_t k = 0; k < n; ++k) {
+      out[k] = (out[k] / m_max_value_ + 1.0f) / 2.0f;
+    }
+  }
 }
 
+template <unsigned int Octaves, bool Repeat, bool Planar, noise_basis Basis>
+auto perlin::fractal_gradient_span(const float* x, const float* z, float* out,
+                                   float* dx, float* dz, const size_t n) const
+    -> void {
+  // The chain rule gives each octave a factor frequency / feature_size on
+  // top of its amplitude, and the mapping to [0, 1] a factor
+  // 1 / (2 * max_value)
+  const float scale = 1.0f / (2.0f * m_max_value_);
+
+  for (size_t k = 0; k < n; ++k) {
+    float total = 0.0f;
+    float total_dx = 0.0f;
+    float total_dz = 0.0f;
+    const auto octave = [&](const unsigned int i) {
+      const float frequency = m_frequency_[i];
+      const float sx = (x[k] * frequency) / feature_size;
+      const float sz = (z[k] * frequency) / feature_size;
+      float noise_dx = 0.0f;
+      float noise_dz = 0.0f;
+      if constexpr (Basis == noise_basis::simplex) {
+        total += simplex_gradient<Repeat, Planar>(sx, sz, noise_dx, noise_dz) *
+                 m_amplitude_[i];
+      } else {
+        total += noise_gradient<Repeat, Planar>(sx, sz, noise_dx, noise_dz) *
+                 m_amplitude_[i];
+      }
+      const float chain = m_amplitude_[i] * frequency / feature_size;
+      total_dx += noise_dx * chain;
+      total_dz += noise_dz * chain;
+    };
+
+    if constexpr (Octaves == dynamic_octaves) {
+      for (unsigned i = 0; i < m_octaves_; i++) octave(i);
+    } else {
+      [&]<unsigned int... I>(std::integer_sequence<unsigned int, I...>) {
+        (octave(I), ...);
+      }(std::make_integer_sequence<unsigned int, Octaves>{});
+    }
+
+    out[k] = (total / m_max_value_ + 1.0f) / 2.0f;
+    dx[k] = total_dx * scale;
+    dz[k] = total_dz * scale;
+  }
+}
+
+float perlin::generate_perlin(const float x, const float y,
+                              const float z) const {
+  return (this->*m_kernels_3d_.point)(x, y, z);
+}
+
+float perlin::generate_perlin_2d(const float x, const float z) const {
+  return (this->*m_kernels_2d_.point)(x, 0.0f, z);
+}
+
+namespace {
+const perlin_simd supported_simd = perlin_kernels::detect();
+std::atomic<perlin_simd> selected_simd{supported_simd};
+}  // namespace
+
+auto perlin::generate_perlin_batch(const float* x, const float* z, float* out,
+                                   const size_t n) const -> void {
+  batch(m_kernels_3d_, false, x, z, out, n);
+}
+
+auto perlin::generate_perlin_volume_batch(const float* x, const float* y,
+                                          const float* z, float* out,
+                                          const size_t n) const -> void {
+  size_t done = 0;
+
+  if (m_repeat_ == 0) {
+    perlin_kernels::fractal_params params;
+    params.permutation = m_p_.data();
+    params.octaves = m_octaves_;
+    params.lacunarity = m_lacunarity_;
+    params.persistence = m_persistence_;
+    params.basis = m_basis_;
+    done = perlin_kernels::fractal_volume(simd_level(), params, x, y, z, out,
+                                          n);
+  }
+
+  (this->*m_kernels_3d_.volume_span)(x + done, y + done, z + done, out + done,
+                                     n - done);
+}
+
+auto perlin::generate_perlin_2d_batch(const float* x, const float* z,
+                                      float* out, const size_t n) const
+    -> void {
+  batch(m_kernels_2d_, true, x, z, out, n);
+}
+
+auto perlin::generate_perlin_gradient_batch(const float* x, const float* z,
+                                            float* out, float* dx, float* dz,
+                                            const size_t n) const -> void {
+  gradient_batch(m_kernels_3d_, false, x, z, out, dx, dz, n);
+}
+
+auto perlin::generate_perlin_2d_gradient_batch(const float* x, const float* z,
+                                               float* out, float* dx,
+                                               float* dz, const size_t n) const
+    -> void {
+  gradient_batch(m_kernels_2d_, true, x, z, out, dx, dz, n);
+}
+
+auto perlin::batch(const fractal_kernels& kernels, const bool planar,
+                   const float* x, const float* z, float* out,
+                   const size_t n) const -> void {
+  size_t done = 0;
+
+  // The kernels skip the repeat wrapping
+  if (m_repeat_ == 0) {
+    perlin_kernels::fractal_params params;
+    params.permutation = m_p_.data();
+    params.octaves = m_octaves_;
+    params.lacunarity = m_lacunarity_;
+    params.persistence = m_persistence_;
+    params.basis = m_basis_;
+    params.planar = planar;
+    done = perlin_kernels::fractal(simd_level(), params, x, z, out, n);
+  }
+
+  (this->*kernels.span)(x + done, z + done, out + done, n - done);
+}
+
+auto perlin::gradient_batch(const fractal_kernels& kernels, const bool planar,
+                            const float* x, const float* z, float* out,
+                            float* dx, float* dz, const size_t n) const
+    -> void {
+  size_t done = 0;
+
+  if (m_repeat_ == 0) {
+    perlin_kernels::fractal_params params;
+    params.permutation = m_p_.data();
+    params.octaves = m_octaves_;
+    params.lacunarity = m_lacunarity_;
+    params.persistence = m_persistence_;
+    params.basis = m_basis_;
+    params.planar = planar;
+    done = perlin_kernels::fractal_gradient(simd_level(), params, x, z, out,
+                                            dx, dz, n);
+  }
+
+  (this->*kernels.gradient_span)(x + done, z + done, out + done, dx + done,
+                                 dz + done, n - done);
+}
+
+auto perlin::simd_level() -> perlin_simd { return selected_simd; }
+
+auto perlin::set_simd_level(const perlin_simd level) -> void {
+  selected_simd = std::min(level, supported_simd);
+}
+
+auto perlin::basis_name(const noise_basis basis) -> const char* {
+  return basis == noise_basis::simplex ? "simplex" : "Perlin";
+}
+
+auto perlin::simd_name(const perlin_simd level) -> const char* {
+  switch (level) {
+    case perlin_simd::sse41:
+      return "SSE4.1";
+    case perlin_simd::avx2:
+      return "AVX2";
+    case perlin_simd::avx512:
+      return "AVX-512";
+    default:
+      return "scalar";
+  }
+}
+
+template <bool Repeat>
 float perlin::noise(float x, float y, float z) const {
   // Apply repeat wrapping if enabled
-  if (m_repeat_ > 0) {
+  if constexpr (Repeat) {
     // Use positive modulo to avoid negative coordinates
     const float repeat_float = static_cast<float>(m_repeat_);
     x = fmod(fmod(x, repeat_float) + repeat_float, repeat_float);
@@ -131,11 +460,413 @@ float perlin::noise(float x, float y, float z) const {
   return lerp(y1, y2, w);
 }
 
+template <bool Repeat>
+auto perlin::update_axis(const float at, const float frequency,
+                         lattice_axis& axis) const -> void {
+  if (at == axis.at) return;
+  axis.at = at;
+
+  // the scaling of fractal and the wrapping and cell of noise
+  float s = (at * frequency) / feature_size;
+  if constexpr (Repeat) {
+    const float repeat_float = static_cast<float>(m_repeat_);
+    s = fmod(fmod(s, repeat_float) + repeat_float, repeat_float);
+  }
+  axis.cell = static_cast<int>(floor(s)) & 255;
+  axis.offset = s - floor(s);
+  axis.fade = fade(axis.offset);
+}
+
+auto perlin::noise_cached(const lattice_axis& x, const lattice_axis& y,
+                          const lattice_axis& z, lattice_cell& cell) const
+    -> float {
+  const int xi = x.cell;
+  const int yi = y.cell;
+  const int zi = z.cell;
+  const float xf = x.offset;
+  const float yf = y.offset;
+  const float zf = z.offset;
+  const float u = x.fade;
+  const float v = y.fade;
+  const float w = z.fade;
+
+  // find coordinates of 8 unit cube corners, unless the last point was in
+  // the same cube
+  if (xi != cell.xi || yi != cell.yi || zi != cell.zi) {
+    const int a = m_p_[xi] + yi;
+    const int aa = m_p_[a] + zi;
+    const int ab = m_p_[a + 1] + zi;
+    const int b = m_p_[xi + 1] + yi;
+    const int ba = m_p_[b] + zi;
+    const int bb = m_p_[b + 1] + zi;
+    const int corners[8] = {aa, ba, ab, bb, aa + 1, ba + 1, ab + 1, bb + 1};
+    for (int c = 0; c < 8; ++c) {
+      const int h = m_p_[corners[c]] & 0xF;
+      cell.gx[c] = grad_2d_x[h];
+      cell.gy[c] = grad_y[h];
+      cell.gz[c] = grad_2d_z[h];
+    }
+    cell.xi = xi;
+    cell.yi = yi;
+    cell.zi = zi;
+  }
+  // grad with the lookups hoisted
+  const auto corner = [&cell](const int c, const float cx, const float cy,
+                              const float cz) {
+    return cell.gx[c] * cx + cell.gz[c] * cz + cell.gy[c] * cy;
+  };
+
+  float x1 = lerp(corner(0, xf, yf, zf),         // a
+                  corner(1, xf - 1.0f, yf, zf),  // b
+                  u);                            // w
+
+  float x2 = lerp(corner(2, xf, yf - 1.0f, zf),         // a
+                  corner(3, xf - 1.0f, yf - 1.0f, zf),  // b
+                  u);                                   // w
+
+  const float y1 = lerp(x1, x2, v);
+
+  x1 = lerp(corner(4, xf, yf, zf - 1.0f),         // a
+            corner(5, xf - 1.0f, yf, zf - 1.0f),  // b
+            u);                                   // w
+
+  x2 = lerp(corner(6, xf, yf - 1.0f, zf - 1.0f),         // a
+            corner(7, xf - 1.0f, yf - 1.0f, zf - 1.0f),  // b
+            u);                                          // w
+  const float y2 = lerp(x1, x2, v);
+
+  // Return the interpolated value (range is approximately [-1, 1])
+  return lerp(y1, y2, w);
+}
+
+template <bool Repeat>
+float perlin::noise_2d(float x, float z) const {
+  if constexpr (Repeat) {
+    const float repeat_float = static_cast<float>(m_repeat_);
+    x = fmod(fmod(x, repeat_float) + repeat_float, repeat_float);
+    z = fmod(fmod(z, repeat_float) + repeat_float, repeat_float);
+  }
+
+  // define unit square containing point
+  const int xi = static_cast<int>(floor(x)) & 255;
+  const int zi = static_cast<int>(floor(z)) & 255;
+
+  const float xf = x - floor(x);
+  const float zf = z - floor(z);
+
+  const float u = fade(xf);
+  const float w = fade(zf);
+
+  // hash the 4 corners with one permutation less than noise
+  const int a = m_p_[xi] + zi;
+  const int b = m_p_[xi + 1] + zi;
+
+  const float x1 = lerp(grad_2d(m_p_[a], xf, zf),         // a
+                        grad_2d(m_p_[b], xf - 1.0f, zf),  // b
+                        u);                               // w
+
+  const float x2 = lerp(grad_2d(m_p_[a + 1], xf, zf - 1.0f),         // a
+                        grad_2d(m_p_[b + 1], xf - 1.0f, zf - 1.0f),  // b
+                        u);                                          // w
+
+  return lerp(x1, x2, w);
+}
+
+template <bool Repeat, bool Planar>
+auto perlin::noise_gradient(float x, float z, float& dx, float& dz) const
+    -> float {
+  // Wrapping only shifts the point, the derivatives are unaffected
+  if constexpr (Repeat) {
+    const float repeat_float = static_cast<float>(m_repeat_);
+    x = fmod(fmod(x, repeat_float) + repeat_float, repeat_float);
+    z = fmod(fmod(z, repeat_float) + repeat_float, repeat_float);
+  }
+
+  const int xi = static_cast<int>(floor(x)) & 255;
+  const int zi = static_cast<int>(floor(z)) & 255;
+
+  const float xf = x - floor(x);
+  const float zf = z - floor(z);
+
+  const float u = fade(xf);
+  const float w = fade(zf);
+
+  // The same corners as noise_2d, or as noise with y = 0 where the y = 1
+  // corners have weight fade(0) = 0
+  int a = m_p_[xi];
+  int b = m_p_[xi + 1];
+  if constexpr (!Planar) {
+    a = m_p_[a];
+    b = m_p_[b];
+  }
+  a += zi;
+  b += zi;
+
+  // Each corner contributes gx * x + gz * z, see grad_2d. Its value goes
+  // through grad_2d so the result matches noise and noise_2d exactly
+  const int h00 = m_p_[a] & 0xF;
+  const int h10 = m_p_[b] & 0xF;
+  const int h01 = m_p_[a + 1] & 0xF;
+  const int h11 = m_p_[b + 1] & 0xF;
+  const float g00 = grad_2d(h00, xf, zf);
+  const float g10 = grad_2d(h10, xf - 1.0f, zf);
+  const float g01 = grad_2d(h01, xf, zf - 1.0f);
+  const float g11 = grad_2d(h11, xf - 1.0f, zf - 1.0f);
+
+  // Derivatives of the lerps below: x1 + (x2 - x1) * w with
+  // x1 = g00 + (g10 - g00) * u and x2 = g01 + (g11 - g01) * u
+  const float du = fade_derivative(xf);
+  const float dw = fade_derivative(zf);
+  const float x1 = lerp(g00, g10, u);
+  const float x2 = lerp(g01, g11, u);
+  const float x1_dx =
+      grad_2d_x[h00] + (grad_2d_x[h10] - grad_2d_x[h00]) * u + (g10 - g00) * du;
+  const float x2_dx =
+      grad_2d_x[h01] + (grad_2d_x[h11] - grad_2d_x[h01]) * u + (g11 - g01) * du;
+  const float x1_dz = grad_2d_z[h00] + (grad_2d_z[h10] - grad_2d_z[h00]) * u;
+  const float x2_dz = grad_2d_z[h01] + (grad_2d_z[h11] - grad_2d_z[h01]) * u;
+
+  dx = x1_dx + (x2_dx - x1_dx) * w;
+  dz = x1_dz + (x2_dz - x1_dz) * w + (x2 - x1) * dw;
+  return lerp(x1, x2, w);
+}
+
+template <bool Repeat>
+float perlin::simplex(float x, float y, float z) const {
+  using namespace perlin_kernels;
+
+  if constexpr (Repeat) {
+    const float repeat_float = static_cast<float>(m_repeat_);
+    x = fmod(fmod(x, repeat_float) + repeat_float, repeat_float);
+    y = fmod(fmod(y, repeat_float) + repeat_float, repeat_float);
+    z = fmod(fmod(z, repeat_float) + repeat_float, repeat_float);
+  }
+
+  // skew the point onto the cube lattice to find the cell containing it
+  const float s = (x + y + z) * simplex_skew_3d;
+  const float fx = floor(x + s);
+  const float fy = floor(y + s);
+  const float fz = floor(z + s);
+
+  // position relative to the cell origin, unskewed
+  const float t = (fx + fy + fz) * simplex_unskew_3d;
+  const float x0 = (x - fx) + t;
+  const float y0 = (y - fy) + t;
+  const float z0 = (z - fz) + t;
+
+  // the tetrahedron containing the point steps along the largest
+  // coordinate first, then the second largest, see simplex_x1. The last
+  // corner steps along all three
+  const int order =
+      (x0 >= y0 ? 1 : 0) | (x0 >= z0 ? 2 : 0) | (y0 >= z0 ? 4 : 0);
+  constexpr float last = 1.0f - 3.0f * simplex_unskew_3d;
+  const float x1 = x0 + simplex_x1[order];
+  const float y1 = y0 + simplex_y1[order];
+  const float z1 = z0 + simplex_z1[order];
+  const float x2 = x0 + simplex_x2[order];
+  const float y2 = y0 + simplex_y2[order];
+  const float z2 = z0 + simplex_z2[order];
+  const float x3 = x0 - last;
+  const float y3 = y0 - last;
+  const float z3 = z0 - last;
+
+  const std::uint32_t origin =
+      simplex_cell(static_cast<int>(fx), static_cast<int>(fy),
+                   static_cast<int>(fz)) +
+      m_simplex_key_;
+  const int h0 = simplex_hash(origin);
+  const int h1 = simplex_hash(origin + simplex_cell_1[order]);
+  const int h2 = simplex_hash(origin + simplex_cell_2[order]);
+  const int h3 = simplex_hash(origin + simplex_cell(1, 1, 1));
+
+  // each corner contributes its gradient, attenuated to 0 at a distance of
+  // sqrt(simplex_radius)
+  const auto corner = [](const int h, const float cx, const float cy,
+                         const float cz) {
+    const float r =
+        clamp_falloff((simplex_radius - cx * cx) - (cy * cy + cz * cz));
+    const float r2 = r * r;
+    return r2 * r2 * simplex_grad(h, cx, cy, cz);
+  };
+
+  // summed in pairs, which the vector kernels wait on less than a chain
+  return simplex_scale_3d *
+         ((corner(h0, x0, y0, z0) + corner(h1, x1, y1, z1)) +
+          (corner(h2, x2, y2, z2) + corner(h3, x3, y3, z3)));
+}
+
+template <bool Repeat>
+float perlin::simplex_2d(float x, float z) const {
+  using namespace perlin_kernels;
+
+  if constexpr (Repeat) {
+    const float repeat_float = static_cast<float>(m_repeat_);
+    x = fmod(fmod(x, repeat_float) + repeat_float, repeat_float);
+    z = fmod(fmod(z, repeat_float) + repeat_float, repeat_float);
+  }
+
+  const float s = (x + z) * simplex_skew_2d;
+  const float fx = floor(x + s);
+  const float fz = floor(z + s);
+
+  const float t = (fx + fz) * simplex_unskew_2d;
+  const float x0 = (x - fx) + t;
+  const float z0 = (z - fz) + t;
+
+  // the lower or upper triangle of the cell
+  const bool i1 = x0 >= z0;
+
+  constexpr float last = 1.0f - 2.0f * simplex_unskew_2d;
+  const float x1 = (x0 + simplex_unskew_2d) - static_cast<float>(i1);
+  const float z1 = (z0 + simplex_unskew_2d) - static_cast<float>(!i1);
+  const float x2 = x0 - last;
+  const float z2 = z0 - last;
+
+  const std::uint32_t origin =
+      simplex_cell(static_cast<int>(fx), 0, static_cast<int>(fz)) +
+      m_simplex_key_;
+  const int h0 = simplex_hash(origin);
+  const int h1 = simplex_hash(origin + simplex_cell(i1, 0, !i1));
+  const int h2 = simplex_hash(origin + simplex_cell(1, 0, 1));
+
+  const auto corner = [](const int h, const float cx, const float cz) {
+    const float r = clamp_falloff(simplex_radius - cx * cx - cz * cz);
+    const float r2 = r * r;
+    return r2 * r2 * simplex_grad_2d(h, cx, cz);
+  };
+
+  return simplex_scale_2d *
+         (corner(h0, x0, z0) + corner(h1, x1, z1) + corner(h2, x2, z2));
+}
+
+template <bool Repeat, bool Planar>
+auto perlin::simplex_gradient(float x, float z, float& dx, float& dz) const
+    -> float {
+  using namespace perlin_kernels;
+
+  if constexpr (Repeat) {
+    const float repeat_float = static_cast<float>(m_repeat_);
+    x = fmod(fmod(x, repeat_float) + repeat_float, repeat_float);
+    z = fmod(fmod(z, repeat_float) + repeat_float, repeat_float);
+  }
+
+  // A corner at offset (cx, cy, cz) adds r^4 * g with r = radius - |c|^2
+  // and g its gradient. Its derivative along x is r^4 * gx - 8 r^3 cx g,
+  // the same for z, and both are 0 outside the radius where r is clamped
+  // The sums are local, since dx and dz may alias and would be stored after
+  // every corner
+  float total = 0.0f;
+  float total_dx = 0.0f;
+  float total_dz = 0.0f;
+  const auto add = [&total, &total_dx, &total_dz](
+                       const int h, const float r, const float g,
+                       const float cx, const float cz) {
+    const float r2 = r * r;
+    const float r4 = r2 * r2;
+    const float falloff = -8.0f * r2 * r * g;
+    total += r4 * g;
+    total_dx += r4 * simplex_grad_x[h] + falloff * cx;
+    total_dz += r4 * simplex_grad_z[h] + falloff * cz;
+  };
+
+  if constexpr (Planar) {
+    // simplex_2d
+    const float s = (x + z) * simplex_skew_2d;
+    const float fx = floor(x + s);
+    const float fz = floor(z + s);
+
+    const float t = (fx + fz) * simplex_unskew_2d;
+    const float x0 = (x - fx) + t;
+    const float z0 = (z - fz) + t;
+
+    const bool i1 = x0 >= z0;
+
+    constexpr float last = 1.0f - 2.0f * simplex_unskew_2d;
+    const float x1 = (x0 + simplex_unskew_2d) - static_cast<float>(i1);
+    const float z1 = (z0 + simplex_unskew_2d) - static_cast<float>(!i1);
+    const float x2 = x0 - last;
+    const float z2 = z0 - last;
+
+    const std::uint32_t origin =
+        simplex_cell(static_cast<int>(fx), 0, static_cast<int>(fz)) +
+        m_simplex_key_;
+    const int h0 = simplex_hash(origin);
+    const int h1 = simplex_hash(origin + simplex_cell(i1, 0, !i1));
+    const int h2 = simplex_hash(origin + simplex_cell(1, 0, 1));
+
+    const auto corner = [&add](const int h, const float cx, const float cz) {
+      const float r = clamp_falloff(simplex_radius - cx * cx - cz * cz);
+      add(h, r, simplex_grad_2d(h, cx, cz), cx, cz);
+    };
+    corner(h0, x0, z0);
+    corner(h1, x1, z1);
+    corner(h2, x2, z2);
+
+    dx = total_dx * simplex_scale_2d;
+    dz = total_dz * simplex_scale_2d;
+    return simplex_scale_2d * total;
+  } else {
+    // simplex at y = 0
+    const float y = 0.0f;
+    const float s = (x + y + z) * simplex_skew_3d;
+    const float fx = floor(x + s);
+    const float fy = floor(y + s);
+    const float fz = floor(z + s);
+
+    const float t = (fx + fy + fz) * simplex_unskew_3d;
+    const float x0 = (x - fx) + t;
+    const float y0 = (y - fy) + t;
+    const float z0 = (z - fz) + t;
+
+    const int order =
+        (x0 >= y0 ? 1 : 0) | (x0 >= z0 ? 2 : 0) | (y0 >= z0 ? 4 : 0);
+    constexpr float last = 1.0f - 3.0f * simplex_unskew_3d;
+    const float x1 = x0 + simplex_x1[order];
+    const float y1 = y0 + simplex_y1[order];
+    const float z1 = z0 + simplex_z1[order];
+    const float x2 = x0 + simplex_x2[order];
+    const float y2 = y0 + simplex_y2[order];
+    const float z2 = z0 + simplex_z2[order];
+    const float x3 = x0 - last;
+    const float y3 = y0 - last;
+    const float z3 = z0 - last;
+
+    const std::uint32_t origin =
+        simplex_cell(static_cast<int>(fx), static_cast<int>(fy),
+                     static_cast<int>(fz)) +
+        m_simplex_key_;
+    const int h0 = simplex_hash(origin);
+    const int h1 = simplex_hash(origin + simplex_cell_1[order]);
+    const int h2 = simplex_hash(origin + simplex_cell_2[order]);
+    const int h3 = simplex_hash(origin + simplex_cell(1, 1, 1));
+
+    const auto corner = [&add](const int h, const float cx, const float cy,
+                               const float cz) {
+      const float r =
+          clamp_falloff((simplex_radius - cx * cx) - (cy * cy + cz * cz));
+      add(h, r, simplex_grad(h, cx, cy, cz), cx, cz);
+    };
+    corner(h0, x0, y0, z0);
+    corner(h1, x1, y1, z1);
+    corner(h2, x2, y2, z2);
+    corner(h3, x3, y3, z3);
+
+    dx = total_dx * simplex_scale_3d;
+    dz = total_dz * simplex_scale_3d;
+    return simplex_scale_3d * total;
+  }
+}
+
 // smooth transition between gradients with ease curve
 float perlin::fade(const float t) {
   return t * t * t * (t * (t * 6 - 15) + 10);
 }
 
+// derivative of fade
+float perlin::fade_derivative(const float t) {
+  return 30.0f * t * t * (t * (t - 2.0f) + 1.0f);
+}
+
 // linearly interpolate between a and b
 // weight w should be between 0 and 1
 float perlin::lerp(const float a, const float b, const float w) {
@@ -183,6 +914,35 @@ float perlin::grad(const int hash, const float x, const float y,
   }
 }
 
+// the gradients of grad with y = 0, so both noises have the same range and
+// distribution of slopes
+float perlin::grad_2d(const int hash, const float x, const float z) {
+  switch (hash & 0xF) {
+    case 0x0:
+    case 0x2:
+    case 0xC:
+      return x;
+    case 0x1:
+    case 0x3:
+    case 0xE:
+      return -x;
+    case 0x4:
+      return x + z;
+    case 0x5:
+      return -x + z;
+    case 0x6:
+      return x - z;
+    case 0x7:
+      return -x - z;
+    case 0x8:
+    case 0x9:
+    case 0xD:
+      return z;
+    default:
+      return -z;
+  }
+}
+
 // increment number to ensure repetition
 int perlin::inc(int num) const {
   num++;
@@ -0,0 +1,2374 @@
+#include "utils/perlin_simd.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || \
+    defined(_M_IX86)
+#define PERLIN_SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+// MSVC accepts every intrinsic in every function
+#define PERLIN_TARGET(isa)
+#define PERLIN_INLINE __forceinline
+#else
+#define PERLIN_TARGET(isa) __attribute__((target(isa)))
+#define PERLIN_INLINE inline __attribute__((always_inline))
+#endif
+#endif
+
+namespace perlin_kernels {
+namespace {
+// With y = 0 every gradient of perlin::grad reduces to gx * x + gz * z with
+// gx, gz in {-1, 0, 1}, indexed by the low four bits of the hash
+alignas(64) constexpr float grad_x[16] = {1,  -1, 1, -1, 1, -1, 1, -1,
+                                          0,  0,  0, 0,  1, 0,  -1, 0};
+alignas(64) constexpr float grad_z[16] = {0, 0, 0,  0,  1, 1, -1, -1,
+                                          1, 1, -1, -1, 0, 1, 0,  -1};
+// Off that plane the y term adds gy * y, which only the volume kernels need
+alignas(64) constexpr float grad_y[16] = {1, 1,  -1, -1, 0, 0,  0, 0,
+                                          1, -1, 1,  -1, 1, -1, 1, -1};
+// The gradients of the simplex noise, see perlin::simplex: those above
+// doubled, as the top byte of a float, where 0x40 is 2 and 0xC0 is -2. The
+// SSE4.1 and AVX2 kernels look them up within a register
+alignas(16) constexpr std::int8_t grad_x_bytes[16] = {
+    64, -64, 64, -64, 64, -64, 64, -64, 0, 0, 0, 0, 64, 0, -64, 0};
+alignas(16) constexpr std::int8_t grad_y_bytes[16] = {
+    64, 64, -64, -64, 0, 0, 0, 0, 64, -64, 64, -64, 64, -64, 64, -64};
+alignas(16) constexpr std::int8_t grad_z_bytes[16] = {
+    0, 0, 0, 0, 64, 64, -64, -64, 64, 64, -64, -64, 0, 64, 0, -64};
+// The same as floats, which the AVX-512 kernels permute out of a register
+alignas(64) constexpr float simplex_grad_x[16] = {2, -2, 2, -2, 2, -2, 2, -2,
+                                                  0, 0,  0, 0,  2, 0,  -2, 0};
+alignas(64) constexpr float simplex_grad_z[16] = {0, 0, 0,  0,  2, 2, -2, -2,
+                                                  2, 2, -2, -2, 0, 2, 0,  -2};
+alignas(64) constexpr float simplex_grad_y[16] = {2, 2,  -2, -2, 0, 0,  0, 0,
+                                                  2, -2, 2,  -2, 2, -2, 2, -2};
+
+// Every kernel but the volume ones follows perlin::noise with y = 0: the y
+// lerp has weight fade(0) = 0, so only the four corners at y = 0 contribute.
+// With Planar set they follow perlin::noise_2d instead, which hashes the
+// corners without the y permutation. Operations are done in the same order as
+// the scalar code.
+
+#ifdef PERLIN_SIMD_X86
+// --- SSE4.1, 4 points ---
+
+PERLIN_TARGET("sse4.1")
+inline auto gather_sse(const int* table, const __m128i index) -> __m128i {
+  alignas(16) int i[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(i), index);
+  return _mm_setr_epi32(table[i[0]], table[i[1]], table[i[2]], table[i[3]]);
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto grad_coefficients_sse(const __m128i hash, __m128& gx, __m128& gz)
+    -> void {
+  alignas(16) int h[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(h),
+                  _mm_and_si128(hash, _mm_set1_epi32(15)));
+  gx = _mm_setr_ps(grad_x[h[0]], grad_x[h[1]], grad_x[h[2]], grad_x[h[3]]);
+  gz = _mm_setr_ps(grad_z[h[0]], grad_z[h[1]], grad_z[h[2]], grad_z[h[3]]);
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto grad_sse(const __m128i hash, const __m128 x, const __m128 z)
+    -> __m128 {
+  __m128 gx;
+  __m128 gz;
+  grad_coefficients_sse(hash, gx, gz);
+  return _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gz, z));
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto fade_sse(const __m128 t) -> __m128 {
+  const __m128 inner = _mm_add_ps(
+      _mm_mul_ps(t, _mm_sub_ps(_mm_mul_ps(t, _mm_set1_ps(6.0f)),
+                               _mm_set1_ps(15.0f))),
+      _mm_set1_ps(10.0f));
+  return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(t, t), t), inner);
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto lerp_sse(const __m128 a, const __m128 b, const __m128 w)
+    -> __m128 {
+  return _mm_add_ps(_mm_mul_ps(_mm_sub_ps(b, a), w), a);
+}
+
+template <bool Planar>
+PERLIN_TARGET("sse4.1")
+auto noise_sse(const int* p, const __m128 x, const __m128 z) -> __m128 {
+  const __m128 fx = _mm_floor_ps(x);
+  const __m128 fz = _mm_floor_ps(z);
+  const __m128i mask = _mm_set1_epi32(255);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i xi = _mm_and_si128(_mm_cvttps_epi32(fx), mask);
+  const __m128i zi = _mm_and_si128(_mm_cvttps_epi32(fz), mask);
+
+  const __m128 xf = _mm_sub_ps(x, fx);
+  const __m128 zf = _mm_sub_ps(z, fz);
+  const __m128 xf1 = _mm_sub_ps(xf, _mm_set1_ps(1.0f));
+  const __m128 zf1 = _mm_sub_ps(zf, _mm_set1_ps(1.0f));
+  const __m128 u = fade_sse(xf);
+  const __m128 w = fade_sse(zf);
+
+  const __m128i a = gather_sse(p, xi);
+  const __m128i b = gather_sse(p, _mm_add_epi32(xi, one));
+  const __m128i aa = _mm_add_epi32(Planar ? a : gather_sse(p, a), zi);
+  const __m128i ba = _mm_add_epi32(Planar ? b : gather_sse(p, b), zi);
+
+  const __m128 x1 = lerp_sse(grad_sse(gather_sse(p, aa), xf, zf),
+                             grad_sse(gather_sse(p, ba), xf1, zf), u);
+  const __m128 x2 =
+      lerp_sse(grad_sse(gather_sse(p, _mm_add_epi32(aa, one)), xf, zf1),
+               grad_sse(gather_sse(p, _mm_add_epi32(ba, one)), xf1, zf1), u);
+  return lerp_sse(x1, x2, w);
+}
+
+// The full perlin::noise, for points off the y = 0 plane. gx and gz are the
+// same as in grad_sse, gy adds the y term the other kernels drop
+
+PERLIN_TARGET("sse4.1")
+inline auto grad_coefficients_sse(const __m128i hash, __m128& gx, __m128& gy,
+                                  __m128& gz) -> void {
+  alignas(16) int h[4];
+  _mm_store_si128(reinterpret_cast<__m128i*>(h),
+                  _mm_and_si128(hash, _mm_set1_epi32(15)));
+  gx = _mm_setr_ps(grad_x[h[0]], grad_x[h[1]], grad_x[h[2]], grad_x[h[3]]);
+  gy = _mm_setr_ps(grad_y[h[0]], grad_y[h[1]], grad_y[h[2]], grad_y[h[3]]);
+  gz = _mm_setr_ps(grad_z[h[0]], grad_z[h[1]], grad_z[h[2]], grad_z[h[3]]);
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto grad_volume_sse(const __m128i hash, const __m128 x, const __m128 y,
+                            const __m128 z) -> __m128 {
+  __m128 gx;
+  __m128 gy;
+  __m128 gz;
+  grad_coefficients_sse(hash, gx, gy, gz);
+  const __m128 planar = _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gz, z));
+  return _mm_add_ps(planar, _mm_mul_ps(gy, y));
+}
+
+// Gradient coefficients of the eight corners around 4 points. Neighbouring
+// points of a volume mostly share their lattice cube, so fractal_volume_sse
+// keeps these from the last points and only looks them up again when a lane
+// moves to another cube. The lookups are emulated gathers, which cost more
+// than the rest of the noise
+struct volume_cell_sse {
+  __m128i xi;
+  __m128i yi;
+  __m128i zi;
+  __m128 gx[8];
+  __m128 gy[8];
+  __m128 gz[8];
+};
+
+// Corners in the order of perlin::noise: aa, ba, ab, bb, then the same at
+// z + 1
+PERLIN_TARGET("sse4.1")
+auto volume_corners_sse(const int* p, volume_cell_sse& cell) -> void {
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i a = _mm_add_epi32(gather_sse(p, cell.xi), cell.yi);
+  const __m128i b =
+      _mm_add_epi32(gather_sse(p, _mm_add_epi32(cell.xi, one)), cell.yi);
+  const __m128i aa = _mm_add_epi32(gather_sse(p, a), cell.zi);
+  const __m128i ab =
+      _mm_add_epi32(gather_sse(p, _mm_add_epi32(a, one)), cell.zi);
+  const __m128i ba = _mm_add_epi32(gather_sse(p, b), cell.zi);
+  const __m128i bb =
+      _mm_add_epi32(gather_sse(p, _mm_add_epi32(b, one)), cell.zi);
+  const __m128i corners[8] = {aa,
+                              ba,
+                              ab,
+                              bb,
+                              _mm_add_epi32(aa, one),
+                              _mm_add_epi32(ba, one),
+                              _mm_add_epi32(ab, one),
+                              _mm_add_epi32(bb, one)};
+  for (int c = 0; c < 8; ++c) {
+    grad_coefficients_sse(gather_sse(p, corners[c]), cell.gx[c], cell.gy[c],
+                          cell.gz[c]);
+  }
+}
+
+// grad_volume_sse with the coefficients of corner c
+PERLIN_TARGET("sse4.1")
+inline auto corner_sse(const volume_cell_sse& cell, const int c,
+                       const __m128 x, const __m128 y, const __m128 z)
+    -> __m128 {
+  const __m128 planar =
+      _mm_add_ps(_mm_mul_ps(cell.gx[c], x), _mm_mul_ps(cell.gz[c], z));
+  return _mm_add_ps(planar, _mm_mul_ps(cell.gy[c], y));
+}
+
+PERLIN_TARGET("sse4.1")
+auto noise_volume_sse(const int* p, const __m128 x, const __m128 y,
+                      const __m128 z, volume_cell_sse& cell) -> __m128 {
+  const __m128 fx = _mm_floor_ps(x);
+  const __m128 fy = _mm_floor_ps(y);
+  const __m128 fz = _mm_floor_ps(z);
+  const __m128i mask = _mm_set1_epi32(255);
+  const __m128i xi = _mm_and_si128(_mm_cvttps_epi32(fx), mask);
+  const __m128i yi = _mm_and_si128(_mm_cvttps_epi32(fy), mask);
+  const __m128i zi = _mm_and_si128(_mm_cvttps_epi32(fz), mask);
+
+  const __m128i same = _mm_and_si128(
+      _mm_and_si128(_mm_cmpeq_epi32(xi, cell.xi), _mm_cmpeq_epi32(yi, cell.yi)),
+      _mm_cmpeq_epi32(zi, cell.zi));
+  if (_mm_movemask_epi8(same) != 0xFFFF) {
+    cell.xi = xi;
+    cell.yi = yi;
+    cell.zi = zi;
+    volume_corners_sse(p, cell);
+  }
+
+  const __m128 xf = _mm_sub_ps(x, fx);
+  const __m128 yf = _mm_sub_ps(y, fy);
+  const __m128 zf = _mm_sub_ps(z, fz);
+  const __m128 xf1 = _mm_sub_ps(xf, _mm_set1_ps(1.0f));
+  const __m128 yf1 = _mm_sub_ps(yf, _mm_set1_ps(1.0f));
+  const __m128 zf1 = _mm_sub_ps(zf, _mm_set1_ps(1.0f));
+  const __m128 u = fade_sse(xf);
+  const __m128 v = fade_sse(yf);
+  const __m128 w = fade_sse(zf);
+
+  const __m128 x1 = lerp_sse(corner_sse(cell, 0, xf, yf, zf),
+                             corner_sse(cell, 1, xf1, yf, zf), u);
+  const __m128 x2 = lerp_sse(corner_sse(cell, 2, xf, yf1, zf),
+                             corner_sse(cell, 3, xf1, yf1, zf), u);
+  const __m128 y1 = lerp_sse(x1, x2, v);
+
+  const __m128 x3 = lerp_sse(corner_sse(cell, 4, xf, yf, zf1),
+                             corner_sse(cell, 5, xf1, yf, zf1), u);
+  const __m128 x4 = lerp_sse(corner_sse(cell, 6, xf, yf1, zf1),
+                             corner_sse(cell, 7, xf1, yf1, zf1), u);
+  const __m128 y2 = lerp_sse(x3, x4, v);
+
+  return lerp_sse(y1, y2, w);
+}
+
+// Simplex noise, see perlin::simplex. The cell functions find the corners of
+// the simplex around each point, their offsets from the point and the inputs
+// of their hashes, for both the value and the derivative kernels. They are
+// forced inline so the corner arrays stay in registers. Unlike the Perlin
+// kernels they read no table from memory: the hashes are arithmetic and the
+// gradients are looked up with pshufb. The steps to the corners are masks,
+// which select both the 1 subtracted from each offset and the simplex_cell
+// added to the hash input
+
+// simplex_hash of each corner as a pshufb index: the hash in the low bits of
+// the top byte, and 0x80 in the others, which pshufb clears
+PERLIN_TARGET("sse4.1")
+inline auto simplex_index_sse(const __m128i corner) -> __m128i {
+  const __m128i h = _mm_xor_si128(corner, _mm_srli_epi32(corner, 15));
+  const __m128i mixed =
+      _mm_mullo_epi32(h, _mm_set1_epi32(static_cast<int>(simplex_mix_2)));
+  return _mm_or_si128(_mm_srli_epi32(mixed, 4), _mm_set1_epi32(0x00808080));
+}
+
+// One of the simplex gradient coefficients for each index. The entry lands
+// in the top byte of a lane that is otherwise 0, which is 2, -2 or 0
+PERLIN_TARGET("sse4.1")
+inline auto simplex_coefficient_sse(const __m128i index,
+                                    const std::int8_t (&table)[16]) -> __m128 {
+  return _mm_castsi128_ps(_mm_shuffle_epi8(
+      _mm_load_si128(reinterpret_cast<const __m128i*>(table)), index));
+}
+
+// grad_volume_sse for a simplex corner, leaving gx and gz for the
+// derivatives
+PERLIN_TARGET("sse4.1")
+inline auto simplex_grad_sse(const __m128i index, const __m128 x,
+                             const __m128 y, const __m128 z, __m128& gx,
+                             __m128& gz) -> __m128 {
+  gx = simplex_coefficient_sse(index, grad_x_bytes);
+  gz = simplex_coefficient_sse(index, grad_z_bytes);
+  const __m128 gy = simplex_coefficient_sse(index, grad_y_bytes);
+  const __m128 planar = _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gz, z));
+  return _mm_add_ps(planar, _mm_mul_ps(gy, y));
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto simplex_grad_2d_sse(const __m128i index, const __m128 x,
+                                const __m128 z, __m128& gx, __m128& gz)
+    -> __m128 {
+  gx = simplex_coefficient_sse(index, grad_x_bytes);
+  gz = simplex_coefficient_sse(index, grad_z_bytes);
+  return _mm_add_ps(_mm_mul_ps(gx, x), _mm_mul_ps(gz, z));
+}
+
+// With Volume unset y is 0, which the sums then leave out
+template <bool Volume>
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_cell_sse(const __m128i key, const __m128 x,
+                                    const __m128 y, const __m128 z,
+                                    __m128 (&cx)[4], __m128 (&cy)[4],
+                                    __m128 (&cz)[4], __m128i (&corner)[4])
+    -> void {
+  const __m128 sum =
+      Volume ? _mm_add_ps(_mm_add_ps(x, y), z) : _mm_add_ps(x, z);
+  const __m128 s = _mm_mul_ps(sum, _mm_set1_ps(simplex_skew_3d));
+  const __m128 fx = _mm_floor_ps(_mm_add_ps(x, s));
+  const __m128 fy = _mm_floor_ps(Volume ? _mm_add_ps(y, s) : s);
+  const __m128 fz = _mm_floor_ps(_mm_add_ps(z, s));
+  const __m128i packed_yz =
+      _mm_add_epi32(_mm_slli_epi32(_mm_cvttps_epi32(fy), simplex_y_shift),
+                    _mm_slli_epi32(_mm_cvttps_epi32(fz), simplex_z_shift));
+  const __m128i packed = _mm_add_epi32(_mm_cvttps_epi32(fx), packed_yz);
+  const __m128i mix = _mm_set1_epi32(static_cast<int>(simplex_mix_1));
+  corner[0] = _mm_add_epi32(_mm_mullo_epi32(packed, mix), key);
+
+  const __m128 unskew = _mm_set1_ps(simplex_unskew_3d);
+  const __m128 t = _mm_mul_ps(_mm_add_ps(_mm_add_ps(fx, fy), fz), unskew);
+  cx[0] = _mm_add_ps(_mm_sub_ps(x, fx), t);
+  cy[0] = Volume ? _mm_add_ps(_mm_sub_ps(y, fy), t) : _mm_sub_ps(t, fy);
+  cz[0] = _mm_add_ps(_mm_sub_ps(z, fz), t);
+
+  // i1 = xy & xz, j1 = ~xy & yz and k1 = ~(xz | yz) for the second corner,
+  // i2 = xy | xz, j2 = ~(xy & ~yz) and k2 = ~(xz & yz) for the third
+  const __m128 xy = _mm_cmpge_ps(cx[0], cy[0]);
+  const __m128 xz = _mm_cmpge_ps(cx[0], cz[0]);
+  const __m128 yz = _mm_cmpge_ps(cy[0], cz[0]);
+  const __m128 i1 = _mm_and_ps(xy, xz);
+  const __m128 j1 = _mm_andnot_ps(xy, yz);
+  const __m128 not_k1 = _mm_or_ps(xz, yz);
+  const __m128 i2 = _mm_or_ps(xy, xz);
+  const __m128 not_j2 = _mm_andnot_ps(yz, xy);
+  const __m128 not_k2 = _mm_and_ps(xz, yz);
+
+  // unskew + -1 along a step, which rounds like simplex_step_1
+  const __m128 back = _mm_set1_ps(-1.0f);
+  const __m128 x1 = _mm_add_ps(unskew, _mm_and_ps(i1, back));
+  const __m128 y1 = _mm_add_ps(unskew, _mm_and_ps(j1, back));
+  const __m128 z1 = _mm_add_ps(unskew, _mm_andnot_ps(not_k1, back));
+  cx[1] = _mm_add_ps(cx[0], x1);
+  cy[1] = _mm_add_ps(cy[0], y1);
+  cz[1] = _mm_add_ps(cz[0], z1);
+  const __m128 unskew2 = _mm_set1_ps(2.0f * simplex_unskew_3d);
+  const __m128 x2 = _mm_add_ps(unskew2, _mm_and_ps(i2, back));
+  const __m128 y2 = _mm_add_ps(unskew2, _mm_andnot_ps(not_j2, back));
+  const __m128 z2 = _mm_add_ps(unskew2, _mm_andnot_ps(not_k2, back));
+  cx[2] = _mm_add_ps(cx[0], x2);
+  cy[2] = _mm_add_ps(cy[0], y2);
+  cz[2] = _mm_add_ps(cz[0], z2);
+  const __m128 last = _mm_set1_ps(1.0f - 3.0f * simplex_unskew_3d);
+  cx[3] = _mm_sub_ps(cx[0], last);
+  cy[3] = _mm_sub_ps(cy[0], last);
+  cz[3] = _mm_sub_ps(cz[0], last);
+
+  const __m128 step_x = _mm_castsi128_ps(
+      _mm_set1_epi32(static_cast<int>(simplex_cell(1, 0, 0))));
+  const __m128 step_y = _mm_castsi128_ps(
+      _mm_set1_epi32(static_cast<int>(simplex_cell(0, 1, 0))));
+  const __m128 step_z = _mm_castsi128_ps(
+      _mm_set1_epi32(static_cast<int>(simplex_cell(0, 0, 1))));
+  const __m128i step_xy1 =
+      _mm_add_epi32(_mm_castps_si128(_mm_and_ps(i1, step_x)),
+                    _mm_castps_si128(_mm_and_ps(j1, step_y)));
+  const __m128 step_z1 = _mm_andnot_ps(not_k1, step_z);
+  corner[1] = _mm_add_epi32(
+      corner[0], _mm_add_epi32(step_xy1, _mm_castps_si128(step_z1)));
+  const __m128i step_xy2 =
+      _mm_add_epi32(_mm_castps_si128(_mm_and_ps(i2, step_x)),
+                    _mm_castps_si128(_mm_andnot_ps(not_j2, step_y)));
+  const __m128 step_z2 = _mm_andnot_ps(not_k2, step_z);
+  corner[2] = _mm_add_epi32(
+      corner[0], _mm_add_epi32(step_xy2, _mm_castps_si128(step_z2)));
+  corner[3] = _mm_add_epi32(
+      corner[0], _mm_set1_epi32(static_cast<int>(simplex_cell(1, 1, 1))));
+}
+
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_cell_2d_sse(const __m128i key, const __m128 x,
+                                       const __m128 z, __m128 (&cx)[3],
+                                       __m128 (&cz)[3], __m128i (&corner)[3])
+    -> void {
+  const __m128 s = _mm_mul_ps(_mm_add_ps(x, z), _mm_set1_ps(simplex_skew_2d));
+  const __m128 fx = _mm_floor_ps(_mm_add_ps(x, s));
+  const __m128 fz = _mm_floor_ps(_mm_add_ps(z, s));
+  const __m128i packed =
+      _mm_add_epi32(_mm_cvttps_epi32(fx),
+                    _mm_slli_epi32(_mm_cvttps_epi32(fz), simplex_z_shift));
+  const __m128i mix = _mm_set1_epi32(static_cast<int>(simplex_mix_1));
+  corner[0] = _mm_add_epi32(_mm_mullo_epi32(packed, mix), key);
+
+  const __m128 unskew = _mm_set1_ps(simplex_unskew_2d);
+  const __m128 t = _mm_mul_ps(_mm_add_ps(fx, fz), unskew);
+  cx[0] = _mm_add_ps(_mm_sub_ps(x, fx), t);
+  cz[0] = _mm_add_ps(_mm_sub_ps(z, fz), t);
+
+  // the second corner is a step along x in the lower triangle, along z in
+  // the upper one
+  const __m128 i1 = _mm_cmpge_ps(cx[0], cz[0]);
+  const __m128 unit = _mm_set1_ps(1.0f);
+  cx[1] = _mm_sub_ps(_mm_add_ps(cx[0], unskew), _mm_and_ps(i1, unit));
+  cz[1] = _mm_sub_ps(_mm_add_ps(cz[0], unskew), _mm_andnot_ps(i1, unit));
+  const __m128 last = _mm_set1_ps(1.0f - 2.0f * simplex_unskew_2d);
+  cx[2] = _mm_sub_ps(cx[0], last);
+  cz[2] = _mm_sub_ps(cz[0], last);
+
+  const __m128 step_x = _mm_castsi128_ps(
+      _mm_set1_epi32(static_cast<int>(simplex_cell(1, 0, 0))));
+  const __m128 step_z = _mm_castsi128_ps(
+      _mm_set1_epi32(static_cast<int>(simplex_cell(0, 0, 1))));
+  const __m128 step =
+      _mm_or_ps(_mm_and_ps(i1, step_x), _mm_andnot_ps(i1, step_z));
+  corner[1] = _mm_add_epi32(corner[0], _mm_castps_si128(step));
+  corner[2] = _mm_add_epi32(
+      corner[0], _mm_set1_epi32(static_cast<int>(simplex_cell(1, 0, 1))));
+}
+
+// What is left of simplex_radius at offset (x, y, z) from a corner, 0 outside
+PERLIN_TARGET("sse4.1")
+inline auto simplex_falloff_sse(const __m128 x, const __m128 y, const __m128 z)
+    -> __m128 {
+  const __m128 rx = _mm_sub_ps(_mm_set1_ps(simplex_radius), _mm_mul_ps(x, x));
+  const __m128 yz = _mm_add_ps(_mm_mul_ps(y, y), _mm_mul_ps(z, z));
+  return _mm_max_ps(_mm_sub_ps(rx, yz), _mm_setzero_ps());
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto simplex_falloff_2d_sse(const __m128 x, const __m128 z) -> __m128 {
+  const __m128 rx = _mm_sub_ps(_mm_set1_ps(simplex_radius), _mm_mul_ps(x, x));
+  return _mm_max_ps(_mm_sub_ps(rx, _mm_mul_ps(z, z)), _mm_setzero_ps());
+}
+
+// The value of one corner. The kernels sum their corners one by one rather
+// than in a loop, which the compiler keeps in memory
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_corner_sse(const __m128i corner, const __m128 x,
+                                      const __m128 y, const __m128 z)
+    -> __m128 {
+  __m128 gx;
+  __m128 gz;
+  const __m128 r = simplex_falloff_sse(x, y, z);
+  const __m128 r2 = _mm_mul_ps(r, r);
+  const __m128 g = simplex_grad_sse(simplex_index_sse(corner), x, y, z, gx, gz);
+  return _mm_mul_ps(_mm_mul_ps(r2, r2), g);
+}
+
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_corner_2d_sse(const __m128i corner, const __m128 x,
+                                         const __m128 z) -> __m128 {
+  __m128 gx;
+  __m128 gz;
+  const __m128 r = simplex_falloff_2d_sse(x, z);
+  const __m128 r2 = _mm_mul_ps(r, r);
+  const __m128 g = simplex_grad_2d_sse(simplex_index_sse(corner), x, z, gx, gz);
+  return _mm_mul_ps(_mm_mul_ps(r2, r2), g);
+}
+
+// The corners are summed in pairs, like perlin::simplex
+template <bool Volume>
+PERLIN_TARGET("sse4.1")
+auto simplex_volume_sse(const __m128i key, const __m128 x, const __m128 y,
+                        const __m128 z) -> __m128 {
+  __m128 cx[4];
+  __m128 cy[4];
+  __m128 cz[4];
+  __m128i corner[4];
+  simplex_cell_sse<Volume>(key, x, y, z, cx, cy, cz, corner);
+
+  const __m128 first =
+      _mm_add_ps(simplex_corner_sse(corner[0], cx[0], cy[0], cz[0]),
+                 simplex_corner_sse(corner[1], cx[1], cy[1], cz[1]));
+  const __m128 second =
+      _mm_add_ps(simplex_corner_sse(corner[2], cx[2], cy[2], cz[2]),
+                 simplex_corner_sse(corner[3], cx[3], cy[3], cz[3]));
+  return _mm_mul_ps(_mm_set1_ps(simplex_scale_3d), _mm_add_ps(first, second));
+}
+
+template <bool Planar>
+PERLIN_TARGET("sse4.1")
+auto simplex_sse(const __m128i key, const __m128 x, const __m128 z) -> __m128 {
+  if constexpr (Planar) {
+    __m128 cx[3];
+    __m128 cz[3];
+    __m128i corner[3];
+    simplex_cell_2d_sse(key, x, z, cx, cz, corner);
+
+    __m128 total = _mm_add_ps(simplex_corner_2d_sse(corner[0], cx[0], cz[0]),
+                              simplex_corner_2d_sse(corner[1], cx[1], cz[1]));
+    total = _mm_add_ps(total, simplex_corner_2d_sse(corner[2], cx[2], cz[2]));
+    return _mm_mul_ps(_mm_set1_ps(simplex_scale_2d), total);
+  } else {
+    return simplex_volume_sse<false>(key, x, _mm_setzero_ps(), z);
+  }
+}
+
+// Adds the value of one corner to total and its derivatives to dx and dz,
+// see perlin::simplex_gradient
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_add_sse(const __m128 gx, const __m128 gz,
+                                   const __m128 r, const __m128 g,
+                                   const __m128 x, const __m128 z,
+                                   __m128& total, __m128& dx, __m128& dz)
+    -> void {
+  const __m128 r2 = _mm_mul_ps(r, r);
+  const __m128 r4 = _mm_mul_ps(r2, r2);
+  const __m128 scaled = _mm_mul_ps(_mm_set1_ps(-8.0f), r2);
+  const __m128 falloff = _mm_mul_ps(_mm_mul_ps(scaled, r), g);
+  total = _mm_add_ps(total, _mm_mul_ps(r4, g));
+  dx = _mm_add_ps(dx, _mm_add_ps(_mm_mul_ps(r4, gx), _mm_mul_ps(falloff, x)));
+  dz = _mm_add_ps(dz, _mm_add_ps(_mm_mul_ps(r4, gz), _mm_mul_ps(falloff, z)));
+}
+
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_add_corner_sse(const __m128i corner, const __m128 x,
+                                          const __m128 y, const __m128 z,
+                                          __m128& total, __m128& dx,
+                                          __m128& dz) -> void {
+  __m128 gx;
+  __m128 gz;
+  const __m128 r = simplex_falloff_sse(x, y, z);
+  const __m128 g = simplex_grad_sse(simplex_index_sse(corner), x, y, z, gx, gz);
+  simplex_add_sse(gx, gz, r, g, x, z, total, dx, dz);
+}
+
+PERLIN_TARGET("sse4.1")
+PERLIN_INLINE auto simplex_add_corner_2d_sse(const __m128i corner,
+                                             const __m128 x, const __m128 z,
+                                             __m128& total, __m128& dx,
+                                             __m128& dz) -> void {
+  __m128 gx;
+  __m128 gz;
+  const __m128 r = simplex_falloff_2d_sse(x, z);
+  const __m128 g = simplex_grad_2d_sse(simplex_index_sse(corner), x, z, gx, gz);
+  simplex_add_sse(gx, gz, r, g, x, z, total, dx, dz);
+}
+
+template <bool Planar>
+PERLIN_TARGET("sse4.1")
+auto simplex_gradient_sse(const __m128i key, const __m128 x, const __m128 z,
+                          __m128& dx, __m128& dz) -> __m128 {
+  __m128 total = _mm_setzero_ps();
+  dx = _mm_setzero_ps();
+  dz = _mm_setzero_ps();
+  float scale = simplex_scale_2d;
+  if constexpr (Planar) {
+    __m128 cx[3];
+    __m128 cz[3];
+    __m128i corner[3];
+    simplex_cell_2d_sse(key, x, z, cx, cz, corner);
+    simplex_add_corner_2d_sse(corner[0], cx[0], cz[0], total, dx, dz);
+    simplex_add_corner_2d_sse(corner[1], cx[1], cz[1], total, dx, dz);
+    simplex_add_corner_2d_sse(corner[2], cx[2], cz[2], total, dx, dz);
+  } else {
+    __m128 cx[4];
+    __m128 cy[4];
+    __m128 cz[4];
+    __m128i corner[4];
+    simplex_cell_sse<false>(key, x, _mm_setzero_ps(), z, cx, cy, cz, corner);
+    simplex_add_corner_sse(corner[0], cx[0], cy[0], cz[0], total, dx, dz);
+    simplex_add_corner_sse(corner[1], cx[1], cy[1], cz[1], total, dx, dz);
+    simplex_add_corner_sse(corner[2], cx[2], cy[2], cz[2], total, dx, dz);
+    simplex_add_corner_sse(corner[3], cx[3], cy[3], cz[3], total, dx, dz);
+    scale = simplex_scale_3d;
+  }
+
+  const __m128 s = _mm_set1_ps(scale);
+  dx = _mm_mul_ps(dx, s);
+  dz = _mm_mul_ps(dz, s);
+  return _mm_mul_ps(s, total);
+}
+
+template <bool Planar>
+PERLIN_TARGET("sse4.1")
+auto fractal_sse(const fractal_params& params, const float max_value,
+                 const float* x, const float* z, float* out, const size_t n)
+    -> void {
+  const __m128 divisor = _mm_set1_ps(200.0f);
+  const __m128i key =
+      _mm_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  for (size_t k = 0; k < n; k += 4) {
+    const __m128 px = _mm_loadu_ps(x + k);
+    const __m128 pz = _mm_loadu_ps(z + k);
+    __m128 total = _mm_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (unsigned int o = 0; o < params.octaves; ++o) {
+      const __m128 f = _mm_set1_ps(frequency);
+      const __m128 sx = _mm_div_ps(_mm_mul_ps(px, f), divisor);
+      const __m128 sz = _mm_div_ps(_mm_mul_ps(pz, f), divisor);
+      const __m128 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_sse<Planar>(key, sx, sz)
+              : noise_sse<Planar>(params.permutation, sx, sz);
+      total = _mm_add_ps(total, _mm_mul_ps(noise, _mm_set1_ps(amplitude)));
+      frequency *= params.lacunarity;
+      amplitude *= params.persistence;
+    }
+    const __m128 normalized = _mm_add_ps(
+        _mm_div_ps(total, _mm_set1_ps(max_value)), _mm_set1_ps(1.0f));
+    _mm_storeu_ps(out + k, _mm_div_ps(normalized, _mm_set1_ps(2.0f)));
+  }
+}
+
+PERLIN_TARGET("sse4.1")
+inline auto fade_derivative_sse(const __m128 t) -> __m128 {
+  const __m128 inner =
+      _mm_add_ps(_mm_mul_ps(t, _mm_sub_ps(t, _mm_set1_ps(2.0f))),
+                 _mm_set1_ps(1.0f));
+  return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(30.0f), t), t), inner);
+}
+
+// noise_sse together with its derivatives along x and z, see
+// perlin::noise_gradient
+template <bool Planar>
+PERLIN_TARGET("sse4.1")
+auto noise_gradient_sse(const int* p, const __m128 x, const __m128 z,
+                        __m128& dx, __m128& dz) -> __m128 {
+  const __m128 fx = _mm_floor_ps(x);
+  const __m128 fz = _mm_floor_ps(z);
+  const __m128i mask = _mm_set1_epi32(255);
+  const __m128i one = _mm_set1_epi32(1);
+  const __m128i xi = _mm_and_si128(_mm_cvttps_epi32(fx), mask);
+  const __m128i zi = _mm_and_si128(_mm_cvttps_epi32(fz), mask);
+
+  const __m128 xf = _mm_sub_ps(x, fx);
+  const __m128 zf = _mm_sub_ps(z, fz);
+  const __m128 xf1 = _mm_sub_ps(xf, _mm_set1_ps(1.0f));
+  const __m128 zf1 = _mm_sub_ps(zf, _mm_set1_ps(1.0f));
+  const __m128 u = fade_sse(xf);
+  const __m128 w = fade_sse(zf);
+  const __m128 du = fade_derivative_sse(xf);
+  const __m128 dw = fade_derivative_sse(zf);
+
+  const __m128i a = gather_sse(p, xi);
+  const __m128i b = gather_sse(p, _mm_add_epi32(xi, one));
+  const __m128i aa = _mm_add_epi32(Planar ? a : gather_sse(p, a), zi);
+  const __m128i ba = _mm_add_epi32(Planar ? b : gather_sse(p, b), zi);
+
+  __m128 gx00, gz00, gx10, gz10, gx01, gz01, gx11, gz11;
+  grad_coefficients_sse(gather_sse(p, aa), gx00, gz00);
+  grad_coefficients_sse(gather_sse(p, ba), gx10, gz10);
+  grad_coefficients_sse(gather_sse(p, _mm_add_epi32(aa, one)),
+                        gx01, gz01);
+  grad_coefficients_sse(gather_sse(p, _mm_add_epi32(ba, one)),
+                        gx11, gz11);
+  const __m128 g00 =
+      _mm_add_ps(_mm_mul_ps(gx00, xf), _mm_mul_ps(gz00, zf));
+  const __m128 g10 =
+      _mm_add_ps(_mm_mul_ps(gx10, xf1), _mm_mul_ps(gz10, zf));
+  const __m128 g01 =
+      _mm_add_ps(_mm_mul_ps(gx01, xf), _mm_mul_ps(gz01, zf1));
+  const __m128 g11 =
+      _mm_add_ps(_mm_mul_ps(gx11, xf1), _mm_mul_ps(gz11, zf1));
+
+  const __m128 x1 = lerp_sse(g00, g10, u);
+  const __m128 x2 = lerp_sse(g01, g11, u);
+  const __m128 x1_dx = _mm_add_ps(
+      _mm_add_ps(gx00, _mm_mul_ps(_mm_sub_ps(gx10, gx00), u)),
+      _mm_mul_ps(_mm_sub_ps(g10, g00), du));
+  const __m128 x2_dx = _mm_add_ps(
+      _mm_add_ps(gx01, _mm_mul_ps(_mm_sub_ps(gx11, gx01), u)),
+      _mm_mul_ps(_mm_sub_ps(g11, g01), du));
+  const __m128 x1_dz =
+      _mm_add_ps(gz00, _mm_mul_ps(_mm_sub_ps(gz10, gz00), u));
+  const __m128 x2_dz =
+      _mm_add_ps(gz01, _mm_mul_ps(_mm_sub_ps(gz11, gz01), u));
+
+  dx = _mm_add_ps(x1_dx, _mm_mul_ps(_mm_sub_ps(x2_dx, x1_dx), w));
+  dz = _mm_add_ps(
+      _mm_add_ps(x1_dz, _mm_mul_ps(_mm_sub_ps(x2_dz, x1_dz), w)),
+      _mm_mul_ps(_mm_sub_ps(x2, x1), dw));
+  return lerp_sse(x1, x2, w);
+}
+
+template <bool Planar>
+PERLIN_TARGET("sse4.1")
+auto fractal_gradient_sse(const fractal_params& params,
+                          const float max_value, const float* x,
+                          const float* z, float* out, float* dx, float* dz,
+                          const size_t n) -> void {
+  const __m128 divisor = _mm_set1_ps(200.0f);
+  const __m128i key =
+      _mm_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  const __m128 scale = _mm_set1_ps(1.0f / (2.0f * max_value));
+  for (size_t k = 0; k < n; k += 4) {
+    const __m128 px = _mm_loadu_ps(x + k);
+    const __m128 pz = _mm_loadu_ps(z + k);
+    __m128 total = _mm_setzero_ps();
+    __m128 total_dx = _mm_setzero_ps();
+    __m128 total_dz = _mm_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (unsigned int o = 0; o < params.octaves; ++o) {
+      const __m128 f = _mm_set1_ps(frequency);
+      __m128 noise_dx;
+      __m128 noise_dz;
+      const __m128 sx = _mm_div_ps(_mm_mul_ps(px, f), divisor);
+      const __m128 sz = _mm_div_ps(_mm_mul_ps(pz, f), divisor);
+      const __m128 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_gradient_sse<Planar>(key, sx, sz,
+                                             noise_dx, noise_dz)
+              : noise_gradient_sse<Planar>(params.permutation, sx, sz,
+                                           noise_dx, noise_dz);
+      total = _mm_add_ps(total,
+                         _mm_mul_ps(noise, _mm_set1_ps(amplitude)));
+      const __m128 chain = _mm_set1_ps(amplitude * frequency / 200.0f);
+      total_dx = _mm_add_ps(total_dx, _mm_mul_ps(noise_dx, chain));
+      total_dz = _mm_add_ps(total_dz, _mm_mul_ps(noise_dz, chain));
+      frequency *= params.lacunarity;
+      amplitude *= params.persistence;
+    }
+    const __m128 normalized = _mm_add_ps(
+        _mm_div_ps(total, _mm_set1_ps(max_value)), _mm_set1_ps(1.0f));
+    _mm_storeu_ps(out + k, _mm_div_ps(normalized, _mm_set1_ps(2.0f)));
+    _mm_storeu_ps(dx + k, _mm_mul_ps(total_dx, scale));
+    _mm_storeu_ps(dz + k, _mm_mul_ps(total_dz, scale));
+  }
+}
+
+// One octave at a time over all the points, so each octave keeps its lattice
+// cube from one group of points to the next. out holds the running total,
+// summed in the same order as per point
+PERLIN_TARGET("sse4.1")
+auto fractal_volume_sse(const fractal_params& params, const float max_value,
+                        const float* x, const float* y, const float* z,
+                        float* out, const size_t n) -> void {
+  const __m128 divisor = _mm_set1_ps(200.0f);
+  const __m128i key =
+      _mm_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  for (size_t k = 0; k < n; k += 4) _mm_storeu_ps(out + k, _mm_setzero_ps());
+
+  float frequency = 1.0f;
+  float amplitude = 1.0f;
+  for (unsigned int o = 0; o < params.octaves; ++o) {
+    const __m128 f = _mm_set1_ps(frequency);
+    const __m128 a = _mm_set1_ps(amplitude);
+    // -1 is no lattice index, so the first group computes its corners
+    volume_cell_sse cell;
+    cell.xi = _mm_set1_epi32(-1);
+    cell.yi = cell.xi;
+    cell.zi = cell.xi;
+    for (size_t k = 0; k < n; k += 4) {
+      const __m128 sx = _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(x + k), f), divisor);
+      const __m128 sy = _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(y + k), f), divisor);
+      const __m128 sz = _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(z + k), f), divisor);
+      const __m128 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_volume_sse<true>(key, sx, sy, sz)
+              : noise_volume_sse(params.permutation, sx, sy, sz, cell);
+      _mm_storeu_ps(out + k,
+                    _mm_add_ps(_mm_loadu_ps(out + k), _mm_mul_ps(noise, a)));
+    }
+    frequency *= params.lacunarity;
+    amplitude *= params.persistence;
+  }
+
+  for (size_t k = 0; k < n; k += 4) {
+    const __m128 normalized = _mm_add_ps(
+        _mm_div_ps(_mm_loadu_ps(out + k), _mm_set1_ps(max_value)),
+        _mm_set1_ps(1.0f));
+    _mm_storeu_ps(out + k, _mm_div_ps(normalized, _mm_set1_ps(2.0f)));
+  }
+}
+
+// --- AVX2, 8 points ---
+
+PERLIN_TARGET("avx2")
+inline auto gather_avx2(const int* table, const __m256i index) -> __m256i {
+  return _mm256_i32gather_epi32(table, index, 4);
+}
+
+PERLIN_TARGET("avx2")
+inline auto grad_coefficients_avx2(const __m256i hash, __m256& gx, __m256& gz)
+    -> void {
+  // permutevar8x32 only looks at the low three bits, bit 3 picks the half
+  const __m256 upper = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+      _mm256_and_si256(hash, _mm256_set1_epi32(8)), _mm256_set1_epi32(8)));
+  gx = _mm256_blendv_ps(
+      _mm256_permutevar8x32_ps(_mm256_load_ps(grad_x), hash),
+      _mm256_permutevar8x32_ps(_mm256_load_ps(grad_x + 8), hash), upper);
+  gz = _mm256_blendv_ps(
+      _mm256_permutevar8x32_ps(_mm256_load_ps(grad_z), hash),
+      _mm256_permutevar8x32_ps(_mm256_load_ps(grad_z + 8), hash), upper);
+}
+
+PERLIN_TARGET("avx2")
+inline auto grad_avx2(const __m256i hash, const __m256 x, const __m256 z)
+    -> __m256 {
+  __m256 gx;
+  __m256 gz;
+  grad_coefficients_avx2(hash, gx, gz);
+  return _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gz, z));
+}
+
+PERLIN_TARGET("avx2")
+inline auto fade_avx2(const __m256 t) -> __m256 {
+  const __m256 inner = _mm256_add_ps(
+      _mm256_mul_ps(t, _mm256_sub_ps(_mm256_mul_ps(t, _mm256_set1_ps(6.0f)),
+                                     _mm256_set1_ps(15.0f))),
+      _mm256_set1_ps(10.0f));
+  return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(t, t), t), inner);
+}
+
+PERLIN_TARGET("avx2")
+inline auto lerp_avx2(const __m256 a, const __m256 b, const __m256 w)
+    -> __m256 {
+  return _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(b, a), w), a);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx2")
+auto noise_avx2(const int* p, const __m256 x, const __m256 z) -> __m256 {
+  const __m256 fx = _mm256_floor_ps(x);
+  const __m256 fz = _mm256_floor_ps(z);
+  const __m256i mask = _mm256_set1_epi32(255);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+  const __m256i zi = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+
+  const __m256 xf = _mm256_sub_ps(x, fx);
+  const __m256 zf = _mm256_sub_ps(z, fz);
+  const __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1.0f));
+  const __m256 zf1 = _mm256_sub_ps(zf, _mm256_set1_ps(1.0f));
+  const __m256 u = fade_avx2(xf);
+  const __m256 w = fade_avx2(zf);
+
+  const __m256i a = gather_avx2(p, xi);
+  const __m256i b = gather_avx2(p, _mm256_add_epi32(xi, one));
+  const __m256i aa = _mm256_add_epi32(Planar ? a : gather_avx2(p, a), zi);
+  const __m256i ba = _mm256_add_epi32(Planar ? b : gather_avx2(p, b), zi);
+
+  const __m256 x1 = lerp_avx2(grad_avx2(gather_avx2(p, aa), xf, zf),
+                              grad_avx2(gather_avx2(p, ba), xf1, zf), u);
+  const __m256 x2 = lerp_avx2(
+      grad_avx2(gather_avx2(p, _mm256_add_epi32(aa, one)), xf, zf1),
+      grad_avx2(gather_avx2(p, _mm256_add_epi32(ba, one)), xf1, zf1), u);
+  return lerp_avx2(x1, x2, w);
+}
+
+// The full perlin::noise, for points off the y = 0 plane. gx and gz are the
+// same as in grad_avx2, gy adds the y term the other kernels drop
+
+PERLIN_TARGET("avx2")
+inline auto grad_coefficients_avx2(const __m256i hash, __m256& gx, __m256& gy,
+                                   __m256& gz) -> void {
+  grad_coefficients_avx2(hash, gx, gz);
+  const __m256 upper = _mm256_castsi256_ps(_mm256_cmpeq_epi32(
+      _mm256_and_si256(hash, _mm256_set1_epi32(8)), _mm256_set1_epi32(8)));
+  gy = _mm256_blendv_ps(
+      _mm256_permutevar8x32_ps(_mm256_load_ps(grad_y), hash),
+      _mm256_permutevar8x32_ps(_mm256_load_ps(grad_y + 8), hash), upper);
+}
+
+PERLIN_TARGET("avx2")
+inline auto grad_volume_avx2(const __m256i hash, const __m256 x, const __m256 y,
+                             const __m256 z) -> __m256 {
+  __m256 gx;
+  __m256 gy;
+  __m256 gz;
+  grad_coefficients_avx2(hash, gx, gy, gz);
+  const __m256 planar =
+      _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gz, z));
+  return _mm256_add_ps(planar, _mm256_mul_ps(gy, y));
+}
+
+// volume_cell_sse for 8 points
+struct volume_cell_avx2 {
+  __m256i xi;
+  __m256i yi;
+  __m256i zi;
+  __m256 gx[8];
+  __m256 gy[8];
+  __m256 gz[8];
+};
+
+PERLIN_TARGET("avx2")
+auto volume_corners_avx2(const int* p, volume_cell_avx2& cell) -> void {
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i a = _mm256_add_epi32(gather_avx2(p, cell.xi), cell.yi);
+  const __m256i b =
+      _mm256_add_epi32(gather_avx2(p, _mm256_add_epi32(cell.xi, one)), cell.yi);
+  const __m256i aa = _mm256_add_epi32(gather_avx2(p, a), cell.zi);
+  const __m256i ab =
+      _mm256_add_epi32(gather_avx2(p, _mm256_add_epi32(a, one)), cell.zi);
+  const __m256i ba = _mm256_add_epi32(gather_avx2(p, b), cell.zi);
+  const __m256i bb =
+      _mm256_add_epi32(gather_avx2(p, _mm256_add_epi32(b, one)), cell.zi);
+  const __m256i corners[8] = {aa,
+                              ba,
+                              ab,
+                              bb,
+                              _mm256_add_epi32(aa, one),
+                              _mm256_add_epi32(ba, one),
+                              _mm256_add_epi32(ab, one),
+                              _mm256_add_epi32(bb, one)};
+  for (int c = 0; c < 8; ++c) {
+    grad_coefficients_avx2(gather_avx2(p, corners[c]), cell.gx[c], cell.gy[c],
+                           cell.gz[c]);
+  }
+}
+
+PERLIN_TARGET("avx2")
+inline auto corner_avx2(const volume_cell_avx2& cell, const int c,
+                        const __m256 x, const __m256 y, const __m256 z)
+    -> __m256 {
+  const __m256 planar = _mm256_add_ps(_mm256_mul_ps(cell.gx[c], x),
+                                      _mm256_mul_ps(cell.gz[c], z));
+  return _mm256_add_ps(planar, _mm256_mul_ps(cell.gy[c], y));
+}
+
+PERLIN_TARGET("avx2")
+auto noise_volume_avx2(const int* p, const __m256 x, const __m256 y,
+                       const __m256 z, volume_cell_avx2& cell) -> __m256 {
+  const __m256 fx = _mm256_floor_ps(x);
+  const __m256 fy = _mm256_floor_ps(y);
+  const __m256 fz = _mm256_floor_ps(z);
+  const __m256i mask = _mm256_set1_epi32(255);
+  const __m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+  const __m256i yi = _mm256_and_si256(_mm256_cvttps_epi32(fy), mask);
+  const __m256i zi = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+
+  const __m256i same = _mm256_and_si256(
+      _mm256_and_si256(_mm256_cmpeq_epi32(xi, cell.xi),
+                       _mm256_cmpeq_epi32(yi, cell.yi)),
+      _mm256_cmpeq_epi32(zi, cell.zi));
+  if (_mm256_movemask_epi8(same) != -1) {
+    cell.xi = xi;
+    cell.yi = yi;
+    cell.zi = zi;
+    volume_corners_avx2(p, cell);
+  }
+
+  const __m256 xf = _mm256_sub_ps(x, fx);
+  const __m256 yf = _mm256_sub_ps(y, fy);
+  const __m256 zf = _mm256_sub_ps(z, fz);
+  const __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1.0f));
+  const __m256 yf1 = _mm256_sub_ps(yf, _mm256_set1_ps(1.0f));
+  const __m256 zf1 = _mm256_sub_ps(zf, _mm256_set1_ps(1.0f));
+  const __m256 u = fade_avx2(xf);
+  const __m256 v = fade_avx2(yf);
+  const __m256 w = fade_avx2(zf);
+
+  const __m256 x1 = lerp_avx2(corner_avx2(cell, 0, xf, yf, zf),
+                              corner_avx2(cell, 1, xf1, yf, zf), u);
+  const __m256 x2 = lerp_avx2(corner_avx2(cell, 2, xf, yf1, zf),
+                              corner_avx2(cell, 3, xf1, yf1, zf), u);
+  const __m256 y1 = lerp_avx2(x1, x2, v);
+
+  const __m256 x3 = lerp_avx2(corner_avx2(cell, 4, xf, yf, zf1),
+                              corner_avx2(cell, 5, xf1, yf, zf1), u);
+  const __m256 x4 = lerp_avx2(corner_avx2(cell, 6, xf, yf1, zf1),
+                              corner_avx2(cell, 7, xf1, yf1, zf1), u);
+  const __m256 y2 = lerp_avx2(x3, x4, v);
+
+  return lerp_avx2(y1, y2, w);
+}
+
+// Simplex noise, see perlin::simplex. The cell functions find the corners of
+// the simplex around each point, their offsets from the point and the inputs
+// of their hashes, for both the value and the derivative kernels. They are
+// forced inline so the corner arrays stay in registers. Unlike the Perlin
+// kernels they read no table from memory: the hashes are arithmetic and the
+// gradients are looked up with vpshufb, within each 128 bit lane. The steps
+// to the corners are masks, which select both the 1 subtracted from each
+// offset and the simplex_cell added to the hash input
+
+// simplex_hash of each corner as a vpshufb index: the hash in the low bits
+// of the top byte, and 0x80 in the others, which vpshufb clears
+PERLIN_TARGET("avx2")
+inline auto simplex_index_avx2(const __m256i corner) -> __m256i {
+  const __m256i h = _mm256_xor_si256(corner, _mm256_srli_epi32(corner, 15));
+  const __m256i mixed =
+      _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int>(simplex_mix_2)));
+  return _mm256_or_si256(_mm256_srli_epi32(mixed, 4),
+                         _mm256_set1_epi32(0x00808080));
+}
+
+// One of the simplex gradient coefficients for each index. The entry lands
+// in the top byte of a lane that is otherwise 0, which is 2, -2 or 0. The
+// table is repeated in both 128 bit lanes, as vpshufb looks up within each
+PERLIN_TARGET("avx2")
+inline auto simplex_coefficient_avx2(const __m256i index,
+                                     const std::int8_t (&table)[16]) -> __m256 {
+  return _mm256_castsi256_ps(_mm256_shuffle_epi8(
+      _mm256_broadcastsi128_si256(
+          _mm_load_si128(reinterpret_cast<const __m128i*>(table))), index));
+}
+
+// grad_volume_avx2 for a simplex corner, leaving gx and gz for the
+// derivatives
+PERLIN_TARGET("avx2")
+inline auto simplex_grad_avx2(const __m256i index, const __m256 x,
+                              const __m256 y, const __m256 z, __m256& gx,
+                              __m256& gz) -> __m256 {
+  gx = simplex_coefficient_avx2(index, grad_x_bytes);
+  gz = simplex_coefficient_avx2(index, grad_z_bytes);
+  const __m256 gy = simplex_coefficient_avx2(index, grad_y_bytes);
+  const __m256 planar =
+      _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gz, z));
+  return _mm256_add_ps(planar, _mm256_mul_ps(gy, y));
+}
+
+PERLIN_TARGET("avx2")
+inline auto simplex_grad_2d_avx2(const __m256i index, const __m256 x,
+                                 const __m256 z, __m256& gx, __m256& gz)
+    -> __m256 {
+  gx = simplex_coefficient_avx2(index, grad_x_bytes);
+  gz = simplex_coefficient_avx2(index, grad_z_bytes);
+  return _mm256_add_ps(_mm256_mul_ps(gx, x), _mm256_mul_ps(gz, z));
+}
+
+// The entry of a simplex_x1 like table for the order of each point
+PERLIN_TARGET("avx2")
+inline auto simplex_lookup_avx2(const float (&table)[8], const __m256i order)
+    -> __m256 {
+  return _mm256_permutevar8x32_ps(_mm256_load_ps(table), order);
+}
+
+PERLIN_TARGET("avx2")
+inline auto simplex_lookup_avx2(const std::uint32_t (&table)[8],
+                                const __m256i order) -> __m256i {
+  return _mm256_permutevar8x32_epi32(
+      _mm256_load_si256(reinterpret_cast<const __m256i*>(table)), order);
+}
+
+// With Volume unset y is 0, which the sums then leave out
+template <bool Volume>
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_cell_avx2(const __m256i key, const __m256 x,
+                                     const __m256 y, const __m256 z,
+                                     __m256 (&cx)[4], __m256 (&cy)[4],
+                                     __m256 (&cz)[4], __m256i (&corner)[4])
+    -> void {
+  const __m256 sum = Volume ? _mm256_add_ps(_mm256_add_ps(x, y), z)
+                            : _mm256_add_ps(x, z);
+  const __m256 s = _mm256_mul_ps(sum, _mm256_set1_ps(simplex_skew_3d));
+  const __m256 fx = _mm256_floor_ps(_mm256_add_ps(x, s));
+  const __m256 fy = _mm256_floor_ps(Volume ? _mm256_add_ps(y, s) : s);
+  const __m256 fz = _mm256_floor_ps(_mm256_add_ps(z, s));
+  const __m256i packed_yz = _mm256_add_epi32(
+      _mm256_slli_epi32(_mm256_cvttps_epi32(fy), simplex_y_shift),
+      _mm256_slli_epi32(_mm256_cvttps_epi32(fz), simplex_z_shift));
+  const __m256i packed = _mm256_add_epi32(_mm256_cvttps_epi32(fx), packed_yz);
+  const __m256i mix = _mm256_set1_epi32(static_cast<int>(simplex_mix_1));
+  corner[0] = _mm256_add_epi32(_mm256_mullo_epi32(packed, mix), key);
+
+  const __m256 unskew = _mm256_set1_ps(simplex_unskew_3d);
+  const __m256 t =
+      _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(fx, fy), fz), unskew);
+  cx[0] = _mm256_add_ps(_mm256_sub_ps(x, fx), t);
+  cy[0] = Volume ? _mm256_add_ps(_mm256_sub_ps(y, fy), t)
+                 : _mm256_sub_ps(t, fy);
+  cz[0] = _mm256_add_ps(_mm256_sub_ps(z, fz), t);
+
+  const __m256 xy = _mm256_cmp_ps(cx[0], cy[0], _CMP_GE_OQ);
+  const __m256 xz = _mm256_cmp_ps(cx[0], cz[0], _CMP_GE_OQ);
+  const __m256 yz = _mm256_cmp_ps(cy[0], cz[0], _CMP_GE_OQ);
+  const __m256i order = _mm256_or_si256(
+      _mm256_or_si256(
+          _mm256_and_si256(_mm256_castps_si256(xy), _mm256_set1_epi32(1)),
+          _mm256_and_si256(_mm256_castps_si256(xz), _mm256_set1_epi32(2))),
+      _mm256_and_si256(_mm256_castps_si256(yz), _mm256_set1_epi32(4)));
+
+  cx[1] = _mm256_add_ps(cx[0], simplex_lookup_avx2(simplex_x1, order));
+  cy[1] = _mm256_add_ps(cy[0], simplex_lookup_avx2(simplex_y1, order));
+  cz[1] = _mm256_add_ps(cz[0], simplex_lookup_avx2(simplex_z1, order));
+  cx[2] = _mm256_add_ps(cx[0], simplex_lookup_avx2(simplex_x2, order));
+  cy[2] = _mm256_add_ps(cy[0], simplex_lookup_avx2(simplex_y2, order));
+  cz[2] = _mm256_add_ps(cz[0], simplex_lookup_avx2(simplex_z2, order));
+  const __m256 last = _mm256_set1_ps(1.0f - 3.0f * simplex_unskew_3d);
+  cx[3] = _mm256_sub_ps(cx[0], last);
+  cy[3] = _mm256_sub_ps(cy[0], last);
+  cz[3] = _mm256_sub_ps(cz[0], last);
+
+  corner[1] = _mm256_add_epi32(corner[0],
+                               simplex_lookup_avx2(simplex_cell_1, order));
+  corner[2] = _mm256_add_epi32(corner[0],
+                               simplex_lookup_avx2(simplex_cell_2, order));
+  corner[3] = _mm256_add_epi32(
+      corner[0], _mm256_set1_epi32(static_cast<int>(simplex_cell(1, 1, 1))));
+}
+
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_cell_2d_avx2(const __m256i key, const __m256 x,
+                                        const __m256 z, __m256 (&cx)[3],
+                                        __m256 (&cz)[3], __m256i (&corner)[3])
+    -> void {
+  const __m256 s =
+      _mm256_mul_ps(_mm256_add_ps(x, z), _mm256_set1_ps(simplex_skew_2d));
+  const __m256 fx = _mm256_floor_ps(_mm256_add_ps(x, s));
+  const __m256 fz = _mm256_floor_ps(_mm256_add_ps(z, s));
+  const __m256i packed = _mm256_add_epi32(
+      _mm256_cvttps_epi32(fx),
+      _mm256_slli_epi32(_mm256_cvttps_epi32(fz), simplex_z_shift));
+  const __m256i mix = _mm256_set1_epi32(static_cast<int>(simplex_mix_1));
+  corner[0] = _mm256_add_epi32(_mm256_mullo_epi32(packed, mix), key);
+
+  const __m256 unskew = _mm256_set1_ps(simplex_unskew_2d);
+  const __m256 t = _mm256_mul_ps(_mm256_add_ps(fx, fz), unskew);
+  cx[0] = _mm256_add_ps(_mm256_sub_ps(x, fx), t);
+  cz[0] = _mm256_add_ps(_mm256_sub_ps(z, fz), t);
+
+  // the second corner is a step along x in the lower triangle, along z in
+  // the upper one
+  const __m256 i1 = _mm256_cmp_ps(cx[0], cz[0], _CMP_GE_OQ);
+  const __m256 unit = _mm256_set1_ps(1.0f);
+  cx[1] = _mm256_sub_ps(_mm256_add_ps(cx[0], unskew), _mm256_and_ps(i1, unit));
+  cz[1] =
+      _mm256_sub_ps(_mm256_add_ps(cz[0], unskew), _mm256_andnot_ps(i1, unit));
+  const __m256 last = _mm256_set1_ps(1.0f - 2.0f * simplex_unskew_2d);
+  cx[2] = _mm256_sub_ps(cx[0], last);
+  cz[2] = _mm256_sub_ps(cz[0], last);
+
+  const __m256 step_x = _mm256_castsi256_ps(
+      _mm256_set1_epi32(static_cast<int>(simplex_cell(1, 0, 0))));
+  const __m256 step_z = _mm256_castsi256_ps(
+      _mm256_set1_epi32(static_cast<int>(simplex_cell(0, 0, 1))));
+  const __m256 step =
+      _mm256_or_ps(_mm256_and_ps(i1, step_x), _mm256_andnot_ps(i1, step_z));
+  corner[1] = _mm256_add_epi32(corner[0], _mm256_castps_si256(step));
+  corner[2] = _mm256_add_epi32(
+      corner[0], _mm256_set1_epi32(static_cast<int>(simplex_cell(1, 0, 1))));
+}
+
+// What is left of simplex_radius at offset (x, y, z) from a corner, 0 outside
+PERLIN_TARGET("avx2")
+inline auto simplex_falloff_avx2(const __m256 x, const __m256 y, const __m256 z)
+    -> __m256 {
+  const __m256 rx =
+      _mm256_sub_ps(_mm256_set1_ps(simplex_radius), _mm256_mul_ps(x, x));
+  const __m256 yz = _mm256_add_ps(_mm256_mul_ps(y, y), _mm256_mul_ps(z, z));
+  return _mm256_max_ps(_mm256_sub_ps(rx, yz), _mm256_setzero_ps());
+}
+
+PERLIN_TARGET("avx2")
+inline auto simplex_falloff_2d_avx2(const __m256 x, const __m256 z) -> __m256 {
+  const __m256 rx =
+      _mm256_sub_ps(_mm256_set1_ps(simplex_radius), _mm256_mul_ps(x, x));
+  return _mm256_max_ps(_mm256_sub_ps(rx, _mm256_mul_ps(z, z)),
+                       _mm256_setzero_ps());
+}
+
+// The value of one corner. The kernels sum their corners one by one rather
+// than in a loop, which the compiler keeps in memory
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_corner_avx2(const __m256i corner, const __m256 x,
+                                       const __m256 y, const __m256 z)
+    -> __m256 {
+  __m256 gx;
+  __m256 gz;
+  const __m256 r = simplex_falloff_avx2(x, y, z);
+  const __m256 r2 = _mm256_mul_ps(r, r);
+  const __m256 g =
+      simplex_grad_avx2(simplex_index_avx2(corner), x, y, z, gx, gz);
+  return _mm256_mul_ps(_mm256_mul_ps(r2, r2), g);
+}
+
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_corner_2d_avx2(const __m256i corner, const __m256 x,
+                                          const __m256 z) -> __m256 {
+  __m256 gx;
+  __m256 gz;
+  const __m256 r = simplex_falloff_2d_avx2(x, z);
+  const __m256 r2 = _mm256_mul_ps(r, r);
+  const __m256 g =
+      simplex_grad_2d_avx2(simplex_index_avx2(corner), x, z, gx, gz);
+  return _mm256_mul_ps(_mm256_mul_ps(r2, r2), g);
+}
+
+// The corners are summed in pairs, like perlin::simplex
+template <bool Volume>
+PERLIN_TARGET("avx2")
+auto simplex_volume_avx2(const __m256i key, const __m256 x, const __m256 y,
+                         const __m256 z) -> __m256 {
+  __m256 cx[4];
+  __m256 cy[4];
+  __m256 cz[4];
+  __m256i corner[4];
+  simplex_cell_avx2<Volume>(key, x, y, z, cx, cy, cz, corner);
+
+  const __m256 first =
+      _mm256_add_ps(simplex_corner_avx2(corner[0], cx[0], cy[0], cz[0]),
+                    simplex_corner_avx2(corner[1], cx[1], cy[1], cz[1]));
+  const __m256 second =
+      _mm256_add_ps(simplex_corner_avx2(corner[2], cx[2], cy[2], cz[2]),
+                    simplex_corner_avx2(corner[3], cx[3], cy[3], cz[3]));
+  return _mm256_mul_ps(_mm256_set1_ps(simplex_scale_3d),
+                       _mm256_add_ps(first, second));
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx2")
+auto simplex_avx2(const __m256i key, const __m256 x, const __m256 z) -> __m256 {
+  if constexpr (Planar) {
+    __m256 cx[3];
+    __m256 cz[3];
+    __m256i corner[3];
+    simplex_cell_2d_avx2(key, x, z, cx, cz, corner);
+
+    __m256 total =
+        _mm256_add_ps(simplex_corner_2d_avx2(corner[0], cx[0], cz[0]),
+                      simplex_corner_2d_avx2(corner[1], cx[1], cz[1]));
+    total =
+        _mm256_add_ps(total, simplex_corner_2d_avx2(corner[2], cx[2], cz[2]));
+    return _mm256_mul_ps(_mm256_set1_ps(simplex_scale_2d), total);
+  } else {
+    return simplex_volume_avx2<false>(key, x, _mm256_setzero_ps(), z);
+  }
+}
+
+// Adds the value of one corner to total and its derivatives to dx and dz,
+// see perlin::simplex_gradient
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_add_avx2(const __m256 gx, const __m256 gz,
+                                    const __m256 r, const __m256 g,
+                                    const __m256 x, const __m256 z,
+                                    __m256& total, __m256& dx, __m256& dz)
+    -> void {
+  const __m256 r2 = _mm256_mul_ps(r, r);
+  const __m256 r4 = _mm256_mul_ps(r2, r2);
+  const __m256 scaled = _mm256_mul_ps(_mm256_set1_ps(-8.0f), r2);
+  const __m256 falloff = _mm256_mul_ps(_mm256_mul_ps(scaled, r), g);
+  total = _mm256_add_ps(total, _mm256_mul_ps(r4, g));
+  dx = _mm256_add_ps(
+      dx, _mm256_add_ps(_mm256_mul_ps(r4, gx), _mm256_mul_ps(falloff, x)));
+  dz = _mm256_add_ps(
+      dz, _mm256_add_ps(_mm256_mul_ps(r4, gz), _mm256_mul_ps(falloff, z)));
+}
+
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_add_corner_avx2(const __m256i corner, const __m256 x,
+                                           const __m256 y, const __m256 z,
+                                           __m256& total, __m256& dx,
+                                           __m256& dz) -> void {
+  __m256 gx;
+  __m256 gz;
+  const __m256 r = simplex_falloff_avx2(x, y, z);
+  const __m256 g =
+      simplex_grad_avx2(simplex_index_avx2(corner), x, y, z, gx, gz);
+  simplex_add_avx2(gx, gz, r, g, x, z, total, dx, dz);
+}
+
+PERLIN_TARGET("avx2")
+PERLIN_INLINE auto simplex_add_corner_2d_avx2(const __m256i corner,
+                                              const __m256 x, const __m256 z,
+                                              __m256& total, __m256& dx,
+                                              __m256& dz) -> void {
+  __m256 gx;
+  __m256 gz;
+  const __m256 r = simplex_falloff_2d_avx2(x, z);
+  const __m256 g =
+      simplex_grad_2d_avx2(simplex_index_avx2(corner), x, z, gx, gz);
+  simplex_add_avx2(gx, gz, r, g, x, z, total, dx, dz);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx2")
+auto simplex_gradient_avx2(const __m256i key, const __m256 x, const __m256 z,
+                           __m256& dx, __m256& dz) -> __m256 {
+  __m256 total = _mm256_setzero_ps();
+  dx = _mm256_setzero_ps();
+  dz = _mm256_setzero_ps();
+  float scale = simplex_scale_2d;
+  if constexpr (Planar) {
+    __m256 cx[3];
+    __m256 cz[3];
+    __m256i corner[3];
+    simplex_cell_2d_avx2(key, x, z, cx, cz, corner);
+    simplex_add_corner_2d_avx2(corner[0], cx[0], cz[0], total, dx, dz);
+    simplex_add_corner_2d_avx2(corner[1], cx[1], cz[1], total, dx, dz);
+    simplex_add_corner_2d_avx2(corner[2], cx[2], cz[2], total, dx, dz);
+  } else {
+    __m256 cx[4];
+    __m256 cy[4];
+    __m256 cz[4];
+    __m256i corner[4];
+    simplex_cell_avx2<false>(key, x, _mm256_setzero_ps(), z, cx, cy, cz,
+                             corner);
+    simplex_add_corner_avx2(corner[0], cx[0], cy[0], cz[0], total, dx, dz);
+    simplex_add_corner_avx2(corner[1], cx[1], cy[1], cz[1], total, dx, dz);
+    simplex_add_corner_avx2(corner[2], cx[2], cy[2], cz[2], total, dx, dz);
+    simplex_add_corner_avx2(corner[3], cx[3], cy[3], cz[3], total, dx, dz);
+    scale = simplex_scale_3d;
+  }
+
+  const __m256 s = _mm256_set1_ps(scale);
+  dx = _mm256_mul_ps(dx, s);
+  dz = _mm256_mul_ps(dz, s);
+  return _mm256_mul_ps(s, total);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx2")
+auto fractal_avx2(const fractal_params& params, const float max_value,
+                  const float* x, const float* z, float* out, const size_t n)
+    -> void {
+  const __m256 divisor = _mm256_set1_ps(200.0f);
+  const __m256i key =
+      _mm256_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  for (size_t k = 0; k < n; k += 8) {
+    const __m256 px = _mm256_loadu_ps(x + k);
+    const __m256 pz = _mm256_loadu_ps(z + k);
+    __m256 total = _mm256_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (unsigned int o = 0; o < params.octaves; ++o) {
+      const __m256 f = _mm256_set1_ps(frequency);
+      const __m256 sx = _mm256_div_ps(_mm256_mul_ps(px, f), divisor);
+      const __m256 sz = _mm256_div_ps(_mm256_mul_ps(pz, f), divisor);
+      const __m256 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_avx2<Planar>(key, sx, sz)
+              : noise_avx2<Planar>(params.permutation, sx, sz);
+      total =
+          _mm256_add_ps(total, _mm256_mul_ps(noise, _mm256_set1_ps(amplitude)));
+      frequency *= params.lacunarity;
+      amplitude *= params.persistence;
+    }
+    const __m256 normalized = _mm256_add_ps(
+        _mm256_div_ps(total, _mm256_set1_ps(max_value)), _mm256_set1_ps(1.0f));
+    _mm256_storeu_ps(out + k,
+                     _mm256_div_ps(normalized, _mm256_set1_ps(2.0f)));
+  }
+}
+
+PERLIN_TARGET("avx2")
+inline auto fade_derivative_avx2(const __m256 t) -> __m256 {
+  const __m256 inner =
+      _mm256_add_ps(_mm256_mul_ps(t, _mm256_sub_ps(t, _mm256_set1_ps(2.0f))),
+                    _mm256_set1_ps(1.0f));
+  return _mm256_mul_ps(
+      _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(30.0f), t), t), inner);
+}
+
+// noise_avx2 together with its derivatives along x and z, see
+// perlin::noise_gradient
+template <bool Planar>
+PERLIN_TARGET("avx2")
+auto noise_gradient_avx2(const int* p, const __m256 x, const __m256 z,
+                        __m256& dx, __m256& dz) -> __m256 {
+  const __m256 fx = _mm256_floor_ps(x);
+  const __m256 fz = _mm256_floor_ps(z);
+  const __m256i mask = _mm256_set1_epi32(255);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i xi = _mm256_and_si256(_mm256_cvttps_epi32(fx), mask);
+  const __m256i zi = _mm256_and_si256(_mm256_cvttps_epi32(fz), mask);
+
+  const __m256 xf = _mm256_sub_ps(x, fx);
+  const __m256 zf = _mm256_sub_ps(z, fz);
+  const __m256 xf1 = _mm256_sub_ps(xf, _mm256_set1_ps(1.0f));
+  const __m256 zf1 = _mm256_sub_ps(zf, _mm256_set1_ps(1.0f));
+  const __m256 u = fade_avx2(xf);
+  const __m256 w = fade_avx2(zf);
+  const __m256 du = fade_derivative_avx2(xf);
+  const __m256 dw = fade_derivative_avx2(zf);
+
+  const __m256i a = gather_avx2(p, xi);
+  const __m256i b = gather_avx2(p, _mm256_add_epi32(xi, one));
+  const __m256i aa = _mm256_add_epi32(Planar ? a : gather_avx2(p, a), zi);
+  const __m256i ba = _mm256_add_epi32(Planar ? b : gather_avx2(p, b), zi);
+
+  __m256 gx00, gz00, gx10, gz10, gx01, gz01, gx11, gz11;
+  grad_coefficients_avx2(gather_avx2(p, aa), gx00, gz00);
+  grad_coefficients_avx2(gather_avx2(p, ba), gx10, gz10);
+  grad_coefficients_avx2(gather_avx2(p, _mm256_add_epi32(aa, one)),
+                        gx01, gz01);
+  grad_coefficients_avx2(gather_avx2(p, _mm256_add_epi32(ba, one)),
+                        gx11, gz11);
+  const __m256 g00 =
+      _mm256_add_ps(_mm256_mul_ps(gx00, xf), _mm256_mul_ps(gz00, zf));
+  const __m256 g10 =
+      _mm256_add_ps(_mm256_mul_ps(gx10, xf1), _mm256_mul_ps(gz10, zf));
+  const __m256 g01 =
+      _mm256_add_ps(_mm256_mul_ps(gx01, xf), _mm256_mul_ps(gz01, zf1));
+  const __m256 g11 =
+      _mm256_add_ps(_mm256_mul_ps(gx11, xf1), _mm256_mul_ps(gz11, zf1));
+
+  const __m256 x1 = lerp_avx2(g00, g10, u);
+  const __m256 x2 = lerp_avx2(g01, g11, u);
+  const __m256 x1_dx = _mm256_add_ps(
+      _mm256_add_ps(gx00, _mm256_mul_ps(_mm256_sub_ps(gx10, gx00), u)),
+      _mm256_mul_ps(_mm256_sub_ps(g10, g00), du));
+  const __m256 x2_dx = _mm256_add_ps(
+      _mm256_add_ps(gx01, _mm256_mul_ps(_mm256_sub_ps(gx11, gx01), u)),
+      _mm256_mul_ps(_mm256_sub_ps(g11, g01), du));
+  const __m256 x1_dz =
+      _mm256_add_ps(gz00, _mm256_mul_ps(_mm256_sub_ps(gz10, gz00), u));
+  const __m256 x2_dz =
+      _mm256_add_ps(gz01, _mm256_mul_ps(_mm256_sub_ps(gz11, gz01), u));
+
+  dx = _mm256_add_ps(x1_dx, _mm256_mul_ps(_mm256_sub_ps(x2_dx, x1_dx), w));
+  dz = _mm256_add_ps(
+      _mm256_add_ps(x1_dz, _mm256_mul_ps(_mm256_sub_ps(x2_dz, x1_dz), w)),
+      _mm256_mul_ps(_mm256_sub_ps(x2, x1), dw));
+  return lerp_avx2(x1, x2, w);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx2")
+auto fractal_gradient_avx2(const fractal_params& params,
+                          const float max_value, const float* x,
+                          const float* z, float* out, float* dx, float* dz,
+                          const size_t n) -> void {
+  const __m256 divisor = _mm256_set1_ps(200.0f);
+  const __m256i key =
+      _mm256_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  const __m256 scale = _mm256_set1_ps(1.0f / (2.0f * max_value));
+  for (size_t k = 0; k < n; k += 8) {
+    const __m256 px = _mm256_loadu_ps(x + k);
+    const __m256 pz = _mm256_loadu_ps(z + k);
+    __m256 total = _mm256_setzero_ps();
+    __m256 total_dx = _mm256_setzero_ps();
+    __m256 total_dz = _mm256_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (unsigned int o = 0; o < params.octaves; ++o) {
+      const __m256 f = _mm256_set1_ps(frequency);
+      __m256 noise_dx;
+      __m256 noise_dz;
+      const __m256 sx = _mm256_div_ps(_mm256_mul_ps(px, f), divisor);
+      const __m256 sz = _mm256_div_ps(_mm256_mul_ps(pz, f), divisor);
+      const __m256 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_gradient_avx2<Planar>(key, sx, sz,
+                                              noise_dx, noise_dz)
+              : noise_gradient_avx2<Planar>(params.permutation, sx, sz,
+                                            noise_dx, noise_dz);
+      total = _mm256_add_ps(total,
+                         _mm256_mul_ps(noise, _mm256_set1_ps(amplitude)));
+      const __m256 chain = _mm256_set1_ps(amplitude * frequency / 200.0f);
+      total_dx = _mm256_add_ps(total_dx, _mm256_mul_ps(noise_dx, chain));
+      total_dz = _mm256_add_ps(total_dz, _mm256_mul_ps(noise_dz, chain));
+      frequency *= params.lacunarity;
+      amplitude *= params.persistence;
+    }
+    const __m256 normalized = _mm256_add_ps(
+        _mm256_div_ps(total, _mm256_set1_ps(max_value)), _mm256_set1_ps(1.0f));
+    _mm256_storeu_ps(out + k,
+                     _mm256_div_ps(normalized, _mm256_set1_ps(2.0f)));
+    _mm256_storeu_ps(dx + k, _mm256_mul_ps(total_dx, scale));
+    _mm256_storeu_ps(dz + k, _mm256_mul_ps(total_dz, scale));
+  }
+}
+
+// fractal_volume_sse for 8 points
+PERLIN_TARGET("avx2")
+auto fractal_volume_avx2(const fractal_params& params, const float max_value,
+                         const float* x, const float* y, const float* z,
+                         float* out, const size_t n) -> void {
+  const __m256 divisor = _mm256_set1_ps(200.0f);
+  const __m256i key =
+      _mm256_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  for (size_t k = 0; k < n; k += 8) {
+    _mm256_storeu_ps(out + k, _mm256_setzero_ps());
+  }
+
+  float frequency = 1.0f;
+  float amplitude = 1.0f;
+  for (unsigned int o = 0; o < params.octaves; ++o) {
+    const __m256 f = _mm256_set1_ps(frequency);
+    const __m256 a = _mm256_set1_ps(amplitude);
+    // -1 is no lattice index, so the first group computes its corners
+    volume_cell_avx2 cell;
+    cell.xi = _mm256_set1_epi32(-1);
+    cell.yi = cell.xi;
+    cell.zi = cell.xi;
+    for (size_t k = 0; k < n; k += 8) {
+      const __m256 sx =
+          _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(x + k), f), divisor);
+      const __m256 sy =
+          _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(y + k), f), divisor);
+      const __m256 sz =
+          _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(z + k), f), divisor);
+      const __m256 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_volume_avx2<true>(key, sx, sy, sz)
+              : noise_volume_avx2(params.permutation, sx, sy, sz, cell);
+      _mm256_storeu_ps(out + k, _mm256_add_ps(_mm256_loadu_ps(out + k),
+                                          _mm256_mul_ps(noise, a)));
+    }
+    frequency *= params.lacunarity;
+    amplitude *= params.persistence;
+  }
+
+  for (size_t k = 0; k < n; k += 8) {
+    const __m256 normalized = _mm256_add_ps(
+        _mm256_div_ps(_mm256_loadu_ps(out + k), _mm256_set1_ps(max_value)),
+        _mm256_set1_ps(1.0f));
+    _mm256_storeu_ps(out + k,
+                     _mm256_div_ps(normalized, _mm256_set1_ps(2.0f)));
+  }
+}
+
+// --- AVX-512F, 16 points ---
+
+PERLIN_TARGET("avx512f")
+inline auto gather_avx512(const int* table, const __m512i index) -> __m512i {
+  return _mm512_i32gather_epi32(index, table, 4);
+}
+
+PERLIN_TARGET("avx512f")
+inline auto grad_coefficients_avx512(const __m512i hash, __m512& gx,
+                                     __m512& gz) -> void {
+  // A full 16 entry table fits in one register
+  const __m512i index = _mm512_and_si512(hash, _mm512_set1_epi32(15));
+  gx = _mm512_permutexvar_ps(index, _mm512_load_ps(grad_x));
+  gz = _mm512_permutexvar_ps(index, _mm512_load_ps(grad_z));
+}
+
+PERLIN_TARGET("avx512f")
+inline auto grad_avx512(const __m512i hash, const __m512 x, const __m512 z)
+    -> __m512 {
+  __m512 gx;
+  __m512 gz;
+  grad_coefficients_avx512(hash, gx, gz);
+  return _mm512_add_ps(_mm512_mul_ps(gx, x), _mm512_mul_ps(gz, z));
+}
+
+PERLIN_TARGET("avx512f")
+inline auto fade_avx512(const __m512 t) -> __m512 {
+  const __m512 inner = _mm512_add_ps(
+      _mm512_mul_ps(t, _mm512_sub_ps(_mm512_mul_ps(t, _mm512_set1_ps(6.0f)),
+                                     _mm512_set1_ps(15.0f))),
+      _mm512_set1_ps(10.0f));
+  return _mm512_mul_ps(_mm512_mul_ps(_mm512_mul_ps(t, t), t), inner);
+}
+
+PERLIN_TARGET("avx512f")
+inline auto lerp_avx512(const __m512 a, const __m512 b, const __m512 w)
+    -> __m512 {
+  return _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(b, a), w), a);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx512f")
+auto noise_avx512(const int* p, const __m512 x, const __m512 z) -> __m512 {
+  const __m512 fx = _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF);
+  const __m512 fz = _mm512_roundscale_ps(z, _MM_FROUND_TO_NEG_INF);
+  const __m512i mask = _mm512_set1_epi32(255);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i xi = _mm512_and_si512(_mm512_cvttps_epi32(fx), mask);
+  const __m512i zi = _mm512_and_si512(_mm512_cvttps_epi32(fz), mask);
+
+  const __m512 xf = _mm512_sub_ps(x, fx);
+  const __m512 zf = _mm512_sub_ps(z, fz);
+  const __m512 xf1 = _mm512_sub_ps(xf, _mm512_set1_ps(1.0f));
+  const __m512 zf1 = _mm512_sub_ps(zf, _mm512_set1_ps(1.0f));
+  const __m512 u = fade_avx512(xf);
+  const __m512 w = fade_avx512(zf);
+
+  const __m512i a = gather_avx512(p, xi);
+  const __m512i b = gather_avx512(p, _mm512_add_epi32(xi, one));
+  const __m512i aa = _mm512_add_epi32(Planar ? a : gather_avx512(p, a), zi);
+  const __m512i ba = _mm512_add_epi32(Planar ? b : gather_avx512(p, b), zi);
+
+  const __m512 x1 = lerp_avx512(grad_avx512(gather_avx512(p, aa), xf, zf),
+                                grad_avx512(gather_avx512(p, ba), xf1, zf), u);
+  const __m512 x2 = lerp_avx512(
+      grad_avx512(gather_avx512(p, _mm512_add_epi32(aa, one)), xf, zf1),
+      grad_avx512(gather_avx512(p, _mm512_add_epi32(ba, one)), xf1, zf1), u);
+  return lerp_avx512(x1, x2, w);
+}
+
+// The full perlin::noise, for points off the y = 0 plane. gx and gz are the
+// same as in grad_avx512, gy adds the y term the other kernels drop
+
+PERLIN_TARGET("avx512f")
+inline auto grad_coefficients_avx512(const __m512i hash, __m512& gx,
+                                     __m512& gy, __m512& gz) -> void {
+  grad_coefficients_avx512(hash, gx, gz);
+  gy = _mm512_permutexvar_ps(_mm512_and_si512(hash, _mm512_set1_epi32(15)),
+                             _mm512_load_ps(grad_y));
+}
+
+PERLIN_TARGET("avx512f")
+inline auto grad_volume_avx512(const __m512i hash, const __m512 x,
+                               const __m512 y, const __m512 z) -> __m512 {
+  __m512 gx;
+  __m512 gy;
+  __m512 gz;
+  grad_coefficients_avx512(hash, gx, gy, gz);
+  const __m512 planar =
+      _mm512_add_ps(_mm512_mul_ps(gx, x), _mm512_mul_ps(gz, z));
+  return _mm512_add_ps(planar, _mm512_mul_ps(gy, y));
+}
+
+// volume_cell_sse for 16 points
+struct volume_cell_avx512 {
+  __m512i xi;
+  __m512i yi;
+  __m512i zi;
+  __m512 gx[8];
+  __m512 gy[8];
+  __m512 gz[8];
+};
+
+PERLIN_TARGET("avx512f")
+auto volume_corners_avx512(const int* p, volume_cell_avx512& cell) -> void {
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i a = _mm512_add_epi32(gather_avx512(p, cell.xi), cell.yi);
+  const __m512i b = _mm512_add_epi32(
+      gather_avx512(p, _mm512_add_epi32(cell.xi, one)), cell.yi);
+  const __m512i aa = _mm512_add_epi32(gather_avx512(p, a), cell.zi);
+  const __m512i ab =
+      _mm512_add_epi32(gather_avx512(p, _mm512_add_epi32(a, one)), cell.zi);
+  const __m512i ba = _mm512_add_epi32(gather_avx512(p, b), cell.zi);
+  const __m512i bb =
+      _mm512_add_epi32(gather_avx512(p, _mm512_add_epi32(b, one)), cell.zi);
+  const __m512i corners[8] = {aa,
+                              ba,
+                              ab,
+                              bb,
+                              _mm512_add_epi32(aa, one),
+                              _mm512_add_epi32(ba, one),
+                              _mm512_add_epi32(ab, one),
+                              _mm512_add_epi32(bb, one)};
+  for (int c = 0; c < 8; ++c) {
+    grad_coefficients_avx512(gather_avx512(p, corners[c]), cell.gx[c],
+                             cell.gy[c], cell.gz[c]);
+  }
+}
+
+PERLIN_TARGET("avx512f")
+inline auto corner_avx512(const volume_cell_avx512& cell, const int c,
+                          const __m512 x, const __m512 y, const __m512 z)
+    -> __m512 {
+  const __m512 planar = _mm512_add_ps(_mm512_mul_ps(cell.gx[c], x),
+                                      _mm512_mul_ps(cell.gz[c], z));
+  return _mm512_add_ps(planar, _mm512_mul_ps(cell.gy[c], y));
+}
+
+PERLIN_TARGET("avx512f")
+auto noise_volume_avx512(const int* p, const __m512 x, const __m512 y,
+                         const __m512 z, volume_cell_avx512& cell) -> __m512 {
+  const __m512 fx = _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF);
+  const __m512 fy = _mm512_roundscale_ps(y, _MM_FROUND_TO_NEG_INF);
+  const __m512 fz = _mm512_roundscale_ps(z, _MM_FROUND_TO_NEG_INF);
+  const __m512i mask = _mm512_set1_epi32(255);
+  const __m512i xi = _mm512_and_si512(_mm512_cvttps_epi32(fx), mask);
+  const __m512i yi = _mm512_and_si512(_mm512_cvttps_epi32(fy), mask);
+  const __m512i zi = _mm512_and_si512(_mm512_cvttps_epi32(fz), mask);
+
+  const __mmask16 same = _mm512_cmpeq_epi32_mask(xi, cell.xi) &
+                         _mm512_cmpeq_epi32_mask(yi, cell.yi) &
+                         _mm512_cmpeq_epi32_mask(zi, cell.zi);
+  if (same != 0xFFFF) {
+    cell.xi = xi;
+    cell.yi = yi;
+    cell.zi = zi;
+    volume_corners_avx512(p, cell);
+  }
+
+  const __m512 xf = _mm512_sub_ps(x, fx);
+  const __m512 yf = _mm512_sub_ps(y, fy);
+  const __m512 zf = _mm512_sub_ps(z, fz);
+  const __m512 xf1 = _mm512_sub_ps(xf, _mm512_set1_ps(1.0f));
+  const __m512 yf1 = _mm512_sub_ps(yf, _mm512_set1_ps(1.0f));
+  const __m512 zf1 = _mm512_sub_ps(zf, _mm512_set1_ps(1.0f));
+  const __m512 u = fade_avx512(xf);
+  const __m512 v = fade_avx512(yf);
+  const __m512 w = fade_avx512(zf);
+
+  const __m512 x1 = lerp_avx512(corner_avx512(cell, 0, xf, yf, zf),
+                                corner_avx512(cell, 1, xf1, yf, zf), u);
+  const __m512 x2 = lerp_avx512(corner_avx512(cell, 2, xf, yf1, zf),
+                                corner_avx512(cell, 3, xf1, yf1, zf), u);
+  const __m512 y1 = lerp_avx512(x1, x2, v);
+
+  const __m512 x3 = lerp_avx512(corner_avx512(cell, 4, xf, yf, zf1),
+                                corner_avx512(cell, 5, xf1, yf, zf1), u);
+  const __m512 x4 = lerp_avx512(corner_avx512(cell, 6, xf, yf1, zf1),
+                                corner_avx512(cell, 7, xf1, yf1, zf1), u);
+  const __m512 y2 = lerp_avx512(x3, x4, v);
+
+  return lerp_avx512(y1, y2, w);
+}
+
+// Simplex noise, see perlin::simplex. The cell functions find the corners of
+// the simplex around each point, their offsets from the point and the inputs
+// of their hashes, for both the value and the derivative kernels. They are
+// forced inline so the corner arrays stay in registers. Unlike the Perlin
+// kernels they read no table from memory: the hashes are arithmetic and the
+// gradients are permuted out of one register. The steps to the corners are
+// mask registers, under which 1 is subtracted from each offset and the
+// simplex_cell added to the hash input
+
+// simplex_hash of each corner
+PERLIN_TARGET("avx512f")
+inline auto simplex_index_avx512(const __m512i corner) -> __m512i {
+  const __m512i h = _mm512_xor_si512(corner, _mm512_srli_epi32(corner, 15));
+  const __m512i mixed =
+      _mm512_mullo_epi32(h, _mm512_set1_epi32(static_cast<int>(simplex_mix_2)));
+  return _mm512_srli_epi32(mixed, 28);
+}
+
+// grad_volume_avx512 for a simplex corner, leaving gx and gz for the
+// derivatives
+PERLIN_TARGET("avx512f")
+inline auto simplex_grad_avx512(const __m512i index, const __m512 x,
+                                const __m512 y, const __m512 z, __m512& gx,
+                                __m512& gz) -> __m512 {
+  gx = _mm512_permutexvar_ps(index, _mm512_load_ps(simplex_grad_x));
+  gz = _mm512_permutexvar_ps(index, _mm512_load_ps(simplex_grad_z));
+  const __m512 gy =
+      _mm512_permutexvar_ps(index, _mm512_load_ps(simplex_grad_y));
+  const __m512 planar =
+      _mm512_add_ps(_mm512_mul_ps(gx, x), _mm512_mul_ps(gz, z));
+  return _mm512_add_ps(planar, _mm512_mul_ps(gy, y));
+}
+
+PERLIN_TARGET("avx512f")
+inline auto simplex_grad_2d_avx512(const __m512i index, const __m512 x,
+                                   const __m512 z, __m512& gx, __m512& gz)
+    -> __m512 {
+  gx = _mm512_permutexvar_ps(index, _mm512_load_ps(simplex_grad_x));
+  gz = _mm512_permutexvar_ps(index, _mm512_load_ps(simplex_grad_z));
+  return _mm512_add_ps(_mm512_mul_ps(gx, x), _mm512_mul_ps(gz, z));
+}
+
+// With Volume unset y is 0, which the sums then leave out
+template <bool Volume>
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_cell_avx512(const __m512i key, const __m512 x,
+                                       const __m512 y, const __m512 z,
+                                       __m512 (&cx)[4], __m512 (&cy)[4],
+                                       __m512 (&cz)[4], __m512i (&corner)[4])
+    -> void {
+  const __m512 sum = Volume ? _mm512_add_ps(_mm512_add_ps(x, y), z)
+                            : _mm512_add_ps(x, z);
+  const __m512 s = _mm512_mul_ps(sum, _mm512_set1_ps(simplex_skew_3d));
+  const __m512 fx =
+      _mm512_roundscale_ps(_mm512_add_ps(x, s), _MM_FROUND_TO_NEG_INF);
+  const __m512 fy = _mm512_roundscale_ps(Volume ? _mm512_add_ps(y, s) : s,
+                                         _MM_FROUND_TO_NEG_INF);
+  const __m512 fz =
+      _mm512_roundscale_ps(_mm512_add_ps(z, s), _MM_FROUND_TO_NEG_INF);
+  const __m512i packed_yz = _mm512_add_epi32(
+      _mm512_slli_epi32(_mm512_cvttps_epi32(fy), simplex_y_shift),
+      _mm512_slli_epi32(_mm512_cvttps_epi32(fz), simplex_z_shift));
+  const __m512i packed = _mm512_add_epi32(_mm512_cvttps_epi32(fx), packed_yz);
+  const __m512i mix = _mm512_set1_epi32(static_cast<int>(simplex_mix_1));
+  corner[0] = _mm512_add_epi32(_mm512_mullo_epi32(packed, mix), key);
+
+  const __m512 unskew = _mm512_set1_ps(simplex_unskew_3d);
+  const __m512 t =
+      _mm512_mul_ps(_mm512_add_ps(_mm512_add_ps(fx, fy), fz), unskew);
+  cx[0] = _mm512_add_ps(_mm512_sub_ps(x, fx), t);
+  cy[0] = Volume ? _mm512_add_ps(_mm512_sub_ps(y, fy), t)
+                 : _mm512_sub_ps(t, fy);
+  cz[0] = _mm512_add_ps(_mm512_sub_ps(z, fz), t);
+
+  const __mmask16 xy = _mm512_cmp_ps_mask(cx[0], cy[0], _CMP_GE_OQ);
+  const __mmask16 xz = _mm512_cmp_ps_mask(cx[0], cz[0], _CMP_GE_OQ);
+  const __mmask16 yz = _mm512_cmp_ps_mask(cy[0], cz[0], _CMP_GE_OQ);
+  const __mmask16 i1 = _kand_mask16(xy, xz);
+  const __mmask16 j1 = _kandn_mask16(xy, yz);
+  const __mmask16 k1 = _knot_mask16(_kor_mask16(xz, yz));
+  const __mmask16 i2 = _kor_mask16(xy, xz);
+  const __mmask16 j2 = _kor_mask16(_knot_mask16(xy), yz);
+  const __mmask16 k2 = _knot_mask16(_kand_mask16(xz, yz));
+
+  const __m512 stepped = _mm512_set1_ps(simplex_step_1);
+  cx[1] = _mm512_add_ps(cx[0], _mm512_mask_blend_ps(i1, unskew, stepped));
+  cy[1] = _mm512_add_ps(cy[0], _mm512_mask_blend_ps(j1, unskew, stepped));
+  cz[1] = _mm512_add_ps(cz[0], _mm512_mask_blend_ps(k1, unskew, stepped));
+  const __m512 unskew2 = _mm512_set1_ps(simplex_stay_2);
+  const __m512 stepped2 = _mm512_set1_ps(simplex_step_2);
+  cx[2] = _mm512_add_ps(cx[0], _mm512_mask_blend_ps(i2, unskew2, stepped2));
+  cy[2] = _mm512_add_ps(cy[0], _mm512_mask_blend_ps(j2, unskew2, stepped2));
+  cz[2] = _mm512_add_ps(cz[0], _mm512_mask_blend_ps(k2, unskew2, stepped2));
+  const __m512 last = _mm512_set1_ps(1.0f - 3.0f * simplex_unskew_3d);
+  cx[3] = _mm512_sub_ps(cx[0], last);
+  cy[3] = _mm512_sub_ps(cy[0], last);
+  cz[3] = _mm512_sub_ps(cz[0], last);
+
+  const __m512i step_x =
+      _mm512_set1_epi32(static_cast<int>(simplex_cell(1, 0, 0)));
+  const __m512i step_y =
+      _mm512_set1_epi32(static_cast<int>(simplex_cell(0, 1, 0)));
+  const __m512i step_z =
+      _mm512_set1_epi32(static_cast<int>(simplex_cell(0, 0, 1)));
+  __m512i step = _mm512_maskz_mov_epi32(i1, step_x);
+  step = _mm512_mask_add_epi32(step, j1, step, step_y);
+  step = _mm512_mask_add_epi32(step, k1, step, step_z);
+  corner[1] = _mm512_add_epi32(corner[0], step);
+  step = _mm512_maskz_mov_epi32(i2, step_x);
+  step = _mm512_mask_add_epi32(step, j2, step, step_y);
+  step = _mm512_mask_add_epi32(step, k2, step, step_z);
+  corner[2] = _mm512_add_epi32(corner[0], step);
+  corner[3] = _mm512_add_epi32(
+      corner[0], _mm512_set1_epi32(static_cast<int>(simplex_cell(1, 1, 1))));
+}
+
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_cell_2d_avx512(const __m512i key, const __m512 x,
+                                          const __m512 z, __m512 (&cx)[3],
+                                          __m512 (&cz)[3],
+                                          __m512i (&corner)[3]) -> void {
+  const __m512 s =
+      _mm512_mul_ps(_mm512_add_ps(x, z), _mm512_set1_ps(simplex_skew_2d));
+  const __m512 fx =
+      _mm512_roundscale_ps(_mm512_add_ps(x, s), _MM_FROUND_TO_NEG_INF);
+  const __m512 fz =
+      _mm512_roundscale_ps(_mm512_add_ps(z, s), _MM_FROUND_TO_NEG_INF);
+  const __m512i packed = _mm512_add_epi32(
+      _mm512_cvttps_epi32(fx),
+      _mm512_slli_epi32(_mm512_cvttps_epi32(fz), simplex_z_shift));
+  const __m512i mix = _mm512_set1_epi32(static_cast<int>(simplex_mix_1));
+  corner[0] = _mm512_add_epi32(_mm512_mullo_epi32(packed, mix), key);
+
+  const __m512 unskew = _mm512_set1_ps(simplex_unskew_2d);
+  const __m512 t = _mm512_mul_ps(_mm512_add_ps(fx, fz), unskew);
+  cx[0] = _mm512_add_ps(_mm512_sub_ps(x, fx), t);
+  cz[0] = _mm512_add_ps(_mm512_sub_ps(z, fz), t);
+
+  // the second corner is a step along x in the lower triangle, along z in
+  // the upper one
+  const __mmask16 i1 = _mm512_cmp_ps_mask(cx[0], cz[0], _CMP_GE_OQ);
+  const __m512 unit = _mm512_set1_ps(1.0f);
+  const __m512 x1 = _mm512_add_ps(cx[0], unskew);
+  const __m512 z1 = _mm512_add_ps(cz[0], unskew);
+  cx[1] = _mm512_mask_sub_ps(x1, i1, x1, unit);
+  cz[1] = _mm512_mask_sub_ps(z1, _knot_mask16(i1), z1, unit);
+  const __m512 last = _mm512_set1_ps(1.0f - 2.0f * simplex_unskew_2d);
+  cx[2] = _mm512_sub_ps(cx[0], last);
+  cz[2] = _mm512_sub_ps(cz[0], last);
+
+  const __m512i step = _mm512_mask_blend_epi32(
+      i1, _mm512_set1_epi32(static_cast<int>(simplex_cell(0, 0, 1))),
+      _mm512_set1_epi32(static_cast<int>(simplex_cell(1, 0, 0))));
+  corner[1] = _mm512_add_epi32(corner[0], step);
+  corner[2] = _mm512_add_epi32(
+      corner[0], _mm512_set1_epi32(static_cast<int>(simplex_cell(1, 0, 1))));
+}
+
+// What is left of simplex_radius at offset (x, y, z) from a corner, 0 outside
+PERLIN_TARGET("avx512f")
+inline auto simplex_falloff_avx512(const __m512 x, const __m512 y,
+                                   const __m512 z) -> __m512 {
+  const __m512 rx =
+      _mm512_sub_ps(_mm512_set1_ps(simplex_radius), _mm512_mul_ps(x, x));
+  const __m512 yz = _mm512_add_ps(_mm512_mul_ps(y, y), _mm512_mul_ps(z, z));
+  return _mm512_max_ps(_mm512_sub_ps(rx, yz), _mm512_setzero_ps());
+}
+
+PERLIN_TARGET("avx512f")
+inline auto simplex_falloff_2d_avx512(const __m512 x, const __m512 z)
+    -> __m512 {
+  const __m512 rx =
+      _mm512_sub_ps(_mm512_set1_ps(simplex_radius), _mm512_mul_ps(x, x));
+  return _mm512_max_ps(_mm512_sub_ps(rx, _mm512_mul_ps(z, z)),
+                       _mm512_setzero_ps());
+}
+
+// The value of one corner. The kernels sum their corners one by one rather
+// than in a loop, which the compiler keeps in memory
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_corner_avx512(const __m512i corner, const __m512 x,
+                                         const __m512 y, const __m512 z)
+    -> __m512 {
+  __m512 gx;
+  __m512 gz;
+  const __m512 r = simplex_falloff_avx512(x, y, z);
+  const __m512 r2 = _mm512_mul_ps(r, r);
+  const __m512 g =
+      simplex_grad_avx512(simplex_index_avx512(corner), x, y, z, gx, gz);
+  return _mm512_mul_ps(_mm512_mul_ps(r2, r2), g);
+}
+
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_corner_2d_avx512(const __m512i corner,
+                                            const __m512 x, const __m512 z)
+    -> __m512 {
+  __m512 gx;
+  __m512 gz;
+  const __m512 r = simplex_falloff_2d_avx512(x, z);
+  const __m512 r2 = _mm512_mul_ps(r, r);
+  const __m512 g =
+      simplex_grad_2d_avx512(simplex_index_avx512(corner), x, z, gx, gz);
+  return _mm512_mul_ps(_mm512_mul_ps(r2, r2), g);
+}
+
+// The corners are summed in pairs, like perlin::simplex
+template <bool Volume>
+PERLIN_TARGET("avx512f")
+auto simplex_volume_avx512(const __m512i key, const __m512 x, const __m512 y,
+                           const __m512 z) -> __m512 {
+  __m512 cx[4];
+  __m512 cy[4];
+  __m512 cz[4];
+  __m512i corner[4];
+  simplex_cell_avx512<Volume>(key, x, y, z, cx, cy, cz, corner);
+
+  const __m512 first =
+      _mm512_add_ps(simplex_corner_avx512(corner[0], cx[0], cy[0], cz[0]),
+                    simplex_corner_avx512(corner[1], cx[1], cy[1], cz[1]));
+  const __m512 second =
+      _mm512_add_ps(simplex_corner_avx512(corner[2], cx[2], cy[2], cz[2]),
+                    simplex_corner_avx512(corner[3], cx[3], cy[3], cz[3]));
+  return _mm512_mul_ps(_mm512_set1_ps(simplex_scale_3d),
+                       _mm512_add_ps(first, second));
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx512f")
+auto simplex_avx512(const __m512i key, const __m512 x, const __m512 z)
+    -> __m512 {
+  if constexpr (Planar) {
+    __m512 cx[3];
+    __m512 cz[3];
+    __m512i corner[3];
+    simplex_cell_2d_avx512(key, x, z, cx, cz, corner);
+
+    __m512 total =
+        _mm512_add_ps(simplex_corner_2d_avx512(corner[0], cx[0], cz[0]),
+                      simplex_corner_2d_avx512(corner[1], cx[1], cz[1]));
+    total =
+        _mm512_add_ps(total, simplex_corner_2d_avx512(corner[2], cx[2], cz[2]));
+    return _mm512_mul_ps(_mm512_set1_ps(simplex_scale_2d), total);
+  } else {
+    return simplex_volume_avx512<false>(key, x, _mm512_setzero_ps(), z);
+  }
+}
+
+// Adds the value of one corner to total and its derivatives to dx and dz,
+// see perlin::simplex_gradient
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_add_avx512(const __m512 gx, const __m512 gz,
+                                      const __m512 r, const __m512 g,
+                                      const __m512 x, const __m512 z,
+                                      __m512& total, __m512& dx, __m512& dz)
+    -> void {
+  const __m512 r2 = _mm512_mul_ps(r, r);
+  const __m512 r4 = _mm512_mul_ps(r2, r2);
+  const __m512 scaled = _mm512_mul_ps(_mm512_set1_ps(-8.0f), r2);
+  const __m512 falloff = _mm512_mul_ps(_mm512_mul_ps(scaled, r), g);
+  total = _mm512_add_ps(total, _mm512_mul_ps(r4, g));
+  dx = _mm512_add_ps(
+      dx, _mm512_add_ps(_mm512_mul_ps(r4, gx), _mm512_mul_ps(falloff, x)));
+  dz = _mm512_add_ps(
+      dz, _mm512_add_ps(_mm512_mul_ps(r4, gz), _mm512_mul_ps(falloff, z)));
+}
+
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_add_corner_avx512(const __m512i corner,
+                                             const __m512 x, const __m512 y,
+                                             const __m512 z, __m512& total,
+                                             __m512& dx, __m512& dz) -> void {
+  __m512 gx;
+  __m512 gz;
+  const __m512 r = simplex_falloff_avx512(x, y, z);
+  const __m512 g =
+      simplex_grad_avx512(simplex_index_avx512(corner), x, y, z, gx, gz);
+  simplex_add_avx512(gx, gz, r, g, x, z, total, dx, dz);
+}
+
+PERLIN_TARGET("avx512f")
+PERLIN_INLINE auto simplex_add_corner_2d_avx512(const __m512i corner,
+                                                const __m512 x, const __m512 z,
+                                                __m512& total, __m512& dx,
+                                                __m512& dz) -> void {
+  __m512 gx;
+  __m512 gz;
+  const __m512 r = simplex_falloff_2d_avx512(x, z);
+  const __m512 g =
+      simplex_grad_2d_avx512(simplex_index_avx512(corner), x, z, gx, gz);
+  simplex_add_avx512(gx, gz, r, g, x, z, total, dx, dz);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx512f")
+auto simplex_gradient_avx512(const __m512i key, const __m512 x, const __m512 z,
+                             __m512& dx, __m512& dz) -> __m512 {
+  __m512 total = _mm512_setzero_ps();
+  dx = _mm512_setzero_ps();
+  dz = _mm512_setzero_ps();
+  float scale = simplex_scale_2d;
+  if constexpr (Planar) {
+    __m512 cx[3];
+    __m512 cz[3];
+    __m512i corner[3];
+    simplex_cell_2d_avx512(key, x, z, cx, cz, corner);
+    simplex_add_corner_2d_avx512(corner[0], cx[0], cz[0], total, dx, dz);
+    simplex_add_corner_2d_avx512(corner[1], cx[1], cz[1], total, dx, dz);
+    simplex_add_corner_2d_avx512(corner[2], cx[2], cz[2], total, dx, dz);
+  } else {
+    __m512 cx[4];
+    __m512 cy[4];
+    __m512 cz[4];
+    __m512i corner[4];
+    simplex_cell_avx512<false>(key, x, _mm512_setzero_ps(), z, cx, cy, cz,
+                               corner);
+    simplex_add_corner_avx512(corner[0], cx[0], cy[0], cz[0], total, dx, dz);
+    simplex_add_corner_avx512(corner[1], cx[1], cy[1], cz[1], total, dx, dz);
+    simplex_add_corner_avx512(corner[2], cx[2], cy[2], cz[2], total, dx, dz);
+    simplex_add_corner_avx512(corner[3], cx[3], cy[3], cz[3], total, dx, dz);
+    scale = simplex_scale_3d;
+  }
+
+  const __m512 s = _mm512_set1_ps(scale);
+  dx = _mm512_mul_ps(dx, s);
+  dz = _mm512_mul_ps(dz, s);
+  return _mm512_mul_ps(s, total);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx512f")
+auto fractal_avx512(const fractal_params& params, const float max_value,
+                    const float* x, const float* z, float* out, const size_t n)
+    -> void {
+  const __m512 divisor = _mm512_set1_ps(200.0f);
+  const __m512i key =
+      _mm512_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  for (size_t k = 0; k < n; k += 16) {
+    const __m512 px = _mm512_loadu_ps(x + k);
+    const __m512 pz = _mm512_loadu_ps(z + k);
+    __m512 total = _mm512_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (unsigned int o = 0; o < params.octaves; ++o) {
+      const __m512 f = _mm512_set1_ps(frequency);
+      const __m512 sx = _mm512_div_ps(_mm512_mul_ps(px, f), divisor);
+      const __m512 sz = _mm512_div_ps(_mm512_mul_ps(pz, f), divisor);
+      const __m512 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_avx512<Planar>(key, sx, sz)
+              : noise_avx512<Planar>(params.permutation, sx, sz);
+      total =
+          _mm512_add_ps(total, _mm512_mul_ps(noise, _mm512_set1_ps(amplitude)));
+      frequency *= params.lacunarity;
+      amplitude *= params.persistence;
+    }
+    const __m512 normalized = _mm512_add_ps(
+        _mm512_div_ps(total, _mm512_set1_ps(max_value)), _mm512_set1_ps(1.0f));
+    _mm512_storeu_ps(out + k,
+                     _mm512_div_ps(normalized, _mm512_set1_ps(2.0f)));
+  }
+}
+PERLIN_TARGET("avx512f")
+inline auto fade_derivative_avx512(const __m512 t) -> __m512 {
+  const __m512 inner =
+      _mm512_add_ps(_mm512_mul_ps(t, _mm512_sub_ps(t, _mm512_set1_ps(2.0f))),
+                    _mm512_set1_ps(1.0f));
+  return _mm512_mul_ps(
+      _mm512_mul_ps(_mm512_mul_ps(_mm512_set1_ps(30.0f), t), t), inner);
+}
+
+// noise_avx512 together with its derivatives along x and z, see
+// perlin::noise_gradient
+template <bool Planar>
+PERLIN_TARGET("avx512f")
+auto noise_gradient_avx512(const int* p, const __m512 x, const __m512 z,
+                        __m512& dx, __m512& dz) -> __m512 {
+  const __m512 fx = _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF);
+  const __m512 fz = _mm512_roundscale_ps(z, _MM_FROUND_TO_NEG_INF);
+  const __m512i mask = _mm512_set1_epi32(255);
+  const __m512i one = _mm512_set1_epi32(1);
+  const __m512i xi = _mm512_and_si512(_mm512_cvttps_epi32(fx), mask);
+  const __m512i zi = _mm512_and_si512(_mm512_cvttps_epi32(fz), mask);
+
+  const __m512 xf = _mm512_sub_ps(x, fx);
+  const __m512 zf = _mm512_sub_ps(z, fz);
+  const __m512 xf1 = _mm512_sub_ps(xf, _mm512_set1_ps(1.0f));
+  const __m512 zf1 = _mm512_sub_ps(zf, _mm512_set1_ps(1.0f));
+  const __m512 u = fade_avx512(xf);
+  const __m512 w = fade_avx512(zf);
+  const __m512 du = fade_derivative_avx512(xf);
+  const __m512 dw = fade_derivative_avx512(zf);
+
+  const __m512i a = gather_avx512(p, xi);
+  const __m512i b = gather_avx512(p, _mm512_add_epi32(xi, one));
+  const __m512i aa = _mm512_add_epi32(Planar ? a : gather_avx512(p, a), zi);
+  const __m512i ba = _mm512_add_epi32(Planar ? b : gather_avx512(p, b), zi);
+
+  __m512 gx00, gz00, gx10, gz10, gx01, gz01, gx11, gz11;
+  grad_coefficients_avx512(gather_avx512(p, aa), gx00, gz00);
+  grad_coefficients_avx512(gather_avx512(p, ba), gx10, gz10);
+  grad_coefficients_avx512(gather_avx512(p, _mm512_add_epi32(aa, one)),
+                        gx01, gz01);
+  grad_coefficients_avx512(gather_avx512(p, _mm512_add_epi32(ba, one)),
+                        gx11, gz11);
+  const __m512 g00 =
+      _mm512_add_ps(_mm512_mul_ps(gx00, xf), _mm512_mul_ps(gz00, zf));
+  const __m512 g10 =
+      _mm512_add_ps(_mm512_mul_ps(gx10, xf1), _mm512_mul_ps(gz10, zf));
+  const __m512 g01 =
+      _mm512_add_ps(_mm512_mul_ps(gx01, xf), _mm512_mul_ps(gz01, zf1));
+  const __m512 g11 =
+      _mm512_add_ps(_mm512_mul_ps(gx11, xf1), _mm512_mul_ps(gz11, zf1));
+
+  const __m512 x1 = lerp_avx512(g00, g10, u);
+  const __m512 x2 = lerp_avx512(g01, g11, u);
+  const __m512 x1_dx = _mm512_add_ps(
+      _mm512_add_ps(gx00, _mm512_mul_ps(_mm512_sub_ps(gx10, gx00), u)),
+      _mm512_mul_ps(_mm512_sub_ps(g10, g00), du));
+  const __m512 x2_dx = _mm512_add_ps(
+      _mm512_add_ps(gx01, _mm512_mul_ps(_mm512_sub_ps(gx11, gx01), u)),
+      _mm512_mul_ps(_mm512_sub_ps(g11, g01), du));
+  const __m512 x1_dz =
+      _mm512_add_ps(gz00, _mm512_mul_ps(_mm512_sub_ps(gz10, gz00), u));
+  const __m512 x2_dz =
+      _mm512_add_ps(gz01, _mm512_mul_ps(_mm512_sub_ps(gz11, gz01), u));
+
+  dx = _mm512_add_ps(x1_dx, _mm512_mul_ps(_mm512_sub_ps(x2_dx, x1_dx), w));
+  dz = _mm512_add_ps(
+      _mm512_add_ps(x1_dz, _mm512_mul_ps(_mm512_sub_ps(x2_dz, x1_dz), w)),
+      _mm512_mul_ps(_mm512_sub_ps(x2, x1), dw));
+  return lerp_avx512(x1, x2, w);
+}
+
+template <bool Planar>
+PERLIN_TARGET("avx512f")
+auto fractal_gradient_avx512(const fractal_params& params,
+                          const float max_value, const float* x,
+                          const float* z, float* out, float* dx, float* dz,
+                          const size_t n) -> void {
+  const __m512 divisor = _mm512_set1_ps(200.0f);
+  const __m512i key =
+      _mm512_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  const __m512 scale = _mm512_set1_ps(1.0f / (2.0f * max_value));
+  for (size_t k = 0; k < n; k += 16) {
+    const __m512 px = _mm512_loadu_ps(x + k);
+    const __m512 pz = _mm512_loadu_ps(z + k);
+    __m512 total = _mm512_setzero_ps();
+    __m512 total_dx = _mm512_setzero_ps();
+    __m512 total_dz = _mm512_setzero_ps();
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    for (unsigned int o = 0; o < params.octaves; ++o) {
+      const __m512 f = _mm512_set1_ps(frequency);
+      __m512 noise_dx;
+      __m512 noise_dz;
+      const __m512 sx = _mm512_div_ps(_mm512_mul_ps(px, f), divisor);
+      const __m512 sz = _mm512_div_ps(_mm512_mul_ps(pz, f), divisor);
+      const __m512 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_gradient_avx512<Planar>(key, sx, sz,
+                                                noise_dx, noise_dz)
+              : noise_gradient_avx512<Planar>(params.permutation, sx, sz,
+                                              noise_dx, noise_dz);
+      total = _mm512_add_ps(total,
+                         _mm512_mul_ps(noise, _mm512_set1_ps(amplitude)));
+      const __m512 chain = _mm512_set1_ps(amplitude * frequency / 200.0f);
+      total_dx = _mm512_add_ps(total_dx, _mm512_mul_ps(noise_dx, chain));
+      total_dz = _mm512_add_ps(total_dz, _mm512_mul_ps(noise_dz, chain));
+      frequency *= params.lacunarity;
+      amplitude *= params.persistence;
+    }
+    const __m512 normalized = _mm512_add_ps(
+        _mm512_div_ps(total, _mm512_set1_ps(max_value)), _mm512_set1_ps(1.0f));
+    _mm512_storeu_ps(out + k,
+                     _mm512_div_ps(normalized, _mm512_set1_ps(2.0f)));
+    _mm512_storeu_ps(dx + k, _mm512_mul_ps(total_dx, scale));
+    _mm512_storeu_ps(dz + k, _mm512_mul_ps(total_dz, scale));
+  }
+}
+
+// fractal_volume_sse for 16 points
+PERLIN_TARGET("avx512f")
+auto fractal_volume_avx512(const fractal_params& params, const float max_value,
+                           const float* x, const float* y, const float* z,
+                           float* out, const size_t n) -> void {
+  const __m512 divisor = _mm512_set1_ps(200.0f);
+  const __m512i key =
+      _mm512_set1_epi32(static_cast<int>(simplex_key(params.permutation)));
+  for (size_t k = 0; k < n; k += 16) {
+    _mm512_storeu_ps(out + k, _mm512_setzero_ps());
+  }
+
+  float frequency = 1.0f;
+  float amplitude = 1.0f;
+  for (unsigned int o = 0; o < params.octaves; ++o) {
+    const __m512 f = _mm512_set1_ps(frequency);
+    const __m512 a = _mm512_set1_ps(amplitude);
+    // -1 is no lattice index, so the first group computes its corners
+    volume_cell_avx512 cell;
+    cell.xi = _mm512_set1_epi32(-1);
+    cell.yi = cell.xi;
+    cell.zi = cell.xi;
+    for (size_t k = 0; k < n; k += 16) {
+      const __m512 sx =
+          _mm512_div_ps(_mm512_mul_ps(_mm512_loadu_ps(x + k), f), divisor);
+      const __m512 sy =
+          _mm512_div_ps(_mm512_mul_ps(_mm512_loadu_ps(y + k), f), divisor);
+      const __m512 sz =
+          _mm512_div_ps(_mm512_mul_ps(_mm512_loadu_ps(z + k), f), divisor);
+      const __m512 noise =
+          params.basis == noise_basis::simplex
+              ? simplex_volume_avx512<true>(key, sx, sy, sz)
+              : noise_volume_avx512(params.permutation, sx, sy, sz, cell);
+      _mm512_storeu_ps(out + k, _mm512_add_ps(_mm512_loadu_ps(out + k),
+                                          _mm512_mul_ps(noise, a)));
+    }
+    frequency *= params.lacunarity;
+    amplitude *= params.persistence;
+  }
+
+  for (size_t k = 0; k < n; k += 16) {
+    const __m512 normalized = _mm512_add_ps(
+        _mm512_div_ps(_mm512_loadu_ps(out + k), _mm512_set1_ps(max_value)),
+        _mm512_set1_ps(1.0f));
+    _mm512_storeu_ps(out + k,
+                     _mm512_div_ps(normalized, _mm512_set1_ps(2.0f)));
+  }
+}
+#endif  // PERLIN_SIMD_X86
+}  // namespace
+
+auto detect() -> perlin_simd {
+#if defined(PERLIN_SIMD_X86) && defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+
+  __cpuid(info, 1);
+  const bool sse41 = (info[2] & (1 << 19)) != 0;
+  const bool os_saves_ymm =
+      (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+      (_xgetbv(0) & 0x6) == 0x6;
+  const bool os_saves_zmm = os_saves_ymm && (_xgetbv(0) & 0xE6) == 0xE6;
+
+  bool avx2 = false;
+  bool avx512 = false;
+  if (max_leaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = os_saves_ymm && (info[1] & (1 << 5)) != 0;
+    avx512 = os_saves_zmm && (info[1] & (1 << 16)) != 0;
+  }
+
+  if (avx512) return perlin_simd::avx512;
+  if (avx2) return perlin_simd::avx2;
+  if (sse41) return perlin_simd::sse41;
+#elif defined(PERLIN_SIMD_X86)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return perlin_simd::avx512;
+  if (__builtin_cpu_supports("avx2")) return perlin_simd::avx2;
+  if (__builtin_cpu_supports("sse4.1")) return perlin_simd::sse41;
+#endif
+  return perlin_simd::scalar;
+}
+
+auto lanes(const perlin_simd level) -> size_t {
+  switch (level) {
+    case perlin_simd::sse41:
+      return 4;
+    case perlin_simd::avx2:
+      return 8;
+    case perlin_simd::avx512:
+      return 16;
+    default:
+      return 1;
+  }
+}
+
+auto fractal(const perlin_simd level, const fractal_params& params,
+             const float* x, const float* z, float* out, const size_t n)
+    -> size_t {
+  const size_t count = level == perlin_simd::scalar ? 0 : n - n % lanes(level);
+  if (count == 0 || params.octaves == 0) return 0;
+
+  float max_value = 0.0f;
+  float amplitude = 1.0f;
+  for (unsigned int o = 0; o < params.octaves; ++o) {
+    max_value += amplitude;
+    amplitude *= params.persistence;
+  }
+
+#ifdef PERLIN_SIMD_X86
+  switch (level) {
+    case perlin_simd::sse41:
+      (params.planar ? fractal_sse<true> : fractal_sse<false>)(
+          params, max_value, x, z, out, count);
+      return count;
+    case perlin_simd::avx2:
+      (params.planar ? fractal_avx2<true> : fractal_avx2<false>)(
+          params, max_value, x, z, out, count);
+      return count;
+    case perlin_simd::avx512:
+      (params.planar ? fractal_avx512<true> : fractal_avx512<false>)(
+          params, max_value, x, z, out, count);
+      return count;
+    default:
+      break;
+  }
+#else
+  (void)x;
+  (void)z;
+  (void)out;
+#endif
+  return 0;
+}
+
+auto fractal_volume(const perlin_simd level, const fractal_params& params,
+                    const float* x, const float* y, const float* z,
+                    float* out, const size_t n) -> size_t {
+  const size_t count = level == perlin_simd::scalar ? 0 : n - n % lanes(level);
+  if (count == 0 || params.octaves == 0) return 0;
+
+  float max_value = 0.0f;
+  float amplitude = 1.0f;
+  for (unsigned int o = 0; o < params.octaves; ++o) {
+    max_value += amplitude;
+    amplitude *= params.persistence;
+  }
+
+#ifdef PERLIN_SIMD_X86
+  switch (level) {
+    case perlin_simd::sse41:
+      fractal_volume_sse(params, max_value, x, y, z, out, count);
+      return count;
+    case perlin_simd::avx2:
+      fractal_volume_avx2(params, max_value, x, y, z, out, count);
+      return count;
+    case perlin_simd::avx512:
+      fractal_volume_avx512(params, max_value, x, y, z, out, count);
+      return count;
+    default:
+      break;
+  }
+#else
+  (void)x;
+  (void)y;
+  (void)z;
+  (void)out;
+#endif
+  return 0;
+}
+
+auto fractal_gradient(const perlin_simd level, const fractal_params& params,
+                      const float* x, const float* z, float* out, float* dx,
+                      float* dz, const size_t n) -> size_t {
+  const size_t count = level == perlin_simd::scalar ? 0 : n - n % lanes(level);
+  if (count == 0 || params.octaves == 0) return 0;
+
+  float max_value = 0.0f;
+  float amplitude = 1.0f;
+  for (unsigned int o = 0; o < params.octaves; ++o) {
+    max_value += amplitude;
+    amplitude *= params.persistence;
+  }
+
+#ifdef PERLIN_SIMD_X86
+  switch (level) {
+    case perlin_simd::sse41:
+      (params.planar ? fractal_gradient_sse<true>
+                     : fractal_gradient_sse<false>)(params, max_value, x, z,
+                                                    out, dx, dz, count);
+      return count;
+    case perlin_simd::avx2:
+      (params.planar ? fractal_gradient_avx2<true>
+                     : fractal_gradient_avx2<false>)(params, max_value, x, z,
+                                                     out, dx, dz, count);
+      return count;
+    case perlin_simd::avx512:
+      (params.planar ? fractal_gradient_avx512<true>
+                     : fractal_gradient_avx512<false>)(params, max_value, x, z,
+                                                       out, dx, dz, count);
+      return count;
+    default:
+      break;
+  }
+#else
+  (void)x;
+  (void)z;
+  (void)out;
+  (void)dx;
+  (void)dz;
+#endif
+  return 0;
+}
+}  // namespace perlin_kernels
@@ -0,0 +1,190 @@
+// Round trip checks of the packed terrain vertex. unpack_vertex mirrors the
+// decode in res/shaders/terrain.vs.glsl, so these bounds are what the shader
+// draws as well
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numbers>
+#include <random>
+
+#include "terrain/heightfield.hpp"
+#include "terrain/packed_vertex.hpp"
+
+namespace {
+int failures = 0;
+
+auto check(const bool condition, const char* what) -> void {
+  if (condition) return;
+  ++failures;
+  std::printf("FAILED: %s\n", what);
+}
+
+// Angle between two unit vectors in degrees, in double so the float error
+// of the vectors themselves dominates
+auto angle_degrees(const glm::vec3& a, const glm::vec3& b) -> double {
+  const double dot = static_cast<double>(a.x) * b.x +
+                     static_cast<double>(a.y) * b.y +
+                     static_cast<double>(a.z) * b.z;
+  return std::acos(std::clamp(dot, -1.0, 1.0)) * 180.0 / std::numbers::pi;
+}
+
+auto distance(const glm::vec3& a, const glm::vec3& b) -> float {
+  return glm::length(a - b);
+}
+
+constexpr double max_normal_degrees = 0.04;
+// The tangent frame is rebuilt from the decoded normal, so it can be off by
+// about as much as the normal: 0.04 degrees is 7e-4 radians
+constexpr float max_frame_error = 1e-3f;
+
+// Every vertex of a bumpy terrain, as each kind of vertex the mesh holds
+auto check_terrain() -> void {
+  constexpr int grid_size = 200;
+  heightfield field(grid_size, 0.5f, glm::vec2(-50.0f, -50.0f));
+  field.set_uv_mapping(glm::vec2(3.0f, -7.0f), 0.25f);
+  for (auto i = 0; i <= grid_size; ++i) {
+    for (auto j = 0; j <= grid_size; ++j) {
+      field.set_height(i, j, 30.0f * std::sin(0.07f * i) * std::cos(0.11f * j) +
+                                 4.0f * std::sin(0.9f * i + 0.4f * j));
+    }
+  }
+  field.compute_normals();
+
+  float min_height = field.height(0, 0);
+  float max_height = min_height;
+  for (const float h : field.heights()) {
+    min_height = glm::min(min_height, h);
+    max_height = glm::max(max_height, h);
+  }
+  const vertex_packing packing =
+      vertex_packing::for_heightfield(field, min_height, max_height);
+
+  // Half a quantization step, with room for the float error of the decode
+  const float max_position_error = 0.5f * packing.height_step * 1.01f;
+
+  float position_error = 0.0f;
+  double normal_error = 0.0;
+  float frame_error = 0.0f;
+  bool uv_exact = true;
+  for (auto i = 0; i <= grid_size; ++i) {
+    for (auto j = 0; j <= grid_size; ++j) {
+      const cgra::mesh_vertex v = field.vertex(i, j);
+      const cgra::mesh_vertex u = unpack_vertex(
+          pack_vertex(v, i, j, packed_vertex_kind::surface, packing), packing);
+
+      position_error = glm::max(position_error, distance(v.pos, u.pos));
+      normal_error = std::max(normal_error, angle_degrees(v.norm, u.norm));
+      frame_error = glm::max(frame_error, distance(v.tang, u.tang));
+      frame_error = glm::max(frame_error, distance(v.bitang, u.bitang));
+      uv_exact = uv_exact && v.uv == u.uv;
+
+      // The bottom grid hangs below the surface, facing down
+      cgra::mesh_vertex bottom = v;
+      bottom.pos.y = min_height;
+      bottom.norm = {0.0f, -1.0f, 0.0f};
+      const cgra::mesh_vertex b = unpack_vertex(
+          pack_vertex(bottom, i, j, packed_vertex_kind::bottom, packing),
+          packing);
+      position_error = glm::max(position_error, distance(bottom.pos, b.pos));
+      normal_error = std::max(normal_error, angle_degrees(bottom.norm, b.norm));
+      uv_exact = uv_exact && bottom.uv == b.uv;
+      check(b.tang == glm::vec3(0.0f) && b.bitang == glm::vec3(0.0f),
+            "bottom vertices have no tangent frame");
+    }
+  }
+
+  // Walls like terrain_model::side_vertices: u along the wall, v = 0 at the
+  // top and 1 at the bottom, normals along the axes
+  const float grid = static_cast<float>(grid_size);
+  const glm::vec3 wall_normals[] = {
+      {0.0f, 0.0f, -1.0f}, {0.0f, 0.0f, 1.0f}, {-1.0f, 0.0f, 0.0f},
+      {1.0f, 0.0f, 0.0f}};
+  for (auto side = 0; side < 4; ++side) {
+    for (auto s = 0; s <= grid_size; ++s) {
+      const int i = side < 2 ? s : (side == 2 ? 0 : grid_size);
+      const int j = side < 2 ? (side == 0 ? 0 : grid_size) : s;
+      for (const auto kind :
+           {packed_vertex_kind::wall_top, packed_vertex_kind::wall_bottom}) {
+        cgra::mesh_vertex w;
+        w.pos = field.position(i, j);
+        if (kind == packed_vertex_kind::wall_bottom) w.pos.y = min_height;
+        w.norm = wall_normals[side];
+        w.uv = {static_cast<float>(s) / grid,
+                kind == packed_vertex_kind::wall_top ? 0.0f : 1.0f};
+
+        const cgra::mesh_vertex u =
+            unpack_vertex(pack_vertex(w, i, j, kind, packing), packing);
+        position_error = glm::max(position_error, distance(w.pos, u.pos));
+        normal_error = std::max(normal_error, angle_degrees(w.norm, u.norm));
+        uv_exact = uv_exact && w.uv == u.uv;
+      }
+    }
+  }
+
+  // The four corners of a solid box's floor, uv across the whole grid
+  for (auto c = 0; c < 4; ++c) {
+    const int i = (c / 2) * grid_size;
+    const int j = (c % 2) * grid_size;
+    cgra::mesh_vertex cap;
+    cap.pos = {field.x(i), min_height, field.z(j)};
+    cap.norm = {0.0f, -1.0f, 0.0f};
+    cap.uv = {static_cast<float>(c / 2), static_cast<float>(c % 2)};
+
+    const cgra::mesh_vertex u = unpack_vertex(
+        pack_vertex(cap, i, j, packed_vertex_kind::cap, packing), packing);
+    position_error = glm::max(position_error, distance(cap.pos, u.pos));
+    normal_error = std::max(normal_error, angle_degrees(cap.norm, u.norm));
+    uv_exact = uv_exact && cap.uv == u.uv;
+  }
+
+  std::printf("terrain: position %.5f (step %.5f), normal %.4f deg, "
+              "tangent frame %.6f\n",
+              static_cast<double>(position_error),
+              static_cast<double>(packing.height_step), normal_error,
+              static_cast<double>(frame_error));
+  check(position_error <= max_position_error,
+        "positions within half a quantization step");
+  check(normal_error <= max_normal_degrees, "normals within 0.04 degrees");
+  check(frame_error <= max_frame_error, "tangent frames follow the normals");
+  check(uv_exact, "uv exact for every kind");
+}
+
+// Unit vectors all over the sphere, including the folded lower half and the
+// axes where the octahedron's faces meet
+auto check_octahedral() -> void {
+  std::mt19937 rng(7);
+  std::normal_distribution<float> gaussian;
+
+  double normal_error = 0.0;
+  const auto round_trip = [&](const glm::vec3& n) {
+    const auto encoded = oct_encode(n);
+    normal_error = std::max(
+        normal_error, angle_degrees(n, oct_decode(encoded.x, encoded.y)));
+  };
+
+  for (auto k = 0; k < 1000000; ++k) {
+    const glm::vec3 n(gaussian(rng), gaussian(rng), gaussian(rng));
+    if (glm::length(n) > 1e-6f) round_trip(glm::normalize(n));
+  }
+  for (auto axis = 0; axis < 3; ++axis) {
+    for (const float sign : {1.0f, -1.0f}) {
+      glm::vec3 n(0.0f);
+      n[axis] = sign;
+      round_trip(n);
+    }
+  }
+
+  std::printf("octahedral: normal %.4f deg\n", normal_error);
+  check(normal_error <= max_normal_degrees,
+        "octahedral normals within 0.04 degrees");
+}
+}  // namespace
+
+auto main() -> int {
+  check_terrain();
+  check_octahedral();
+
+  if (failures == 0) std::printf("packed_vertex: all round trips in bounds\n");
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Headless checks of terrain_lod: every selection of patches has to close up
+// with itself and with the walls, which hang from every sample of the grid's
+// border (terrain_model::side_vertices)
+
+#include <cstdio>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "terrain/heightfield.hpp"
+#include "terrain/terrain_lod.hpp"
+
+namespace {
+int failures = 0;
+
+auto check(const bool condition, const char* what, const int grid_size,
+           const glm::vec3& camera) -> void {
+  if (condition) return;
+  ++failures;
+  std::printf("FAILED: %s (grid %d, camera %.1f %.1f %.1f)\n", what, grid_size,
+              static_cast<double>(camera.x), static_cast<double>(camera.y),
+              static_cast<double>(camera.z));
+}
+
+auto check_selection(const terrain_lod& lod, const heightfield& field,
+                     const glm::vec3& camera) -> void {
+  const int grid_size = field.grid_size();
+  const unsigned int row_length = grid_size + 1;
+
+  // Uses of every directed edge of the top face, between sample indices
+  std::map<std::pair<unsigned int, unsigned int>, int> edges;
+  long long doubled_area = 0;
+  for (const lod_node& node : lod.selected()) {
+    const unsigned int base = node.i * row_length + node.j;
+    const std::vector<unsigned int> indices =
+        lod.pattern(node.level, node.stitch_mask, node.border_mask);
+    for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+      unsigned int k[3];
+      for (auto c = 0; c < 3; ++c) {
+        k[c] = base + indices[t + c];
+        ++edges[{base + indices[t + c], base + indices[t + (c + 1) % 3]}];
+      }
+
+      // Twice the signed area in the (i, j) plane, positive for the winding
+      // of the full resolution top face
+      const long long i0 = k[0] / row_length, j0 = k[0] % row_length;
+      const long long i1 = k[1] / row_length, j1 = k[1] % row_length;
+      const long long i2 = k[2] / row_length, j2 = k[2] % row_length;
+      const long long area = (i1 - i0) * (j2 - j0) - (j1 - j0) * (i2 - i0);
+      check(area < 0, "triangle wound like the top face", grid_size, camera);
+      doubled_area -= area;
+    }
+  }
+
+  // The patches cover the grid exactly once
+  check(doubled_area == 2ll * grid_size * grid_size, "patches cover the grid",
+        grid_size, camera);
+
+  // Inside, every edge is shared by two triangles running it both ways.
+  // The rest is the outline, which has to be the unit steps between the
+  // border samples the walls hang from
+  std::map<std::pair<unsigned int, unsigned int>, int> outline;
+  for (const auto& [edge, uses] : edges) {
+    check(uses == 1, "no edge used twice the same way", grid_size, camera);
+    if (edges.contains({edge.second, edge.first})) continue;
+
+    const auto [a, b] = std::minmax(edge.first, edge.second);
+    ++outline[{a, b}];
+  }
+
+  std::map<std::pair<unsigned int, unsigned int>, int> walls;
+  for (auto s = 0u; s < static_cast<unsigned int>(grid_size); ++s) {
+    ++walls[{s, s + 1}];                                            // i = 0
+    ++walls[{grid_size * row_length + s, grid_size * row_length + s + 1}];
+    ++walls[{s * row_length, (s + 1) * row_length}];                // j = 0
+    ++walls[{s * row_length + grid_size, (s + 1) * row_length + grid_size}];
+  }
+  check(outline == walls, "outline meets the walls", grid_size, camera);
+}
+}  // namespace
+
+auto main() -> int {
+  for (const int grid_size : {16, 64, 200, 256, 1000}) {
+    heightfield field(grid_size, 1.0f, glm::vec2(0.0f));
+    for (auto i = 0; i <= grid_size; ++i) {
+      for (auto j = 0; j <= grid_size; ++j) {
+        field.set_height(i, j, static_cast<float>((i * 7 + j * 13) % 11));
+      }
+    }
+
+    terrain_lod lod;
+    lod.build(field);
+    if (lod.patch_cells() == 0) continue;
+
+    const float size = static_cast<float>(grid_size);
+    for (const glm::vec3 camera :
+         {glm::vec3(size / 2.0f, 20.0f, size / 2.0f),
+          glm::vec3(0.0f, 5.0f, 0.0f), glm::vec3(size, 5.0f, size / 3.0f),
+          glm::vec3(size / 5.0f, 2.0f, size), glm::vec3(-size, 50.0f, -size),
+          glm::vec3(size / 2.0f, 10.0f * size, size / 2.0f)}) {
+      for (const float detail : {0.5f, 2.0f, 8.0f}) {
+        lod.m_detail = detail;
+        lod.select(camera);
+        check_selection(lod, field, camera);
+      }
+    }
+  }
+
+  if (failures == 0) std::printf("terrain_lod: all selections watertight\n");
+  return failures == 0 ? 0 : 1;
+}